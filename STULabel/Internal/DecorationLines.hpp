@@ -84,4 +84,16 @@ struct Strikethroughs {
   void drawLLO(DrawingContext&) const;
 };
 
+struct GlyphLineIntersectionCacheStatistics {
+  UInt64 hitCount;
+  UInt64 missCount;
+  Int entryCount;
+};
+
+/// Only used for testing.
+GlyphLineIntersectionCacheStatistics glyphLineIntersectionCacheStatistics();
+
+/// Only used for testing.
+void clearGlyphLineIntersectionCache();
+
 } // stu_label
@@ -7,6 +7,15 @@
 #import "GlyphPathIntersectionBounds.hpp"
 #import "TextFrame.hpp"
 
+#import "STULabel/stu_mutex.h"
+
+#import "Hash.hpp"
+#import "LRUCacheStorage.hpp"
+
+#import "stu/Vector.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
 namespace stu_label {
 
 using OffsetAndThickness = DecorationLine::OffsetAndThickness;
@@ -107,6 +116,191 @@ OffsetAndThickness
   return {.offsetLLO = offset, .thickness = thickness, .unroundedThickness = unroundedThickness};
 }
 
+namespace {
+
+/// A global cache for the x-bounds of the intersections of glyph paths with underline stripes.
+///
+/// The stripe y-intervals in the key and the cached x-intervals are relative to the glyph origin.
+/// The font size is part of the key, since the stripe intervals include an absolute (not
+/// size-relative) margin.
+struct GlyphLineIntersectionCacheEntry {
+  struct Key {
+    CGFont* cgFont;
+    Float32 fontSize;
+    CGGlyph glyph;
+    /// The lower and upper stripe y-intervals.
+    Float32 y[4];
+
+    HashCode<UInt64> hash() const {
+      return stu_label::hash(reinterpret_cast<UInt64>(cgFont), fontSize, UInt64{glyph},
+                             y[0], y[1], y[2], y[3]);
+    }
+
+    friend bool operator==(const Key& lhs, const Key& rhs) {
+      return lhs.cgFont == rhs.cgFont && lhs.fontSize == rhs.fontSize && lhs.glyph == rhs.glyph
+          && lhs.y[0] == rhs.y[0] && lhs.y[1] == rhs.y[1]
+          && lhs.y[2] == rhs.y[2] && lhs.y[3] == rhs.y[3];
+    }
+  };
+
+  Key key; // The cgFont is retained.
+  HashCode<UInt64> hashCode;
+  UInt64 lastUse;
+  UInt cost;
+  /// An interval is empty if start > end.
+  Range<Float32> lower;
+  Range<Float32> upper;
+
+  void release() {
+    CFRelease(key.cgFont);
+  }
+};
+
+using GlyphLineIntersectionCache = LRUCacheStorage<GlyphLineIntersectionCacheEntry>;
+
+} // namespace
+
+/// When the cache exceeds this number of entries, the least recently used entries are evicted.
+static constexpr Int glyphLineIntersectionCacheMaxEntryCount = 4096;
+
+static stu_mutex glyphLineIntersectionCacheMutex = STU_MUTEX_INIT;
+static bool glyphLineIntersectionCacheIsInitialized = false;
+alignas(GlyphLineIntersectionCache)
+static Byte glyphLineIntersectionCacheStorage[sizeof(GlyphLineIntersectionCache)];
+
+/// Must be called while holding the glyphLineIntersectionCacheMutex.
+static GlyphLineIntersectionCache& glyphLineIntersectionCache() {
+  if (STU_UNLIKELY(!glyphLineIntersectionCacheIsInitialized)) {
+    glyphLineIntersectionCacheIsInitialized = true;
+    GlyphLineIntersectionCache& cache =
+      *new (glyphLineIntersectionCacheStorage) GlyphLineIntersectionCache{64};
+
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearCacheBlock = ^(NSNotification*) {
+      stu_mutex_lock(&glyphLineIntersectionCacheMutex);
+      cache.clear();
+      stu_mutex_unlock(&glyphLineIntersectionCacheMutex);
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+  }
+  return reinterpret_cast<GlyphLineIntersectionCache&>(glyphLineIntersectionCacheStorage);
+}
+
+GlyphLineIntersectionCacheStatistics glyphLineIntersectionCacheStatistics() {
+  GlyphLineIntersectionCacheStatistics stats = {};
+  stu_mutex_lock(&glyphLineIntersectionCacheMutex);
+  if (glyphLineIntersectionCacheIsInitialized) {
+    const GlyphLineIntersectionCache& cache = glyphLineIntersectionCache();
+    stats = {.hitCount = cache.hitCount, .missCount = cache.missCount,
+             .entryCount = cache.count()};
+  }
+  stu_mutex_unlock(&glyphLineIntersectionCacheMutex);
+  return stats;
+}
+
+void clearGlyphLineIntersectionCache() {
+  stu_mutex_lock(&glyphLineIntersectionCacheMutex);
+  if (glyphLineIntersectionCacheIsInitialized) {
+    GlyphLineIntersectionCache& cache = glyphLineIntersectionCache();
+    cache.clear();
+    cache.hitCount = 0;
+    cache.missCount = 0;
+  }
+  stu_mutex_unlock(&glyphLineIntersectionCacheMutex);
+}
+
+/// Looks up the intersection bounds of the glyphs in the GlyphLineIntersectionCache and computes
+/// the missing ones from the glyph paths, taking the cache mutex only twice for all glyphs.
+///
+/// @param glyphIndices The indices of the glyphs for which the bounds are needed.
+/// @param outBounds The bounds relative to the glyph origin, in the order of `glyphIndices`.
+/// @pre The font has an identity font matrix and the glyphs are drawn with an identity text
+///      matrix.
+static void findXBoundsOfGlyphIntersectionsWithHorizontalLines(
+              const CTFont* font, CGFont* cgFont, const GlyphsWithPositions& gwp,
+              ArrayRef<const Int> glyphIndices,
+              Range<CGFloat> lowerLineY, Range<CGFloat> upperLineY,
+              ArrayRef<LowerAndUpperInterval> outBounds)
+{
+  using Entry = GlyphLineIntersectionCacheEntry;
+  const Int n = glyphIndices.count();
+  const Float32 fontSize = narrow_cast<Float32>(CTFontGetSize(font));
+  TempArray<Entry> entries{uninitialized, Count{n}};
+  for (Int k = 0; k < n; ++k) {
+    const Int i = glyphIndices[k];
+    const CGFloat y = gwp.positions()[i].y;
+    Entry& entry = entries[k];
+    entry.key = {.cgFont = cgFont, .fontSize = fontSize, .glyph = gwp.glyphs()[i],
+                 .y = {static_cast<Float32>(lowerLineY.start - y),
+                       static_cast<Float32>(lowerLineY.end - y),
+                       static_cast<Float32>(upperLineY.start - y),
+                       static_cast<Float32>(upperLineY.end - y)}};
+    entry.hashCode = entry.key.hash();
+  }
+  TempArray<bool> isCached{uninitialized, Count{n}};
+  Int missCount = 0;
+  stu_mutex_lock(&glyphLineIntersectionCacheMutex);
+  {
+    GlyphLineIntersectionCache& cache = glyphLineIntersectionCache();
+    for (Int k = 0; k < n; ++k) {
+      Entry& entry = entries[k];
+      const Entry* const cachedEntry = cache.find(entry.hashCode, [&](const Entry& other) {
+                                         return other.key == entry.key;
+                                       });
+      isCached[k] = cachedEntry != nullptr;
+      if (cachedEntry) {
+        entry.lower = cachedEntry->lower;
+        entry.upper = cachedEntry->upper;
+      } else {
+        ++missCount;
+      }
+    }
+    cache.hitCount += sign_cast(n - missCount);
+    cache.missCount += sign_cast(missCount);
+  }
+  stu_mutex_unlock(&glyphLineIntersectionCacheMutex);
+  for (Int k = 0; k < n; ++k) {
+    Entry& entry = entries[k];
+    if (!isCached[k]) {
+      LowerAndUpperInterval xis;
+      const CGPathRef path = CTFontCreatePathForGlyph(font, entry.key.glyph, nullptr);
+      if (path) {
+        xis = findXBoundsOfPathIntersectionWithHorizontalLines(
+                path, Range<CGFloat>{entry.key.y[0], entry.key.y[1]},
+                Range<CGFloat>{entry.key.y[2], entry.key.y[3]});
+        CFRelease(path);
+      } else {
+        xis = {.lower = Range<CGFloat>::infinitelyEmpty(),
+               .upper = Range<CGFloat>::infinitelyEmpty()};
+      }
+      entry.lower = narrow_cast<Range<Float32>>(xis.lower);
+      entry.upper = narrow_cast<Range<Float32>>(xis.upper);
+    }
+    outBounds[k] = {.lower = Range<CGFloat>{entry.lower}, .upper = Range<CGFloat>{entry.upper}};
+  }
+  if (missCount == 0) return;
+  stu_mutex_lock(&glyphLineIntersectionCacheMutex);
+  {
+    GlyphLineIntersectionCache& cache = glyphLineIntersectionCache();
+    const UInt budget = glyphLineIntersectionCacheMaxEntryCount*sizeof(Entry);
+    for (Int k = 0; k < n; ++k) {
+      if (isCached[k]) continue;
+      const Entry& entry = entries[k];
+      cache.insert(entry.hashCode, sizeof(Entry), budget,
+                   [&](const Entry& other) { return other.key == entry.key; },
+                   [&]() {
+                     CFRetain(entry.key.cgFont);
+                     return entry;
+                   });
+    }
+  }
+  stu_mutex_unlock(&glyphLineIntersectionCacheMutex);
+}
+
 /// Assumes an LLO coordinate system, with the baseline at y = 0.
 static void findXBoundsOfIntersectionsOfGlyphsWithHorizontalLine(
               CGFloat runXOffset, GlyphSpan span,
@@ -132,6 +326,10 @@ static void findXBoundsOfIntersectionsOfGlyphsWithHorizontalLine(
   const bool hasNonIdentityMatrix = span.run().status() & kCTRunStatusHasNonIdentityMatrix;
   const FontFaceGlyphBoundsCache::Ref boundsCache = localGlyphBoundsCache.glyphBoundsCache(font);
   const GlyphsWithPositions gwp = span.getGlyphsWithPositions();
+  const bool canUseIntersectionCache = !hasNonIdentityMatrix
+                                    && CGAffineTransformIsIdentity(CTFontGetMatrix(font));
+  const Range<CGFloat> lowerLineY = {minY - 0.25f, lowerStripeMaxY + 0.25f};
+  const Range<CGFloat> upperLineY = {upperStripeMinY - 0.25f, maxY + 0.25f};
 
   const auto dilateAndRoundGap = [&](Range<CGFloat> xi) STU_INLINE_LAMBDA -> Range<CGFloat> {
     CGFloat start = xi.start - dilation;
@@ -146,7 +344,16 @@ static void findXBoundsOfIntersectionsOfGlyphsWithHorizontalLine(
     }
     return {start, end};
   };
+  const auto addBounds = [&](const LowerAndUpperInterval& xis) {
+    if (xis.lower.start <= xis.lower.end) {
+      buffer.add(dilateAndRoundGap(xis.lower));
+    }
+    if (upperStripeBuffer && xis.upper.start <= xis.upper.end) {
+      upperStripeBuffer->add(dilateAndRoundGap(xis.upper));
+    }
+  };
 
+  TempVector<Int> glyphIndices{MaxInitialCapacity{gwp.count()}};
   for (Int i = 0; i < gwp.count(); ++i) {
     CGPoint position = gwp.positions()[i];
     position.x += runXOffset;
@@ -156,24 +363,28 @@ static void findXBoundsOfIntersectionsOfGlyphsWithHorizontalLine(
       bounds = CGRectApplyAffineTransform(bounds, textMatrix);
     }
     if (!bounds.y.overlaps(Range{minY, maxY})) continue;
+    if (canUseIntersectionCache) {
+      glyphIndices.append(i);
+      continue;
+    }
     CGAffineTransform matrix = textMatrix;
     matrix.tx = position.x;
     matrix.ty = position.y;
     const CGPathRef path = CTFontCreatePathForGlyph(font, gwp.glyphs()[i], &matrix);
     if (!path) continue;
-    const LowerAndUpperInterval xis = findXBoundsOfPathIntersectionWithHorizontalLines(
-                                        path,
-                                        Range<CGFloat>{minY - 0.25f, lowerStripeMaxY + 0.25f},
-                                        Range<CGFloat>{upperStripeMinY - 0.25f, maxY + 0.25f},
-                                        0.25f);
-    if (xis.lower.start <= xis.lower.end) {
-      buffer.add(dilateAndRoundGap(xis.lower));
-    }
-    if (upperStripeBuffer && xis.upper.start <= xis.upper.end) {
-      upperStripeBuffer->add(dilateAndRoundGap(xis.upper));
-    }
+    addBounds(findXBoundsOfPathIntersectionWithHorizontalLines(path, lowerLineY, upperLineY));
     CFRelease(path);
   }
+  if (glyphIndices.isEmpty()) return;
+
+  const RC<CGFont> cgFont{CTFontCopyGraphicsFont(font, nullptr), ShouldIncrementRefCount{false}};
+  TempArray<LowerAndUpperInterval> xis{uninitialized, Count{glyphIndices.count()}};
+  findXBoundsOfGlyphIntersectionsWithHorizontalLines(font, cgFont.get(), gwp, glyphIndices,
+                                                     lowerLineY, upperLineY, xis);
+  for (Int k = 0; k < glyphIndices.count(); ++k) {
+    const CGFloat x = gwp.positions()[glyphIndices[k]].x + runXOffset;
+    addBounds({.lower = xis[k].lower + x, .upper = xis[k].upper + x});
+  }
 }
 
 static void removeLinePartsNotIntersectingClipRectAndMergeIdenticallyStyledAdjacentUnderlines(
@@ -6,8 +6,10 @@
 
 #import "CancellationFlag.hpp"
 #import "DisplayScaleRounding.hpp"
+#import "GlyphRasterCache.hpp"
 #import "GlyphSpan.hpp"
 #import "Once.hpp"
+#import "ShadowMaskCache.hpp"
 #import "TextFrame.hpp"
 #import "TextFrameDrawingOptions.hpp"
 #import "TextStyle.hpp"
@@ -115,6 +117,44 @@ public:
     setShadow_slowPath(shadowInfo);
   }
 
+  /// Indicates whether glyphs drawn into the context currently have a shadow, or are drawn only for
+  /// their shadow.
+  bool hasShadow() const {
+    return shadowInfo_ != nullptr || shadowOnlyScopeCount_ != 0;
+  }
+
+  STU_INLINE_T
+  const TextStyle::ShadowInfo* __nullable shadowInfo() const { return shadowInfo_; }
+
+  /// Indicates whether glyphs are currently drawn only for their shadow.
+  STU_INLINE_T
+  bool drawsOnlyShadows() const { return shadowOnlyScopeCount_ != 0; }
+
+  /// The context settings that the `GlyphRasterCache` masks have to be rasterized with.
+  STU_INLINE_T
+  GlyphRasterCache::ContextSettings glyphRasterCacheContextSettings() const {
+    return glyphRasterCacheContextSettings_;
+  }
+
+  /// Indicates whether fill-only glyphs should be drawn using the `GlyphRasterCache`.
+  STU_INLINE_T
+  bool usesGlyphRasterCache() const { return usesGlyphRasterCache_; }
+
+  /// Indicates whether the shadows of fill-only glyphs should be drawn using the
+  /// `ShadowMaskCache`.
+  STU_INLINE_T
+  bool usesShadowMaskCache() const { return usesShadowMaskCache_; }
+
+  /// Draws the current shadow of the glyphs with the `ShadowMaskCache` and then removes the shadow
+  /// from the context. The fill color of the context is left unchanged. Returns false and leaves
+  /// the shadow unchanged if the shadow could not be drawn with the cache.
+  ///
+  /// @pre `usesShadowMaskCache() && shadowInfo()`
+  /// @pre `ShadowMaskCache::canDraw(font, fontInfo(font), textMatrix, ctm)`
+  bool drawShadowUsingShadowMaskCache(CTFont* __nonnull font, const GlyphsWithPositions& gwp,
+                                      const CGAffineTransform& textMatrix,
+                                      const CGAffineTransform& ctm);
+
   class TextFrameLineDrawingScope {
     DrawingContext* context_;
     const Optional<TextStyleOverride&> originalStyleOverride_;
@@ -226,6 +266,13 @@ public:
     textFrameOrigin_{textFrameOrigin},
     shadowYExtraScaleFactor_{-(displayScale ? displayScale->value() : 1)/contextBaseCTM_d.value},
     offCanvasShadowExtraXOffset_{max(4*clipRect.x.diameter(), 1024.f)},
+    usesGlyphRasterCache_{GlyphRasterCache::isEnabled()},
+    glyphRasterCacheContextSettings_{
+      .shouldAntialias = !options || options->contextShouldAntialias(),
+      .shouldSmoothFonts = !options || options->contextShouldSmoothFonts()},
+    // Shadow offsets are specified in the base space of the context, which only coincides with
+    // the pixel space of the context if the base CTM is the identity.
+    usesShadowMaskCache_{contextBaseCTM_d.value == 1 && ShadowMaskCache::isEnabled()},
     colorArrays_{otherColors_, textFrame.colors().begin()}
   {
     STU_STATIC_CONST_ONCE_PRESERVE_MOST(CGColor*, cgBlackColor,
@@ -309,6 +356,9 @@ private:
   // clip area. We use this to coerce CoreGraphics into drawing *only* the shadow (by translating
   // the CGContext by minus this offset and then adding this offset to the shadow offset).
   const CGFloat offCanvasShadowExtraXOffset_;
+  const bool usesGlyphRasterCache_;
+  const GlyphRasterCache::ContextSettings glyphRasterCacheContextSettings_;
+  const bool usesShadowMaskCache_;
   const ColorRef* __nullable const colorArrays_[2]; // {otherColors_, textFrameColors}
   ColorRef otherColors_[ColorIndex::fixedColorCount];
   LocalFontInfoCache fontInfoCache_;
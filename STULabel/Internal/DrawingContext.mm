@@ -39,6 +39,31 @@ void DrawingContext::setShadow_slowPath(const TextStyle::ShadowInfo* __nullable
   }
 }
 
+bool DrawingContext::drawShadowUsingShadowMaskCache(CTFont* font, const GlyphsWithPositions& gwp,
+                                                    const CGAffineTransform& textMatrix,
+                                                    const CGAffineTransform& ctm)
+{
+  const TextStyle::ShadowInfo* const shadowInfo = shadowInfo_;
+  STU_DEBUG_ASSERT(shadowInfo && usesShadowMaskCache_);
+  const CGFloat yScale = shadowYExtraScaleFactor_;
+  const CGFloat xScale = abs(yScale);
+  const CGPoint offset = {xScale*(shadowInfo->offsetX + currentShadowExtraXOffset()),
+                          yScale*shadowInfo->offsetY};
+  // We draw the mask in a separate graphics state, so that the fill color of the context isn't
+  // left set to the shadow color.
+  CGContextSaveGState(cgContext_);
+  CGContextSetShadowWithColor(cgContext_, CGSize{}, 0, nullptr);
+  CGContextSetFillColorWithColor(cgContext_, cgColor(shadowInfo->colorIndex));
+  const bool didDraw = ShadowMaskCache::drawShadow(font, gwp.glyphs(), gwp.positions().begin(),
+                                                   textMatrix, ctm, offset,
+                                                   xScale*shadowInfo->blurRadius, cgContext_);
+  CGContextRestoreGState(cgContext_);
+  if (!didDraw) return false;
+  // The glyphs themselves must now be drawn without the Core Graphics shadow.
+  setShadow(nullptr);
+  return true;
+}
+
 STU_NO_INLINE
 void DrawingContext::initializeGlyphBoundsCache() {
   STU_APPEARS_UNUSED
@@ -11,20 +11,27 @@ struct LowerAndUpperInterval {
 
 /// @brief Finds the x-axis bounds of the intersection of a path with one or two horizontal lines.
 ///
-/// The implementation is optimized for a single line or two lines close to each other, like e.g.
-/// text underlines.
+/// The intersections of the path's curves with the lines are calculated analytically, see
+/// `findXBoundsOfSegmentsWithinHorizontalStripes` in SegmentStripeIntersection.hpp.
 ///
 /// @param lowerLineY The y interval for the lower horizontal line.
 /// @param upperLineY
 ///   The y interval for the upper horizontal line.
 ///   If this interval has the same min value as lowerLineY, it is ignored and the returned upper
 ///   interval will always be empty.
-/// @param maxError
-///   The desired maximum absolute error of the endpoints of the returned intervals.
-///   Must be greater than 0.
 ///
 /// @pre lowerLineY.min <= upperLineY.min && lowerLineY.max <= uppeLineY.max
 LowerAndUpperInterval findXBoundsOfPathIntersectionWithHorizontalLines(
+                        __nonnull CGPathRef path,
+                        Range<CGFloat> lowerLineY, Range<CGFloat> upperLineY);
+
+/// An approximate implementation of `findXBoundsOfPathIntersectionWithHorizontalLines` that
+/// linearizes the curves by recursive subdivision. Only used for testing.
+///
+/// @param maxError
+///   The desired maximum absolute error of the endpoints of the returned intervals.
+///   Must be greater than 0.
+LowerAndUpperInterval findXBoundsOfPathIntersectionWithHorizontalLinesUsingFlattening(
                         __nonnull CGPathRef path,
                         Range<CGFloat> lowerLineY, Range<CGFloat> upperLineY,
                         CGFloat maxError);
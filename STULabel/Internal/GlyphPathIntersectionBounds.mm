@@ -3,9 +3,72 @@
 #import "GlyphPathIntersectionBounds.hpp"
 
 #import "CoreGraphicsUtils.hpp"
+#import "SegmentStripeIntersection.hpp"
+#import "ThreadLocalAllocator.hpp"
 
 namespace stu_label {
 
+struct PathSegmentsState {
+  TempVector<StripeIntersectionSegment> segments;
+  CGPoint startPoint;
+  CGPoint previousPoint;
+};
+
+static void appendSegment(void* state, const CGPathElement* e) {
+  PathSegmentsState& s = *stu::down_cast<PathSegmentsState*>(state);
+  const CGPoint p = s.previousPoint;
+  CGPoint lastPoint;
+  switch (e->type) {
+  case kCGPathElementMoveToPoint:
+    lastPoint = e->points[0];
+    s.startPoint = lastPoint;
+    break;
+  case kCGPathElementCloseSubpath:
+    lastPoint = s.startPoint;
+    s.segments.append(StripeIntersectionSegment::line(p.x, p.y, lastPoint.x, lastPoint.y));
+    break;
+  case kCGPathElementAddLineToPoint:
+    lastPoint = e->points[0];
+    s.segments.append(StripeIntersectionSegment::line(p.x, p.y, lastPoint.x, lastPoint.y));
+    break;
+  case kCGPathElementAddQuadCurveToPoint: {
+    const CGPoint* const ps = e->points;
+    lastPoint = ps[1];
+    s.segments.append(StripeIntersectionSegment::quadraticCurve(p.x, p.y, ps[0].x, ps[0].y,
+                                                                ps[1].x, ps[1].y));
+    break;
+  }
+  case kCGPathElementAddCurveToPoint: {
+    const CGPoint* const ps = e->points;
+    lastPoint = ps[2];
+    s.segments.append(StripeIntersectionSegment::cubicCurve(p.x, p.y, ps[0].x, ps[0].y,
+                                                            ps[1].x, ps[1].y, ps[2].x, ps[2].y));
+    break;
+  }
+  }
+  s.previousPoint = lastPoint;
+}
+
+LowerAndUpperInterval findXBoundsOfPathIntersectionWithHorizontalLines(
+                        __nonnull CGPathRef path,
+                        Range<CGFloat> lowerLineY, Range<CGFloat> upperLineY)
+{
+  STU_DEBUG_ASSERT(lowerLineY.start <= upperLineY.start);
+  STU_DEBUG_ASSERT(lowerLineY.end <= upperLineY.end);
+  STU_DEBUG_ASSERT(lowerLineY.start != upperLineY.start || lowerLineY.end == upperLineY.end);
+
+  PathSegmentsState state = {.segments = TempVector<StripeIntersectionSegment>{
+                                            MaxInitialCapacity{128}}};
+  CGPathApply(path, &state, appendSegment);
+  const StripeXBounds xis = findXBoundsOfSegmentsWithinHorizontalStripes(
+                              state.segments.begin(), state.segments.count(),
+                              Range<Float64>{lowerLineY}, Range<Float64>{upperLineY});
+  return {.lower = narrow_cast<Range<CGFloat>>(xis.lower),
+          .upper = narrow_cast<Range<CGFloat>>(xis.upper)};
+}
+
+// The following implementation based on flattening the curves is only used for testing.
+
 struct PathIntersectionXBoundsState {
   const LowerAndUpperInterval yis;
   LowerAndUpperInterval xis;
@@ -156,7 +219,7 @@ static void findXBoundsOfIntersectionWithHorizontalLine(void* state, const CGPat
   s.previousPoint = lastPoint;
 }
 
-LowerAndUpperInterval findXBoundsOfPathIntersectionWithHorizontalLines(
+LowerAndUpperInterval findXBoundsOfPathIntersectionWithHorizontalLinesUsingFlattening(
                         __nonnull CGPathRef path,
                         Range<CGFloat> lowerLineY, Range<CGFloat> upperLineY,
                         CGFloat maxError)
@@ -0,0 +1,73 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Font.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// A global cache of rasterized glyph coverage masks.
+///
+/// Entries are keyed by the graphics font, the font size, the glyph, the horizontal subpixel
+/// offset (quantized to quarter pixels, like Core Graphics does by default), the display scale and
+/// the antialiasing and font smoothing settings of the context. Since Core Graphics has no public
+/// API for querying the latter settings, they are specified by the caller (via the
+/// `STUTextFrameDrawingOptions`).
+/// The masks are drawn with `CGContextDrawImage`, which paints the current fill color through the
+/// mask. The cache is only used for fill-only text drawn without a shadow into an upright,
+/// unrotated context; color glyph fonts and fonts with a non-identity font matrix are always drawn
+/// with Core Text.
+///
+/// The cache is disabled by default and is enabled by setting a non-zero memory budget.
+class GlyphRasterCache {
+public:
+  struct Statistics {
+    UInt64 hitCount;
+    UInt64 missCount;
+    Int entryCount;
+    UInt memoryUsage;
+  };
+
+  /// The text rendering settings of the target context that affect the rasterized glyphs.
+  struct ContextSettings {
+    bool shouldAntialias;
+    bool shouldSmoothFonts;
+  };
+
+  /// Thread-safe.
+  static bool isEnabled();
+
+  /// Thread-safe.
+  static UInt memoryBudget();
+
+  /// Thread-safe.
+  static void setMemoryBudget(UInt memoryBudget);
+
+  /// Thread-safe.
+  static Statistics statistics();
+
+  /// Thread-safe.
+  static void clear();
+
+  /// Indicates whether `drawGlyphs` can be used for a run with the specified font and text matrix
+  /// in a context with the specified CTM.
+  static bool canDraw(CTFont* __nonnull font, const CachedFontInfo& fontInfo,
+                      const CGAffineTransform& textMatrix, const CGAffineTransform& ctm);
+
+  /// Draws the glyphs with the current fill color of the context, using cached masks where
+  /// possible.
+  ///
+  /// @pre `canDraw(font, fontInfo, textMatrix, ctm)`
+  /// @pre The text drawing mode of the context is `kCGTextFill` and the context has no shadow.
+  /// @pre `settings` match the settings of the context.
+  ///
+  /// Thread-safe.
+  static void drawGlyphs(CTFont* __nonnull font, ArrayRef<const CGGlyph> glyphs,
+                         const CGPoint* __nonnull positions,
+                         const CGAffineTransform& textMatrix, const CGAffineTransform& ctm,
+                         ContextSettings settings, CGContext* __nonnull context);
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
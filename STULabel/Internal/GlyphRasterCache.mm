@@ -0,0 +1,347 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "GlyphRasterCache.hpp"
+
+#import "STULabel/stu_mutex.h"
+
+#import "Hash.hpp"
+#import "LRUCacheStorage.hpp"
+#import "Rect.hpp"
+
+#include <atomic>
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// The number of horizontal subpixel positions per pixel. Core Graphics by default also quantizes
+/// horizontal glyph positions to quarter pixels.
+static constexpr Int subpixelPositionCount = 4;
+
+/// Glyphs with larger masks are drawn directly with Core Text.
+static constexpr Int maxMaskPixelCount = 128*128;
+
+/// The approximate memory overhead of a CGImage and its data provider.
+static constexpr UInt imageOverheadCost = 256;
+
+namespace {
+
+struct GlyphKey {
+  CGFont* cgFont;
+  Float32 fontSize;
+  Float32 scale;
+  CGGlyph glyph;
+  UInt8 subpixelPosition;
+  /// `shouldAntialias | (shouldSmoothFonts << 1)`
+  UInt8 contextSettings;
+
+  HashCode<UInt64> hash() const {
+    return stu_label::hash(reinterpret_cast<UInt64>(cgFont), fontSize, scale,
+                           (UInt64{glyph} << 16) | (UInt64{contextSettings} << 8)
+                           | subpixelPosition);
+  }
+
+  friend bool operator==(const GlyphKey& lhs, const GlyphKey& rhs) {
+    return lhs.cgFont == rhs.cgFont
+        && lhs.fontSize == rhs.fontSize
+        && lhs.scale == rhs.scale
+        && lhs.glyph == rhs.glyph
+        && lhs.subpixelPosition == rhs.subpixelPosition
+        && lhs.contextSettings == rhs.contextSettings;
+  }
+};
+
+struct GlyphMask {
+  /// An 8-bit image mask (retained), or null if the glyph has no ink.
+  CGImage* __nullable image;
+  /// The offset in pixels of the lower-left corner of the mask from the pixel containing the
+  /// glyph origin.
+  Int16 x;
+  Int16 y;
+  UInt16 width;
+  UInt16 height;
+};
+
+struct GlyphRasterCacheEntry {
+  GlyphKey key; // The cgFont is retained.
+  HashCode<UInt64> hashCode;
+  UInt64 lastUse;
+  UInt cost;
+  GlyphMask mask;
+
+  void release() {
+    CFRelease(key.cgFont);
+    if (mask.image) {
+      CFRelease(mask.image);
+    }
+  }
+};
+
+using GlyphRasterCacheStorage = LRUCacheStorage<GlyphRasterCacheEntry>;
+
+} // namespace
+
+static stu_mutex glyphRasterCacheMutex = STU_MUTEX_INIT;
+static bool glyphRasterCacheIsInitialized = false;
+static std::atomic<UInt> glyphRasterCacheMemoryBudget{0};
+alignas(GlyphRasterCacheStorage)
+static Byte glyphRasterCacheStorage[sizeof(GlyphRasterCacheStorage)];
+
+/// Must be called while holding the glyphRasterCacheMutex.
+static GlyphRasterCacheStorage& glyphRasterCache() {
+  if (STU_UNLIKELY(!glyphRasterCacheIsInitialized)) {
+    glyphRasterCacheIsInitialized = true;
+    GlyphRasterCacheStorage& cache = *new (glyphRasterCacheStorage) GlyphRasterCacheStorage{256};
+
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearCacheBlock = ^(NSNotification*) {
+      stu_mutex_lock(&glyphRasterCacheMutex);
+      cache.clear();
+      stu_mutex_unlock(&glyphRasterCacheMutex);
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+  }
+  return reinterpret_cast<GlyphRasterCacheStorage&>(glyphRasterCacheStorage);
+}
+
+bool GlyphRasterCache::isEnabled() {
+  return glyphRasterCacheMemoryBudget.load(std::memory_order_relaxed) != 0;
+}
+
+UInt GlyphRasterCache::memoryBudget() {
+  return glyphRasterCacheMemoryBudget.load(std::memory_order_relaxed);
+}
+
+void GlyphRasterCache::setMemoryBudget(UInt memoryBudget) {
+  stu_mutex_lock(&glyphRasterCacheMutex);
+  glyphRasterCacheMemoryBudget.store(memoryBudget, std::memory_order_relaxed);
+  if (glyphRasterCacheIsInitialized) {
+    GlyphRasterCacheStorage& cache = glyphRasterCache();
+    if (memoryBudget == 0) {
+      cache.clear();
+    } else {
+      cache.evict(memoryBudget);
+    }
+  }
+  stu_mutex_unlock(&glyphRasterCacheMutex);
+}
+
+auto GlyphRasterCache::statistics() -> Statistics {
+  Statistics stats = {};
+  stu_mutex_lock(&glyphRasterCacheMutex);
+  if (glyphRasterCacheIsInitialized) {
+    const GlyphRasterCacheStorage& cache = glyphRasterCache();
+    stats = Statistics{.hitCount = cache.hitCount, .missCount = cache.missCount,
+                       .entryCount = cache.count(), .memoryUsage = cache.memoryUsage()};
+  }
+  stu_mutex_unlock(&glyphRasterCacheMutex);
+  return stats;
+}
+
+void GlyphRasterCache::clear() {
+  stu_mutex_lock(&glyphRasterCacheMutex);
+  if (glyphRasterCacheIsInitialized) {
+    GlyphRasterCacheStorage& cache = glyphRasterCache();
+    cache.clear();
+    cache.hitCount = 0;
+    cache.missCount = 0;
+  }
+  stu_mutex_unlock(&glyphRasterCacheMutex);
+}
+
+bool GlyphRasterCache::canDraw(CTFont* font, const CachedFontInfo& fontInfo,
+                               const CGAffineTransform& textMatrix, const CGAffineTransform& ctm)
+{
+  return !fontInfo.hasColorGlyphs
+      && textMatrix.a == 1 && textMatrix.b == 0 && textMatrix.c == 0 && textMatrix.d == 1
+      && ctm.b == 0 && ctm.c == 0 && ctm.a > 0 && ctm.a == ctm.d
+      && CGAffineTransformIsIdentity(CTFontGetMatrix(font));
+}
+
+/// Returns none if the glyph mask would be too large.
+static Optional<GlyphMask> rasterizeGlyph(CTFont* font, CGGlyph glyph, CGFloat scale,
+                                          UInt8 subpixelPosition,
+                                          GlyphRasterCache::ContextSettings settings)
+{
+  const Rect<CGFloat> bounds = CTFontGetBoundingRectsForGlyphs(font, kCTFontOrientationHorizontal,
+                                                               &glyph, nullptr, 1);
+  if (bounds.isEmpty()) {
+    return GlyphMask{};
+  }
+  const CGFloat dx = CGFloat(subpixelPosition)/subpixelPositionCount;
+  // We add a one pixel margin to accommodate antialiasing.
+  const CGFloat minX = floor(bounds.x.start*scale + dx) - 1;
+  const CGFloat maxX = ceil(bounds.x.end*scale + dx) + 1;
+  const CGFloat minY = floor(bounds.y.start*scale) - 1;
+  const CGFloat maxY = ceil(bounds.y.end*scale) + 1;
+  const Int width = static_cast<Int>(maxX - minX);
+  const Int height = static_cast<Int>(maxY - minY);
+  if (width*height > maxMaskPixelCount || minX < minValue<Int16> || minY < minValue<Int16>) {
+    return none;
+  }
+  const Int bytesPerRow = (width + 3) & ~Int{3};
+  const UInt size = sign_cast(bytesPerRow*height);
+  Byte* const data = static_cast<Byte*>(malloc(size));
+  if (!data) return none;
+  // Image mask samples with value 0 paint and samples with the maximum value mask out the paint,
+  // so we draw the glyph in black onto a white background.
+  memset(data, 0xff, size);
+  const RC<CGColorSpace> grayColorSpace{CGColorSpaceCreateDeviceGray(),
+                                        ShouldIncrementRefCount{false}};
+  CGContext* const context = CGBitmapContextCreate(data, sign_cast(width), sign_cast(height), 8,
+                                                   sign_cast(bytesPerRow), grayColorSpace.get(),
+                                                   kCGImageAlphaNone);
+  if (!context) {
+    free(data);
+    return none;
+  }
+  CGContextSetGrayFillColor(context, 0, 1);
+  CGContextSetShouldAntialias(context, settings.shouldAntialias);
+  CGContextSetShouldSmoothFonts(context, settings.shouldSmoothFonts);
+  CGContextSetAllowsFontSubpixelPositioning(context, true);
+  CGContextSetShouldSubpixelPositionFonts(context, true);
+  CGContextSetShouldSubpixelQuantizeFonts(context, false);
+  CGContextScaleCTM(context, scale, scale);
+  const CGPoint position = {(dx - minX)/scale, -minY/scale};
+  CTFontDrawGlyphs(font, &glyph, &position, 1, context);
+  CGContextRelease(context);
+
+  const RC<CGDataProvider> dataProvider{
+    CGDataProviderCreateWithData(nullptr, data, size, [](void*, const void* data, size_t) {
+                                   free(const_cast<void*>(data));
+                                 }),
+    ShouldIncrementRefCount{false}};
+  CGImage* const image = CGImageMaskCreate(sign_cast(width), sign_cast(height), 8, 8,
+                                           sign_cast(bytesPerRow), dataProvider.get(),
+                                           nullptr, false);
+  if (!image) return none;
+  return GlyphMask{.image = image,
+                   .x = static_cast<Int16>(minX), .y = static_cast<Int16>(minY),
+                   .width = static_cast<UInt16>(width), .height = static_cast<UInt16>(height)};
+}
+
+void GlyphRasterCache::drawGlyphs(CTFont* font, ArrayRef<const CGGlyph> glyphs,
+                                  const CGPoint* positions,
+                                  const CGAffineTransform& textMatrix, const CGAffineTransform& ctm,
+                                  ContextSettings settings, CGContext* context)
+{
+  const Int n = glyphs.count();
+  if (n == 0) return;
+  const CGFloat scale = ctm.a;
+  const CGFloat inverseScale = 1/scale;
+  RC<CGFont> cgFont{CTFontCopyGraphicsFont(font, nullptr), ShouldIncrementRefCount{false}};
+  const Float32 fontSize = narrow_cast<Float32>(CTFontGetSize(font));
+  const UInt8 contextSettings = static_cast<UInt8>(settings.shouldAntialias
+                                                   | (settings.shouldSmoothFonts << 1));
+
+  struct Glyph {
+    HashCode<UInt64> hashCode;
+    GlyphKey key;
+    /// The device pixel containing the (quantized) glyph origin.
+    Int32 pixelX;
+    Int32 pixelY;
+    Optional<GlyphMask> mask;
+  };
+  TempArray<Glyph> gs{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    const CGFloat x = scale*(textMatrix.tx + positions[i].x) + ctm.tx;
+    const CGFloat y = scale*(textMatrix.ty + positions[i].y) + ctm.ty;
+    const CGFloat qx = nearbyint(x*subpixelPositionCount);
+    const CGFloat pixelX = floor(qx/subpixelPositionCount);
+    Glyph& g = gs[i];
+    g.key = GlyphKey{.cgFont = cgFont.get(), .fontSize = fontSize,
+                     .scale = narrow_cast<Float32>(scale), .glyph = glyphs[i],
+                     .subpixelPosition = static_cast<UInt8>(qx - pixelX*subpixelPositionCount),
+                     .contextSettings = contextSettings};
+    g.hashCode = g.key.hash();
+    g.pixelX = narrow_cast<Int32>(pixelX);
+    g.pixelY = narrow_cast<Int32>(nearbyint(y));
+    new (&g.mask) Optional<GlyphMask>{};
+  }
+
+  Int missCount = 0;
+  stu_mutex_lock(&glyphRasterCacheMutex);
+  {
+    GlyphRasterCacheStorage& cache = glyphRasterCache();
+    for (Glyph& g : gs) {
+      const GlyphRasterCacheEntry* const entry =
+        cache.find(g.hashCode, [&](const GlyphRasterCacheEntry& e) { return e.key == g.key; });
+      if (entry) {
+        g.mask = entry->mask;
+        if (g.mask->image) {
+          CFRetain(g.mask->image);
+        }
+      } else {
+        ++missCount;
+      }
+    }
+    cache.hitCount += sign_cast(n - missCount);
+    cache.missCount += sign_cast(missCount);
+  }
+  stu_mutex_unlock(&glyphRasterCacheMutex);
+
+  // We rasterize the missing glyphs without holding the lock.
+  if (missCount != 0) {
+    TempArray<bool> isCacheable{zeroInitialized, Count{n}};
+    for (Int i = 0; i < n; ++i) {
+      Glyph& g = gs[i];
+      if (g.mask) continue;
+      g.mask = rasterizeGlyph(font, g.key.glyph, scale, g.key.subpixelPosition, settings);
+      if (!g.mask) continue;
+      isCacheable[i] = true;
+      if (g.mask->image) {
+        CFRetain(g.mask->image); // The other reference is transferred to the cache.
+      }
+    }
+    stu_mutex_lock(&glyphRasterCacheMutex);
+    {
+      GlyphRasterCacheStorage& cache = glyphRasterCache();
+      const UInt budget = glyphRasterCacheMemoryBudget.load(std::memory_order_relaxed);
+      for (Int i = 0; i < n; ++i) {
+        if (!isCacheable[i]) continue;
+        const Glyph& g = gs[i];
+        const GlyphMask& mask = *g.mask;
+        const UInt cost = sizeof(GlyphRasterCacheEntry)
+                        + (mask.image ? CGImageGetBytesPerRow(mask.image)*mask.height
+                                        + imageOverheadCost
+                                      : 0);
+        // The cache takes over the reference to the mask image if the insertion succeeds.
+        const bool inserted = budget != 0
+                           && cache.insert(g.hashCode, cost, budget,
+                                           [&](const GlyphRasterCacheEntry& e) {
+                                             return e.key == g.key;
+                                           },
+                                           [&]() {
+                                             CFRetain(g.key.cgFont);
+                                             return GlyphRasterCacheEntry{.key = g.key,
+                                                                          .mask = mask};
+                                           });
+        if (!inserted && mask.image) {
+          CFRelease(mask.image);
+        }
+      }
+    }
+    stu_mutex_unlock(&glyphRasterCacheMutex);
+  }
+
+  for (Int i = 0; i < n; ++i) {
+    const Glyph& g = gs[i];
+    if (!g.mask) {
+      // The glyph is too large for the cache.
+      CTFontDrawGlyphs(font, &glyphs[i], &positions[i], 1, context);
+      continue;
+    }
+    if (!g.mask->image) continue;
+    const CGRect rect = {{(g.pixelX + g.mask->x - ctm.tx)*inverseScale,
+                          (g.pixelY + g.mask->y - ctm.ty)*inverseScale},
+                         {g.mask->width*inverseScale, g.mask->height*inverseScale}};
+    CGContextDrawImage(context, rect, g.mask->image);
+    CFRelease(g.mask->image);
+  }
+}
+
+} // namespace stu_label
@@ -40,6 +40,68 @@ Float64 typographicWidth(CTLine* __nullable line) {
   return max(0, CTLineGetTypographicBounds(line, nullptr, nullptr, nullptr));
 }
 
+/// Returns the string range of the glyphs in the specified glyph range of a run. The range ends
+/// at the start of the string range of the next glyph that doesn't belong to the same cluster.
+///
+/// This function doesn't depend on CoreText and implements `GlyphSpan::stringRange()`.
+///
+/// @param stringIndices The string indices of all glyphs in the run, indexable with `Int` values.
+/// @param runGlyphCount The number of glyphs in the run.
+/// @param runStringRangeEnd The end of the string range of the run.
+/// @pre `!glyphRange.isEmpty() && Range(0, runGlyphCount).contains(glyphRange)`
+template <typename StringIndices>
+Range<Int> stringRangeOfGlyphsInRun(const StringIndices& stringIndices, Int runGlyphCount,
+                                    Int runStringRangeEnd, bool isRightToLeft,
+                                    bool isNonMonotonic, Range<Int> glyphRange)
+{
+  STU_DEBUG_ASSERT(!glyphRange.isEmpty() && Range(0, runGlyphCount).contains(glyphRange));
+  Range<Int> stringRange{uninitialized};
+  if (!isNonMonotonic) {
+    stringRange.start = stringIndices[glyphRange.start];
+    if (!isRightToLeft) {
+      for (; glyphRange.end < runGlyphCount; ++glyphRange.end) {
+        const Int stringIndex = stringIndices[glyphRange.end];
+        if (stringIndex > stringRange.start) {
+          stringRange.end = stringIndex;
+          break;
+        }
+      }
+      if (glyphRange.end == runGlyphCount) {
+        stringRange.end = runStringRangeEnd;
+      }
+    } else { // isRightToLeft
+      for (; glyphRange.start - 1 >= 0; --glyphRange.start) {
+        const Int stringIndex = stringIndices[glyphRange.start - 1];
+        if (stringIndex > stringRange.start) {
+          stringRange.end = stringIndex;
+          break;
+        }
+      }
+      if (glyphRange.start == 0) {
+        stringRange.end = runStringRangeEnd;
+      }
+    }
+  } else { // Non-monotonous run
+    stringRange.start = maxValue<Int>;
+    STU_DISABLE_LOOP_UNROLL
+    for (Int i = glyphRange.start; i < glyphRange.end; ++i) {
+      stringRange.start = min(stringRange.start, Int{stringIndices[i]});
+    }
+    stringRange.end = maxValue<Int>;
+    STU_DISABLE_LOOP_UNROLL
+    for (Int i = 0; i < runGlyphCount; ++i) {
+      const Int stringIndex = stringIndices[i];
+      if (stringRange.start < stringIndex && stringIndex < stringRange.end) {
+        stringRange.end = stringIndex;
+      }
+    }
+    if (stringRange.end == maxValue<Int>) {
+      stringRange.end = runStringRangeEnd;
+    }
+  }
+  return stringRange;
+}
+
 class GlyphSpan;
 
 template <typename T>
@@ -90,27 +152,58 @@ public:
 using StringIndicesArray = OptionallyAllocatedArray<Int>;
 using AdvancesArray = OptionallyAllocatedArray<CGSize>;
 
-/// A non-owning CTRun reference.
+/// A copy of the glyph data of a CTRun in a text frame's compact glyph storage
+/// (see TextFrameGlyphStorage.hpp).
+struct StoredGlyphRun {
+  /// Retained by the glyph storage.
+  CTFont* __nullable font;
+  const CGGlyph* glyphs;
+  const CGPoint* positions;
+  const Int* stringIndices;
+  /// The `glyphCount + 1` non-decreasing typographic X offsets of the glyph boundaries relative
+  /// to the start of the run. The last offset is the typographic width of the run.
+  const Float64* glyphXOffsets;
+  CGAffineTransform textMatrix;
+  Range<Int32> stringRange;
+  Int32 glyphCount;
+  CTRunStatus status;
+};
+
+/// A non-owning reference to a CTRun or to a `StoredGlyphRun`.
 class GlyphRunRef {
   CTRun* run_;
+  const StoredGlyphRun* storedRun_;
 public:
   explicit STU_INLINE_T
-  GlyphRunRef(Uninitialized) noexcept : run_{} {}
+  GlyphRunRef(Uninitialized) noexcept : run_{}, storedRun_{} {}
 
   /* implicit */ STU_INLINE_T
-  GlyphRunRef(CTRun* __nonnull run) : run_{run} {}
+  GlyphRunRef(CTRun* __nonnull run) : run_{run}, storedRun_{} {}
+
+  /* implicit */ STU_INLINE_T
+  GlyphRunRef(const StoredGlyphRun& run) : run_{}, storedRun_{&run} {}
 
   STU_INLINE STU_PURE
-  Int count() const { return CTRunGetGlyphCount(run_); }
+  Int count() const { return storedRun_ ? storedRun_->glyphCount : CTRunGetGlyphCount(run_); }
 
+  /// @pre `!storedRun()`
   STU_INLINE
-  CTRun* ctRun() const { return run_; }
+  CTRun* ctRun() const {
+    STU_DEBUG_ASSERT(!storedRun_);
+    return run_;
+  }
+
+  /// Null if the run references a CTRun.
+  STU_INLINE_T
+  const StoredGlyphRun* __nullable storedRun() const { return storedRun_; }
 
   STU_INLINE STU_PURE
-  CGAffineTransform textMatrix() const { return CTRunGetTextMatrix(run_); }
+  CGAffineTransform textMatrix() const {
+    return storedRun_ ? storedRun_->textMatrix : CTRunGetTextMatrix(run_);
+  }
 
   STU_INLINE STU_PURE
-  CTRunStatus status() const { return CTRunGetStatus(run_); }
+  CTRunStatus status() const { return storedRun_ ? storedRun_->status : CTRunGetStatus(run_); }
 
   STU_INLINE
   bool isRightToLeft() const { return status() & kCTRunStatusRightToLeft; }
@@ -121,15 +214,21 @@ public:
   }
 
   STU_INLINE
-  CTFont* font() const { return getFont(run_); }
+  CTFont* font() const { return storedRun_ ? storedRun_->font : getFont(run_); }
 
   STU_INLINE STU_PURE
   Float64 typographicWidth() const {
+    if (storedRun_) {
+      return storedRun_->glyphXOffsets[storedRun_->glyphCount];
+    }
     return CTRunGetTypographicBounds(run_, CFRange{}, nullptr, nullptr, nullptr);
   }
 
   STU_INLINE STU_PURE
   Range<Int> stringRange() const {
+    if (storedRun_) {
+      return {storedRun_->stringRange.start, storedRun_->stringRange.end};
+    }
     return CTRunGetStringRange(run_);
   }
 
@@ -138,17 +237,23 @@ private:
 
   STU_INLINE STU_PURE
   const CGGlyph* __nullable glyhsPointer() const {
-    return CTRunGetGlyphsPtr(run_);
+    return storedRun_ ? storedRun_->glyphs : CTRunGetGlyphsPtr(run_);
   }
 
+  STU_INLINE STU_PURE
+  const CGPoint* __nullable positionsPointer() const {
+    return storedRun_ ? storedRun_->positions : CTRunGetPositionsPtr(run_);
+  }
+
+  /// @pre `!storedRun()`
   STU_INLINE STU_PURE
   const CGSize* __nullable advancesPointer() const {
-    return CTRunGetAdvancesPtr(run_);
+    return CTRunGetAdvancesPtr(ctRun());
   }
 
   STU_INLINE STU_PURE
   const Int* __nullable stringIndicesPointer() const {
-    return CTRunGetStringIndicesPtr(run_);
+    return storedRun_ ? storedRun_->stringIndices : CTRunGetStringIndicesPtr(run_);
   }
 
   friend class GlyphSpan;
@@ -158,7 +263,7 @@ private:
 
 class LocalGlyphBoundsCache;
 
-/// A non-owning CTRun subrange.
+/// A non-owning subrange of a CTRun or of a `StoredGlyphRun`.
 ///
 /// @note
 ///  The CoreText CTRun API functions accepting a CFRange argument and a pointer output
@@ -282,6 +387,10 @@ public:
 
   STU_INLINE
   Float64 typographicWidth() const {
+    if (const StoredGlyphRun* const run = run_.storedRun_) {
+      const Range<Int> range = glyphRange();
+      return run->glyphXOffsets[range.end] - run->glyphXOffsets[range.start];
+    }
     if (const Optional<CFRange> range = ctRunGlyphRange()) {
       return CTRunGetTypographicBounds(run_.ctRun(), *range, nullptr, nullptr, nullptr);
     }
@@ -297,6 +406,7 @@ public:
     return {};
   }
 
+  /// @pre `!run().storedRun()`
   STU_INLINE
   void draw(CGContextRef cgContext) const {
     if (const Optional<CFRange> range = ctRunGlyphRange()) {
@@ -310,6 +420,9 @@ public:
   STU_INLINE
   CGGlyph operator[](Int index) const {
     STU_ASSERT(0 <= index && index < count());
+    if (const StoredGlyphRun* const run = run_.storedRun_) {
+      return run->glyphs[startIndex_ + index];
+    }
     CGGlyph glyph;
     CTRunGetGlyphs(run_.ctRun(), CFRange{startIndex_ + index, 1}, &glyph);
     return glyph;
@@ -330,6 +443,12 @@ public:
     STU_ASSERT(glyphIndexRange.count() == out.count());
     STU_ASSERT(Range(0, count()).contains(glyphIndexRange));
     if (glyphIndexRange.isEmpty()) return;
+    if (const StoredGlyphRun* const run = run_.storedRun_) {
+      array_utils::copyConstructArray(ArrayRef{run->glyphs + startIndex_ + glyphIndexRange.start,
+                                               glyphIndexRange.count()},
+                                      out.begin());
+      return;
+    }
     CTRunGetGlyphs(run_.ctRun(), startIndex_ + glyphIndexRange, out.begin());
   }
 
@@ -355,6 +474,9 @@ public:
   STU_INLINE
   Int stringIndexForGlyphAtIndex(Int index) const {
     STU_PRECONDITION(0 <= index && index < count());
+    if (const StoredGlyphRun* const run = run_.storedRun_) {
+      return run->stringIndices[startIndex_ + index];
+    }
     Int stringIndex;
     CTRunGetStringIndices(run_.ctRun(), CFRange{.location = startIndex_ + index, .length = 1},
                           &stringIndex);
@@ -376,6 +498,12 @@ public:
     STU_PRECONDITION(glyphIndexRange.count() == out.count());
     STU_PRECONDITION(Range(0, count()).contains(glyphIndexRange));
     if (glyphIndexRange.isEmpty()) return;
+    if (const StoredGlyphRun* const run = run_.storedRun_) {
+      array_utils::copyConstructArray(
+        ArrayRef{run->stringIndices + startIndex_ + glyphIndexRange.start, glyphIndexRange.count()},
+        out.begin());
+      return;
+    }
     CTRunGetStringIndices(run_.ctRun(), startIndex_ + glyphIndexRange, out.begin());
   }
 
@@ -403,6 +531,7 @@ public:
   // clear whether this is intended CoreText behaviour.)
 
   class AdvancesRef;
+  /// @pre `!run().storedRun()`
   STU_INLINE AdvancesRef advances() const { return {*this}; }
 
   class GlyphsRef {
@@ -414,7 +543,7 @@ public:
     /* implicit */ STU_INLINE
     GlyphsRef(const GlyphSpan& span)
     : array_{span.run_.glyhsPointer()}, count_{span.count()}, startIndex_{span.startIndex_},
-      run_{span.run_.ctRun()}
+      run_{span.run_.run_}
     {}
 
     STU_INLINE
@@ -438,7 +567,7 @@ public:
     /* implicit */ STU_INLINE
     StringIndicesRef(const GlyphSpan& span)
     : array_{span.run_.stringIndicesPointer()}, count_{span.count()},
-      startIndex_{span.startIndex_}, run_{span.run_.ctRun()}
+      startIndex_{span.startIndex_}, run_{span.run_.run_}
     {}
 
     STU_INLINE
@@ -524,6 +653,37 @@ struct RunGlyphIndex {
   }
 };
 
+/// The runs of a CTLine or an array of `StoredGlyphRun`s.
+class GlyphRuns {
+  NSArrayRef<CTRun*> ctRuns_;
+  ArrayRef<const StoredGlyphRun> storedRuns_;
+public:
+  STU_INLINE_T
+  GlyphRuns() = default;
+
+  explicit STU_INLINE
+  GlyphRuns(CTLine* __nonnull line) : ctRuns_{glyphRuns(line)} {}
+
+  explicit STU_INLINE_T
+  GlyphRuns(ArrayRef<const StoredGlyphRun> runs) : storedRuns_{runs} {}
+
+  /// False for a default-constructed instance and for an empty array of stored runs.
+  explicit STU_INLINE
+  operator bool() const { return ctRuns_ || !storedRuns_.isEmpty(); }
+
+  STU_INLINE
+  Int count() const { return ctRuns_ ? ctRuns_.count() : storedRuns_.count(); }
+
+  STU_INLINE
+  bool isValidIndex(Int index) const { return 0 <= index && index < count(); }
+
+  STU_INLINE
+  GlyphRunRef operator[](Int index) const {
+    if (ctRuns_) return ctRuns_[index];
+    return storedRuns_[index];
+  }
+};
+
 } // namespace stu_label
 
 template <>
@@ -531,8 +691,13 @@ class stu::OptionalValueStorage<stu_label::GlyphRunRef> {
 public:
   stu_label::GlyphRunRef value_{uninitialized};
 
-  STU_INLINE bool hasValue() const noexcept { return value_.run_ != nullptr; }
-  STU_INLINE void clearValue() noexcept { value_.run_ = nullptr; }
+  STU_INLINE bool hasValue() const noexcept {
+    return value_.run_ != nullptr || value_.storedRun_ != nullptr;
+  }
+  STU_INLINE void clearValue() noexcept {
+    value_.run_ = nullptr;
+    value_.storedRun_ = nullptr;
+  }
   STU_INLINE void constructValue(stu_label::GlyphRunRef run) { value_ = run; }
 };
 
@@ -541,9 +706,14 @@ class stu::OptionalValueStorage<stu_label::GlyphSpan> {
 public:
   stu_label::GlyphSpan value_{uninitialized};
 
-  STU_INLINE bool hasValue() const noexcept { return value_.run_.run_ != nullptr; }
+  STU_INLINE bool hasValue() const noexcept {
+    return value_.run_.run_ != nullptr || value_.run_.storedRun_ != nullptr;
+  }
 
-  STU_INLINE void clearValue() noexcept { value_.run_.run_ = nullptr; }
+  STU_INLINE void clearValue() noexcept {
+    value_.run_.run_ = nullptr;
+    value_.run_.storedRun_ = nullptr;
+  }
 
   template <typename... Args>
   STU_INLINE void constructValue(Args&&... args) {
@@ -14,18 +14,18 @@ STU_NO_INLINE
 GlyphsWithPositions GlyphSpan::getGlyphsWithPositionsImpl(GlyphRunRef run, CFRange glyphRange) {
   const Int count = glyphRange.length;
   STU_ASSERT(count > 0);
-  CTRun* const ctRun = run.ctRun();
-  const CGGlyph* glyphs = CTRunGetGlyphsPtr(ctRun);
+  const CGGlyph* glyphs = run.glyhsPointer();
   if (glyphs) {
     glyphs += glyphRange.location;
   }
-  const CGPoint* positions = CTRunGetPositionsPtr(ctRun);
+  const CGPoint* positions = run.positionsPointer();
   if (positions) {
     positions += glyphRange.location;
   }
   if (glyphs && positions) {
     return GlyphsWithPositions{none, count, glyphs, positions};
   }
+  CTRun* const ctRun = run.ctRun();
   static_assert(alignof(CGPoint)%alignof(CGGlyph) == 0);
   const Int bufferSize = count*sign_cast(  (positions ? 0 : sizeof(CGPoint))
                                          + (glyphs ? 0 : sizeof(CGGlyph)));
@@ -59,7 +59,13 @@ StringIndicesArray GlyphSpan::stringIndicesArray_slowPath(GlyphRunRef run, CFRan
   if (STU_UNLIKELY(glyphRange.length <= 0)) return {};
   auto& alloc = ThreadLocalAllocatorRef().get();
   Int* const p = alloc.allocate<Int>(glyphRange.length);
-  CTRunGetStringIndices(run.ctRun(), glyphRange, p);
+  if (const StoredGlyphRun* const storedRun = run.storedRun()) {
+    array_utils::copyConstructArray(ArrayRef{storedRun->stringIndices + glyphRange.location,
+                                             glyphRange.length},
+                                    p);
+  } else {
+    CTRunGetStringIndices(run.ctRun(), glyphRange, p);
+  }
   return {ArrayRef{p, glyphRange.length}, alloc};
 }
 
@@ -83,55 +89,16 @@ STU_NO_INLINE
 Range<Int> GlyphSpan::stringRangeImpl(const GlyphRunRef run, Range<Int> glyphRange) {
   const GlyphSpan runSpan{run};
   const Int runGlyphCount = runSpan.count();
-  STU_DEBUG_ASSERT(!glyphRange.isEmpty() && Range(0, runGlyphCount).contains(glyphRange));
   const auto status = run.status();
   const bool isRightToLeft = status & kCTRunStatusRightToLeft;
-  Range<Int> stringRange{uninitialized};
+  const Int runStringRangeEnd = run.stringRange().end;
   if (!(status & kCTRunStatusNonMonotonic)) {
-    const auto stringIndices = runSpan.stringIndices();
-    stringRange.start = stringIndices[glyphRange.start];
-    if (!isRightToLeft) {
-      for (; glyphRange.end < runGlyphCount; ++glyphRange.end) {
-        const Int stringIndex = stringIndices[glyphRange.end];
-        if (stringIndex > stringRange.start) {
-          stringRange.end = stringIndex;
-          break;
-        }
-      }
-      if (glyphRange.end == runGlyphCount) {
-        stringRange.end = run.stringRange().end;
-      }
-    } else { // isRightToLeft
-      for (; glyphRange.start - 1 >= 0; --glyphRange.start) {
-        const Int stringIndex = stringIndices[glyphRange.start - 1];
-        if (stringIndex > stringRange.start) {
-          stringRange.end = stringIndex;
-          break;
-        }
-      }
-      if (glyphRange.start == 0) {
-        stringRange.end = run.stringRange().end;
-      }
-    }
-  } else { // Non-monotonous run
-    const auto stringIndices = runSpan.stringIndicesArray();
-    stringRange.start = maxValue<Int>;
-    STU_DISABLE_LOOP_UNROLL
-    for (const Int stringIndex : stringIndices[glyphRange]) {
-      stringRange.start = min(stringRange.start, stringIndex);
-    }
-    stringRange.end = maxValue<Int>;
-    STU_DISABLE_LOOP_UNROLL
-    for (const Int stringIndex : stringIndices) {
-      if (stringRange.start < stringIndex && stringIndex < stringRange.end) {
-        stringRange.end = stringIndex;
-      }
-    }
-    if (stringRange.end == maxValue<Int>) {
-      stringRange.end = run.stringRange().end;
-    }
+    return stringRangeOfGlyphsInRun(runSpan.stringIndices(), runGlyphCount, runStringRangeEnd,
+                                    isRightToLeft, false, glyphRange);
+  } else {
+    return stringRangeOfGlyphsInRun(runSpan.stringIndicesArray(), runGlyphCount,
+                                    runStringRangeEnd, isRightToLeft, true, glyphRange);
   }
-  return stringRange;
 }
 
 STU_NO_INLINE
@@ -0,0 +1,43 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Hyphenator.hpp"
+#import "NSStringRef.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// Trims and lowercases the patterns and exceptions and then calls `Hyphenator::create`.
+/// Returns null if the patterns or exceptions are malformed, e.g. contain inner whitespace.
+RC<Hyphenator> createHyphenator(NSArray<NSString*>* __nonnull patterns,
+                                NSArray<NSString*>* __nullable exceptions,
+                                Int minPrefixLength = 2, Int minSuffixLength = 3);
+
+/// Calls `onLocation` with the string index of every hyphenation location in the specified
+/// range, in increasing order. Words that cross the boundaries of the range are ignored.
+///
+/// A word is a maximal sequence of letters (as defined by `kCFCharacterSetLetter`).
+/// No location is reported before a non-base character.
+void findHyphenationLocations(const Hyphenator&, const NSStringRef& string, Range<Int> range,
+                              FunctionRef<void(Int)> onLocation);
+
+/// Registers the hyphenator for the canonical form of the locale identifier.
+/// A null hyphenator removes the registration.
+///
+/// Thread-safe.
+void setHyphenatorForLocaleIdentifier(CFString* __nonnull localeId, RC<Hyphenator> hyphenator);
+
+/// Returns the hyphenator registered for the canonical form of the locale identifier or,
+/// if there is none, the hyphenator registered for the language code of the locale identifier.
+///
+/// Thread-safe.
+RC<Hyphenator> hyphenatorForLocaleIdentifier(CFString* __nonnull localeId);
+
+/// Indicates whether any hyphenator is registered.
+///
+/// Thread-safe.
+bool hasRegisteredHyphenators();
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
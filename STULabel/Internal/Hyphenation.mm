@@ -0,0 +1,199 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Hyphenation.hpp"
+
+#import "UnicodeCodePointProperties.hpp"
+
+#import "STULabel/stu_mutex.h"
+
+#include <atomic>
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+using CFCharacterSet = RemovePointer<CFCharacterSetRef>;
+using CFMutableString = RemovePointer<CFMutableStringRef>;
+
+/// Appends the trimmed and lowercased UTF-16 code units of the strings to `chars` and the
+/// corresponding ranges to `ranges`. Returns false if a trimmed string contains whitespace.
+static bool appendTrimmedLowercaseStrings(
+               NSArray<NSString*>* __unsafe_unretained __nullable strings,
+               Vector<Char16>& chars, Vector<Range<Int>>& ranges)
+{
+  for (NSString* __unsafe_unretained string in strings) {
+    string = [[string stringByTrimmingCharactersInSet:NSCharacterSet.whitespaceCharacterSet]
+                lowercaseString];
+    const NSStringRef ref{string};
+    const Int start = chars.count();
+    ref.copyUTF16Chars(Range{0, ref.count()},
+                       ArrayRef{chars.append(repeat(uninitialized, ref.count())), ref.count()});
+    for (const Char16 c : chars[{start, $}]) {
+      if (isUnicodeWhitespace(c)) return false;
+    }
+    ranges.append(Range{start, chars.count()});
+  }
+  return true;
+}
+
+RC<Hyphenator> createHyphenator(NSArray<NSString*>* __unsafe_unretained patterns,
+                                NSArray<NSString*>* __unsafe_unretained __nullable exceptions,
+                                Int minPrefixLength, Int minSuffixLength)
+{
+  Vector<Char16> chars;
+  Vector<Range<Int>> patternRanges;
+  Vector<Range<Int>> exceptionRanges;
+  if (!appendTrimmedLowercaseStrings(patterns, chars, patternRanges)
+      || !appendTrimmedLowercaseStrings(exceptions, chars, exceptionRanges))
+  {
+    return nullptr;
+  }
+  // The chars vector doesn't change anymore, so we can now reference the strings.
+  Vector<ArrayRef<const Char16>> patternStrings;
+  for (const Range<Int> range : patternRanges) {
+    patternStrings.append(chars[range]);
+  }
+  Vector<ArrayRef<const Char16>> exceptionStrings;
+  for (const Range<Int> range : exceptionRanges) {
+    exceptionStrings.append(chars[range]);
+  }
+  return Hyphenator::create(patternStrings, exceptionStrings, minPrefixLength, minSuffixLength);
+}
+
+static bool isLetter(Char16 c, CFCharacterSet* letters) {
+  if (c < 0x80) return 'a' <= (c | 0x20) && (c | 0x20) <= 'z';
+  return !isSurrogate(c) && CFCharacterSetIsCharacterMember(letters, c);
+}
+
+/// Lowercases the non-ASCII code units, unless that would change the length of the word.
+STU_NO_INLINE
+static void lowercaseNonASCII(ArrayRef<Char16> word) {
+  const RC<CFMutableString> string{CFStringCreateMutable(nullptr, 0),
+                                   ShouldIncrementRefCount{false}};
+  CFStringAppendCharacters(string.get(), word.begin(), word.count());
+  CFStringLowercase(string.get(), nullptr);
+  if (CFStringGetLength(string.get()) != word.count()) return;
+  CFStringGetCharacters(string.get(), CFRange{0, word.count()}, word.begin());
+}
+
+void findHyphenationLocations(const Hyphenator& hyphenator, const NSStringRef& string,
+                              Range<Int> range, FunctionRef<void(Int)> onLocation)
+{
+  CFCharacterSet* const letters = CFCharacterSetGetPredefined(kCFCharacterSetLetter);
+  CFCharacterSet* const nonBaseChars = CFCharacterSetGetPredefined(kCFCharacterSetNonBase);
+  Char16 word[Hyphenator::maxWordLength];
+  for (Int i = range.start; i < range.end;) {
+    if (!isLetter(string[i], letters)) {
+      ++i;
+      continue;
+    }
+    const Int start = i;
+    while (++i < range.end && isLetter(string[i], letters)) {}
+    const Int end = i;
+    const Int n = end - start;
+    if (n > Hyphenator::maxWordLength) continue;
+    if ((start == range.start && start > 0 && isLetter(string[start - 1], letters))
+        || (end < string.count() && end == range.end && isLetter(string[end], letters)))
+    {
+      continue;
+    }
+    string.copyUTF16Chars(Range{start, end}, ArrayRef{word, n});
+    bool isASCII = true;
+    for (Int k = 0; k < n; ++k) {
+      const Char16 c = word[k];
+      if (c < 0x80) {
+        word[k] = c | ('A' <= c && c <= 'Z' ? 0x20 : 0);
+      } else {
+        isASCII = false;
+      }
+    }
+    if (!isASCII) {
+      lowercaseNonASCII(ArrayRef{word, n});
+    }
+    hyphenator.hyphenateWord(ArrayRef{word, n}, [&](Int k) {
+      const Char16 c = word[k];
+      if (c >= 0x80 && CFCharacterSetIsCharacterMember(nonBaseChars, c)) return;
+      onLocation(start + k);
+    });
+  }
+}
+
+namespace {
+struct RegistryEntry {
+  RC<CFString> localeId;
+  RC<Hyphenator> hyphenator;
+};
+}
+
+static stu_mutex hyphenatorRegistryMutex = STU_MUTEX_INIT;
+static Vector<RegistryEntry>* hyphenatorRegistry;
+static std::atomic<Int> registeredHyphenatorCount{0};
+
+bool hasRegisteredHyphenators() {
+  return registeredHyphenatorCount.load(std::memory_order_relaxed) != 0;
+}
+
+static RC<CFString> canonicalLocaleIdentifier(CFString* localeId) {
+  return {CFLocaleCreateCanonicalLocaleIdentifierFromString(nullptr, localeId),
+          ShouldIncrementRefCount{false}};
+}
+
+void setHyphenatorForLocaleIdentifier(CFString* localeId, RC<Hyphenator> hyphenator) {
+  RC<CFString> id = canonicalLocaleIdentifier(localeId);
+  if (!id) return;
+  // The previously registered hyphenator must be released outside the critical section.
+  RC<Hyphenator> oldHyphenator;
+  stu_mutex_lock(&hyphenatorRegistryMutex);
+  if (!hyphenatorRegistry) {
+    hyphenatorRegistry = new Vector<RegistryEntry>();
+  }
+  Vector<RegistryEntry>& registry = *hyphenatorRegistry;
+  Int index = 0;
+  while (index < registry.count() && !CFEqual(registry[index].localeId.get(), id.get())) {
+    ++index;
+  }
+  if (index < registry.count()) {
+    oldHyphenator = std::move(registry[index].hyphenator);
+    if (hyphenator) {
+      registry[index].hyphenator = std::move(hyphenator);
+    } else {
+      registry.removeRange({index, index + 1});
+    }
+  } else if (hyphenator) {
+    registry.append(RegistryEntry{std::move(id), std::move(hyphenator)});
+  }
+  registeredHyphenatorCount.store(registry.count(), std::memory_order_relaxed);
+  stu_mutex_unlock(&hyphenatorRegistryMutex);
+}
+
+static RC<Hyphenator> registeredHyphenator_locked(CFString* canonicalLocaleId) {
+  if (!hyphenatorRegistry) return nullptr;
+  for (const RegistryEntry& entry : *hyphenatorRegistry) {
+    if (CFEqual(entry.localeId.get(), canonicalLocaleId)) return entry.hyphenator;
+  }
+  return nullptr;
+}
+
+RC<Hyphenator> hyphenatorForLocaleIdentifier(CFString* localeId) {
+  if (!hasRegisteredHyphenators()) return nullptr;
+  const RC<CFString> id = canonicalLocaleIdentifier(localeId);
+  if (!id) return nullptr;
+  RC<CFString> languageCode;
+  const CFRange separator = CFStringFind(id.get(), CFSTR("_"), 0);
+  if (separator.location > 0) {
+    languageCode = RC<CFString>{CFStringCreateWithSubstring(nullptr, id.get(),
+                                                            CFRange{0, separator.location}),
+                                ShouldIncrementRefCount{false}};
+  }
+  stu_mutex_lock(&hyphenatorRegistryMutex);
+  RC<Hyphenator> result = registeredHyphenator_locked(id.get());
+  if (!result && languageCode) {
+    result = registeredHyphenator_locked(languageCode.get());
+  }
+  stu_mutex_unlock(&hyphenatorRegistryMutex);
+  return result;
+}
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -0,0 +1,255 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#include "Hyphenator.hpp"
+
+#include "stu/BinarySearch.hpp"
+
+#include <algorithm>
+
+namespace stu_label {
+
+/// Patterns with more code units are rejected.
+static constexpr Int maxPatternLength = 64;
+
+static constexpr Char16 wordBoundaryChar = '.';
+
+/// The value of an exception pattern at a position where the word may be hyphenated.
+static constexpr UInt8 exceptionHyphenValue = 0xff;
+/// The value of an exception pattern at a position where the word must not be hyphenated.
+static constexpr UInt8 exceptionNoHyphenValue = 0xfe;
+
+namespace {
+
+struct PatternRef {
+  Int32 charIndex;
+  Int32 length;
+  /// The index of the `length + 1` values in the pattern value array.
+  Int32 valueIndex;
+};
+
+struct PatternData {
+  Vector<Char16> chars;
+  Vector<UInt8> values;
+  Vector<PatternRef> patterns;
+
+  ArrayRef<const Char16> charsOf(const PatternRef& p) const {
+    return chars[{p.charIndex, p.charIndex + p.length}];
+  }
+  ArrayRef<UInt8> valuesOf(const PatternRef& p) {
+    return values[{p.valueIndex, p.valueIndex + p.length + 1}];
+  }
+};
+
+} // namespace
+
+static bool isDigit(Char16 c) { return '0' <= c && c <= '9'; }
+
+static bool addPattern(PatternData& data, ArrayRef<const Char16> pattern) {
+  if (pattern.isEmpty()) return true;
+  PatternRef p = {.charIndex = narrow_cast<Int32>(data.chars.count()),
+                  .valueIndex = narrow_cast<Int32>(data.values.count())};
+  UInt8 value = 0;
+  bool previousWasDigit = false;
+  for (Int i = 0; i < pattern.count(); ++i) {
+    const Char16 c = pattern[i];
+    if (isDigit(c)) {
+      if (previousWasDigit) return false;
+      value = narrow_cast<UInt8>(c - '0');
+      previousWasDigit = true;
+      continue;
+    }
+    if (c == wordBoundaryChar && i != 0 && i != pattern.count() - 1) return false;
+    data.values.append(value);
+    data.chars.append(c);
+    value = 0;
+    previousWasDigit = false;
+  }
+  data.values.append(value);
+  p.length = narrow_cast<Int32>(data.chars.count() - p.charIndex);
+  if (p.length == 0 || p.length > maxPatternLength) return false;
+  data.patterns.append(p);
+  return true;
+}
+
+static bool addException(PatternData& data, ArrayRef<const Char16> exception) {
+  if (exception.isEmpty()) return true;
+  PatternRef p = {.charIndex = narrow_cast<Int32>(data.chars.count()),
+                  .valueIndex = narrow_cast<Int32>(data.values.count())};
+  data.chars.append(wordBoundaryChar);
+  data.values.append(0);
+  bool hyphen = false;
+  for (Int i = 0; i < exception.count(); ++i) {
+    const Char16 c = exception[i];
+    if (c == '-') {
+      hyphen = true;
+      continue;
+    }
+    if (isDigit(c) || c == wordBoundaryChar) return false;
+    const bool isFirstLetter = data.chars.count() - p.charIndex == 1;
+    data.values.append(isFirstLetter ? 0
+                       : hyphen ? exceptionHyphenValue : exceptionNoHyphenValue);
+    data.chars.append(c);
+    hyphen = false;
+  }
+  data.values.append(0);
+  data.chars.append(wordBoundaryChar);
+  data.values.append(0);
+  p.length = narrow_cast<Int32>(data.chars.count() - p.charIndex);
+  if (p.length == 2 || p.length > maxPatternLength) return false;
+  data.patterns.append(p);
+  return true;
+}
+
+RC<Hyphenator> Hyphenator::create(ArrayRef<const ArrayRef<const Char16>> patterns,
+                                  ArrayRef<const ArrayRef<const Char16>> exceptions,
+                                  Int minPrefixLength, Int minSuffixLength)
+{
+  if (minPrefixLength < 1 || minSuffixLength < 1
+      || minPrefixLength + minSuffixLength > maxWordLength)
+  {
+    return nullptr;
+  }
+  PatternData data;
+  for (const ArrayRef<const Char16>& pattern : patterns) {
+    if (!addPattern(data, pattern)) return nullptr;
+  }
+  for (const ArrayRef<const Char16>& exception : exceptions) {
+    if (!addException(data, exception)) return nullptr;
+  }
+
+  // Sort the patterns lexicographically and merge the values of duplicates.
+  std::sort(data.patterns.begin(), data.patterns.end(),
+            [&](const PatternRef& p1, const PatternRef& p2) {
+              const ArrayRef<const Char16> cs1 = data.charsOf(p1);
+              const ArrayRef<const Char16> cs2 = data.charsOf(p2);
+              return std::lexicographical_compare(cs1.begin(), cs1.end(), cs2.begin(), cs2.end());
+            });
+  {
+    Int n = 0;
+    for (const PatternRef& p : data.patterns) {
+      const ArrayRef<const Char16> chars = data.charsOf(p);
+      const ArrayRef<const Char16> previousChars = n > 0 ? data.charsOf(data.patterns[n - 1])
+                                                 : ArrayRef<const Char16>{};
+      if (n > 0 && std::equal(chars.begin(), chars.end(),
+                              previousChars.begin(), previousChars.end()))
+      {
+        const ArrayRef<UInt8> values = data.valuesOf(data.patterns[n - 1]);
+        const ArrayRef<const UInt8> otherValues = data.valuesOf(p);
+        for (Int i = 0; i < values.count(); ++i) {
+          values[i] = max(values[i], otherValues[i]);
+        }
+        continue;
+      }
+      data.patterns[n++] = p;
+    }
+    data.patterns.removeLast(data.patterns.count() - n);
+  }
+
+  RC<Hyphenator> hyphenator{new Hyphenator(), ShouldIncrementRefCount{false}};
+  Hyphenator& h = *hyphenator;
+  h.minPrefixLength_ = narrow_cast<UInt8>(minPrefixLength);
+  h.minSuffixLength_ = narrow_cast<UInt8>(min(minSuffixLength, 255));
+
+  // Construct the trie in breadth-first order. Every node corresponds to the range of (sorted)
+  // patterns that have the node's path as a prefix.
+  struct NodePatterns {
+    Int32 start;
+    Int32 end;
+    Int32 depth;
+  };
+  Vector<NodePatterns> nodePatterns;
+  h.nodes_.append(Node{});
+  h.nodeChars_.append(0);
+  nodePatterns.append(NodePatterns{0, narrow_cast<Int32>(data.patterns.count()), 0});
+  for (Int i = 0; i < h.nodes_.count(); ++i) {
+    const NodePatterns np = nodePatterns[i];
+    Int32 p = np.start;
+    if (p < np.end && data.patterns[p].length == np.depth) {
+      const ArrayRef<const UInt8> values = data.valuesOf(data.patterns[p]);
+      ++p;
+      Int start = 0;
+      while (start < values.count() && values[start] == 0) ++start;
+      Int end = values.count();
+      while (end > start && values[end - 1] == 0) --end;
+      if (start < end) {
+        Node& node = h.nodes_[i];
+        node.valueOffset = narrow_cast<UInt8>(start);
+        node.valueCount = narrow_cast<UInt8>(end - start);
+        node.valueIndex = narrow_cast<UInt32>(h.values_.count());
+        h.values_.append(values[{start, end}]);
+      }
+    }
+    const Int firstChildIndex = h.nodes_.count();
+    while (p < np.end) {
+      const Char16 c = data.charsOf(data.patterns[p])[np.depth];
+      Int32 q = p + 1;
+      while (q < np.end && data.charsOf(data.patterns[q])[np.depth] == c) ++q;
+      h.nodes_.append(Node{});
+      h.nodeChars_.append(c);
+      nodePatterns.append(NodePatterns{p, q, np.depth + 1});
+      p = q;
+    }
+    Node& node = h.nodes_[i];
+    node.firstChildIndex = narrow_cast<UInt32>(firstChildIndex);
+    node.childCount = narrow_cast<UInt16>(h.nodes_.count() - firstChildIndex);
+  }
+  h.nodes_.trimFreeCapacity();
+  h.nodeChars_.trimFreeCapacity();
+  h.values_.trimFreeCapacity();
+  return hyphenator;
+}
+
+Int32 Hyphenator::childIndex(const Node& node, Char16 ch) const {
+  const ArrayRef<const Char16> chars = nodeChars_[{node.firstChildIndex,
+                                                   node.firstChildIndex + node.childCount}];
+  Int i;
+  if (chars.count() <= 8) {
+    for (i = 0; i < chars.count() && chars[i] < ch; ++i) {}
+  } else {
+    i = binarySearchFirstIndexWhere(chars, [ch](Char16 c) { return c >= ch; }).indexOrArrayCount;
+  }
+  if (i == chars.count() || chars[i] != ch) return -1;
+  return narrow_cast<Int32>(node.firstChildIndex + i);
+}
+
+void Hyphenator::computePatternValues(ArrayRef<const Char16> word, ArrayRef<UInt8> values) const {
+  STU_DEBUG_ASSERT(values.count() == word.count() + 1);
+  for (Int i = 0; i < word.count(); ++i) {
+    const Node* node = &nodes_[0];
+    for (Int j = i; j < word.count(); ++j) {
+      const Int32 index = childIndex(*node, word[j]);
+      if (index < 0) break;
+      node = &nodes_[index];
+      if (node->valueCount == 0) continue;
+      const ArrayRef<const UInt8> nodeValues = values_[{node->valueIndex,
+                                                        node->valueIndex + node->valueCount}];
+      const Int offset = i + node->valueOffset;
+      for (Int k = 0; k < nodeValues.count(); ++k) {
+        values[offset + k] = max(values[offset + k], nodeValues[k]);
+      }
+    }
+  }
+}
+
+void Hyphenator::hyphenateWord(ArrayRef<const Char16> word,
+                               FunctionRef<void(Int)> onLocation) const
+{
+  const Int n = word.count();
+  if (n < minPrefixLength_ + minSuffixLength_ || n > maxWordLength) return;
+  Char16 chars[maxWordLength + 2];
+  UInt8 values[maxWordLength + 3];
+  chars[0] = wordBoundaryChar;
+  array_utils::copyConstructArray(word, chars + 1);
+  chars[n + 1] = wordBoundaryChar;
+  const ArrayRef<UInt8> wordValues{values, n + 3};
+  array_utils::initializeArray(wordValues.begin(), wordValues.count(), UInt8{0});
+  computePatternValues(ArrayRef{chars, n + 2}, wordValues);
+  // wordValues[k + 1] is the value for the position before the k-th code unit of the word.
+  for (Int k = minPrefixLength_; k <= n - minSuffixLength_; ++k) {
+    if (wordValues[k + 1] & 1) {
+      onLocation(k);
+    }
+  }
+}
+
+} // namespace stu_label
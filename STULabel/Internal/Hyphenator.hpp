@@ -0,0 +1,110 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#pragma once
+
+// This header and Hyphenator.cpp only depend on the C++ standard library and the stu library.
+// The Foundation-based parts (pattern string preprocessing, word segmentation and the locale
+// registry) are in Hyphenation.hpp.
+
+#include "stu/FunctionRef.hpp"
+#include "stu/RefCounting.hpp"
+#include "stu/Vector.hpp"
+
+#include <atomic>
+
+namespace stu_label { class Hyphenator; }
+
+template <> struct stu::RefCountTraits<stu_label::Hyphenator>;
+
+namespace stu_label {
+
+using namespace stu;
+using stu::UInt8;
+using stu::UInt16;
+using stu::Int32;
+using stu::UInt32;
+
+/// A hyphenator implementing Frank Liang's pattern-based hyphenation algorithm (as used by TeX).
+///
+/// The patterns are stored in a packed trie: the nodes are laid out in breadth-first order, so
+/// that the children of every node occupy a contiguous index range, with the code units of the
+/// incoming edges stored in a separate array that is sorted within each range. Nodes that end a
+/// pattern refer to a run of pattern values in a shared byte array, with leading and trailing zero
+/// values trimmed.
+///
+/// Hyphenation exceptions are compiled into word-anchored patterns with values that are larger
+/// than any digit in a TeX pattern, so that they always take precedence.
+///
+/// Instances are immutable and hence thread-safe.
+class Hyphenator {
+public:
+  /// Longer words (which usually aren't natural language words) are not hyphenated.
+  static constexpr Int maxWordLength = 96;
+
+  /// Returns null if the patterns or exceptions are malformed.
+  ///
+  /// @param patterns Lowercase UTF-16 patterns in the TeX format, e.g. ".hy3p", "4m1p" or "1tio",
+  ///                 without any whitespace. Empty patterns are ignored.
+  /// @param exceptions Lowercase UTF-16 words with explicit hyphens, e.g. "as-so-ciate", without
+  ///                   any whitespace. Empty exceptions are ignored.
+  /// @param minPrefixLength The minimum number of code units before a hyphenation location in a
+  ///                        word (TeX's `\lefthyphenmin`).
+  /// @param minSuffixLength The minimum number of code units after a hyphenation location in a
+  ///                        word (TeX's `\righthyphenmin`).
+  static RC<Hyphenator> create(ArrayRef<const ArrayRef<const Char16>> patterns,
+                               ArrayRef<const ArrayRef<const Char16>> exceptions,
+                               Int minPrefixLength = 2, Int minSuffixLength = 3);
+
+  /// Calls `onLocation` with the number of code units before every hyphenation location in the
+  /// word, in increasing order.
+  ///
+  /// @param word The lowercase UTF-16 code units of a single word.
+  void hyphenateWord(ArrayRef<const Char16> word, FunctionRef<void(Int)> onLocation) const;
+
+  Int nodeCount() const { return nodeChars_.count(); }
+
+private:
+  friend RefCountTraits<Hyphenator>;
+
+  struct Node {
+    UInt32 firstChildIndex;
+    UInt16 childCount;
+    /// The offset of the first non-zero pattern value from the start of the pattern.
+    UInt8 valueOffset;
+    UInt8 valueCount;
+    UInt32 valueIndex;
+  };
+
+  Hyphenator() = default;
+
+  Int32 childIndex(const Node& node, Char16 ch) const;
+
+  /// @param word The lowercase code units of the word, enclosed in '.' boundary markers.
+  /// @param values Zero-initialized, with word.count() + 1 elements.
+  void computePatternValues(ArrayRef<const Char16> word, ArrayRef<UInt8> values) const;
+
+  std::atomic<Int> refCount_{1};
+  UInt8 minPrefixLength_;
+  UInt8 minSuffixLength_;
+  Vector<Node> nodes_;
+  /// The code unit of the incoming edge of each node.
+  Vector<Char16> nodeChars_;
+  Vector<UInt8> values_;
+};
+
+} // namespace stu_label
+
+template <>
+struct stu::RefCountTraits<stu_label::Hyphenator> {
+  STU_INLINE
+  static void incrementRefCount(stu_label::Hyphenator* hyphenator) {
+    hyphenator->refCount_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  STU_INLINE
+  static void decrementRefCount(stu_label::Hyphenator* hyphenator) {
+    if (hyphenator->refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete hyphenator;
+    }
+  }
+};
@@ -0,0 +1,142 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "HashTable.hpp"
+#import "ThreadLocalAllocator.hpp"
+
+#import "stu/Vector.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// The entry storage of a global cache with a memory budget, whose entries are evicted in
+/// least-recently-used order. The storage is not thread-safe; the caches protect it with a mutex.
+///
+/// `Entry` must have the data members `HashCode<UInt64> hashCode`, `UInt64 lastUse` and
+/// `UInt cost`, and a `void release()` method that releases the resources owned by the entry.
+template <typename Entry>
+class LRUCacheStorage {
+public:
+  static constexpr Int maxEntryCount = maxValue<UInt16> - 1;
+
+  UInt64 hitCount{};
+  UInt64 missCount{};
+
+  explicit LRUCacheStorage(Int initialBucketCount) {
+    indices_.initializeWithBucketCount(initialBucketCount);
+  }
+
+  STU_INLINE Int count() const { return entries_.count(); }
+
+  STU_INLINE UInt memoryUsage() const { return memoryUsage_; }
+
+  /// Returns the entry for which `isEqual(const Entry&)` returns true, after marking it as the
+  /// most recently used entry.
+  template <typename IsEqual>
+  Entry* __nullable find(HashCode<UInt64> hashCode, IsEqual&& isEqual) {
+    const Optional<UInt16> index = indices_.find(hashCode, [&](UInt16 index) -> bool {
+                                     return isEqual(entries_[index]);
+                                   });
+    if (!index) return nullptr;
+    Entry& entry = entries_[*index];
+    entry.lastUse = ++useCounter_;
+    return &entry;
+  }
+
+  /// Inserts the entry returned by `createEntry()` if the cache doesn't yet contain an entry for
+  /// which `isEqual(const Entry&)` returns true. Afterwards evicts the least recently used entries
+  /// until the memory usage is at most 3/4 of the budget, if the budget was exceeded.
+  ///
+  /// The storage takes ownership of the created entry. The `hashCode`, `lastUse` and `cost` fields
+  /// of the created entry are overwritten.
+  ///
+  /// Returns false if the cache already contained an equal entry.
+  template <typename IsEqual, typename CreateEntry>
+  bool insert(HashCode<UInt64> hashCode, UInt cost, UInt budget,
+              IsEqual&& isEqual, CreateEntry&& createEntry)
+  {
+    if (indices_.find(hashCode, [&](UInt16 index) -> bool { return isEqual(entries_[index]); })) {
+      return false;
+    }
+    if (entries_.count() == maxEntryCount) {
+      // Evicting only a single entry would make every subsequent insertion rebuild the index.
+      evict(maxValue<UInt>, maxEntryCount - maxEntryCount/8);
+    }
+    const UInt16 newIndex = narrow_cast<UInt16>(entries_.count());
+    indices_.insertNew(hashCode, newIndex);
+    entries_.append(createEntry());
+    Entry& entry = entries_[newIndex];
+    entry.hashCode = hashCode;
+    entry.lastUse = ++useCounter_;
+    entry.cost = cost;
+    memoryUsage_ += cost;
+    if (memoryUsage_ > budget) {
+      evict(budget - budget/4);
+    }
+    return true;
+  }
+
+  /// Removes the least recently used entries until the memory usage is not greater than
+  /// `targetMemoryUsage` and the entry count is not greater than `targetEntryCount`.
+  STU_NO_INLINE
+  void evict(UInt targetMemoryUsage, Int targetEntryCount = maxEntryCount) {
+    if (memoryUsage_ <= targetMemoryUsage && entries_.count() <= targetEntryCount) return;
+    struct Use {
+      UInt64 lastUse;
+      UInt cost;
+    };
+    TempArray<Use> uses{uninitialized, Count{entries_.count()}};
+    for (Int i = 0; i < entries_.count(); ++i) {
+      uses[i] = Use{entries_[i].lastUse, entries_[i].cost};
+    }
+    uses.sort([](const Use& lhs, const Use& rhs) { return lhs.lastUse < rhs.lastUse; });
+    // The lastUse values are unique.
+    UInt64 minLastUse = 0;
+    UInt usage = memoryUsage_;
+    Int count = entries_.count();
+    for (const Use& use : uses) {
+      if (usage <= targetMemoryUsage && count <= targetEntryCount) break;
+      usage -= use.cost;
+      count -= 1;
+      minLastUse = use.lastUse + 1;
+    }
+    entries_.removeWhere([&](Entry& entry) {
+      if (entry.lastUse >= minLastUse) return false;
+      releaseEntry(entry);
+      return true;
+    });
+    rebuildIndices();
+  }
+
+  STU_NO_INLINE
+  void clear() {
+    for (Entry& entry : entries_) {
+      releaseEntry(entry);
+    }
+    entries_.removeAll();
+    entries_.trimFreeCapacity();
+    rebuildIndices();
+  }
+
+private:
+  void releaseEntry(Entry& entry) {
+    memoryUsage_ -= entry.cost;
+    entry.release();
+  }
+
+  void rebuildIndices() {
+    indices_.removeAll();
+    for (Int i = 0; i < entries_.count(); ++i) {
+      indices_.insertNew(entries_[i].hashCode, narrow_cast<UInt16>(i));
+    }
+  }
+
+  Vector<Entry> entries_;
+  HashSet<UInt16, Malloc> indices_{uninitialized};
+  UInt64 useCounter_{};
+  UInt memoryUsage_{};
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -32,6 +32,7 @@ public:
   bool releasesTextFrameAfterRendering : 1;
   bool releasesTextFrameAfterRenderingWasExplicitlySet : 1;
   bool alwaysUsesContentSublayer : 1;
+  bool usesAlphaMaskForSingleColorText : 1;
 
 protected:
   bool isHighlighted_ : 1;
@@ -0,0 +1,66 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Common.hpp"
+
+#import <QuartzCore/QuartzCore.h>
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// Runs the asynchronous label render tasks on a bounded number of worker threads, in the order
+/// of their deadlines.
+///
+/// The deadline of a task is derived from the distance of the label to the visible bounds of its
+/// window: a visible label should be rendered within the next frame, while the deadline of labels
+/// outside the window grows with their distance to it. Among tasks with equal deadlines the one
+/// that was dispatched first runs first.
+///
+/// A task that was removed from the queue with `tryRemovePendingTask` before it was started is
+/// never run. Label layers use this to drop the obsolete task when a label is invalidated again,
+/// so that repeated invalidations of a label don't queue up redundant work. Label layers also
+/// update the deadlines of their pending tasks with `tryUpdatePendingTaskDeadline` while the
+/// labels are scrolled.
+class LabelRenderScheduler {
+public:
+  using TaskFunction = void (*)(void* __nonnull task);
+
+  /// The scheduler's bookkeeping data for a task. The handle must be stored in the task and must
+  /// not be moved while the task is pending.
+  struct TaskHandle {
+    /// The index of the task in the scheduler's queue, or -1 if the task is not pending.
+    /// Only accessed by the scheduler while it holds its mutex.
+    Int queueIndex{-1};
+  };
+
+  /// The duration of a frame that deadlines are based on.
+  static constexpr CFTimeInterval frameDuration = 1/60.;
+
+  /// Returns the deadline for a label whose bounds have the specified distance (in points) from
+  /// the visible bounds of its window.
+  ///
+  /// @param distanceToWindowBounds Must be infinity if the label has no window.
+  static CFTimeInterval deadline(CFTimeInterval now, CGFloat distanceToWindowBounds,
+                                 CGFloat windowHeight);
+
+  /// Thread-safe.
+  static void dispatchAsync(TaskHandle& handle, void* __nonnull task, TaskFunction function,
+                            CFTimeInterval deadline);
+
+  /// Removes the task from the queue if it hasn't been started yet.
+  /// Returns true if the task was removed.
+  /// Thread-safe.
+  static bool tryRemovePendingTask(TaskHandle& handle);
+
+  /// Changes the deadline of the task if it hasn't been started yet.
+  /// Returns true if the task is still pending.
+  /// Thread-safe.
+  static bool tryUpdatePendingTaskDeadline(TaskHandle& handle, CFTimeInterval deadline);
+
+  /// The maximum number of tasks that are run concurrently.
+  static Int maxWorkerCount();
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
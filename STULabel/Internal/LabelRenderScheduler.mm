@@ -0,0 +1,203 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "LabelRenderScheduler.hpp"
+
+#import "STULabel/stu_mutex.h"
+
+#import "Once.hpp"
+
+#import "stu/Vector.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// A label at a distance of one window height from the visible window bounds gets a deadline this
+/// many frames later than a visible label.
+static constexpr CGFloat framesPerWindowHeightDistance = 30;
+
+/// Labels without a window are rendered after all labels close to the visible window bounds.
+static constexpr CFTimeInterval noWindowDeadlineDelay = 1;
+
+CFTimeInterval LabelRenderScheduler::deadline(CFTimeInterval now, CGFloat distance,
+                                              CGFloat windowHeight)
+{
+  if (!(distance < infinity<CGFloat>) || !(windowHeight > 0)) {
+    return now + noWindowDeadlineDelay;
+  }
+  const CGFloat frames = 1 + framesPerWindowHeightDistance*max(0.f, distance)/windowHeight;
+  return now + frameDuration*min(frames, CGFloat(noWindowDeadlineDelay/frameDuration));
+}
+
+namespace {
+
+struct PendingTask {
+  CFTimeInterval deadline;
+  UInt64 sequenceNumber;
+  LabelRenderScheduler::TaskHandle* handle;
+  void* task;
+  LabelRenderScheduler::TaskFunction function;
+
+  bool isEarlierThan(const PendingTask& other) const {
+    if (deadline != other.deadline) return deadline < other.deadline;
+    return sequenceNumber < other.sequenceNumber;
+  }
+};
+
+/// A binary min-heap of the pending tasks that keeps the task handles updated with the current
+/// index of each task, so that tasks can be removed or rescheduled in logarithmic time.
+class PendingTaskHeap {
+public:
+  bool isEmpty() const { return heap_.isEmpty(); }
+
+  void insert(const PendingTask& task) {
+    heap_.append(task);
+    siftUp(heap_.count() - 1);
+  }
+
+  PendingTask removeFirst() { return remove(0); }
+
+  PendingTask remove(Int index) {
+    const PendingTask task = heap_[index];
+    task.handle->queueIndex = -1;
+    const PendingTask last = heap_[$ - 1];
+    heap_.removeLast();
+    if (index < heap_.count()) {
+      place(index, last);
+      siftUpOrDown(index);
+    }
+    return task;
+  }
+
+  void updateDeadline(Int index, CFTimeInterval deadline) {
+    heap_[index].deadline = deadline;
+    siftUpOrDown(index);
+  }
+
+private:
+  void place(Int index, const PendingTask& task) {
+    heap_[index] = task;
+    task.handle->queueIndex = index;
+  }
+
+  void siftUpOrDown(Int index) {
+    if (index > 0 && heap_[index].isEarlierThan(heap_[(index - 1)/2])) {
+      siftUp(index);
+    } else {
+      siftDown(index);
+    }
+  }
+
+  void siftUp(Int index) {
+    const PendingTask task = heap_[index];
+    while (index > 0) {
+      const Int parent = (index - 1)/2;
+      if (!task.isEarlierThan(heap_[parent])) break;
+      place(index, heap_[parent]);
+      index = parent;
+    }
+    place(index, task);
+  }
+
+  void siftDown(Int index) {
+    const PendingTask task = heap_[index];
+    const Int count = heap_.count();
+    for (;;) {
+      Int child = 2*index + 1;
+      if (child >= count) break;
+      if (child + 1 < count && heap_[child + 1].isEarlierThan(heap_[child])) {
+        child += 1;
+      }
+      if (!heap_[child].isEarlierThan(task)) break;
+      place(index, heap_[child]);
+      index = child;
+    }
+    place(index, task);
+  }
+
+  Vector<PendingTask> heap_;
+};
+
+struct SchedulerState {
+  PendingTaskHeap heap;
+  UInt64 sequenceNumber{};
+  Int activeWorkerCount{};
+};
+
+} // namespace
+
+static stu_mutex schedulerMutex = STU_MUTEX_INIT;
+static bool schedulerIsInitialized = false;
+alignas(SchedulerState)
+static Byte schedulerStorage[sizeof(SchedulerState)];
+
+/// Must be called while holding the schedulerMutex.
+static SchedulerState& schedulerState() {
+  if (STU_UNLIKELY(!schedulerIsInitialized)) {
+    schedulerIsInitialized = true;
+    new (schedulerStorage) SchedulerState{};
+  }
+  return reinterpret_cast<SchedulerState&>(schedulerStorage);
+}
+
+Int LabelRenderScheduler::maxWorkerCount() {
+  // We leave one core for the main thread.
+  STU_STATIC_CONST_ONCE(Int, value,
+                        clamp(1, sign_cast(NSProcessInfo.processInfo.activeProcessorCount) - 1,
+                              4));
+  return value;
+}
+
+static void runTasks(void* __unused context) {
+  stu_mutex_lock(&schedulerMutex);
+  SchedulerState& state = schedulerState();
+  while (!state.heap.isEmpty()) {
+    const PendingTask next = state.heap.removeFirst();
+    stu_mutex_unlock(&schedulerMutex);
+    next.function(next.task);
+    stu_mutex_lock(&schedulerMutex);
+  }
+  state.activeWorkerCount -= 1;
+  stu_mutex_unlock(&schedulerMutex);
+}
+
+void LabelRenderScheduler::dispatchAsync(TaskHandle& handle, void* task, TaskFunction function,
+                                         CFTimeInterval deadline)
+{
+  stu_mutex_lock(&schedulerMutex);
+  STU_ASSERT(handle.queueIndex < 0);
+  SchedulerState& state = schedulerState();
+  state.heap.insert(PendingTask{deadline, state.sequenceNumber++, &handle, task, function});
+  const bool startWorker = state.activeWorkerCount < maxWorkerCount();
+  if (startWorker) {
+    state.activeWorkerCount += 1;
+  }
+  stu_mutex_unlock(&schedulerMutex);
+  if (startWorker) {
+    dispatch_async_f(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), nullptr, runTasks);
+  }
+}
+
+bool LabelRenderScheduler::tryRemovePendingTask(TaskHandle& handle) {
+  stu_mutex_lock(&schedulerMutex);
+  const Int index = handle.queueIndex;
+  if (index >= 0) {
+    schedulerState().heap.remove(index);
+  }
+  stu_mutex_unlock(&schedulerMutex);
+  return index >= 0;
+}
+
+bool LabelRenderScheduler::tryUpdatePendingTaskDeadline(TaskHandle& handle,
+                                                        CFTimeInterval deadline)
+{
+  stu_mutex_lock(&schedulerMutex);
+  const Int index = handle.queueIndex;
+  if (index >= 0) {
+    schedulerState().heap.updateDeadline(index, deadline);
+  }
+  stu_mutex_unlock(&schedulerMutex);
+  return index >= 0;
+}
+
+} // namespace stu_label
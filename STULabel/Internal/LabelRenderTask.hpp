@@ -5,6 +5,7 @@
 #import "AtomicEnum.hpp"
 #import "CancellationFlag.hpp"
 #import "LabelParameters.hpp"
+#import "LabelRenderScheduler.hpp"
 #import "LabelRendering.hpp"
 #import "ShapedString.hpp"
 
@@ -44,6 +45,7 @@ protected:
   bool allowExtendedRGBBitmapFormat_{true};
 
   LabelLayer* label_{};
+  LabelRenderScheduler::TaskHandle schedulerHandle_;
 
   LabelParameters params_{};
   LabelTextFrameRenderInfo renderInfo_;
@@ -122,7 +124,7 @@ public:
   // Defined in STULabelLayer.mm
   void assignResultTo(LabelLayer& label);
 
-  static auto dispatchAsync(__nonnull dispatch_queue_t queue,
+  static auto dispatchAsync(CFTimeInterval deadline,
                             LabelLayer& label,
                             const LabelParameters& params,
                             bool allowExtendedRGBBitmapFormat,
@@ -138,13 +140,19 @@ public:
     task->textFrameInfo_ = textFrameLayoutInfo;
     task->textFrameOriginInLayer_ = textFrameOriginInLayer;
     task->completedLayout_.store(true, std::memory_order_relaxed);
-    dispatch_async_f(queue, task, run);
+    LabelRenderScheduler::dispatchAsync(task->schedulerHandle_, task, run, deadline);
     return task;
   }
 
   // Defined in STULabelLayer.mm
   void abandonedByLabel(LabelLayer& layer);
 
+  /// Returns false if the task is no longer pending.
+  bool tryUpdateDeadline(CFTimeInterval deadline) {
+    STU_DEBUG_ASSERT(type_ != Type::prerender);
+    return LabelRenderScheduler::tryUpdatePendingTaskDeadline(schedulerHandle_, deadline);
+  }
+
   void cancelRendering() {
     renderingIsCancelled_.setCancelled();
   }
@@ -171,7 +179,7 @@ protected:
   void createTextFrame();
 
 public:
-  static auto dispatchAsync(__nonnull dispatch_queue_t queue,
+  static auto dispatchAsync(CFTimeInterval deadline,
                             LabelLayer& label,
                             const LabelParameters& params,
                             bool allowExtendedRGBBitmapFormat,
@@ -184,7 +192,7 @@ public:
     task->commonNonPrerenderInit(label, params, allowExtendedRGBBitmapFormat);
     task->shapedString_ = shapedString;
     task->textFrameOptions_ = textFrameOptions;
-    dispatch_async_f(queue, task, run);
+    LabelRenderScheduler::dispatchAsync(task->schedulerHandle_, task, run, deadline);
     return task;
   }
 };
@@ -206,7 +214,7 @@ protected:
   static void run(void* task);
 
 public:
-  static auto dispatchAsync(__nonnull dispatch_queue_t queue,
+  static auto dispatchAsync(CFTimeInterval deadline,
                             LabelLayer& label,
                             const LabelParameters& params,
                             bool allowExtendedRGBBitmapFormat,
@@ -219,7 +227,7 @@ public:
     task->commonNonPrerenderInit(label, params, allowExtendedRGBBitmapFormat);
     task->textFrameOptions_ = textFrameOptions;
     task->attributedString_ = attributedString;
-    dispatch_async_f(queue, task, run);
+    LabelRenderScheduler::dispatchAsync(task->schedulerHandle_, task, run, deadline);
     return task;
   }
 };
@@ -27,7 +27,11 @@ void LabelRenderTask::abandonedByLabel(LabelLayer& label) {
     STU_DEBUG_ASSERT(label_ == &label);
     label_ = nullptr;
     isCancelled_.setCancelled();
-    if (releaseReferenceAndReturnTrueIfItWasTheLast(Referers::layerOrPrerenderer)) {
+    // If the task hasn't been started yet, we can drop it without waiting for a worker thread
+    // to pick it up. This way repeated invalidations of a label don't queue up stale tasks.
+    if (LabelRenderScheduler::tryRemovePendingTask(schedulerHandle_)
+        || releaseReferenceAndReturnTrueIfItWasTheLast(Referers::layerOrPrerenderer))
+    {
       destroyAndDeallocateNonPrerenderTask();
     }
   } else {
@@ -38,8 +42,9 @@ void LabelRenderTask::abandonedByLabel(LabelLayer& label) {
 void LabelTextShapingAndLayoutAndRenderTask
      ::createShapedString(const STUCancellationFlag* __nullable cancellationFlag)
 {
-  shapedString_ = STUShapedStringCreate(nil, attributedString_, params_.defaultBaseWritingDirection,
-                                        cancellationFlag);
+  shapedString_ = STUShapedStringCreateUsingSharedCache(attributedString_,
+                                                        params_.defaultBaseWritingDirection,
+                                                        cancellationFlag);
 }
 
 void LabelLayoutAndRenderTask::createTextFrame() {
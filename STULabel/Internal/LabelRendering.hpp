@@ -16,9 +16,24 @@ enum class LabelRenderMode : UInt8 {
   drawInCAContext,
   image,
   imageInSublayer,
-  tiledSublayer
+  tiledSublayer,
+  /// The glyph coverage is rendered into an `alphaMaskCGImageFormat` image that is used as the
+  /// mask of a sublayer whose background color is the text color.
+  alphaMaskInSublayer
+};
+constexpr int LabelRenderModeBitSize = 3;
+
+/// The original colors of the text in a text frame that can be rendered as an alpha mask.
+struct LabelAlphaMaskTextColors {
+  /// The color of the non-link text, or null if the text frame contains no non-link text.
+  RC<CGColor> textColor;
+  /// The color of the link text, or null if the text frame contains no link text.
+  RC<CGColor> linkColor;
+
+  /// Returns the color in which all text would be drawn with the specified drawing options, or
+  /// null if the link and the non-link text would be drawn in different colors.
+  CGColor* __nullable tintColor(const STUTextFrameDrawingOptions* __nullable) const;
 };
-constexpr int LabelRenderModeBitSize = 2;
 
 struct LabelTextFrameRenderInfo {
   CGRect bounds;
@@ -27,6 +42,8 @@ struct LabelTextFrameRenderInfo {
   bool shouldDrawBackgroundColor;
   bool isOpaque;
   bool mayBeClipped;
+  /// Only set if `mode == LabelRenderMode::alphaMaskInSublayer`.
+  LabelAlphaMaskTextColors alphaMaskTextColors;
 };
 
 LabelTextFrameRenderInfo labelTextFrameRenderInfo(const STUTextFrame*,
@@ -48,6 +65,23 @@ PurgeableImage createLabelTextFrameImage(const STUTextFrame*,
                                          const LabelParameters&,
                                          const STUCancellationFlag* __nullable);
 
+/// Returns the bounds (relative to the text frame origin) of the drawn content that may differ
+/// between drawing the text frame with the old and with the new drawing options, assuming that
+/// the options only differ in their highlight range or highlight style.
+Rect<CGFloat> labelTextFrameHighlightChangeBounds(
+                const STUTextFrame*, const DisplayScale&,
+                const STUTextFrameDrawingOptions* __nullable oldOptions,
+                const STUTextFrameDrawingOptions* __nullable newOptions);
+
+/// Returns a copy of the image created with `createLabelTextFrameImage` in which only the content
+/// within `bounds` (relative to the text frame origin) has been redrawn, or a null image if the
+/// image was purged.
+///
+/// @pre `renderInfo` is the render info the image was created with.
+PurgeableImage redrawLabelTextFrameImageBounds(PurgeableImage& image, const STUTextFrame*,
+                                               const LabelTextFrameRenderInfo& renderInfo,
+                                               const LabelParameters&, Rect<CGFloat> bounds);
+
 } // namespace stu_label
 
 
@@ -4,12 +4,94 @@
 
 #import "STULabel/STULabelDrawingBlock-Internal.hpp"
 #import "STULabel/STUTextFrame-Internal.hpp"
+#import "STULabel/STUTextFrameDrawingOptions-Internal.hpp"
 #import "STULabel/STUTextHighlightStyle-Internal.hpp"
 
 #import "LabelParameters.hpp"
+#import "TextFrame.hpp"
 
 namespace stu_label {
 
+CGColor* __nullable LabelAlphaMaskTextColors::tintColor(
+                      const STUTextFrameDrawingOptions* __unsafe_unretained __nullable options)
+                    const
+{
+  CGColor* overrideTextColor = nullptr;
+  CGColor* overrideLinkColor = nullptr;
+  if (options) {
+    overrideTextColor = options->impl.overrideTextColor().cgColor();
+    overrideLinkColor = options->impl.overrideLinkColor().cgColor();
+  }
+  CGColor* const text = !textColor ? nullptr : overrideTextColor ?: textColor.get();
+  CGColor* const link = !linkColor ? nullptr
+                      : overrideLinkColor ?: overrideTextColor ?: linkColor.get();
+  if (!text) return link;
+  if (!link || link == text || CGColorEqualToColor(link, text)) return text;
+  return nullptr;
+}
+
+/// Returns true if the line contains a glyph from a font with color glyphs, e.g. an emoji.
+static bool lineHasColorGlyph(const TextFrameLine& line) {
+  // The layouter sets the mayNotBeGrayscale flag for lines with color glyphs.
+  if (!(line.textFlags & STUTextMayNotBeGrayscale)) return false;
+  CTFont* previousFont = nullptr;
+  bool hasColorGlyph = false;
+  line.forEachGlyphSpan([&](TextLinePart, CTLineXOffset, GlyphSpan span) -> ShouldStop {
+    CTFont* const font = span.run().font();
+    if (font == previousFont) return {};
+    previousFont = font;
+    hasColorGlyph = CTFontGetSymbolicTraits(font) & kCTFontTraitColorGlyphs;
+    return ShouldStop{hasColorGlyph};
+  });
+  return hasColorGlyph;
+}
+
+/// Returns none if the text frame contains anything other than glyphs drawn in a single text
+/// color and a single link color, e.g. decorations, attachments or color glyphs.
+static Optional<LabelAlphaMaskTextColors> alphaMaskTextColors(const TextFrame& textFrame) {
+  const STUTextFrameFlags unsupportedFlags = STUTextFrameHasBackground
+                                           | STUTextFrameHasShadow
+                                           | STUTextFrameHasUnderline
+                                           | STUTextFrameHasStrikethrough
+                                           | STUTextFrameHasStroke
+                                           | STUTextFrameHasTextAttachment;
+  if (textFrame.flags & unsupportedFlags) return none;
+  for (const TextFrameLine& line : textFrame.lines()) {
+    if (lineHasColorGlyph(line)) return none;
+  }
+  const ArrayRef<const ColorRef> colors = textFrame.colors();
+  CGColor* textColor = nullptr;
+  CGColor* linkColor = nullptr;
+  const auto addStyles = [&](const TextStyle* style) -> bool {
+    for (;;) {
+      const ColorIndex colorIndex = style->colorIndex();
+      CGColor* color;
+      if (colorIndex == ColorIndex::black) {
+        color = UIColor.blackColor.CGColor;
+      } else {
+        if (colorIndex.value < ColorIndex::fixedColorIndexRange.end) return false;
+        color = colors[colorIndex.value - ColorIndex::fixedColorIndexRange.end].cgColor();
+      }
+      CGColor*& styleColor = style->flags() & TextFlags::hasLink ? linkColor : textColor;
+      if (!styleColor) {
+        styleColor = color;
+      } else if (color != styleColor && !CGColorEqualToColor(color, styleColor)) {
+        return false;
+      }
+      const TextStyle& next = style->next();
+      if (&next == style) return true;
+      style = &next;
+    }
+  };
+  if (!addStyles(reinterpret_cast<const TextStyle*>(textFrame._textStylesData))) return none;
+  for (Int i = 0; i < textFrame.lineCount; ++i) {
+    if (!textFrame.lines()[i].hasTruncationToken) continue;
+    if (!addStyles(&textFrame.firstTokenTextStyleForLineAtIndex(i))) return none;
+  }
+  if (!textColor && !linkColor) return none;
+  return LabelAlphaMaskTextColors{.textColor = textColor, .linkColor = linkColor};
+}
+
 static Rect<CGFloat> renderBoundsForTextFrameImageBounds(Rect<CGFloat> imageBounds,
                                                          const LabelTextFrameInfo& info,
                                                          CGSize sizeIncludingEdgeInsets,
@@ -223,6 +305,28 @@ LabelTextFrameRenderInfo labelTextFrameRenderInfo(const STUTextFrame* __unsafe_u
   const auto imageFormat = isGrayscale ? STUPredefinedCGImageFormatGrayscale
                          : !useExtendedColor ? STUPredefinedCGImageFormatRGB
                          : STUPredefinedCGImageFormatExtendedRGB;
+
+  if (params.usesAlphaMaskForSingleColorText && mode != LabelRenderMode::tiledSublayer
+      && !params.drawingBlock && !params.isEffectivelyHighlighted())
+  {
+    if (Optional<LabelAlphaMaskTextColors> colors = alphaMaskTextColors(textFrameRef(textFrame))) {
+      if (colors->tintColor(params.drawingOptions)) {
+        if (mode == LabelRenderMode::drawInCAContext) {
+          bounds = Rect{-frameOriginInLayer, params.size()};
+        }
+        return {
+          .bounds = bounds,
+          .mode = LabelRenderMode::alphaMaskInSublayer,
+          .imageFormat = alphaMaskCGImageFormat,
+          .shouldDrawBackgroundColor = false,
+          .isOpaque = false,
+          .mayBeClipped = mayBeClipped,
+          .alphaMaskTextColors = std::move(*colors)
+        };
+      }
+    }
+  }
+
   return {
     .bounds = bounds,
     .mode = mode,
@@ -262,6 +366,22 @@ PurgeableImage createLabelTextFrameImage(const STUTextFrame* __unsafe_unretained
                                          const LabelParameters& params,
                                          const STUCancellationFlag* __nullable cancellationFlag)
 {
+  if (renderInfo.mode == LabelRenderMode::alphaMaskInSublayer) {
+    // The glyphs are drawn in opaque black, so that the alpha component of the text color is
+    // only applied once, by the tint color of the sublayer.
+    STUTextFrameDrawingOptions* const options =
+      STUTextFrameDrawingOptionsCopy(params.drawingOptions);
+    options->impl.setOverrideTextColor(UIColor.blackColor);
+    options->impl.setOverrideLinkColor(UIColor.blackColor);
+    options->impl.freeze();
+    return {renderInfo.bounds.size, params.displayScale(), nil,
+            alphaMaskCGImageFormat, STUCGImageFormatOptionsNone,
+            [&](CGContext* context) {
+              drawLabelTextFrame(textFrame, STUTextFrameGetRange(textFrame),
+                                 -renderInfo.bounds.origin, context, ContextBaseCTM_d{1},
+                                 PixelAlignBaselines{true}, options, nil, cancellationFlag);
+            }};
+  }
   return {renderInfo.bounds.size, params.displayScale(),
           renderInfo.shouldDrawBackgroundColor ? params.backgroundColor() : nil,
           renderInfo.imageFormat,
@@ -274,5 +394,82 @@ PurgeableImage createLabelTextFrameImage(const STUTextFrame* __unsafe_unretained
           }};
 }
 
+/// Returns the range of the text frame that is highlighted when the frame is drawn with the
+/// specified options.
+static Optional<Range<TextFrameIndex>> highlightedRange(
+                                         const TextFrame& textFrame,
+                                         const STUTextFrameDrawingOptions* __unsafe_unretained
+                                           __nullable options)
+{
+  if (!options || !options->impl.highlightStyle()) return none;
+  const TextFrameDrawingOptions& impl = options->impl;
+  Range<TextFrameIndex> range{uninitialized};
+  if (const Optional<STUTextFrameRange> frameRange = impl.highlightTextFrameRange()) {
+    range = Range<TextFrameIndex>{frameRange->start, frameRange->end};
+  } else {
+    range = textFrame.range(impl.highlightRange());
+  }
+  if (!(range.start < range.end)) return none;
+  return range;
+}
+
+Rect<CGFloat> labelTextFrameHighlightChangeBounds(
+                const STUTextFrame* __unsafe_unretained textFrame,
+                const DisplayScale& displayScale,
+                const STUTextFrameDrawingOptions* __unsafe_unretained __nullable oldOptions,
+                const STUTextFrameDrawingOptions* __unsafe_unretained __nullable newOptions)
+{
+  const TextFrame& tf = textFrameRef(textFrame);
+  const Optional<Range<TextFrameIndex>> oldRange = highlightedRange(tf, oldOptions);
+  const Optional<Range<TextFrameIndex>> newRange = highlightedRange(tf, newOptions);
+  Rect<CGFloat> bounds = Rect<CGFloat>::infinitelyEmpty();
+  // Only the content of the old and the new highlighted range can change. Since the content
+  // drawn for a range may differ in extent depending on whether it is highlighted (e.g. if the
+  // highlight style has a shadow or background), we need the bounds for both options.
+  const auto addBounds = [&](Range<TextFrameIndex> range,
+                             const STUTextFrameDrawingOptions* __unsafe_unretained options)
+  {
+    const Rect<CGFloat> r = STUTextFrameGetImageBoundsForRange(textFrame, range, CGPoint{},
+                                                               displayScale, options, nullptr);
+    if (!r.isEmpty()) {
+      bounds = bounds.convexHull(r);
+    }
+  };
+  if (oldRange) {
+    addBounds(*oldRange, oldOptions);
+    addBounds(*oldRange, newOptions);
+  }
+  if (newRange) {
+    addBounds(*newRange, oldOptions);
+    addBounds(*newRange, newOptions);
+  }
+  return bounds;
+}
+
+PurgeableImage redrawLabelTextFrameImageBounds(PurgeableImage& image,
+                                               const STUTextFrame* __unsafe_unretained textFrame,
+                                               const LabelTextFrameRenderInfo& renderInfo,
+                                               const LabelParameters& params,
+                                               Rect<CGFloat> bounds)
+{
+  STU_DEBUG_ASSERT(renderInfo.mode == LabelRenderMode::image
+                   || renderInfo.mode == LabelRenderMode::imageInSublayer);
+  const DisplayScale& scale = params.displayScale();
+  // We outset the bounds by a pixel to account for antialiasing and then round them to the pixel
+  // grid, so that the redrawn pixels exactly replace the old ones.
+  bounds = ceilToScale(bounds.outset(scale.inverseValue()), scale);
+  bounds -= Point{renderInfo.bounds.origin};
+  bounds.intersect(Rect{CGPoint{}, renderInfo.bounds.size});
+  if (bounds.isEmpty()) return image;
+  return image.copyWithRedrawnRect(
+           bounds, scale, renderInfo.shouldDrawBackgroundColor ? params.backgroundColor() : nil,
+           [&](CGContext* context) {
+             drawLabelTextFrame(textFrame, STUTextFrameGetRange(textFrame),
+                                -renderInfo.bounds.origin, context, ContextBaseCTM_d{1},
+                                PixelAlignBaselines{true}, params.drawingOptions,
+                                params.drawingBlock, nullptr);
+           });
+}
+
 } // namespace stu_label
 
@@ -55,6 +55,14 @@ public:
   /// calculateVisibleBounds is called.
   CGFloat areaScale() const { return areaScale_; }
 
+  /// The `CACurrentMediaTime()` at which the observer last registered a possible change of the
+  /// visible bounds, i.e. the time of the first superlayer change notification after the preceding
+  /// `calculateVisibleBounds` call. Is 0 if there was no such notification yet.
+  ///
+  /// For a layer in a scroll view this is the time at which the scroll view updated its bounds,
+  /// which is a better timestamp for the new visible bounds than the time of the next layout pass.
+  CFTimeInterval visibleBoundsChangeTime() const { return visibleBoundsChangeTime_; }
+
   UIScreen* screen();
 
   void _private_superlayerIsBeingRemovedOrDestroyed(CALayer* superlayer);
@@ -114,6 +122,7 @@ private:
   Vector<SuperlayerRef> superlayers_;
   Callback callback_; // arc
   CGFloat areaScale_{};
+  CFTimeInterval visibleBoundsChangeTime_{};
   bool visibleBoundsMayHaveChanged_{};
   bool rootSuperlayerIsScrollViewLayer_;
 };
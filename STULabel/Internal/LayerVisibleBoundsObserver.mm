@@ -190,6 +190,7 @@ void LayerVisibleBoundsObserver
 void LayerVisibleBoundsObserver::_private_visibleBoundsMayHaveChanged() {
   if (visibleBoundsMayHaveChanged_) return;
   visibleBoundsMayHaveChanged_ = true;
+  visibleBoundsChangeTime_ = CACurrentMediaTime();
   if (callback_) {
     callback_();
   }
@@ -4,16 +4,23 @@
 
 #import "Kerning.hpp"
 
+#import "stu/BinarySearch.hpp"
+
 #include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
 namespace stu_label {
 
+/// In runs with fewer glyphs the initial offset is found by stepping through the grapheme
+/// clusters.
+constexpr static Int minGlyphCountForPrefixSumSearch = 16;
+
 constexpr static Float64 one_minusOne_F64[] = {1, -1};
 constexpr static Int one_minusOne_Int[] = {1, -1};
 
 struct StartAtEndOfLineString : Parameter<StartAtEndOfLineString> { using Parameter::Parameter; };
 struct IsRightToLeftLine : Parameter<IsRightToLeftLine> { using Parameter::Parameter; };
 struct MinInitialOffset : Parameter<MinInitialOffset, Float64> { using Parameter::Parameter; };
+struct MaxInitialOffset : Parameter<MaxInitialOffset, Float64> { using Parameter::Parameter; };
 
 /// An iterator for iterating over the grapheme clusters in a line such that both the skipped
 /// string range and the corresponding glyph range are continuous, i.e. do not have gaps.
@@ -56,9 +63,15 @@ struct Iterator {
   ArrayRef<const Int> stringIndices_;
   TempVector<Int> stringIndexBuffer_;
 
+  /// The prefix sums of the glyph advances of the run with the index advancePrefixSumsRunIndex_.
+  TempVector<Float64> advancePrefixSums_;
+  Int advancePrefixSumsRunIndex_;
+
+  /// The iterator initially skips the grapheme clusters up to the last cluster boundary before
+  /// `maxOffset` and then advances until the offset is not less than `minOffset`.
   STU_INLINE
   Iterator(const TruncatableTextLine& line, const StartAtEndOfLineString startAtEndOfLineString,
-           const MinInitialOffset minOffset = {})
+           const MinInitialOffset minOffset = {}, const MaxInitialOffset maxOffset = {})
   : attributedString_{line.attributedString},
     string_{attributedString_.string},
     lineStringRange_{line.stringRange},
@@ -72,12 +85,13 @@ struct Iterator {
     skipRun_{true},
     offset_{0},
     stringIndex_{isStringForwardIterator_ ? lineStringRange_.start : lineStringRange_.end},
-    runIndex_{!isRightToLeftIterator_ ? -1 : runs_.count()}
+    runIndex_{!isRightToLeftIterator_ ? -1 : runs_.count()},
+    advancePrefixSumsRunIndex_{-1}
   {
-    if (minOffset <= 0) {
+    if (minOffset <= 0 && maxOffset <= 0) {
       loadNextRun();
     } else {
-      advanceToInitialMinOffset(minOffset.value);
+      advanceToInitialOffset(minOffset.value, max(minOffset.value, maxOffset.value));
     }
     STU_APPEARS_UNUSED
     const bool startAtLineStringStart = !startAtEndOfLineString;
@@ -161,7 +175,11 @@ private:
   template <bool isStringForwardIterator>
   bool advanceImpl();
 
-  void advanceToInitialMinOffset(Float64 minOffset);
+  void advanceToInitialOffset(Float64 minOffset, Float64 maxOffset);
+
+  void skipGlyphsInRunUpToOffset(Float64 maxOffset);
+
+  ArrayRef<const Float64> advancePrefixSums();
 
   STU_INLINE
   Int runGlyphCount() const {
@@ -214,7 +232,7 @@ Int Iterator::glyphStringIndex_slowPath() {
   return stringIndices_[glyphIndex_];
 }
 
-void Iterator::advanceToInitialMinOffset(const Float64 minOffset) {
+void Iterator::advanceToInitialOffset(const Float64 minOffset, const Float64 maxOffset) {
   STU_ASSERT(!run_); // This method is only called from the constructor.
   const Int minusOneIfRightToLeftIterator = one_minusOne_Int[isRightToLeftIterator_];
   const CTRunStatus isRTLStatus = isRightToLeftLineAsCTRunStatus();
@@ -226,7 +244,13 @@ void Iterator::advanceToInitialMinOffset(const Float64 minOffset) {
     if (!(0 <= runIndex && runIndex < runs_.count())) break;
     const GlyphRunRef run = runs_[runIndex];
     const Float64 nextOffset = offset + run.typographicWidth();
-    if (nextOffset > minOffset && isRTLStatus == (run.status() & kCTRunStatusRightToLeft)) break;
+    // A run that the iterator can only skip as a whole is stepped over if the iterator would
+    // have to advance over it anyway in order to reach the min offset.
+    if (nextOffset > maxOffset
+        && (offset >= minOffset || isRTLStatus == (run.status() & kCTRunStatusRightToLeft)))
+    {
+      break;
+    }
     offset = nextOffset;
     if (isStringForwardIterator_) {
       stringIndex = max(stringIndex, run.stringRange().end);
@@ -244,11 +268,92 @@ void Iterator::advanceToInitialMinOffset(const Float64 minOffset) {
     stringIndex_ = string_.startIndexOfGraphemeClusterAt(stringIndex);
   }
   loadNextRun();
+  skipGlyphsInRunUpToOffset(maxOffset);
   while (offset_ < minOffset) {
     advance();
   }
 }
 
+/// Returns the prefix sums of the glyph advances of the current run, in glyph order. The sums are
+/// only computed once per run.
+ArrayRef<const Float64> Iterator::advancePrefixSums() {
+  STU_DEBUG_ASSERT(run_ != none);
+  if (advancePrefixSumsRunIndex_ != runIndex_) {
+    advancePrefixSumsRunIndex_ = runIndex_;
+    const Int n = runGlyphCount();
+    CTRun* const ctRun = run_->ctRun();
+    const CGSize* advances = CTRunGetAdvancesPtr(ctRun);
+    TempArray<CGSize> buffer{uninitialized, Count{advances ? 0 : n}};
+    if (!advances) {
+      CTRunGetAdvances(ctRun, CFRange{}, buffer.begin());
+      advances = buffer.begin();
+    }
+    advancePrefixSums_.removeAll();
+    advancePrefixSums_.append(repeat(uninitialized, n + 1));
+    Float64 sum = 0;
+    advancePrefixSums_[0] = 0;
+    for (Int i = 0; i < n; ++i) {
+      sum += advances[i].width;
+      advancePrefixSums_[i + 1] = sum;
+    }
+  }
+  return advancePrefixSums_;
+}
+
+/// Skips the glyphs of the current run up to the last grapheme cluster boundary before the
+/// specified offset. The boundary is found with a binary search over the prefix sums of the glyph
+/// advances, so that long runs don't have to be stepped through cluster by cluster.
+///
+/// Doesn't change the iterator if the current run is skipped or non-monotonic, or if there's no
+/// suitable grapheme cluster boundary.
+void Iterator::skipGlyphsInRunUpToOffset(const Float64 maxOffset) {
+  STU_DEBUG_ASSERT(!isReversed_);
+  if (!run_ || skipRun_ || isNonMonotonicRun_ || offset_ >= maxOffset) return;
+  const Int d = one_minusOne_Int[isRightToLeftIterator_];
+  const Int g = glyphIndex_;
+  // The number of glyphs that have not yet been skipped.
+  const Int m = !isRightToLeftIterator_ ? runGlyphCount() - g : g + 1;
+  if (m < minGlyphCountForPrefixSumSearch) return;
+  const ArrayRef<const Float64> sums = advancePrefixSums();
+  const Float64 maxWidth = maxOffset - offset_;
+  // The number of glyphs to skip.
+  Int k = !isRightToLeftIterator_
+        ? binarySearchFirstIndexWhere(sums[{g, $}], [&](Float64 sum) {
+            return sum - sums[g] >= maxWidth;
+          }).indexOrArrayCount - 1
+        : g + 1 - binarySearchFirstIndexWhere(sums[{0, g + 2}], [&](Float64 sum) {
+                    return sums[g + 1] - sum < maxWidth;
+                  }).indexOrArrayCount;
+  k = min(k, m - 1);
+  if (k < 1) return;
+  if (!stringIndices_.isValidIndex(g)) {
+    glyphStringIndex_slowPath();
+  }
+  const ArrayRef<const Int> stringIndices = stringIndices_;
+  Int nextGlyphStringIndex;
+  Int lastGlyphStringIndex;
+  for (;; --k) {
+    if (k < 1) return;
+    nextGlyphStringIndex = stringIndices[g + k*d];
+    lastGlyphStringIndex = stringIndices[g + (k - 1)*d];
+    if (isStringForwardIterator_
+        ? lastGlyphStringIndex < nextGlyphStringIndex
+          && string_.startIndexOfGraphemeClusterAt(nextGlyphStringIndex) == nextGlyphStringIndex
+        : nextGlyphStringIndex < lastGlyphStringIndex
+          && string_.startIndexOfGraphemeClusterAt(lastGlyphStringIndex) == lastGlyphStringIndex)
+    {
+      break;
+    }
+  }
+  const Float64 width = !isRightToLeftIterator_ ? sums[g + k] - sums[g]
+                                                : sums[g + 1] - sums[g + 1 - k];
+  // Negative advances can make the prefix sums non-monotonic.
+  if (!(offset_ + width < maxOffset)) return;
+  offset_ += width;
+  glyphIndex_ += k*d;
+  stringIndex_ = isStringForwardIterator_ ? nextGlyphStringIndex : lastGlyphStringIndex;
+}
+
 STU_NO_INLINE
 bool Iterator::loadNextRun() {
   // Note that this method may be called from the constructor
@@ -555,12 +660,6 @@ ExcisedGlyphRange findRangeToExciseForMiddleTruncation(
   // We iteratively determine the two spans at the ends of the lines that will remain after
   // truncation. We alternate between both sides to keep the widths balanced when possible.
 
-  Iterator iterS{line, StartAtEndOfLineString{false}};
-  Iterator iterE{line, StartAtEndOfLineString{true}};
-
-  auto& iterL = line.isRightToLeftLine ? iterE : iterS;
-  auto& iterR = line.isRightToLeftLine ? iterS : iterE;
-
   // - 0.01 to protect against infinite iteration due to accumulated floating point rounding errors.
   const Float64 maxWidthForIteration = min(maxWidth, line.width - 0.01);
 
@@ -569,9 +668,19 @@ ExcisedGlyphRange findRangeToExciseForMiddleTruncation(
   STU_DEBUG_ASSERT(line.stringRange.contains(truncationRange));
   const bool isMiddleStartOrEndTruncation = truncationType != kCTLineTruncationMiddle;
 
+  // For a regular middle truncation the alternating iteration below would advance both iterators
+  // to about half the max width, so we let the iterators skip there directly.
+  const MaxInitialOffset maxInitialOffset{isMiddleStartOrEndTruncation
+                                          ? 0 : maxWidthForIteration/2};
+  Iterator iterS{line, StartAtEndOfLineString{false}, MinInitialOffset{}, maxInitialOffset};
+  Iterator iterE{line, StartAtEndOfLineString{true}, MinInitialOffset{}, maxInitialOffset};
+
+  auto& iterL = line.isRightToLeftLine ? iterE : iterS;
+  auto& iterR = line.isRightToLeftLine ? iterS : iterE;
+
   {
-    Float64 offsetS = 0;
-    Float64 offsetE = 0;
+    Float64 offsetS = iterS.offset();
+    Float64 offsetE = iterE.offset();
     // Look ahead one step.
     iterS.advance();
     iterE.advance();
@@ -6,6 +6,8 @@
 
 #import "stu/FunctionRef.hpp"
 
+@class STUPurgeableImageBuffer;
+
 namespace stu_label {
 
 template <typename Int>
@@ -45,11 +47,21 @@ struct SizeInPixels : Size<Int> {
   }
 };
 
+/// An 8-bit alpha-only image format (without a color space) that is only used internally, for
+/// glyph coverage masks. This value isn't a valid argument for the public `stuCGImageFormat`
+/// function; `PurgeableImage` maps it to the `CGImageFormat` itself.
+constexpr STUPredefinedCGImageFormat alphaMaskCGImageFormat = STUPredefinedCGImageFormat{3};
+static_assert(alphaMaskCGImageFormat > STUPredefinedCGImageFormatGrayscale);
+static_assert(alphaMaskCGImageFormat < (1 << STUPredefinedCGImageFormatBitSize));
+
 /// The images created with `createCGImage()` reference the purgeable data and keep it from being
 /// purged. The data automatically becomes purgeable when all CGImages referencing the data have
-/// been destroyed (after at least one CGImage has been created or
-/// `makePurgeableOnceAllCGImagesAreDestroyed` was called).
+/// been destroyed (after at least one CGImage has been created,
+/// `makePurgeableOnceAllCGImagesAreDestroyed` was called or the `PurgeableImage` was destroyed).
 /// `createCGImage()` will return a null pointer if the data has been purged.
+///
+/// Once the `PurgeableImage` and all CGImages referencing its data have been destroyed, the
+/// bitmap buffer is returned to the `PurgeableImageBufferPool` (if the pool is enabled).
 class PurgeableImage {
 public:
   /// Returns null if the image was purged.
@@ -79,9 +91,29 @@ public:
                  STUPredefinedCGImageFormat, STUCGImageFormatOptions,
                  FunctionRef<void(CGContext*)> drawingFunction);
 
+  /// Returns a copy of this image in which the pixels within the specified rect have been
+  /// cleared (or filled with the background color) and then redrawn by the drawing function.
+  /// The rect is specified in the coordinate system of the drawing function and the drawing
+  /// function is called with a context that is clipped to the rect.
+  ///
+  /// Returns a null image if the data of this image was purged.
+  ///
+  /// @param scale The scale that was used for creating this image.
+  /// @param backgroundColor The background color that was used for creating this image.
+  PurgeableImage copyWithRedrawnRect(CGRect rect, CGFloat scale,
+                                     __nullable CGColorRef backgroundColor,
+                                     FunctionRef<void(CGContext*)> drawingFunction);
+
+  STU_INLINE
+  ~PurgeableImage() {
+    if (hasUnconsumedContentAccessBegin_) {
+      makePurgeableOnceAllCGImagesAreDestroyed();
+    }
+  }
+
   STU_INLINE
   PurgeableImage(const PurgeableImage& other)
-  : data_{}
+  : data_{}, hasUnconsumedContentAccessBegin_{}
   {
     assign(other);
   }
@@ -95,7 +127,7 @@ public:
 
   STU_INLINE
   PurgeableImage(PurgeableImage&& other) noexcept
-  : data_{}
+  : data_{}, hasUnconsumedContentAccessBegin_{}
   {
     assign(std::move(other));
   }
@@ -111,6 +143,9 @@ private:
   template <typename Other>
   STU_INLINE
   void assign(Other&& other) {
+    if (hasUnconsumedContentAccessBegin_) {
+      makePurgeableOnceAllCGImagesAreDestroyed();
+    }
     data_ = other.data_;
     if constexpr (isSame<Other&&, const PurgeableImage&>) {
       hasUnconsumedContentAccessBegin_ = false;
@@ -127,7 +162,7 @@ private:
   }
 
   STU_INLINE
-  PurgeableImage(NSPurgeableData* data, SizeInPixels<UInt32> size,
+  PurgeableImage(STUPurgeableImageBuffer* data, SizeInPixels<UInt32> size,
                  STUPredefinedCGImageFormat format, STUCGImageFormatOptions formatOptions,
                  size_t bytesPerRow)
   : data_{data}, size_{size}, bytesPerRowDiv32_{narrow_cast<UInt32>(bytesPerRow/32)},
@@ -137,7 +172,7 @@ private:
     STU_DEBUG_ASSERT(0 < bytesPerRow && bytesPerRow%32 == 0);
   }
 
-  NSPurgeableData* data_; // arc
+  STUPurgeableImageBuffer* data_; // arc
   SizeInPixels<UInt32> size_;
   UInt32 bytesPerRowDiv32_;
   STUCGImageFormatOptions formatOptions_ : 8;
@@ -145,6 +180,42 @@ private:
   bool hasUnconsumedContentAccessBegin_;
 };
 
+/// A bounded global pool of purgeable bitmap buffers that `PurgeableImage` reuses, so that
+/// repeatedly rendering images of similar size (e.g. in table or collection view cells) doesn't
+/// have to allocate, page in and zero new memory for every image.
+///
+/// Buffers are pooled by size class, with 4 size classes per power of two. Pooled buffers stay
+/// purgeable, so the system can still reclaim their memory; purged buffers are discarded when
+/// they are taken from the pool. The pool is also cleared when the app enters the background or
+/// receives a memory warning.
+class PurgeableImageBufferPool {
+public:
+  struct Statistics {
+    /// The number of buffers requested by `PurgeableImage` while the pool was enabled.
+    UInt64 requestCount;
+    /// The number of requests that were satisfied with a pooled buffer.
+    UInt64 reuseCount;
+    /// The number of pooled buffers that were found to have been purged by the system.
+    UInt64 purgedCount;
+    Int bufferCount;
+    UInt memoryUsage;
+  };
+
+  /// Thread-safe.
+  static UInt memoryBudget();
+
+  /// Setting the budget to 0 disables the pool.
+  /// Thread-safe.
+  static void setMemoryBudget(UInt memoryBudget);
+
+  /// Thread-safe.
+  static Statistics statistics();
+
+  /// Removes all buffers from the pool and resets the statistics.
+  /// Thread-safe.
+  static void clear();
+};
+
 } // namespace stu_label
 
 template <> struct stu::IsBitwiseMovable<stu_label::PurgeableImage> : stu::True {};
@@ -2,10 +2,225 @@
 
 #import "PurgeableImage.hpp"
 
+#import "STULabel/stu_mutex.h"
+
+#include <atomic>
+
 #include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
+using namespace stu_label;
+
+/// Owns the bitmap buffer of a `PurgeableImage`. The `PurgeableImage` instances sharing the
+/// buffer and the data providers of the CGImages created from it retain this object. When it is
+/// deallocated, the buffer is returned to the `PurgeableImageBufferPool`.
+@interface STUPurgeableImageBuffer : NSObject {
+@package
+  NSPurgeableData* _data;
+  /// The size class of the buffer, or 0 if the buffer was allocated while the pool was disabled.
+  UInt _sizeClass;
+}
+@end
+
+namespace stu_label {
+
+static void returnBufferToPool(NSPurgeableData* data, UInt sizeClass);
+
+} // namespace stu_label
+
+@implementation STUPurgeableImageBuffer
+
+- (instancetype)initWithData:(NSPurgeableData*)data sizeClass:(UInt)sizeClass {
+  _data = data;
+  _sizeClass = sizeClass;
+  return self;
+}
+
+- (void)dealloc {
+  if (_sizeClass != 0) {
+    returnBufferToPool(_data, _sizeClass);
+  }
+}
+
+@end
+
 namespace stu_label {
 
+/// Buffers larger than this fraction of the budget are not pooled.
+static constexpr UInt maxPooledBufferSizeBudgetDivisor = 4;
+
+static constexpr Int maxPooledBufferCount = 32;
+
+static constexpr UInt defaultBufferPoolMemoryBudget = 8 << 20;
+
+/// Rounds up the size to the next size class. There are 4 size classes per power of two and all
+/// size classes are multiples of the page size, so that at most 25% of a buffer is unused.
+static UInt bufferSizeClass(UInt size) {
+  const UInt pageSize = NSPageSize();
+  if (size <= pageSize) return pageSize;
+  const UInt log2 = sizeof(UInt)*8 - 1 - static_cast<UInt>(__builtin_clzl(size - 1));
+  const UInt step = max(pageSize, UInt{1} << (log2 - 2));
+  return (size + (step - 1)) & ~(step - 1);
+}
+
+namespace {
+
+struct PooledBuffer {
+  /// A purgeable NSPurgeableData instance (retained).
+  const void* data;
+  UInt sizeClass;
+};
+
+struct BufferPoolStorage {
+  /// Ordered from the least to the most recently returned buffer.
+  PooledBuffer buffers[maxPooledBufferCount];
+  Int bufferCount{};
+  UInt memoryUsage{};
+  UInt64 requestCount{};
+  UInt64 reuseCount{};
+  UInt64 purgedCount{};
+
+  /// Returns the buffer with content access begun, or nil.
+  NSPurgeableData* take(UInt sizeClass) {
+    ++requestCount;
+    for (Int i = bufferCount - 1; i >= 0; --i) {
+      if (buffers[i].sizeClass != sizeClass) continue;
+      NSPurgeableData* const data = (__bridge_transfer NSPurgeableData*)buffers[i].data;
+      remove(i);
+      if (![data beginContentAccess]) {
+        ++purgedCount;
+        continue;
+      }
+      ++reuseCount;
+      return data;
+    }
+    return nil;
+  }
+
+  void add(NSPurgeableData* data, UInt sizeClass, UInt budget) {
+    if (sizeClass > budget/maxPooledBufferSizeBudgetDivisor) return;
+    while (bufferCount == maxPooledBufferCount || memoryUsage + sizeClass > budget) {
+      CFRelease(buffers[0].data);
+      remove(0);
+    }
+    buffers[bufferCount++] = PooledBuffer{(__bridge_retained const void*)data, sizeClass};
+    memoryUsage += sizeClass;
+  }
+
+  void evict(UInt targetMemoryUsage) {
+    while (memoryUsage > targetMemoryUsage) {
+      CFRelease(buffers[0].data);
+      remove(0);
+    }
+  }
+
+  void clear() {
+    evict(0);
+  }
+
+private:
+  /// Doesn't release the buffer.
+  void remove(Int index) {
+    memoryUsage -= buffers[index].sizeClass;
+    --bufferCount;
+    std::memmove(&buffers[index], &buffers[index + 1],
+                 sign_cast(bufferCount - index)*sizeof(PooledBuffer));
+  }
+};
+
+} // namespace
+
+static stu_mutex bufferPoolMutex = STU_MUTEX_INIT;
+static bool bufferPoolIsInitialized = false;
+static std::atomic<UInt> bufferPoolMemoryBudget{defaultBufferPoolMemoryBudget};
+alignas(BufferPoolStorage)
+static Byte bufferPoolStorage[sizeof(BufferPoolStorage)];
+
+/// Must be called while holding the bufferPoolMutex.
+static BufferPoolStorage& bufferPool() {
+  if (STU_UNLIKELY(!bufferPoolIsInitialized)) {
+    bufferPoolIsInitialized = true;
+    BufferPoolStorage& pool = *new (bufferPoolStorage) BufferPoolStorage{};
+
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearPoolBlock = ^(NSNotification*) {
+      stu_mutex_lock(&bufferPoolMutex);
+      pool.clear();
+      stu_mutex_unlock(&bufferPoolMutex);
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearPoolBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearPoolBlock];
+  }
+  return reinterpret_cast<BufferPoolStorage&>(bufferPoolStorage);
+}
+
+/// Returns a buffer from the pool with content access begun, or nil.
+static NSPurgeableData* takeBufferFromPool(UInt sizeClass) {
+  stu_mutex_lock(&bufferPoolMutex);
+  NSPurgeableData* const data = bufferPool().take(sizeClass);
+  stu_mutex_unlock(&bufferPoolMutex);
+  return data;
+}
+
+static void returnBufferToPool(NSPurgeableData* data, UInt sizeClass) {
+  const UInt budget = bufferPoolMemoryBudget.load(std::memory_order_relaxed);
+  if (budget == 0) return;
+  stu_mutex_lock(&bufferPoolMutex);
+  bufferPool().add(data, sizeClass, budget);
+  stu_mutex_unlock(&bufferPoolMutex);
+}
+
+UInt PurgeableImageBufferPool::memoryBudget() {
+  return bufferPoolMemoryBudget.load(std::memory_order_relaxed);
+}
+
+void PurgeableImageBufferPool::setMemoryBudget(UInt memoryBudget) {
+  stu_mutex_lock(&bufferPoolMutex);
+  bufferPoolMemoryBudget.store(memoryBudget, std::memory_order_relaxed);
+  if (bufferPoolIsInitialized) {
+    bufferPool().evict(memoryBudget);
+  }
+  stu_mutex_unlock(&bufferPoolMutex);
+}
+
+auto PurgeableImageBufferPool::statistics() -> Statistics {
+  Statistics stats = {};
+  stu_mutex_lock(&bufferPoolMutex);
+  if (bufferPoolIsInitialized) {
+    const BufferPoolStorage& pool = bufferPool();
+    stats = Statistics{.requestCount = pool.requestCount, .reuseCount = pool.reuseCount,
+                       .purgedCount = pool.purgedCount, .bufferCount = pool.bufferCount,
+                       .memoryUsage = pool.memoryUsage};
+  }
+  stu_mutex_unlock(&bufferPoolMutex);
+  return stats;
+}
+
+void PurgeableImageBufferPool::clear() {
+  stu_mutex_lock(&bufferPoolMutex);
+  if (bufferPoolIsInitialized) {
+    BufferPoolStorage& pool = bufferPool();
+    pool.clear();
+    pool.requestCount = 0;
+    pool.reuseCount = 0;
+    pool.purgedCount = 0;
+  }
+  stu_mutex_unlock(&bufferPoolMutex);
+}
+
+static STUCGImageFormat cgImageFormat(STUPredefinedCGImageFormat format,
+                                      STUCGImageFormatOptions formatOptions)
+{
+  if (format == alphaMaskCGImageFormat) {
+    return STUCGImageFormat{.colorSpace = nullptr,
+                            .bitmapInfo = CGBitmapInfo(kCGImageAlphaOnly),
+                            .bitsPerComponent = 8, .bitsPerPixel = 8};
+  }
+  return stuCGImageFormat(format, formatOptions);
+}
+
 PurgeableImage::PurgeableImage(CGSize size, CGFloat scale, __nullable CGColorRef backgroundColor,
                                STUPredefinedCGImageFormat format,
                                STUCGImageFormatOptions formatOptions,
@@ -14,6 +229,36 @@ PurgeableImage::PurgeableImage(CGSize size, CGFloat scale, __nullable CGColorRef
                  drawingFunction}
 {}
 
+static void logBufferAllocationFailure() {
+#if STU_DEBUG
+  STU_CHECK_MSG(false, "Failed to allocate purgeable image bitmap buffer");
+#else
+  NSLog(@"Failed to allocate purgeable image bitmap buffer");
+#endif
+}
+
+/// Returns a pooled buffer or a newly allocated one, or nil if the allocation failed.
+/// A newly allocated buffer is zeroed, a pooled buffer still contains the previous image.
+static NSPurgeableData* takeOrAllocateBuffer(UInt allocationSize, Out<UInt> outSizeClass,
+                                             Out<bool> outIsReused)
+{
+  UInt sizeClass = 0;
+  NSPurgeableData* data = nil;
+  if (bufferPoolMemoryBudget.load(std::memory_order_relaxed) != 0) {
+    sizeClass = bufferSizeClass(allocationSize);
+    data = takeBufferFromPool(sizeClass);
+  }
+  outSizeClass = sizeClass;
+  outIsReused = data != nil;
+  if (!data) {
+    data = [[NSPurgeableData alloc] initWithLength:sizeClass != 0 ? sizeClass : allocationSize];
+    if (![data mutableBytes]) return nil;
+  }
+  // The memory allocated by NSPurgeableData should be page-aligned.
+  STU_DEBUG_ASSERT((reinterpret_cast<uintptr_t>([data mutableBytes]) & 4095) == 0);
+  return data;
+}
+
 PurgeableImage::PurgeableImage(SizeInPixels<UInt32> size, CGFloat scale,
                                __nullable CGColorRef backgroundColor,
                                STUPredefinedCGImageFormat format,
@@ -24,10 +269,12 @@ PurgeableImage::PurgeableImage(SizeInPixels<UInt32> size, CGFloat scale,
   size.width = max(1u, size.width);
   size.height = max(1u, size.height);
 
-  const STUCGImageFormat imageFormat = stuCGImageFormat(format, formatOptions);
+  const STUCGImageFormat imageFormat = cgImageFormat(format, formatOptions);
 
   UInt bytesPerRow;
   UInt allocationSize;
+  UInt sizeClass;
+  bool isReused;
   NSPurgeableData* data;
   void* bytes;
   CGContextRef context;
@@ -39,12 +286,14 @@ PurgeableImage::PurgeableImage(SizeInPixels<UInt32> size, CGFloat scale,
 
   if (__builtin_mul_overflow(bytesPerRow, size.height, &allocationSize)) goto Failure;
 
-  data = [[NSPurgeableData alloc] initWithLength:allocationSize];
+  data = takeOrAllocateBuffer(allocationSize, Out{sizeClass}, Out{isReused});
+  if (!data) goto Failure;
   bytes = [data mutableBytes];
-  if (!bytes) goto Failure;
-
-  // The memory allocated by NSPurgeableData should be page-aligned.
-  STU_DEBUG_ASSERT((reinterpret_cast<uintptr_t>(bytes) & 4095) == 0);
+  // A reused buffer still contains the previous image. An opaque background color overwrites
+  // all pixels anyway.
+  if (isReused && (!backgroundColor || CGColorGetAlpha(backgroundColor) < 1)) {
+    memset(bytes, 0, allocationSize);
+  }
 
   context = stu_createCGBitmapContext(size.width, size.height, scale, backgroundColor, imageFormat,
                                       bytes, bytesPerRow);
@@ -53,22 +302,59 @@ PurgeableImage::PurgeableImage(SizeInPixels<UInt32> size, CGFloat scale,
   CGContextFlush(context);
   CFRelease(context);
 
-  *this = PurgeableImage(data, size, format, formatOptions, bytesPerRow);
+  *this = PurgeableImage([[STUPurgeableImageBuffer alloc] initWithData:data sizeClass:sizeClass],
+                         size, format, formatOptions, bytesPerRow);
   return;
 
 Failure:
-#if STU_DEBUG
-  STU_CHECK_MSG(false, "Failed to allocate purgeable image bitmap buffer");
-#else
-  NSLog(@"Failed to allocate purgeable image bitmap buffer");
-#endif
+  logBufferAllocationFailure();
   return;
 }
 
+PurgeableImage PurgeableImage::copyWithRedrawnRect(CGRect rect, CGFloat scale,
+                                                   __nullable CGColorRef backgroundColor,
+                                                   FunctionRef<void(CGContext*)> drawingFunction)
+{
+  if (!tryMakeNonPurgeableUntilNextCGImageIsCreated()) return PurgeableImage{};
+  const UInt bytesPerRow = static_cast<UInt>(bytesPerRowDiv32_)*32;
+  const UInt allocationSize = bytesPerRow*size_.height;
+  UInt sizeClass;
+  bool isReused;
+  NSPurgeableData* const data = takeOrAllocateBuffer(allocationSize, Out{sizeClass},
+                                                     Out{isReused});
+  if (!data) {
+    logBufferAllocationFailure();
+    return PurgeableImage{};
+  }
+  void* const bytes = [data mutableBytes];
+  memcpy(bytes, data_->_data.bytes, allocationSize);
+
+  const CGContextRef context = stu_createCGBitmapContext(size_.width, size_.height, scale, nil,
+                                                         cgImageFormat(format_, formatOptions_),
+                                                         bytes, bytesPerRow);
+  if (!context) return PurgeableImage{};
+  CGContextClipToRect(context, rect);
+  if (backgroundColor) {
+    CGContextSaveGState(context);
+    CGContextSetBlendMode(context, kCGBlendModeCopy);
+    CGContextSetFillColorWithColor(context, backgroundColor);
+    CGContextFillRect(context, rect);
+    CGContextRestoreGState(context);
+  } else {
+    CGContextClearRect(context, rect);
+  }
+  drawingFunction(context);
+  CGContextFlush(context);
+  CFRelease(context);
+
+  return PurgeableImage([[STUPurgeableImageBuffer alloc] initWithData:data sizeClass:sizeClass],
+                        size_, format_, formatOptions_, bytesPerRow);
+}
+
 void PurgeableImage::makePurgeableOnceAllCGImagesAreDestroyed() {
   if (!hasUnconsumedContentAccessBegin_) return;
   hasUnconsumedContentAccessBegin_ = false;
-  [data_ endContentAccess];
+  [data_->_data endContentAccess];
 }
 
 bool PurgeableImage::tryMakeNonPurgeableUntilNextCGImageIsCreated() {
@@ -77,7 +363,7 @@ bool PurgeableImage::tryMakeNonPurgeableUntilNextCGImageIsCreated() {
     return true;
   }
   if (data_) {
-    if ([data_ beginContentAccess]) {
+    if ([data_->_data beginContentAccess]) {
       hasUnconsumedContentAccessBegin_ = true;
       return true;
     }
@@ -87,7 +373,8 @@ bool PurgeableImage::tryMakeNonPurgeableUntilNextCGImageIsCreated() {
 }
 
 static void endCGImageContentAccess(void* info, const void* __unused bytes, size_t __unused size) {
-  [(__bridge_transfer NSPurgeableData*)info endContentAccess];
+  STUPurgeableImageBuffer* const buffer = (__bridge_transfer STUPurgeableImageBuffer*)info;
+  [buffer->_data endContentAccess];
 }
 
 RC<CGImage> PurgeableImage::createCGImage() {
@@ -96,18 +383,19 @@ RC<CGImage> PurgeableImage::createCGImage() {
     STU_DEBUG_ASSERT(data_ != nil);
   } else {
     if (!data_) return nullptr;
-    if (![data_ beginContentAccess]) {
+    if (![data_->_data beginContentAccess]) {
       data_ = nil;
       return nullptr;
     }
   }
+  const UInt bytesPerRow = static_cast<UInt>(bytesPerRowDiv32_)*32;
   const CGDataProviderRef dp = CGDataProviderCreateWithData((__bridge_retained void*)data_,
-                                                            data_.bytes, data_.length,
+                                                            data_->_data.bytes,
+                                                            bytesPerRow*size_.height,
                                                             endCGImageContentAccess);
-  const STUCGImageFormat format = stuCGImageFormat(format_, formatOptions_);
+  const STUCGImageFormat format = cgImageFormat(format_, formatOptions_);
   RC<CGImage> image = {CGImageCreate(size_.width, size_.height, format.bitsPerComponent,
-                                     format.bitsPerPixel,
-                                     static_cast<UInt>(bytesPerRowDiv32_)*32,
+                                     format.bitsPerPixel, bytesPerRow,
                                      format.colorSpace, format.bitmapInfo, dp,
                                      nullptr, true, kCGRenderingIntentPerceptual),
                        ShouldIncrementRefCount{false}};
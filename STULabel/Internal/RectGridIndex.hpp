@@ -0,0 +1,71 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Rect.hpp"
+
+#import "stu/Vector.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// A uniform grid spatial index over a set of tagged rectangles that supports finding the
+/// rectangle closest to a point.
+///
+/// The grid covers the bounds of all rectangles and has roughly as many cells as there are
+/// rectangles. Every cell stores the indices of the rectangles intersecting the cell, in increasing
+/// order, in a single flat array. A closest-rectangle query visits the cells in rings of increasing
+/// distance around the point and stops as soon as the remaining rings can't contain a closer
+/// rectangle, so for evenly distributed rectangles the expected query time is constant.
+///
+/// Instances are immutable and hence thread-safe.
+class RectGridIndex {
+public:
+  struct TaggedRect {
+    Rect<Float64> rect;
+    Int32 tag;
+  };
+
+  explicit RectGridIndex(ArrayRef<const TaggedRect> rects);
+
+  struct TagAndDistance {
+    /// -1 if no rectangle was found.
+    Int32 tag;
+    Float64 distance;
+  };
+
+  /// Returns the tag of the rectangle closest to the point, or -1 if there is no rectangle with a
+  /// distance less than or equal to `maxDistance`. If multiple rectangles have the same minimal
+  /// distance, the one with the smallest tag is returned.
+  TagAndDistance findRectClosestTo(Point<Float64> point, Float64 maxDistance) const;
+
+  static constexpr Int maxGridDimension = 256;
+
+  Int columnCount() const { return columnCount_; }
+  Int rowCount() const { return rowCount_; }
+
+private:
+  Range<Int> cellIndices(Int column, Int row) const {
+    const Int cell = row*columnCount_ + column;
+    return {cellStartIndices_[cell], cellStartIndices_[cell + 1]};
+  }
+
+  Int columnIndex(Float64 x) const;
+  Int rowIndex(Float64 y) const;
+
+  Vector<TaggedRect> rects_;
+  /// The `cellStartIndices_[c]..<cellStartIndices_[c + 1]` elements of `cellRectIndices_` are the
+  /// indices of the rectangles in `rects_` intersecting the cell with the row-major index `c`.
+  Vector<Int32> cellStartIndices_;
+  Vector<Int32> cellRectIndices_;
+  Rect<Float64> bounds_{};
+  Float64 inverseCellWidth_{};
+  Float64 inverseCellHeight_{};
+  /// The minimum of the cell width and height, ignoring zero values.
+  Float64 minCellSize_{};
+  Int columnCount_{};
+  Int rowCount_{};
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -0,0 +1,153 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "RectGridIndex.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+static Int gridDimension(Float64 value) {
+  const Float64 maxValue = RectGridIndex::maxGridDimension;
+  return !(value > 1) ? 1 : value >= maxValue ? RectGridIndex::maxGridDimension
+       : static_cast<Int>(ceil(value));
+}
+
+RectGridIndex::RectGridIndex(ArrayRef<const TaggedRect> rects) {
+  rects_.append(rects);
+  if (rects.isEmpty()) return;
+  Rect<Float64> bounds = Rect<Float64>::infinitelyEmpty();
+  for (const TaggedRect& r : rects) {
+    bounds = bounds.convexHull(r.rect);
+  }
+  bounds_ = bounds;
+  // Non-finite bounds result in a single grid cell.
+  Float64 width = bounds.width();
+  Float64 height = bounds.height();
+  if (!(width < infinity<Float64> && height < infinity<Float64>)) {
+    width = 0;
+    height = 0;
+  }
+  width = max(0, width);
+  height = max(0, height);
+  const Float64 n = rects.count();
+  // We aim for square cells and roughly one cell per rectangle.
+  if (width > 0 && height > 0) {
+    const Float64 cellSize = sqrt(width*height/n);
+    columnCount_ = gridDimension(width/cellSize);
+    rowCount_ = gridDimension(height/cellSize);
+  } else {
+    columnCount_ = width > 0 ? gridDimension(n) : 1;
+    rowCount_ = height > 0 ? gridDimension(n) : 1;
+  }
+  const Float64 cellWidth = width/columnCount_;
+  const Float64 cellHeight = height/rowCount_;
+  inverseCellWidth_ = width > 0 ? 1/cellWidth : 0;
+  inverseCellHeight_ = height > 0 ? 1/cellHeight : 0;
+  minCellSize_ = cellWidth == 0 ? cellHeight
+               : cellHeight == 0 ? cellWidth
+               : min(cellWidth, cellHeight);
+
+  // Two passes: The first counts the rectangles per cell, the second stores the indices.
+  const Int cellCount = columnCount_*rowCount_;
+  cellStartIndices_.append(repeat(Int32{0}, cellCount + 1));
+  const auto forEachCell = [&](const Rect<Float64>& rect, auto&& body) {
+    const Int column0 = columnIndex(rect.x.start);
+    const Int column1 = columnIndex(rect.x.end);
+    const Int row1 = rowIndex(rect.y.end);
+    for (Int row = rowIndex(rect.y.start); row <= row1; ++row) {
+      for (Int column = column0; column <= column1; ++column) {
+        body(row*columnCount_ + column);
+      }
+    }
+  };
+  for (const TaggedRect& r : rects_) {
+    forEachCell(r.rect, [&](Int cell) { cellStartIndices_[cell + 1] += 1; });
+  }
+  for (Int i = 1; i <= cellCount; ++i) {
+    cellStartIndices_[i] += cellStartIndices_[i - 1];
+  }
+  cellRectIndices_.append(repeat(uninitialized, cellStartIndices_[cellCount]));
+  // Temporarily use the start indices as insertion positions.
+  for (Int i = 0; i < rects_.count(); ++i) {
+    forEachCell(rects_[i].rect, [&](Int cell) {
+      cellRectIndices_[cellStartIndices_[cell]++] = narrow_cast<Int32>(i);
+    });
+  }
+  for (Int i = cellCount; i > 0; --i) {
+    cellStartIndices_[i] = cellStartIndices_[i - 1];
+  }
+  cellStartIndices_[0] = 0;
+}
+
+Int RectGridIndex::columnIndex(Float64 x) const {
+  const Float64 c = (x - bounds_.x.start)*inverseCellWidth_;
+  return !(c > 0) ? 0 : c >= columnCount_ ? columnCount_ - 1 : static_cast<Int>(c);
+}
+
+Int RectGridIndex::rowIndex(Float64 y) const {
+  const Float64 r = (y - bounds_.y.start)*inverseCellHeight_;
+  return !(r > 0) ? 0 : r >= rowCount_ ? rowCount_ - 1 : static_cast<Int>(r);
+}
+
+auto RectGridIndex::findRectClosestTo(Point<Float64> point, Float64 maxDistance) const
+  -> TagAndDistance
+{
+  TagAndDistance result = {.tag = -1, .distance = maxDistance};
+  if (rects_.isEmpty() || !(maxDistance >= 0)) return result;
+  const Float64 maxSquaredDistance = maxDistance*maxDistance;
+  Float64 minSquaredDistance = infinity<Float64>;
+  const auto visitCell = [&](Int column, Int row) {
+    for (const Int i : cellIndices(column, row).iter()) {
+      const TaggedRect& r = rects_[cellRectIndices_[i]];
+      const Float64 squaredDistance = r.rect.squaredDistanceTo(point);
+      if (squaredDistance > maxSquaredDistance) continue;
+      if (squaredDistance < minSquaredDistance
+          || (squaredDistance == minSquaredDistance && r.tag < result.tag))
+      {
+        minSquaredDistance = squaredDistance;
+        result.tag = r.tag;
+      }
+    }
+  };
+  // The projection of the point onto the grid bounds lies in the center cell. Since the projection
+  // onto a convex set doesn't increase distances, any rectangle in a cell in ring r >= 1 around
+  // the center cell has a distance of at least (r - 1)*minCellSize_ from the point.
+  const Int column = columnIndex(point.x);
+  const Int row = rowIndex(point.y);
+  const Int maxRing = max(max(column, columnCount_ - 1 - column), max(row, rowCount_ - 1 - row));
+  for (Int ring = 0; ring <= maxRing; ++ring) {
+    if (ring > 0) {
+      const Float64 minDistance = (ring - 1)*minCellSize_;
+      if (minDistance*minDistance > min(minSquaredDistance, maxSquaredDistance)) break;
+    }
+    const Range<Int> columns = Range{column - ring, column + ring + 1}
+                               .intersection(Range{Int{0}, columnCount_});
+    const Range<Int> rows = Range{row - ring, row + ring + 1}
+                            .intersection(Range{Int{0}, rowCount_});
+    if (ring == 0) {
+      visitCell(column, row);
+      continue;
+    }
+    if (row - ring >= 0) {
+      for (const Int c : columns.iter()) visitCell(c, row - ring);
+    }
+    if (row + ring < rowCount_) {
+      for (const Int c : columns.iter()) visitCell(c, row + ring);
+    }
+    const Range<Int> innerRows = rows.intersection(Range{row - ring + 1, row + ring});
+    if (column - ring >= 0) {
+      for (const Int r : innerRows.iter()) visitCell(column - ring, r);
+    }
+    if (column + ring < columnCount_) {
+      for (const Int r : innerRows.iter()) visitCell(column + ring, r);
+    }
+  }
+  if (result.tag >= 0) {
+    result.distance = sqrt(minSquaredDistance);
+  }
+  return result;
+}
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
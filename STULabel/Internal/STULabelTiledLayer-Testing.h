@@ -0,0 +1,19 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "STULabelTiledLayer.h"
+
+STU_ASSUME_NONNULL_AND_STRONG_BEGIN
+
+/// Only used for testing.
+@interface STULabelTiledLayer (Testing)
+
+/// The total size in bytes of the images in the retained tile image cache.
+@property (class, readonly) size_t retainedTileImagesByteCount;
+
+/// Inserts a blank image for a tile with the specified frame (in pixels) of this layer into the
+/// retained tile image cache.
+- (void)retainBlankTileImageWithFrame:(CGRect)frame;
+
+@end
+
+STU_ASSUME_NONNULL_AND_STRONG_END
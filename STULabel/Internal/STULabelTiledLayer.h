@@ -16,6 +16,14 @@ typedef void (^ STULabelTileDrawingBlock)(CGContextRef context, CGRect rect,
 
 @property (nonatomic) STUPredefinedCGImageFormat imageFormat;
 
+/// The memory budget in bytes of an LRU cache shared by all tiled layers that retains the images
+/// of tiles removed from a layer's tile rect, so that they don't need to be rendered again when
+/// they become visible again. The cached images are purgeable. The cache is cleared on memory
+/// warnings and when the app enters the background. Setting the budget to 0 disables the cache.
+///
+/// Default value: 32 MiB. This property can be accessed from any thread.
+@property (class) size_t retainedTileImagesMemoryBudget;
+
 @end
 
 STU_ASSUME_NONNULL_AND_STRONG_END
@@ -1,6 +1,6 @@
 
 
-#import "STULabelTiledLayer.h"
+#import "STULabelTiledLayer-Testing.h"
 
 #import "CancellationFlag.hpp"
 #import "CoreAnimationUtils.hpp"
@@ -9,6 +9,10 @@
 #import "Once.hpp"
 #import "PurgeableImage.hpp"
 #import "Rect.hpp"
+#import "ScrollMotion.hpp"
+#import "TileImageCache.hpp"
+
+#import "STULabel/stu_mutex.h"
 
 #import "stu/Vector.hpp"
 #import "stu/UniquePtr.hpp"
@@ -88,6 +92,9 @@ namespace stu_label {
   #define STU_TRACE_IF(condition, string, ...)
 #endif
 
+/// Guards the retained tile image cache shared by all tiled layers.
+static stu_mutex tileImageCacheMutex = STU_MUTEX_INIT;
+
 /// Must be zero-initialized.
 class TiledLayer {
   using SInt = Int32;
@@ -239,9 +246,6 @@ public:
       STU_TRACE("Prerender rect: [%i, %i] [%i, %i]",
                 prerenderTileRect_.x.start, prerenderTileRect_.x.end - 1,
                 prerenderTileRect_.y.start, prerenderTileRect_.y.end - 1);
-      for (bool& value : sectorPrerendered_) {
-        value = false;
-      }
       if (!applicationDidEnterBackground) {
         forEachTileIn(prerenderTileRect, [&](Point<SInt> location __unused, Tile*& tile) {
           if (tile && !tile->hasLayer()) {
@@ -260,36 +264,20 @@ public:
     }
     if (applicationDidEnterBackground) return;
 
-    // We let the scrolling drive the prerendering and prerender with up to 2 threads.
-    const Point<SInt> d = lastVisibleBoundsCenterDelta_;
-    if (d.y != 0 && (!prerenderTile1_ || !isTileUsedByTask(*prerenderTile1_))) {
-      const auto sectorIndex = d.y > 0 ? topSectorIndex : bottomSectorIndex;
-      if (!sectorPrerendered_[sectorIndex]) {
-        prerenderTile1_ = findTileToPrerender(visibleTileRect_.x, prerenderTileRect_.x, d.x,
-                                              visibleTileRect_.y, prerenderTileRect_.y, d.y, false);
-        if (prerenderTile1_) {
-          prerenderTile1StartTimestamp_ = CACurrentMediaTime();
-          prerenderTile1_->startPrerenderTask(displayScale_, inverseDisplayScale_, imageFormat_,
-                                              drawingBlock_);
-        } else {
-          sectorPrerendered_[sectorIndex] = true;
-        }
-      }
-    }
-    if (d.x != 0 && (!prerenderTile2_ || !isTileUsedByTask(*prerenderTile2_))) {
-      const auto sectorIndex = d.x > 0 ? rightSectorIndex : leftSectorIndex;
-      if (!sectorPrerendered_[sectorIndex]) {
-        prerenderTile2_ = findTileToPrerender(visibleTileRect_.y, prerenderTileRect_.y, d.y,
-                                              visibleTileRect_.x, prerenderTileRect_.x, d.x, true);
-        if (prerenderTile2_) {
-          prerenderTile2StartTimestamp_ = CACurrentMediaTime();
-          prerenderTile2_->startPrerenderTask(displayScale_, inverseDisplayScale_, imageFormat_,
-                                              drawingBlock_);
-        } else {
-          sectorPrerendered_[sectorIndex] = true;
-        }
+    // We let the predicted scroll motion drive the prerendering.
+    const Rect<SInt> predictedTileRect = this->predictedTileRect();
+    if (predictedTileRect_ != predictedTileRect) {
+      predictedTileRect_ = predictedTileRect;
+      predictedTilesArePrerendered_ = false;
+      STU_TRACE("Predicted rect: [%i, %i] [%i, %i]",
+                predictedTileRect_.x.start, predictedTileRect_.x.end - 1,
+                predictedTileRect_.y.start, predictedTileRect_.y.end - 1);
+      // When the motion stops, the tasks started for the last prediction are still useful.
+      if (!predictedTileRect.isEmpty()) {
+        cancelPrerenderTasksOutside(predictedTileRect);
       }
     }
+    startPrerenderTasks();
   }
 
   void display() {
@@ -320,24 +308,16 @@ public:
       displayTiles.removeAll();
     }
 
-    Tile* prerenderTile1 = nullptr;
-    Tile* prerenderTile2 = nullptr;
-    if (prerenderTile1_ && visibleTileRect_.contains(prerenderTile1_->location())) {
-      prerenderTile1 = std::exchange(prerenderTile1_, nullptr);
-    }
-    if (prerenderTile2_ && visibleTileRect_.contains(prerenderTile2_->location())) {
-      prerenderTile2 = std::exchange(prerenderTile2_, nullptr);
-    }
-    if (prerenderTile1 && prerenderTile2
-        && prerenderTile1StartTimestamp_ > prerenderTile2StartTimestamp_)
-    {
-      std::swap(prerenderTile1, prerenderTile2);
-    }
-    if (prerenderTile1) {
-      prerenderTile1->awaitTaskAndSetLayerImage();
-    }
-    if (prerenderTile2) {
-      prerenderTile2->awaitTaskAndSetLayerImage();
+    // prerenderTiles_ is ordered by the start time of the tasks, so we await the tasks that are
+    // most likely to have finished first.
+    Vector<Tile*, maxPrerenderTaskCountLimit> visiblePrerenderTiles;
+    prerenderTiles_.removeWhere([&](Tile* tile) {
+      if (!visibleTileRect_.contains(tile->location())) return false;
+      visiblePrerenderTiles.append(tile);
+      return true;
+    });
+    for (Tile* const tile : visiblePrerenderTiles) {
+      tile->awaitTaskAndSetLayerImage();
     }
 
     isDisplaying_ = false;
@@ -362,15 +342,6 @@ private:
 
   // MARK: - Size calculations
 
-  template <typename Int, EnableIf<isSignedInteger<Int>> = 0>
-  static STU_INLINE Int sub_saturated(Int a, Int b) {
-    Int result;
-    if (STU_UNLIKELY(__builtin_sub_overflow(a, b, &result))) {
-      result = b > 0 ? minValue<Int> : maxValue<Int>;
-    }
-    return result;
-  }
-
   template <typename Int, EnableIf<isInteger<Int>> = 0>
   static STU_INLINE Int mul_positive_saturated(Int a, Int b) {
     STU_ASSUME(a >= 0);
@@ -445,14 +416,20 @@ private:
     bounds.x.end = bounds.x.start + width;
     bounds.y.end = bounds.y.start + height;
 
-    const Point<SInt> newCenter{bounds.x.start + width/2, bounds.y.start + height/2};
-    const Point<SInt> oldCenter{visibleBounds_.x.start + visibleBounds_.width()/2,
-                                 visibleBounds_.y.start + visibleBounds_.height()/2};
-
     sizeChanged |= bounds.size() != visibleBounds_.size();
     visibleBounds_ = bounds;
-    lastVisibleBoundsCenterDelta_ = Point{sub_saturated(newCenter.x, oldCenter.x),
-                                          sub_saturated(newCenter.y, oldCenter.y)};
+    if (sizeChanged) {
+      scrollMotion_.reset();
+    }
+    // We sample the scroll motion at the times the visible bounds observer registered the
+    // changes, not at the times of the layout passes, which can lag behind by varying amounts.
+    // If the observer registered no change, the visible bounds didn't move.
+    if (const CFTimeInterval changeTime = visibleBoundsObserver_.visibleBoundsChangeTime();
+        !scrollMotion_.hasSample || changeTime > scrollMotion_.timestamp)
+    {
+      scrollMotion_.addSample(Point{bounds.x.start + width/2., bounds.y.start + height/2.},
+                              changeTime);
+    }
     return sizeChanged;
   }
 
@@ -559,76 +536,146 @@ private:
     }
   }
 
-  Tile* __nullable getTileToPrerenderAt(SInt x, SInt y, bool swapXAndY) {
-    if (swapXAndY) {
-      std::swap(x, y);
-    }
-    Tile*& tile = tileAt(x, y);
+  // MARK: - Scroll motion prediction
+
+  /// How far ahead (in seconds) we predict the scroll motion: about 15 frames at 60 Hz.
+  static constexpr Float64 predictionHorizon = 0.25;
+
+  /// Slower motions are ignored.
+  static constexpr Float64 minPredictionVelocity = 30;
+
+  /// The predicted area extends at least this fraction of the visible length beyond the visible
+  /// bounds in the direction of the motion...
+  static constexpr Float64 minLookaheadFactor = 0.5;
+  /// ... and at most this multiple, which keeps the predicted area inside the tile rect.
+  /// (The tile rect extends 2 screen lengths beyond the visible bounds.)
+  static constexpr Float64 maxLookaheadFactor = 1.5;
+
+  /// The prerendered images of the non-visible tiles in the predicted area must not use more
+  /// memory than the visible area of a full screen in the layer's image format would.
+  UInt prerenderMemoryBudget() const {
+    return UInt{sign_cast(screenSize_.width)}*sign_cast(screenSize_.height)*bytesPerPixel();
+  }
+
+  UInt bytesPerPixel() const {
+    return stuCGImageFormat(imageFormat_, STUCGImageFormatOptionsNone).bitsPerPixel/8;
+  }
+
+  /// The tiles that the visible bounds are predicted to sweep over within the prediction horizon
+  /// (including the currently visible tiles).
+  Rect<SInt> predictedTileRect() const {
+    if (!scrollMotion_.hasVelocity || tileRect_.isEmpty()
+        // A motion without recent samples has stopped.
+        || !(CACurrentMediaTime() - scrollMotion_.timestamp <= ScrollMotion::maxSampleInterval))
+    {
+      return Rect<SInt>{};
+    }
+    Rect<SInt> bounds = visibleBounds_.clampedTo({{}, size_});
+    if (bounds.isEmpty()) return Rect<SInt>{};
+    bool isMoving = false;
+    const auto extend = [&](Range<SInt>& range, SInt length, const AxisMotion& motion) {
+      if (abs(motion.velocity) < minPredictionVelocity) return;
+      isMoving = true;
+      const Float64 visibleLength = range.end - range.start;
+      const Float64 d = clamp(minLookaheadFactor*visibleLength,
+                              abs(motion.predictedDisplacement(predictionHorizon)),
+                              maxLookaheadFactor*visibleLength);
+      if (motion.velocity > 0) {
+        range.end = static_cast<SInt>(min(Float64(length), ceil(range.end + d)));
+      } else {
+        range.start = static_cast<SInt>(max(0., floor(range.start - d)));
+      }
+    };
+    extend(bounds.x, size_.width, scrollMotion_.x);
+    extend(bounds.y, size_.height, scrollMotion_.y);
+    if (!isMoving) return Rect<SInt>{};
+    Rect<SInt> tileRect = tileRectOverlappingNonNegativeBounds(bounds, tileSize_);
+    tileRect.intersect(tileRect_);
+    return tileRect;
+  }
+
+  /// The maximum number of concurrently running prerender tasks of a single tiled layer.
+  static constexpr Int maxPrerenderTaskCountLimit = 4;
+
+  static Int maxPrerenderTaskCount() {
+    STU_STATIC_CONST_ONCE(Int, value,
+                          clamp(1,
+                                sign_cast(NSProcessInfo.processInfo.activeProcessorCount) - 1,
+                                maxPrerenderTaskCountLimit));
+    return value;
+  }
+
+  Tile* __nullable getTileToPrerenderAt(Point<SInt> location) {
+    Tile*& tile = tileAt(location.x, location.y);
     if (!tile) {
-      tile = getSpareTileOrCreateOne(Point{x, y});
-    } else if (tile->hasLayer() || tile->tryMakeNonPurgeableUntilNextCGImageIsCreated()) {
+      // The new tile may have a retained image.
+      tile = getSpareTileOrCreateOne(location);
+    }
+    if (tile->hasLayer() || tile->tryMakeNonPurgeableUntilNextCGImageIsCreated()) {
       return nullptr;
     }
     return tile;
   }
 
-  /// The sign of dx and dy indicate the respective scroll direction.
+  /// Starts prerender tasks for the tiles in `predictedTileRect_` that don't have an image yet,
+  /// in the order in which they are expected to become visible, until the task limit or the memory
+  /// budget is reached.
   STU_NO_INLINE
-  Tile* findTileToPrerender(Range<SInt> visibleX, Range<SInt> prerenderX, SInt dx,
-                            Range<SInt> visibleY, Range<SInt> prerenderY, SInt dy,
-                            bool swapXAndY)
-  {
-    // This implementation is slightly obfuscated, because we want to reduce code size by having
-    // only a single nested loop and only calling the loop body in one place.
-    STU_DEBUG_ASSERT(!visibleX.isEmpty());
-    STU_DEBUG_ASSERT(!visibleY.isEmpty());
-    STU_DEBUG_ASSERT(prerenderX.contains(visibleX));
-    STU_DEBUG_ASSERT(prerenderY.contains(visibleY));
-    STU_DEBUG_ASSERT(dy != 0);
-    SInt y0, y1, yd;
-    // The outer loop iterates over y:
-    //   y0, y0 + yd, y0 + 2*yd, ..., y1 - yd
-    if (dy > 0) {
-      yd = 1;
-      y0 = visibleY.end;
-      y1 = prerenderY.end;
-    } else { // dy < 0
-      yd = -1;
-      y0 = visibleY.start - 1;
-      y1 = prerenderY.start - 1;
-    }
-    // The inner loop iterates over x in two parts:
-    //   x0, x0 + xd, x0 + 2*xd, ..., x1 - xd
-    //   And if x1 != x2:
-    //     x0 - xd, x0 - 2*xd, ..., x2 + xd
-    SInt x0, x1, x2, xd;
-    if (dx >= 0) {
-      xd = -1;
-      x0 = visibleX.end - 1;
-      x1 = visibleX.start - 1;
-      x2 = dx == 0 ? x1 : prerenderX.end;
-    } else { // dx < 0
-      xd = 1;
-      x0 = visibleX.start;
-      x1 = visibleX.end;
-      x2 = prerenderX.start - 1;
-    }
-    for (SInt y = y0; y != y1; y += yd) {
-      for (SInt x = x0, d = xd, xEnd = x1;;) {
-        if (Tile* const tile = getTileToPrerenderAt(x, y, swapXAndY)) {
-          return tile;
-        }
-        x += d;
-        if (x == xEnd) {
-          if (xEnd == x2) break;
-          d = -d;
-          x = x0 + d;
-          xEnd = x2;
-          if (x == xEnd) break;
-        }
+  void startPrerenderTasks() {
+    if (predictedTilesArePrerendered_ || predictedTileRect_.isEmpty()) return;
+    for (Int i = prerenderTiles_.count() - 1; i >= 0; --i) {
+      discard(isTileUsedByTask(*prerenderTiles_[i])); // Removes the tile if the task has finished.
+    }
+    const Int maxTaskCount = maxPrerenderTaskCount();
+    if (prerenderTiles_.count() >= maxTaskCount) return;
+
+    struct Candidate {
+      Point<SInt> location;
+      /// The distance in pixels between the tile and the visible bounds.
+      SInt distance;
+      UInt imageByteCount;
+    };
+    Vector<Candidate, 16> candidates;
+    const Rect<SInt> bounds = visibleBounds_.clampedTo({{}, size_});
+    const UInt bytesPerPixel = this->bytesPerPixel();
+    forEachTileIn(predictedTileRect_, [&](Point<SInt> location, Tile*& tile) {
+      if (visibleTileRect_.contains(location) || (tile && tile->hasLayer())) return;
+      const SInt x = location.x*tileSize_.width;
+      const SInt y = location.y*tileSize_.height;
+      const SInt dx = max(0, x - bounds.x.end, bounds.x.start - (x + tileSize_.width));
+      const SInt dy = max(0, y - bounds.y.end, bounds.y.start - (y + tileSize_.height));
+      const UInt width = sign_cast(min(tileSize_.width, size_.width - x));
+      const UInt height = sign_cast(min(tileSize_.height, size_.height - y));
+      candidates.append(Candidate{location, dx + dy, width*height*bytesPerPixel});
+    });
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.distance < b.distance; });
+    // The budget also covers the tiles that already have a prerendered image or task.
+    const UInt memoryBudget = prerenderMemoryBudget();
+    UInt byteCount = 0;
+    for (const Candidate& candidate : candidates) {
+      if (byteCount > 0 && candidate.imageByteCount > memoryBudget - byteCount) break;
+      byteCount += candidate.imageByteCount;
+      if (prerenderTiles_.count() == maxTaskCount) return;
+      Tile* const tile = getTileToPrerenderAt(candidate.location);
+      if (!tile) continue;
+      prerenderTiles_.append(tile);
+      tile->startPrerenderTask(displayScale_, inverseDisplayScale_, imageFormat_, drawingBlock_);
+    }
+    predictedTilesArePrerendered_ = true;
+  }
+
+  /// Cancels the prerender tasks for tiles that are no longer predicted to become visible.
+  void cancelPrerenderTasksOutside(Rect<SInt> rect) {
+    for (Int i = prerenderTiles_.count() - 1; i >= 0; --i) {
+      Tile& tile = *prerenderTiles_[i];
+      const Point<SInt> location = tile.location();
+      if (rect.contains(location) || visibleTileRect_.contains(location)) continue;
+      if (!isTileUsedByTask(tile)) continue;
+      if (abandonTileIfUsedByTaskElseMakeItPurgeableOrDeleteIt(tile, false)) {
+        tileAt(location.x, location.y) = nullptr;
       }
     }
-    return nullptr;
   }
 
   // MARK: - Tile helpers
@@ -642,6 +689,8 @@ private:
     frame.y.end = min(frame.y.end, size_.height);
     STU_DEBUG_ASSERT(!frame.isEmpty());
     tile->frame_ = frame;
+    STU_DEBUG_ASSERT(!tile->image_);
+    tile->image_ = takeRetainedTileImage(frame);
     return tile;
   }
 
@@ -686,12 +735,7 @@ private:
   [[nodiscard]]
   bool abandonTileIfUsedByTaskElseMakeItPurgeableOrDeleteIt(Tile& tile, bool deleteImage) {
     if (tile.task_) {
-      if (prerenderTile1_ == &tile) {
-        prerenderTile1_ = nullptr;
-      } else {
-        STU_ASSERT(prerenderTile2_ == &tile);
-        prerenderTile2_ = nullptr;
-      }
+      removePrerenderTile(tile);
       if (tile.isUsedByTask()) {
         removeTileLayer(tile);
       }
@@ -702,23 +746,31 @@ private:
   bool isTileUsedByTask(Tile& tile) {
     if (!tile.task_) return false;
     if (tile.isUsedByTask()) return true;
-    if (prerenderTile1_ == &tile) {
-      prerenderTile1_ = nullptr;
-    } else {
-      STU_ASSERT(prerenderTile2_ == &tile);
-      prerenderTile2_ = nullptr;
-    }
+    removePrerenderTile(tile);
     return false;
   }
 
+  void removePrerenderTile(Tile& tile) {
+    for (Int i = 0; i < prerenderTiles_.count(); ++i) {
+      if (prerenderTiles_[i] != &tile) continue;
+      prerenderTiles_.removeRange({i, i + 1});
+      return;
+    }
+    STU_ASSERT(false && "tile not found");
+  }
+
   // MARK: - Changing the current tile rect
 
+  /// Also removes the retained images of the tiles, since this is called when the content changes.
   void removeAllTiles() {
+    removeRetainedTileImages();
     if (!tiles_.isEmpty()) return
-    setTileRect({tileRect_.origin(), Size<SInt>{}});
+    setTileRect({tileRect_.origin(), Size<SInt>{}}, RetainImages{false});
   }
 
-  void setTileRect(Rect<SInt> newRect) {
+  struct RetainImages : Parameter<RetainImages> { using Parameter::Parameter; };
+
+  void setTileRect(Rect<SInt> newRect, RetainImages retainImages = RetainImages{true}) {
     if (newRect == tileRect_) return;
     newRect.x.end = max(newRect.x.start, newRect.x.end);
     newRect.y.end = max(newRect.y.start, newRect.y.end);
@@ -732,6 +784,9 @@ private:
       if (!tile) return;
       if (newRect.contains(location)) return;
       removeTileLayer(*tile);
+      if (retainImages && !isTileUsedByTask(*tile)) {
+        retainTileImage(*tile);
+      }
       if (!abandonTileIfUsedByTaskElseMakeItPurgeableOrDeleteIt(*tile, true)) {
         STU_DEBUG_ASSERT(!tile->layerHasImage());
         spareTiles_.append(tile);
@@ -767,6 +822,8 @@ private:
     tileColumnCount_ = newColumnCount;
     keepLayerTileRect_.intersect(newRect);
     prerenderTileRect_.intersect(newRect);
+    predictedTileRect_.intersect(newRect);
+    predictedTilesArePrerendered_ = false;
     visibleTileRect_.intersect(newRect);
   }
 
@@ -851,8 +908,7 @@ private:
       }
       tile = nullptr;
     }
-    prerenderTile1_ = nullptr;
-    prerenderTile2_ = nullptr;
+    prerenderTiles_.removeAll();
     // Create new new Tiles.
     tempTileVector_.removeAll();
     tempTileVector_.ensureFreeCapacity(newTileCount);
@@ -915,6 +971,8 @@ private:
     visibleTileRect_ = Rect<SInt>{tileRect_.origin(), Size<SInt>{}};
     prerenderTileRect_ = visibleTileRect_;
     keepLayerTileRect_ = visibleTileRect_;
+    predictedTileRect_ = visibleTileRect_;
+    predictedTilesArePrerendered_ = false;
   }
 
   // MARK: - Tile
@@ -939,6 +997,7 @@ private:
     RC<CGImage> tempCGImage_;
 
     friend Tile* TiledLayer::getSpareTileOrCreateOne(Point<SInt>);
+    friend void TiledLayer::retainTileImage(Tile&);
     friend void TiledLayer::removeTileLayer(Tile&);
     friend void TiledLayer::insertTileLayer(Tile&);
     friend bool TiledLayer::isTileUsedByTask(Tile&);
@@ -1122,11 +1181,94 @@ private:
 
   STU_NO_INLINE
   static void releaseMemoryOfAllTiledLayers() {
+    stu_mutex_lock(&tileImageCacheMutex);
+    tileImageCache().removeAll();
+    stu_mutex_unlock(&tileImageCacheMutex);
     forAllTiledLayers([](TiledLayer& layer){
       layer.releaseMemory();
     });
   }
 
+  // MARK: - Retained tile images
+
+  // When tiles are removed from the tile rect of a tiled layer, their images are kept in an LRU
+  // cache shared by all tiled layers, so that scrolling back to previously displayed content
+  // doesn't require rendering the tiles again. The images are purgeable while they are in the
+  // cache. The cache is guarded by tileImageCacheMutex, so that the memory budget can be accessed
+  // from any thread.
+
+  static TileImageCache& tileImageCache() {
+    static TileImageCache* const cache = new TileImageCache{32 << 20};
+    return *cache;
+  }
+
+public:
+  static UInt retainedTileImagesMemoryBudget() {
+    stu_mutex_lock(&tileImageCacheMutex);
+    const UInt budget = tileImageCache().memoryBudget();
+    stu_mutex_unlock(&tileImageCacheMutex);
+    return budget;
+  }
+
+  static void setRetainedTileImagesMemoryBudget(UInt budget) {
+    stu_mutex_lock(&tileImageCacheMutex);
+    tileImageCache().setMemoryBudget(budget);
+    stu_mutex_unlock(&tileImageCacheMutex);
+  }
+
+  /// Only used for testing.
+  static UInt retainedTileImagesByteCount() {
+    stu_mutex_lock(&tileImageCacheMutex);
+    const UInt byteCount = tileImageCache().byteCount();
+    stu_mutex_unlock(&tileImageCacheMutex);
+    return byteCount;
+  }
+
+  /// Only used for testing.
+  void retainBlankTileImage(Rect<SInt> frame) {
+    STU_ASSERT(is_main_thread());
+    PurgeableImage image{SizeInPixels{Size<UInt32>{frame.size()}}, -1, nil, imageFormat_,
+                         STUCGImageFormatOptionsNone, [](CGContext*) {}};
+    const UInt byteCount = imageByteCount(image);
+    insertRetainedTileImage(frame, std::move(image), byteCount);
+  }
+
+private:
+  /// The key for the retained images of this layer in the tile image cache.
+  const void* tileImageCacheKey() const { return (__bridge const void*)self; }
+
+  void insertRetainedTileImage(Rect<SInt> frame, PurgeableImage&& image, UInt byteCount) {
+    stu_mutex_lock(&tileImageCacheMutex);
+    tileImageCache().insert(tileImageCacheKey(), frame, std::move(image), byteCount);
+    stu_mutex_unlock(&tileImageCacheMutex);
+  }
+
+  PurgeableImage takeRetainedTileImage(Rect<SInt> frame) {
+    stu_mutex_lock(&tileImageCacheMutex);
+    PurgeableImage image = tileImageCache().take(tileImageCacheKey(), frame);
+    stu_mutex_unlock(&tileImageCacheMutex);
+    return image;
+  }
+
+  void removeRetainedTileImages() {
+    stu_mutex_lock(&tileImageCacheMutex);
+    tileImageCache().removeAll(tileImageCacheKey());
+    stu_mutex_unlock(&tileImageCacheMutex);
+  }
+
+  /// Moves the image of the tile into the cache (if it has one and it isn't too large).
+  void retainTileImage(Tile& tile) {
+    STU_DEBUG_ASSERT(!tile.task_);
+    if (!tile.image_) return;
+    const UInt byteCount = imageByteCount(tile.image_);
+    insertRetainedTileImage(tile.frame_, std::move(tile.image_), byteCount);
+  }
+
+  UInt imageByteCount(const PurgeableImage& image) const {
+    const Size<UInt32> size = image.sizeInPixels();
+    return UInt{size.width}*size.height*bytesPerPixel();
+  }
+
   void releaseMemory() {
     if (!visibleBoundsObserver_.screen()) {
       removeAllTiles();
@@ -1204,7 +1346,7 @@ private:
 public:
   ~TiledLayer() {
     deregisterTiledLayer(*this);
-    removeAllTiles();
+    removeAllTiles(); // Also removes the retained tile images.
     STU_DEBUG_ASSERT(tiles_.isEmpty());
     removeSpareTiles();
   }
@@ -1223,10 +1365,7 @@ private:
   bool contentsScaleChanged_ : 1;
   STUPredefinedCGImageFormat imageFormat_{STUPredefinedCGImageFormatRGB};
 
-  enum PrerenderSectorIndex {
-    bottomSectorIndex = 0, topSectorIndex, rightSectorIndex, leftSectorIndex
-  };
-  bool sectorPrerendered_[4];
+  bool predictedTilesArePrerendered_;
 
   CGFloat contentsScale_{1};
   CGFloat screenScale_; ///< Updated by layout().
@@ -1240,18 +1379,17 @@ private:
   Size<SInt> screenSize_; ///< The screen size in pixels.
   Size<SInt> tileSize_; ///< The maximum tile size in pixels.
   Rect<SInt> visibleBounds_; ///< The visible bounds in pixels. NOT clamped to Rect{{}, size_}.
-  Point<SInt> lastVisibleBoundsCenterDelta_;
+  ScrollMotion scrollMotion_;
 
   Rect<SInt> tileRect_;
   SInt tileColumnCount_;
   Rect<SInt> keepLayerTileRect_;
   Rect<SInt> prerenderTileRect_;
   Rect<SInt> visibleTileRect_;
+  Rect<SInt> predictedTileRect_;
 
-  Tile* prerenderTile1_;
-  CFTimeInterval prerenderTile1StartTimestamp_;
-  Tile* prerenderTile2_;
-  CFTimeInterval prerenderTile2StartTimestamp_;
+  /// The tiles with prerender tasks, ordered by the start time of the tasks.
+  Vector<Tile*, maxPrerenderTaskCountLimit> prerenderTiles_;
 
   LayerVisibleBoundsObserver visibleBoundsObserver_;
 
@@ -1317,6 +1455,13 @@ using namespace stu_label;
   impl.setImageFormat(imageFormat);
 }
 
++ (size_t)retainedTileImagesMemoryBudget {
+  return TiledLayer::retainedTileImagesMemoryBudget();
+}
++ (void)setRetainedTileImagesMemoryBudget:(size_t)memoryBudget {
+  TiledLayer::setRetainedTileImagesMemoryBudget(memoryBudget);
+}
+
 - (void)setContentsFormat:(NSString* __unsafe_unretained)contentsFormat {
   [super setContentsFormat:contentsFormat];
   impl.setImageFormat(contentsImageFormat(contentsFormat, STUPredefinedCGImageFormatRGB));
@@ -1345,3 +1490,16 @@ using namespace stu_label;
 }
 
 @end
+
+@implementation STULabelTiledLayer (Testing)
+
++ (size_t)retainedTileImagesByteCount {
+  return TiledLayer::retainedTileImagesByteCount();
+}
+
+- (void)retainBlankTileImageWithFrame:(CGRect)frame {
+  impl.retainBlankTileImage(Rect{Range{Int32(frame.origin.x), Int32(CGRectGetMaxX(frame))},
+                                 Range{Int32(frame.origin.y), Int32(CGRectGetMaxY(frame))}});
+}
+
+@end
@@ -0,0 +1,83 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Rect.hpp"
+
+namespace stu_label {
+
+/// Estimates the scroll velocity and acceleration along one axis from successive position
+/// samples.
+struct AxisMotion {
+  Float64 position;
+  Float64 velocity; ///< In pixels per second.
+  Float64 acceleration; ///< In pixels per second squared.
+
+  /// The weights of the prediction error of a new sample in the updated estimates.
+  static constexpr Float64 velocitySmoothing = 0.5;
+  static constexpr Float64 accelerationSmoothing = 0.25;
+
+  /// Updates the estimates with an alpha-beta filter, which, unlike plain exponential smoothing,
+  /// doesn't lag behind a constantly accelerating motion.
+  void update(Float64 newPosition, Float64 dt, bool hasVelocity) {
+    // The average velocity since the last sample, i.e. the velocity at the midpoint of the
+    // interval if the acceleration is constant.
+    const Float64 sampleVelocity = (newPosition - position)/dt;
+    if (hasVelocity) {
+      const Float64 error = sampleVelocity - (velocity + acceleration*(dt/2));
+      velocity += acceleration*dt + velocitySmoothing*error;
+      acceleration += accelerationSmoothing*error/dt;
+    } else {
+      velocity = sampleVelocity;
+      acceleration = 0;
+    }
+    position = newPosition;
+  }
+
+  /// The predicted displacement after `t` seconds. If the acceleration would reverse the
+  /// direction of the motion within that time, the distance until the motion stops is returned
+  /// instead, since a decelerating scroll view comes to a stop instead of turning around.
+  Float64 predictedDisplacement(Float64 t) const {
+    if (velocity*(velocity + acceleration*t) < 0) {
+      return -velocity*velocity/(2*acceleration);
+    }
+    return (velocity + acceleration*(t/2))*t;
+  }
+};
+
+/// Estimates the 2D scroll motion from timestamped samples of the center of the visible bounds.
+struct ScrollMotion {
+  /// Samples further apart than this interval (in seconds) are considered to belong to
+  /// different scroll motions.
+  static constexpr CFTimeInterval maxSampleInterval = 0.1;
+  /// Samples taken shortly after each other (e.g. within the same frame) don't yield useful
+  /// velocity estimates.
+  static constexpr CFTimeInterval minSampleInterval = 0.004;
+
+  AxisMotion x;
+  AxisMotion y;
+  CFTimeInterval timestamp;
+  bool hasSample;
+  bool hasVelocity;
+
+  void reset() {
+    hasSample = false;
+    hasVelocity = false;
+  }
+
+  void addSample(Point<Float64> center, CFTimeInterval newTimestamp) {
+    const CFTimeInterval dt = newTimestamp - timestamp;
+    if (!hasSample || !(dt <= maxSampleInterval)) {
+      x = AxisMotion{.position = center.x};
+      y = AxisMotion{.position = center.y};
+      hasSample = true;
+      hasVelocity = false;
+    } else {
+      if (dt < minSampleInterval) return;
+      x.update(center.x, dt, hasVelocity);
+      y.update(center.y, dt, hasVelocity);
+      hasVelocity = true;
+    }
+    timestamp = newTimestamp;
+  }
+};
+
+} // namespace stu_label
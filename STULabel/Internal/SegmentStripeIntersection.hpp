@@ -0,0 +1,249 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#pragma once
+
+#include "stu/Range.hpp"
+
+#include <cmath>
+
+// This header only depends on the portable stu headers, so that the intersection code can be
+// compiled, tested and benchmarked independently of Core Graphics.
+
+namespace stu_label {
+
+/// A line or Bézier curve segment of a path.
+struct StripeIntersectionSegment {
+  /// 1 for a line, 2 for a quadratic curve and 3 for a cubic curve.
+  stu::Int32 degree;
+  /// The control points. The points after the first `degree + 1` points equal the end point,
+  /// so that the bounding box of the control points can be computed without branching.
+  stu::Float64 x[4];
+  stu::Float64 y[4];
+
+  static StripeIntersectionSegment line(stu::Float64 x0, stu::Float64 y0,
+                                        stu::Float64 x1, stu::Float64 y1)
+  {
+    return {1, {x0, x1, x1, x1}, {y0, y1, y1, y1}};
+  }
+
+  static StripeIntersectionSegment quadraticCurve(stu::Float64 x0, stu::Float64 y0,
+                                                  stu::Float64 x1, stu::Float64 y1,
+                                                  stu::Float64 x2, stu::Float64 y2)
+  {
+    return {2, {x0, x1, x2, x2}, {y0, y1, y2, y2}};
+  }
+
+  static StripeIntersectionSegment cubicCurve(stu::Float64 x0, stu::Float64 y0,
+                                              stu::Float64 x1, stu::Float64 y1,
+                                              stu::Float64 x2, stu::Float64 y2,
+                                              stu::Float64 x3, stu::Float64 y3)
+  {
+    return {3, {x0, x1, x2, x3}, {y0, y1, y2, y3}};
+  }
+};
+
+struct StripeXBounds {
+  stu::Range<stu::Float64> lower;
+  stu::Range<stu::Float64> upper;
+};
+
+namespace detail {
+
+/// The coefficients of a polynomial a*t³ + b*t² + c*t + d.
+struct CubicPolynomial {
+  stu::Float64 a, b, c, d;
+
+  STU_INLINE
+  stu::Float64 operator()(stu::Float64 t) const { return ((a*t + b)*t + c)*t + d; }
+
+  STU_INLINE
+  static CubicPolynomial forSegment(stu::Int32 degree, const stu::Float64 (& p)[4]) {
+    switch (degree) {
+    case 1:
+      return {0, 0, p[1] - p[0], p[0]};
+    case 2:
+      return {0, p[0] - 2*p[1] + p[2], 2*(p[1] - p[0]), p[0]};
+    default:
+      return {-p[0] + 3*(p[1] - p[2]) + p[3], 3*(p[0] - 2*p[1] + p[2]), 3*(p[1] - p[0]), p[0]};
+    }
+  }
+};
+
+/// Roots with a distance of less than this value from the unit interval are clamped to it.
+constexpr stu::Float64 unitIntervalRootTolerance = 1e-9;
+
+STU_INLINE
+void addRootIfInUnitInterval(stu::Float64 t, stu::Float64* roots, stu::Int& count) {
+  if (t >= -unitIntervalRootTolerance && t <= 1 + unitIntervalRootTolerance) {
+    roots[count++] = stu::max(0.0, stu::min(t, 1.0));
+  }
+}
+
+/// Writes the real roots of a*t² + b*t + c in the unit interval into the roots array and returns
+/// the number of roots. Returns 0 if all coefficients are zero.
+inline stu::Int solveQuadraticInUnitInterval(stu::Float64 a, stu::Float64 b, stu::Float64 c,
+                                             stu::Float64* roots)
+{
+  stu::Int count = 0;
+  if (a == 0) {
+    if (b != 0) {
+      addRootIfInUnitInterval(-c/b, roots, count);
+    }
+    return count;
+  }
+  stu::Float64 discriminant = b*b - 4*a*c;
+  if (discriminant < 0) {
+    // Treat slightly negative discriminants caused by rounding errors as zero.
+    if (discriminant < -1e-12*b*b) return 0;
+    discriminant = 0;
+  }
+  // Numerically stable variant of the quadratic formula.
+  const stu::Float64 q = -(b + std::copysign(std::sqrt(discriminant), b))/2;
+  if (q == 0) { // b == 0 && c == 0
+    addRootIfInUnitInterval(0, roots, count);
+    return count;
+  }
+  addRootIfInUnitInterval(q/a, roots, count);
+  addRootIfInUnitInterval(c/q, roots, count);
+  return count;
+}
+
+/// Writes the real roots of the polynomial in the unit interval into the roots array and returns
+/// the number of roots. Returns 0 if all coefficients are zero.
+inline stu::Int solveCubicInUnitInterval(const CubicPolynomial& p, stu::Float64* roots) {
+  const stu::Float64 scale = stu::max(std::abs(p.b), std::abs(p.c), std::abs(p.d));
+  // For nearly degenerate cubic polynomials the normalized coefficients below would overflow or
+  // be very imprecise.
+  if (std::abs(p.a) <= 1e-9*scale) {
+    return solveQuadraticInUnitInterval(p.b, p.c, p.d, roots);
+  }
+  // See e.g. section 5.6 in Numerical Recipes, 3rd edition.
+  const stu::Float64 A = p.b/p.a;
+  const stu::Float64 B = p.c/p.a;
+  const stu::Float64 C = p.d/p.a;
+  const stu::Float64 Q = (A*A - 3*B)/9;
+  const stu::Float64 R = (2*A*A*A - 9*A*B + 27*C)/54;
+  const stu::Float64 Q3 = Q*Q*Q;
+  stu::Float64 ts[3];
+  stu::Int n;
+  if (R*R < Q3) {
+    const stu::Float64 theta = std::acos(R/std::sqrt(Q3));
+    const stu::Float64 m = -2*std::sqrt(Q);
+    constexpr stu::Float64 twoPi = 2*M_PI;
+    ts[0] = m*std::cos(theta/3) - A/3;
+    ts[1] = m*std::cos((theta + twoPi)/3) - A/3;
+    ts[2] = m*std::cos((theta - twoPi)/3) - A/3;
+    n = 3;
+  } else {
+    const stu::Float64 u = -std::copysign(std::cbrt(std::abs(R) + std::sqrt(R*R - Q3)), R);
+    const stu::Float64 v = u == 0 ? 0 : Q/u;
+    ts[0] = (u + v) - A/3;
+    n = 1;
+  }
+  stu::Int count = 0;
+  for (stu::Int i = 0; i < n; ++i) {
+    // Polish the root with a Newton step.
+    stu::Float64 t = ts[i];
+    const stu::Float64 derivative = (3*p.a*t + 2*p.b)*t + p.c;
+    if (derivative != 0) {
+      t -= p(t)/derivative;
+    }
+    addRootIfInUnitInterval(t, roots, count);
+  }
+  return count;
+}
+
+STU_INLINE
+bool yBoundsOverlap(const StripeIntersectionSegment& s, stu::Range<stu::Float64> y) {
+  const stu::Float64 minY = stu::min(stu::min(s.y[0], s.y[1]), stu::min(s.y[2], s.y[3]));
+  const stu::Float64 maxY = stu::max(stu::max(s.y[0], s.y[1]), stu::max(s.y[2], s.y[3]));
+  return (minY <= y.end) & (maxY >= y.start);
+}
+
+/// Extends `xi` by the x-bounds of the parts of the segment within the stripe.
+inline void addSegment(const StripeIntersectionSegment& s, stu::Range<stu::Float64> stripeY,
+                       stu::Range<stu::Float64>& xi)
+{
+  if (!yBoundsOverlap(s, stripeY)) return;
+  const stu::Float64 minX = stu::min(stu::min(s.x[0], s.x[1]), stu::min(s.x[2], s.x[3]));
+  const stu::Float64 maxX = stu::max(stu::max(s.x[0], s.x[1]), stu::max(s.x[2], s.x[3]));
+  // The segment lies within the convex hull of its control points.
+  if (xi.start <= minX && maxX <= xi.end) return;
+
+  const CubicPolynomial x = CubicPolynomial::forSegment(s.degree, s.x);
+  const CubicPolynomial y = CubicPolynomial::forSegment(s.degree, s.y);
+
+  const auto include = [&](stu::Float64 t) STU_INLINE_LAMBDA {
+    const stu::Float64 value = x(t);
+    xi.start = stu::min(xi.start, value);
+    xi.end = stu::max(xi.end, value);
+  };
+  const auto includeIfInStripe = [&](stu::Float64 t) STU_INLINE_LAMBDA {
+    const stu::Float64 value = y(t);
+    if (stripeY.start <= value && value <= stripeY.end) {
+      include(t);
+    }
+  };
+
+  // The minimum and maximum of x(t) on the set {t ∈ [0, 1] | y(t) ∈ stripeY} are attained either
+  // at the boundary points of the set, i.e. at t = 0, t = 1 or at a t where the curve crosses one
+  // of the stripe's boundary lines, or at a local extremum of x(t).
+  includeIfInStripe(0);
+  includeIfInStripe(1);
+  stu::Float64 roots[3];
+  for (const stu::Float64 boundaryY : {stripeY.start, stripeY.end}) {
+    const stu::Int n = solveCubicInUnitInterval({y.a, y.b, y.c, y.d - boundaryY}, roots);
+    for (stu::Int i = 0; i < n; ++i) {
+      include(roots[i]);
+    }
+  }
+  if (s.degree > 1) {
+    const stu::Int n = solveQuadraticInUnitInterval(3*x.a, 2*x.b, x.c, roots);
+    for (stu::Int i = 0; i < n; ++i) {
+      includeIfInStripe(roots[i]);
+    }
+  }
+}
+
+} // namespace detail
+
+/// @brief Finds the x-axis bounds of the parts of the path segments that lie within one or two
+///        horizontal stripes.
+///
+/// The intersections of the segments with the stripe boundaries are calculated analytically.
+/// The segments are processed in blocks: the bounding box rejection test for all segments in a
+/// block is branch-free, so that it can be vectorized.
+///
+/// @param upperY
+///   If this interval has the same start value as `lowerY`, it is ignored and the returned upper
+///   interval will always be empty.
+///
+/// @pre `lowerY.start <= upperY.start && lowerY.end <= upperY.end`
+inline StripeXBounds findXBoundsOfSegmentsWithinHorizontalStripes(
+                       const StripeIntersectionSegment* segments, stu::Int count,
+                       stu::Range<stu::Float64> lowerY, stu::Range<stu::Float64> upperY)
+{
+  StripeXBounds result = {stu::Range<stu::Float64>::infinitelyEmpty(),
+                          stu::Range<stu::Float64>::infinitelyEmpty()};
+  const bool hasUpperStripe = lowerY.start != upperY.start;
+  const stu::Range<stu::Float64> y = {lowerY.start, upperY.end};
+  constexpr stu::Int blockSize = 8;
+  for (stu::Int i0 = 0; i0 < count; i0 += blockSize) {
+    const StripeIntersectionSegment* const block = segments + i0;
+    const stu::Int n = stu::min(blockSize, count - i0);
+    bool overlaps[blockSize];
+    for (stu::Int i = 0; i < n; ++i) {
+      overlaps[i] = detail::yBoundsOverlap(block[i], y);
+    }
+    for (stu::Int i = 0; i < n; ++i) {
+      if (!overlaps[i]) continue;
+      detail::addSegment(block[i], lowerY, result.lower);
+      if (hasUpperStripe) {
+        detail::addSegment(block[i], upperY, result.upper);
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace stu_label
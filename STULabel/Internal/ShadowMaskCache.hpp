@@ -0,0 +1,71 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Font.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// A global cache of blurred glyph run coverage masks that are used for drawing text shadows.
+///
+/// Core Graphics blurs the shadow of every glyph drawing call on the CPU, which for large blur
+/// radii can take longer than drawing the glyphs themselves. With this cache the shadow of a glyph
+/// run is rendered once as an 8-bit coverage mask that is blurred with three separable box blur
+/// passes (which approximate the Gaussian blur used by Core Graphics). The mask is then drawn with
+/// `CGContextDrawImage`, which paints the current fill color through the mask.
+///
+/// Entries are keyed by the graphics font, the font size, the display scale, the blur radius, the
+/// glyphs and their positions relative to the first glyph (quantized to quarter pixels
+/// horizontally and to whole pixels vertically). The shadow color is not part of the key, so that
+/// a mask can be reused when only the colors of the text change.
+///
+/// The cache is disabled by default and is enabled by setting a non-zero memory budget.
+class ShadowMaskCache {
+public:
+  struct Statistics {
+    UInt64 hitCount;
+    UInt64 missCount;
+    Int entryCount;
+    UInt memoryUsage;
+  };
+
+  /// Thread-safe.
+  static bool isEnabled();
+
+  /// Thread-safe.
+  static UInt memoryBudget();
+
+  /// Thread-safe.
+  static void setMemoryBudget(UInt memoryBudget);
+
+  /// Thread-safe.
+  static Statistics statistics();
+
+  /// Thread-safe.
+  static void clear();
+
+  /// Indicates whether `drawShadow` can be used for a run with the specified font and text matrix
+  /// in a context with the specified CTM.
+  static bool canDraw(CTFont* __nonnull font, const CachedFontInfo& fontInfo,
+                      const CGAffineTransform& textMatrix, const CGAffineTransform& ctm);
+
+  /// Draws the blurred shadow of the glyphs with the current fill color of the context.
+  /// Returns false without drawing anything if the shadow is too large for the cache.
+  ///
+  /// @param deviceOffset The shadow offset in device pixels.
+  /// @param deviceBlurRadius The shadow blur radius in device pixels.
+  ///
+  /// @pre `canDraw(font, fontInfo, textMatrix, ctm)`
+  /// @pre The context has no shadow.
+  ///
+  /// Thread-safe.
+  static bool drawShadow(CTFont* __nonnull font, ArrayRef<const CGGlyph> glyphs,
+                         const CGPoint* __nonnull positions,
+                         const CGAffineTransform& textMatrix, const CGAffineTransform& ctm,
+                         CGPoint deviceOffset, CGFloat deviceBlurRadius,
+                         CGContext* __nonnull context);
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -0,0 +1,425 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "ShadowMaskCache.hpp"
+
+#import "GlyphRasterCache.hpp"
+
+#import "STULabel/stu_mutex.h"
+
+#import "Hash.hpp"
+#import "LRUCacheStorage.hpp"
+#import "Rect.hpp"
+
+#include <atomic>
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// The number of horizontal subpixel positions per pixel.
+static constexpr Int subpixelPositionCount = 4;
+
+/// Shadows with larger masks are drawn directly with Core Graphics.
+static constexpr Int maxMaskPixelCount = 512*512;
+
+/// The approximate memory overhead of a CGImage and its data provider.
+static constexpr UInt imageOverheadCost = 256;
+
+namespace {
+
+struct ShadowMaskKey {
+  CGFont* cgFont;
+  Float32 fontSize;
+  Float32 scale;
+  Float32 blurRadius;
+  /// Triples of the glyph, the x-offset in quarter pixels and the y-offset in pixels from the
+  /// pixel containing the (quantized) position of the first glyph.
+  ArrayRef<const Int32> glyphData;
+
+  HashCode<UInt64> hash() const {
+    UInt64 h = stu_label::hash(reinterpret_cast<UInt64>(cgFont), fontSize, scale, blurRadius).value;
+    for (const Int32 value : glyphData) {
+      h = stu_label::hash(h, static_cast<UInt64>(value)).value;
+    }
+    return HashCode{h};
+  }
+
+  friend bool operator==(const ShadowMaskKey& lhs, const ShadowMaskKey& rhs) {
+    return lhs.cgFont == rhs.cgFont
+        && lhs.fontSize == rhs.fontSize
+        && lhs.scale == rhs.scale
+        && lhs.blurRadius == rhs.blurRadius
+        && lhs.glyphData.count() == rhs.glyphData.count()
+        && memcmp(lhs.glyphData.begin(), rhs.glyphData.begin(),
+                  sign_cast(lhs.glyphData.arraySizeInBytes())) == 0;
+  }
+};
+
+struct ShadowMask {
+  /// An 8-bit image mask (retained), or null if the glyphs have no ink.
+  CGImage* __nullable image;
+  /// The offset in pixels of the lower-left corner of the mask from the pixel containing the
+  /// position of the first glyph.
+  Int32 x;
+  Int32 y;
+  Int32 width;
+  Int32 height;
+};
+
+struct ShadowMaskCacheEntry {
+  ShadowMaskKey key; // The cgFont is retained and the glyphData is owned (malloc'd).
+  HashCode<UInt64> hashCode;
+  UInt64 lastUse;
+  UInt cost;
+  ShadowMask mask;
+
+  void release() {
+    CFRelease(key.cgFont);
+    free(const_cast<Int32*>(key.glyphData.begin()));
+    if (mask.image) {
+      CFRelease(mask.image);
+    }
+  }
+};
+
+using ShadowMaskCacheStorage = LRUCacheStorage<ShadowMaskCacheEntry>;
+
+} // namespace
+
+static stu_mutex shadowMaskCacheMutex = STU_MUTEX_INIT;
+static bool shadowMaskCacheIsInitialized = false;
+static std::atomic<UInt> shadowMaskCacheMemoryBudget{0};
+alignas(ShadowMaskCacheStorage)
+static Byte shadowMaskCacheStorage[sizeof(ShadowMaskCacheStorage)];
+
+/// Must be called while holding the shadowMaskCacheMutex.
+static ShadowMaskCacheStorage& shadowMaskCache() {
+  if (STU_UNLIKELY(!shadowMaskCacheIsInitialized)) {
+    shadowMaskCacheIsInitialized = true;
+    ShadowMaskCacheStorage& cache = *new (shadowMaskCacheStorage) ShadowMaskCacheStorage{64};
+
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearCacheBlock = ^(NSNotification*) {
+      stu_mutex_lock(&shadowMaskCacheMutex);
+      cache.clear();
+      stu_mutex_unlock(&shadowMaskCacheMutex);
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+  }
+  return reinterpret_cast<ShadowMaskCacheStorage&>(shadowMaskCacheStorage);
+}
+
+bool ShadowMaskCache::isEnabled() {
+  return shadowMaskCacheMemoryBudget.load(std::memory_order_relaxed) != 0;
+}
+
+UInt ShadowMaskCache::memoryBudget() {
+  return shadowMaskCacheMemoryBudget.load(std::memory_order_relaxed);
+}
+
+void ShadowMaskCache::setMemoryBudget(UInt memoryBudget) {
+  stu_mutex_lock(&shadowMaskCacheMutex);
+  shadowMaskCacheMemoryBudget.store(memoryBudget, std::memory_order_relaxed);
+  if (shadowMaskCacheIsInitialized) {
+    ShadowMaskCacheStorage& cache = shadowMaskCache();
+    if (memoryBudget == 0) {
+      cache.clear();
+    } else {
+      cache.evict(memoryBudget);
+    }
+  }
+  stu_mutex_unlock(&shadowMaskCacheMutex);
+}
+
+auto ShadowMaskCache::statistics() -> Statistics {
+  Statistics stats = {};
+  stu_mutex_lock(&shadowMaskCacheMutex);
+  if (shadowMaskCacheIsInitialized) {
+    const ShadowMaskCacheStorage& cache = shadowMaskCache();
+    stats = Statistics{.hitCount = cache.hitCount, .missCount = cache.missCount,
+                       .entryCount = cache.count(), .memoryUsage = cache.memoryUsage()};
+  }
+  stu_mutex_unlock(&shadowMaskCacheMutex);
+  return stats;
+}
+
+void ShadowMaskCache::clear() {
+  stu_mutex_lock(&shadowMaskCacheMutex);
+  if (shadowMaskCacheIsInitialized) {
+    ShadowMaskCacheStorage& cache = shadowMaskCache();
+    cache.clear();
+    cache.hitCount = 0;
+    cache.missCount = 0;
+  }
+  stu_mutex_unlock(&shadowMaskCacheMutex);
+}
+
+bool ShadowMaskCache::canDraw(CTFont* font, const CachedFontInfo& fontInfo,
+                              const CGAffineTransform& textMatrix, const CGAffineTransform& ctm)
+{
+  return GlyphRasterCache::canDraw(font, fontInfo, textMatrix, ctm);
+}
+
+/// Computes the radii of three box filters whose successive application approximates a Gaussian
+/// filter with the specified standard deviation (see P. Kovesi, "Fast Almost-Gaussian Filtering").
+static void boxBlurRadii(Float64 sigma, Int (& radii)[3]) {
+  constexpr Int n = 3;
+  if (!(sigma > 0.25)) {
+    radii[0] = radii[1] = radii[2] = 0;
+    return;
+  }
+  const Float64 idealWidth = std::sqrt(12*sigma*sigma/n + 1);
+  Int lowerWidth = static_cast<Int>(idealWidth);
+  if (lowerWidth%2 == 0) {
+    lowerWidth -= 1;
+  }
+  const Int upperWidth = lowerWidth + 2;
+  const Float64 idealM = (12*sigma*sigma - n*lowerWidth*lowerWidth - 4*n*lowerWidth - 3*n)
+                       /(-4*lowerWidth - 4);
+  const Int m = static_cast<Int>(nearbyint(idealM));
+  for (Int i = 0; i < n; ++i) {
+    radii[i] = ((i < m ? lowerWidth : upperWidth) - 1)/2;
+  }
+}
+
+/// Applies a box filter with the specified radius to the values, treating values outside the
+/// array as zero.
+static void boxBlur(const UInt8* __restrict src, UInt8* __restrict dst, Int count, Int radius) {
+  if (radius == 0) {
+    memcpy(dst, src, sign_cast(count));
+    return;
+  }
+  const Int width = 2*radius + 1;
+  Int sum = 0;
+  for (Int i = 0; i < min(radius + 1, count); ++i) {
+    sum += src[i];
+  }
+  for (Int i = 0; i < count; ++i) {
+    dst[i] = static_cast<UInt8>((sum + width/2)/width);
+    if (i + radius + 1 < count) {
+      sum += src[i + radius + 1];
+    }
+    if (i - radius >= 0) {
+      sum -= src[i - radius];
+    }
+  }
+}
+
+/// Blurs the 8-bit image in place with the three box filters, first horizontally, then vertically.
+static void blurImage(UInt8* data, Int width, Int height, Int bytesPerRow,
+                      const Int (& radii)[3])
+{
+  TempArray<UInt8> a{uninitialized, Count{max(width, height)}};
+  TempArray<UInt8> b{uninitialized, Count{max(width, height)}};
+  const auto blurLine = [&](Int count) STU_INLINE_LAMBDA {
+    boxBlur(a.begin(), b.begin(), count, radii[0]);
+    boxBlur(b.begin(), a.begin(), count, radii[1]);
+    boxBlur(a.begin(), b.begin(), count, radii[2]);
+  };
+  for (Int y = 0; y < height; ++y) {
+    UInt8* const row = data + y*bytesPerRow;
+    memcpy(a.begin(), row, sign_cast(width));
+    blurLine(width);
+    memcpy(row, b.begin(), sign_cast(width));
+  }
+  for (Int x = 0; x < width; ++x) {
+    for (Int y = 0; y < height; ++y) {
+      a[y] = data[y*bytesPerRow + x];
+    }
+    blurLine(height);
+    for (Int y = 0; y < height; ++y) {
+      data[y*bytesPerRow + x] = b[y];
+    }
+  }
+}
+
+/// Returns none if the shadow mask would be too large.
+static Optional<ShadowMask> renderShadowMask(CTFont* font, ArrayRef<const Int32> glyphData,
+                                             CGFloat scale, CGFloat blurRadius)
+{
+  const Int n = glyphData.count()/3;
+  TempArray<CGGlyph> glyphs{uninitialized, Count{n}};
+  TempArray<CGRect> glyphRects{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    glyphs[i] = static_cast<CGGlyph>(glyphData[3*i]);
+  }
+  CTFontGetBoundingRectsForGlyphs(font, kCTFontOrientationHorizontal, glyphs.begin(),
+                                  glyphRects.begin(), n);
+  Rect<CGFloat> bounds = Rect<CGFloat>::infinitelyEmpty();
+  for (Int i = 0; i < n; ++i) {
+    const Rect<CGFloat> r = glyphRects[i];
+    if (r.isEmpty()) continue;
+    const Point<CGFloat> p = {CGFloat(glyphData[3*i + 1])/subpixelPositionCount,
+                              CGFloat(glyphData[3*i + 2])};
+    bounds = bounds.convexHull(scale*r + p);
+  }
+  if (bounds.isEmpty()) {
+    return ShadowMask{};
+  }
+  // Core Graphics blurs shadows with a Gaussian filter whose standard deviation is half the
+  // blur radius.
+  Int radii[3];
+  boxBlurRadii(blurRadius/2, radii);
+  // The margin accommodates the blur and the antialiasing.
+  const CGFloat margin = radii[0] + radii[1] + radii[2] + 1;
+  const CGFloat minX = floor(bounds.x.start) - margin;
+  const CGFloat maxX = ceil(bounds.x.end) + margin;
+  const CGFloat minY = floor(bounds.y.start) - margin;
+  const CGFloat maxY = ceil(bounds.y.end) + margin;
+  if (!((maxX - minX)*(maxY - minY) <= maxMaskPixelCount)
+      || minX < minValue<Int32> || minY < minValue<Int32>)
+  {
+    return none;
+  }
+  const Int width = static_cast<Int>(maxX - minX);
+  const Int height = static_cast<Int>(maxY - minY);
+  const Int bytesPerRow = (width + 3) & ~Int{3};
+  const UInt size = sign_cast(bytesPerRow*height);
+  Byte* const data = static_cast<Byte*>(calloc(size, 1));
+  if (!data) return none;
+  CGContext* const context = CGBitmapContextCreate(data, sign_cast(width), sign_cast(height), 8,
+                                                   sign_cast(bytesPerRow), nullptr,
+                                                   kCGImageAlphaOnly);
+  if (!context) {
+    free(data);
+    return none;
+  }
+  CGContextSetShouldSmoothFonts(context, false);
+  CGContextSetAllowsFontSubpixelPositioning(context, true);
+  CGContextSetShouldSubpixelPositionFonts(context, true);
+  CGContextSetShouldSubpixelQuantizeFonts(context, false);
+  CGContextScaleCTM(context, scale, scale);
+  TempArray<CGPoint> positions{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    positions[i] = CGPoint{(CGFloat(glyphData[3*i + 1])/subpixelPositionCount - minX)/scale,
+                           (CGFloat(glyphData[3*i + 2]) - minY)/scale};
+  }
+  CTFontDrawGlyphs(font, glyphs.begin(), positions.begin(), sign_cast(n), context);
+  CGContextRelease(context);
+
+  blurImage(data, width, height, bytesPerRow, radii);
+  // Image mask samples with value 0 paint and samples with the maximum value mask out the paint.
+  for (UInt i = 0; i < size; ++i) {
+    data[i] = static_cast<Byte>(0xff - data[i]);
+  }
+
+  const RC<CGDataProvider> dataProvider{
+    CGDataProviderCreateWithData(nullptr, data, size, [](void*, const void* data, size_t) {
+                                   free(const_cast<void*>(data));
+                                 }),
+    ShouldIncrementRefCount{false}};
+  CGImage* const image = CGImageMaskCreate(sign_cast(width), sign_cast(height), 8, 8,
+                                           sign_cast(bytesPerRow), dataProvider.get(),
+                                           nullptr, true);
+  if (!image) return none;
+  return ShadowMask{.image = image,
+                    .x = static_cast<Int32>(minX), .y = static_cast<Int32>(minY),
+                    .width = static_cast<Int32>(width), .height = static_cast<Int32>(height)};
+}
+
+bool ShadowMaskCache::drawShadow(CTFont* font, ArrayRef<const CGGlyph> glyphs,
+                                 const CGPoint* positions,
+                                 const CGAffineTransform& textMatrix, const CGAffineTransform& ctm,
+                                 CGPoint deviceOffset, CGFloat deviceBlurRadius,
+                                 CGContext* context)
+{
+  const Int n = glyphs.count();
+  if (n == 0) return true;
+  const CGFloat scale = ctm.a;
+  const CGFloat inverseScale = 1/scale;
+
+  const auto devicePosition = [&](Int i) -> CGPoint {
+    return {scale*(textMatrix.tx + positions[i].x) + ctm.tx + deviceOffset.x,
+            scale*(textMatrix.ty + positions[i].y) + ctm.ty + deviceOffset.y};
+  };
+  const CGPoint p0 = devicePosition(0);
+  const CGFloat pixelX = floor(nearbyint(p0.x*subpixelPositionCount)/subpixelPositionCount);
+  const CGFloat pixelY = nearbyint(p0.y);
+  if (!(abs(pixelX) < (1 << 28) && abs(pixelY) < (1 << 28))) return false;
+  TempArray<Int32> glyphData{uninitialized, Count{3*n}};
+  for (Int i = 0; i < n; ++i) {
+    const CGPoint p = devicePosition(i);
+    const CGFloat qx = nearbyint(p.x*subpixelPositionCount) - pixelX*subpixelPositionCount;
+    const CGFloat qy = nearbyint(p.y) - pixelY;
+    if (!(abs(qx) < (1 << 28) && abs(qy) < (1 << 28))) return false;
+    glyphData[3*i] = glyphs[i];
+    glyphData[3*i + 1] = static_cast<Int32>(qx);
+    glyphData[3*i + 2] = static_cast<Int32>(qy);
+  }
+
+  RC<CGFont> cgFont{CTFontCopyGraphicsFont(font, nullptr), ShouldIncrementRefCount{false}};
+  const ShadowMaskKey key = {.cgFont = cgFont.get(),
+                             .fontSize = narrow_cast<Float32>(CTFontGetSize(font)),
+                             .scale = narrow_cast<Float32>(scale),
+                             .blurRadius = narrow_cast<Float32>(deviceBlurRadius),
+                             .glyphData = glyphData};
+  const HashCode<UInt64> hashCode = key.hash();
+
+  const auto isEqualToKey = [&](const ShadowMaskCacheEntry& entry) { return entry.key == key; };
+
+  Optional<ShadowMask> mask;
+  stu_mutex_lock(&shadowMaskCacheMutex);
+  {
+    ShadowMaskCacheStorage& cache = shadowMaskCache();
+    if (const ShadowMaskCacheEntry* const entry = cache.find(hashCode, isEqualToKey)) {
+      mask = entry->mask;
+      cache.hitCount += 1;
+      if (mask->image) {
+        CFRetain(mask->image);
+      }
+    } else {
+      cache.missCount += 1;
+    }
+  }
+  stu_mutex_unlock(&shadowMaskCacheMutex);
+
+  if (!mask) {
+    // We render the mask without holding the lock.
+    mask = renderShadowMask(font, glyphData, scale, deviceBlurRadius);
+    if (!mask) return false;
+    if (mask->image) {
+      CFRetain(mask->image); // The other reference is transferred to the cache.
+    }
+    stu_mutex_lock(&shadowMaskCacheMutex);
+    {
+      ShadowMaskCacheStorage& cache = shadowMaskCache();
+      const UInt budget = shadowMaskCacheMemoryBudget.load(std::memory_order_relaxed);
+      const UInt glyphDataSize = sign_cast(key.glyphData.arraySizeInBytes());
+      const UInt cost = sizeof(ShadowMaskCacheEntry) + glyphDataSize
+                      + (mask->image ? CGImageGetBytesPerRow(mask->image)*sign_cast(mask->height)
+                                       + imageOverheadCost
+                                     : 0);
+      // The cache takes over the reference to the mask image if the insertion succeeds.
+      const bool inserted = budget != 0
+                         && cache.insert(hashCode, cost, budget, isEqualToKey, [&]() {
+                              Int32* const glyphData =
+                                static_cast<Int32*>(malloc(max(glyphDataSize, UInt{1})));
+                              memcpy(glyphData, key.glyphData.begin(), glyphDataSize);
+                              CFRetain(key.cgFont);
+                              ShadowMaskKey ownedKey = key;
+                              ownedKey.glyphData = ArrayRef<const Int32>{glyphData,
+                                                                         key.glyphData.count()};
+                              return ShadowMaskCacheEntry{.key = ownedKey, .mask = *mask};
+                            });
+      if (!inserted && mask->image) {
+        CFRelease(mask->image);
+      }
+    }
+    stu_mutex_unlock(&shadowMaskCacheMutex);
+  }
+
+  if (mask->image) {
+    const CGRect rect = {{(pixelX + mask->x - ctm.tx)*inverseScale,
+                          (pixelY + mask->y - ctm.ty)*inverseScale},
+                         {mask->width*inverseScale, mask->height*inverseScale}};
+    CGContextDrawImage(context, rect, mask->image);
+    CFRelease(mask->image);
+  }
+  return true;
+}
+
+} // namespace stu_label
@@ -105,6 +105,8 @@ public:
   const STUWritingDirection defaultBaseWritingDirection;
   const bool defaultBaseWritingDirectionWasUsed;
   const Int textStylesSize;
+  /// The number of entries in the sparse text style index (which may be empty).
+  const Int32 textStyleIndexCount;
 private:
   Paragraph paragraphs_[];
 
@@ -128,6 +130,7 @@ public:
     static_assert(alignof(ColorRef) >= alignof(ColorHashBucket));
     static_assert(alignof(ColorRef) >= alignof(TextStyle));
     static_assert(sizeof(ColorHashBucket)%alignof(TextStyle) == 0);
+    static_assert(alignof(TextStyle) >= alignof(TextStyleIndexEntry));
 
     const ArrayRef<const Paragraph> paragraphs{
       paragraphs_, paragraphCount, unchecked
@@ -152,15 +155,38 @@ public:
    const auto terminatorStyle =
                 (const TextStyle*)((const Byte*)firstStyle + textStylesSize
                                    - TextStyle::sizeOfTerminatorWithStringIndex(stringLength));
+    const ArrayRef<const TextStyleIndexEntry> textStyleIndex{
+      (const TextStyleIndexEntry*)((const Byte*)firstStyle + textStylesSize + sanitizerGap),
+      textStyleIndexCount, unchecked
+    };
 
     return {paragraphs, truncationScopes, fontMetrics, colors, colorHashBuckets,
-            TextStyleSpan{.firstStyle = firstStyle, .terminatorStyle = terminatorStyle}};
+            TextStyleSpan{.firstStyle = firstStyle, .terminatorStyle = terminatorStyle,
+                          .index = textStyleIndex}};
   };
 
+  /// The memory overhead of the sparse text style index.
+  STU_INLINE
+  UInt textStyleIndexSizeInBytes() const {
+    return sizeof(TextStyleIndexEntry)*sign_cast(textStyleIndexCount);
+  }
+
   static ShapedString* __nullable create(NSAttributedString*, STUWritingDirection,
                                          const STUCancellationFlag*,
                                          FunctionRef<void*(UInt)> alloc);
 
+  /// Returns a copy of the shaped string with all fonts adjusted for the specified content size
+  /// category, or null if no font needs to be adjusted or the cancellation flag was set.
+  ///
+  /// The text styles only reference fonts through font indices, so the encoded text style data is
+  /// copied, and only the font-derived values in the underline, strikethrough and stroke infos are
+  /// re-encoded. The font metrics, the minimum line heights of the paragraphs and the typesetter
+  /// are recomputed.
+  static ShapedString* __nullable createWithFontsAdjustedForContentSizeCategory(
+                                    const ShapedString& original, UIContentSizeCategory,
+                                    const STUCancellationFlag*, FunctionRef<void*(UInt)> alloc)
+                                    API_AVAILABLE(ios(10.0), tvos(10.0));
+
   ~ShapedString();
 
 private:
@@ -174,7 +200,15 @@ private:
                         ArrayRef<const ColorRef> colors,
                         ArrayRef<const ColorHashBucket> colorHashBuckets,
                         ArrayRef<const FontRef> fonts,
-                        ArrayRef<const Byte> textStyleDataIncludingTerminator);
+                        ArrayRef<const Byte> textStyleDataIncludingTerminator,
+                        ArrayRef<const TextStyleIndexEntry> textStyleIndex);
+
+  /// Copies the original with the specified attributed string. The fonts array has the length
+  /// `original.fontCount`. A null entry means that the font metrics are copied from the original.
+  explicit ShapedString(const ShapedString& original, NSAttributedString* attributedString,
+                        ArrayRef<const RC<CTFont>> fonts, ArrayRef<const CGFloat> fontSizeRatios);
+
+  UInt allocationSize() const;
 };
 
 } // stu_label
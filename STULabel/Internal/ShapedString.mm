@@ -5,6 +5,7 @@
 #import "STULabel/STUObjCRuntimeWrappers.h"
 #import "STULabel/STUStartEndRange-Internal.hpp"
 #import "STULabel/STUTextAttributes-Internal.hpp"
+#import "STULabel/UIFont+STUDynamicTypeFontScaling.h"
 
 #import "CancellationFlag.hpp"
 #import "InputClamping.hpp"
@@ -419,6 +420,7 @@ ShapedString* __nullable
   TempVector<TruncationScope> truncationScopes{Capacity{4}, paragraphs.allocator()};
   LocalFontInfoCache fontInfoCache;
   TextStyleBuffer textStyleBuffer{Ref{fontInfoCache}, paragraphs.allocator()};
+  textStyleBuffer.enableStyleIndex();
 
   const auto status = scanAttributedString(attributedString, defaultBaseWritingDirection,
                                            paragraphs, truncationScopes, textStyleBuffer);
@@ -451,13 +453,15 @@ ShapedString* __nullable
                   + sizeof(FontMetrics)*sign_cast(textStyleBuffer.fonts().count()) + sanitizerGap
                   + colors.arraySizeInBytes() + sanitizerGap
                   + sizeof(ColorHashBucket)*sign_cast(colors.count()) + sanitizerGap
-                  + sign_cast(textStyleBuffer.data().count()) + sanitizerGap;
+                  + sign_cast(textStyleBuffer.data().count()) + sanitizerGap
+                  + textStyleBuffer.styleIndexSizeInBytes() + sanitizerGap;
 
   return new (alloc(size))
              ShapedString{attributedString, status.stringLength,
                           defaultBaseWritingDirection, status.defaultBaseWritingDirectionWasUsed,
                           paragraphs, truncationScopes, colors, colorHashBuckets,
-                          textStyleBuffer.fonts(), textStyleBuffer.data()};
+                          textStyleBuffer.fonts(), textStyleBuffer.data(),
+                          textStyleBuffer.styleIndex()};
 }
 
 static
@@ -497,7 +501,8 @@ ShapedString::ShapedString(NSAttributedString* const attributedString, const Int
                            const ArrayRef<const ColorRef> colors,
                            const ArrayRef<const ColorHashBucket> colorHashBuckets,
                            const ArrayRef<const FontRef> fonts,
-                           const ArrayRef<const Byte> textStyleDataIncludingTerminator)
+                           const ArrayRef<const Byte> textStyleDataIncludingTerminator,
+                           const ArrayRef<const TextStyleIndexEntry> textStyleIndex)
 : attributedString{attributedString},
   typesetter{createTypesetter((__bridge CFAttributedStringRef)attributedString, stringLength),
               ShouldIncrementRefCount{false}},
@@ -508,7 +513,8 @@ ShapedString::ShapedString(NSAttributedString* const attributedString, const Int
   colorCount{narrow_cast<UInt16>(colors.count())},
   defaultBaseWritingDirection{defaultBaseWritingDirection},
   defaultBaseWritingDirectionWasUsed{defaultBaseWritingDirectionWasUsed},
-  textStylesSize{textStyleDataIncludingTerminator.count()}
+  textStylesSize{textStyleDataIncludingTerminator.count()},
+  textStyleIndexCount{narrow_cast<Int32>(textStyleIndex.count())}
 {
   const ArraysRef tas = arrays();
 
@@ -518,6 +524,7 @@ ShapedString::ShapedString(NSAttributedString* const attributedString, const Int
   sanitizer::poison((Byte*)tas.colors.end(), sanitizerGap);
   sanitizer::poison((Byte*)tas.fontMetrics.end(), sanitizerGap);
   sanitizer::poison((Byte*)(tas.textStyles.dataBegin() + textStylesSize), sanitizerGap);
+  sanitizer::poison((Byte*)tas.textStyles.index.end(), sanitizerGap);
 #endif
 
   using array_utils::copyConstructArray;
@@ -549,6 +556,160 @@ ShapedString::ShapedString(NSAttributedString* const attributedString, const Int
   }
   copyConstructArray(textStyleDataIncludingTerminator,
                      const_cast<Byte*>(tas.textStyles.dataBegin()));
+  copyConstructArray(textStyleIndex, const_array_cast(tas.textStyles.index).begin());
+
+  initializeParagraphMinFontMetrics(const_array_cast(tas.paragraphs), tas.textStyles.firstStyle,
+                                    tas.fontMetrics);
+}
+
+ShapedString* __nullable
+  ShapedString::createWithFontsAdjustedForContentSizeCategory(
+                  const ShapedString& original,
+                  UIContentSizeCategory __unsafe_unretained const category,
+                  const STUCancellationFlag* cancellationFlagPointer,
+                  const FunctionRef<void*(UInt)> alloc)
+{
+  const STUCancellationFlag& cancellationFlag = *(cancellationFlagPointer
+                                                  ?: &CancellationFlag::neverCancelledFlag);
+  const ArraysRef tas = original.arrays();
+  NSAttributedString* const originalString = original.attributedString;
+
+  // The font with a given index is identified by the font attribute at the string index of the
+  // first style that references the font index. (If a style has no font attribute, the
+  // TextStyleBuffer used the default font, which can't be scaled.)
+  TempArray<RC<CTFont>> scaledFonts{Count{tas.fontMetrics.count()}};
+  TempArray<CGFloat> fontSizeRatios{zeroInitialized, Count{tas.fontMetrics.count()},
+                                    scaledFonts.allocator()};
+  TempArray<bool> fontWasChecked{zeroInitialized, Count{tas.fontMetrics.count()},
+                                 scaledFonts.allocator()};
+  bool someFontNeedsAdjustment = false;
+  for (const TextStyle* style = tas.textStyles.firstStyle; style != tas.textStyles.terminatorStyle;
+       style = &style->next())
+  {
+    const UInt16 fontIndex = style->fontIndex().value;
+    if (fontWasChecked[fontIndex]) continue;
+    fontWasChecked[fontIndex] = true;
+    UIFont* const font = [originalString attribute:NSFontAttributeName
+                                           atIndex:sign_cast(style->stringIndex())
+                                    effectiveRange:nil];
+    if (!font) continue;
+    UIFont* const scaledFont = [font stu_fontAdjustedForContentSizeCategory:category];
+    if (scaledFont == font) continue;
+    scaledFonts[fontIndex] = (__bridge CTFont*)scaledFont;
+    fontSizeRatios[fontIndex] = scaledFont.pointSize/font.pointSize;
+    someFontNeedsAdjustment = true;
+  }
+  if (!someFontNeedsAdjustment || isCancelled(cancellationFlag)) return nullptr;
+
+  NSMutableAttributedString* const mutableString = [originalString mutableCopy];
+  for (const TextStyle* style = tas.textStyles.firstStyle; style != tas.textStyles.terminatorStyle;
+       style = &style->next())
+  {
+    CTFont* const scaledFont = scaledFonts[style->fontIndex().value].get();
+    if (!scaledFont) continue;
+    const Int32 start = style->stringIndex();
+    const Int32 end = style->next().stringIndex();
+    [mutableString addAttribute:NSFontAttributeName value:(__bridge UIFont*)scaledFont
+                          range:NSRange{sign_cast(start), sign_cast(end - start)}];
+  }
+  if (isCancelled(cancellationFlag)) return nullptr;
+  // The CTTypesetter will make a copy of the attributedString. By making it immutable now
+  // we can turn that later copy into a retain and thus reduce memory usage.
+  NSAttributedString* const attributedString = [mutableString copy];
+
+  return new (alloc(original.allocationSize()))
+             ShapedString{original, attributedString, scaledFonts, fontSizeRatios};
+}
+
+UInt ShapedString::allocationSize() const {
+  return sizeof(ShapedString)
+       + sizeof(Paragraph)*sign_cast(paragraphCount) + sanitizerGap
+       + sizeof(TruncationScope)*sign_cast(truncationScopeCount) + sanitizerGap
+       + sizeof(FontMetrics)*fontCount + sanitizerGap
+       + sizeof(ColorRef)*colorCount + sanitizerGap
+       + sizeof(ColorHashBucket)*colorCount + sanitizerGap
+       + sign_cast(textStylesSize) + sanitizerGap
+       + textStyleIndexSizeInBytes() + sanitizerGap;
+}
+
+ShapedString::ShapedString(const ShapedString& original, NSAttributedString* const attributedString,
+                           const ArrayRef<const RC<CTFont>> fonts,
+                           const ArrayRef<const CGFloat> fontSizeRatios)
+: attributedString{attributedString},
+  typesetter{createTypesetter((__bridge CFAttributedStringRef)attributedString,
+                              original.stringLength),
+             ShouldIncrementRefCount{false}},
+  stringLength{original.stringLength},
+  paragraphCount{original.paragraphCount},
+  truncationScopeCount{original.truncationScopeCount},
+  fontCount{original.fontCount},
+  colorCount{original.colorCount},
+  defaultBaseWritingDirection{original.defaultBaseWritingDirection},
+  defaultBaseWritingDirectionWasUsed{original.defaultBaseWritingDirectionWasUsed},
+  textStylesSize{original.textStylesSize},
+  textStyleIndexCount{original.textStyleIndexCount}
+{
+  STU_ASSERT(fonts.count() == fontCount);
+  const ArraysRef tas = arrays();
+  const ArraysRef otas = original.arrays();
+
+#if STU_USE_ADDRESS_SANITIZER
+  sanitizer::poison((Byte*)tas.paragraphs.end(), sanitizerGap);
+  sanitizer::poison((Byte*)tas.truncationSopes.end(), sanitizerGap);
+  sanitizer::poison((Byte*)tas.colors.end(), sanitizerGap);
+  sanitizer::poison((Byte*)tas.fontMetrics.end(), sanitizerGap);
+  sanitizer::poison((Byte*)(tas.textStyles.dataBegin() + textStylesSize), sanitizerGap);
+  sanitizer::poison((Byte*)tas.textStyles.index.end(), sanitizerGap);
+#endif
+
+  using array_utils::copyConstructArray;
+
+  copyConstructArray(otas.paragraphs, const_array_cast(tas.paragraphs).begin());
+
+  copyConstructArray(otas.truncationSopes, const_array_cast(tas.truncationSopes).begin());
+
+  {
+    ArrayRef<FontMetrics> fontMetrics = const_array_cast(tas.fontMetrics);
+    for (Int i = 0; i < fontCount; ++i) {
+      new (&fontMetrics[i]) FontMetrics{!fonts[i] ? otas.fontMetrics[i]
+                                        : CachedFontInfo::get(fonts[i].get()).metrics};
+    }
+  }
+  for (auto& color : otas.colors) {
+    incrementRefCount(color.cgColor());
+  }
+  copyConstructArray(otas.colors, const_array_cast(tas.colors).begin());
+  copyConstructArray(otas.colorHashBuckets, const_array_cast(tas.colorHashBuckets).begin());
+  copyConstructArray(ArrayRef{otas.textStyles.dataBegin(), textStylesSize},
+                     const_cast<Byte*>(tas.textStyles.dataBegin()));
+  copyConstructArray(otas.textStyles.index, const_array_cast(tas.textStyles.index).begin());
+
+  // The decoration infos contain values derived from the font at the time of encoding.
+  const TextFlags fontDependentFlags = TextFlags::hasUnderline | TextFlags::hasStrikethrough
+                                     | TextFlags::hasStroke;
+  LocalFontInfoCache fontInfoCache;
+  for (const TextStyle* style = tas.textStyles.firstStyle; style != tas.textStyles.terminatorStyle;
+       style = &style->next())
+  {
+    if (!(style->flags() & fontDependentFlags)) continue;
+    const UInt16 fontIndex = style->fontIndex().value;
+    CTFont* const font = fonts[fontIndex].get();
+    if (!font) continue;
+    const CachedFontInfo& fontInfo = fontInfoCache[font];
+    if (const TextStyle::UnderlineInfo* const info = style->underlineInfo()) {
+      *const_cast<TextStyle::UnderlineInfo*>(info) =
+        TextStyle::UnderlineInfo{info->style(), info->colorIndex, fontInfo};
+    }
+    if (const TextStyle::StrikethroughInfo* const info = style->strikethroughInfo()) {
+      const_cast<TextStyle::StrikethroughInfo*>(info)->originalFontStrikethroughThickness =
+        fontInfo.strikethroughThickness;
+    }
+    if (const TextStyle::StrokeInfo* const info = style->strokeInfo()) {
+      // The stroke width is encoded as a percentage of the font size.
+      const_cast<TextStyle::StrokeInfo*>(info)->strokeWidth =
+        narrow_cast<Float32>(info->strokeWidth*fontSizeRatios[fontIndex]);
+    }
+  }
 
   initializeParagraphMinFontMetrics(const_array_cast(tas.paragraphs), tas.textStyles.firstStyle,
                                     tas.fontMetrics);
@@ -565,6 +726,7 @@ ShapedString::~ShapedString() {
   sanitizer::unpoison((Byte*)tas.colors.end(), sanitizerGap);
   sanitizer::unpoison((Byte*)tas.fontMetrics.end(), sanitizerGap);
   sanitizer::unpoison((Byte*)(tas.textStyles.dataBegin() + textStylesSize), sanitizerGap);
+  sanitizer::unpoison((Byte*)tas.textStyles.index.end(), sanitizerGap);
 #endif
 }
 
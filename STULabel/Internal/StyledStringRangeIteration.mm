@@ -12,6 +12,7 @@ struct IsTruncationTokenRange : Parameter<IsTruncationTokenRange> { using Parame
 
 STU_INLINE
 ShouldStop forEachStyledStringRangeImpl(
+             const TextFrame& textFrame,
              Range<Int32> stringRange, Int32 offsetInTruncatedString,
              IsTruncationTokenRange isTruncationTokenRange,
              InOut<const TextStyle*> inOutStyle, Optional<TextStyleOverride&> styleOverride,
@@ -19,7 +20,11 @@ ShouldStop forEachStyledStringRangeImpl(
 {
   if (stringRange.isEmpty()) return {};
   Int32 index = stringRange.start;
-  const TextStyle* style = &inOutStyle->styleForStringIndex(index);
+  // The range after a truncation token may start many styles after the end of the range
+  // before the token.
+  const TextStyle* style = isTruncationTokenRange.value
+                         ? &inOutStyle->styleForStringIndex(index)
+                         : &textFrame.originalStringStyleForStringIndex(index, *inOutStyle);
   ShouldStop shouldStop;
   for (;;) {
     const TextStyle& next = style->next();
@@ -41,6 +46,7 @@ ShouldStop forEachStyledStringRangeImpl(
 
 STU_INLINE
 ShouldStop forEachStyledStringRangeImpl(
+             const TextFrame& textFrame,
              Range<Int32> stringRange, Int32 offsetInTruncatedString,
              IsTruncationTokenRange isTruncationTokenRange,
              InOut<const TextStyle*> inOutStyle,
@@ -62,16 +68,16 @@ ShouldStop forEachStyledStringRangeImpl(
   const Int32 i1 = !styleOverride ? stringRange.end
                  : max(stringRange.start, overriddenStringRange.start);
   ShouldStop shouldStop = forEachStyledStringRangeImpl(
-                            Range{stringRange.start, i1}, offsetInTruncatedString,
+                            textFrame, Range{stringRange.start, i1}, offsetInTruncatedString,
                             isTruncationTokenRange, inOutStyle, nil, body);
   if (!shouldStop && styleOverride) {
     const Int32 i2 = min(overriddenStringRange.end, stringRange.end);
     shouldStop = forEachStyledStringRangeImpl(
-                   Range{i1, i2}, offsetInTruncatedString, isTruncationTokenRange,
+                   textFrame, Range{i1, i2}, offsetInTruncatedString, isTruncationTokenRange,
                    inOutStyle, styleOverride, body);
     if (!shouldStop) {
       shouldStop = forEachStyledStringRangeImpl(
-                     Range{i2, stringRange.end}, offsetInTruncatedString,
+                     textFrame, Range{i2, stringRange.end}, offsetInTruncatedString,
                      isTruncationTokenRange, inOutStyle, nil, body);
     }
   }
@@ -106,18 +112,20 @@ ShouldStop forEachStyledStringRange(
     overrideRangeInTruncatedString = styleOverride->overrideRange.rangeInTruncatedString();
   }
   ShouldStop shouldStop = forEachStyledStringRangeImpl(
-                            range1, range1OffsetInTruncatedString, IsTruncationTokenRange{false},
+                            textFrame, range1, range1OffsetInTruncatedString,
+                            IsTruncationTokenRange{false},
                             InOut{style}, styleOverride, drawnRangeInTruncatedString,
                             overrideRangeInTruncatedString, body);
   if (!shouldStop && STU_UNLIKELY(range1.end < range2.start)) {
     shouldStop = forEachStyledStringRangeImpl(
-                   {0, paragraph.truncationTokenLength},
+                   textFrame, {0, paragraph.truncationTokenLength},
                    paragraph.rangeOfTruncationTokenInTruncatedString().start,
                    IsTruncationTokenRange{true}, InOut{tokenStyle}, styleOverride,
                    drawnRangeInTruncatedString, overrideRangeInTruncatedString, body);
     if (!shouldStop) {
       shouldStop = forEachStyledStringRangeImpl(
-                     range2, range2OffsetInTruncatedString, IsTruncationTokenRange{false},
+                     textFrame, range2, range2OffsetInTruncatedString,
+                     IsTruncationTokenRange{false},
                      InOut{style}, styleOverride,
                      drawnRangeInTruncatedString, overrideRangeInTruncatedString,
                      body);
@@ -209,4 +209,17 @@ Range<Int32> TextFrame::rangeInOriginalString(STUTextFrameRange range) const {
   return {start, end};
 }
 
+Range<Int32> TextFrame::lineIndexRange(Range<TextFrameIndex> range) const {
+  Range<Int32> lineIndexRange = {sign_cast(range.start.lineIndex),
+                                 sign_cast(range.end.lineIndex)};
+  if (lineIndexRange.end < lines().count()
+      && (range.end.isIndexOfInsertedHyphen
+          || (range.end.indexInTruncatedString
+              != lineStringIndices()[lineIndexRange.end].startIndexInTruncatedString)))
+  {
+    lineIndexRange.end += 1;
+  }
+  return lineIndexRange;
+}
+
 } // stu_label
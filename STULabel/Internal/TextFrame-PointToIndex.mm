@@ -4,37 +4,14 @@
 
 namespace stu_label {
 
-auto TextFrame::rangeOfGraphemeClusterClosestTo(Point<Float64> point,
-                                                TextFrameOrigin unscaledTextFrameOrigin,
-                                                CGFloat displayScaleValue) const
-  -> GraphemeClusterRange
+/// Returns -1 if no line with a positive width could be found.
+static Int indexOfLineClosestTo(const TextFrame& textFrame, Point<Float64> point,
+                                Point<Float64> origin, const Optional<DisplayScale>& displayScale)
 {
-  if (this->lineCount == 0 || this->maxX <= this->minX) {
-  Empty:
-    const TextFrameIndex index = range().start;
-    return {.range = {index, index},
-            .bounds = CGRectZero,
-            .writingDirection = paragraphs().isEmpty() ? STUWritingDirectionLeftToRight
-                              : paragraphs()[0].baseWritingDirection,
-            .isLigatureFraction = false};
-  }
-
-  Point<Float64> origin = unscaledTextFrameOrigin.value;
-
-  if (this->textScaleFactor < 1) {
-    displayScaleValue *= this->textScaleFactor;
-    const Float64 inverseScaleFactor = 1.0/this->textScaleFactor;
-    point.x *= inverseScaleFactor;
-    point.y *= inverseScaleFactor;
-    origin.x *= inverseScaleFactor;
-    origin.y *= inverseScaleFactor;
-  }
-  const Optional<DisplayScale> displayScale = DisplayScale::create(displayScaleValue);
-
   const Float64 e = displayScale ? displayScale->inverseValue_f64() : 0.5;
-  Range<Int> lineIndexRange = verticalSearchTable().indexRange(
+  Range<Int> lineIndexRange = textFrame.verticalSearchTable().indexRange(
                                 narrow_cast<Range<Float32>>(point.y - origin.y + Range{-e, e}));
-  const auto lines = this->lines();
+  const auto lines = textFrame.lines();
   if (lineIndexRange.isEmpty()) {
     if (lineIndexRange.start > 0) {
       lineIndexRange.end = lineIndexRange.start;
@@ -44,7 +21,7 @@ auto TextFrame::rangeOfGraphemeClusterClosestTo(Point<Float64> point,
       lineIndexRange.end += 1;
     } else {
       STU_DEBUG_ASSERT(false && "we shouldn't get here");
-      goto Empty;
+      return -1;
     }
   }
   while (lineIndexRange.start > 0 && lines[lineIndexRange.start].width == 0) {
@@ -78,13 +55,14 @@ auto TextFrame::rangeOfGraphemeClusterClosestTo(Point<Float64> point,
   }
   if (closestLineIndex < 0) {
     STU_DEBUG_ASSERT(false && "we shouldn't get here");
-    goto Empty;
+    return -1;
   }
   // If the point lies outside the typographic bounds of any line, a glyph in a line above or below
   // the point might be closest.
   if (0 < closestSquaredDistance) {
     const auto yRange = point.y + Range<Float64>{}.outsetBy(sqrt(closestSquaredDistance) + e);
-    const auto lineIndexRange2 = verticalSearchTable().indexRange(Range<Float32>{yRange - origin.y});
+    const auto lineIndexRange2 = textFrame.verticalSearchTable().indexRange(
+                                   Range<Float32>{yRange - origin.y});
     for (const auto& line : lines[{lineIndexRange2.start, lineIndexRange.start}].reversed()) {
       updateClosestLineIndex(line);
     }
@@ -92,153 +70,352 @@ auto TextFrame::rangeOfGraphemeClusterClosestTo(Point<Float64> point,
       updateClosestLineIndex(line);
     }
   }
+  return closestLineIndex;
+}
 
-  const TextFrameLine& line = lines[closestLineIndex];
-  auto result = line.rangeOfGraphemeClusterAtXOffset(point.x - origin.x - line.originX);
-  result.bounds.x += line.originX;
-  Float64 baseline = line.originY;
-  if (displayScale) {
-    baseline = ceilToScale(baseline, *displayScale);
-  }
-  result.bounds.y += baseline;
-  result.bounds *= this->textScaleFactor;
-  result.bounds += unscaledTextFrameOrigin.value;
+auto TextFrame::rangeOfGraphemeClusterClosestTo(Point<Float64> point,
+                                                TextFrameOrigin unscaledTextFrameOrigin,
+                                                CGFloat displayScaleValue) const
+  -> GraphemeClusterRange
+{
+  GraphemeClusterRange result;
+  rangesOfGraphemeClustersClosestTo(ArrayRef<const Point<Float64>>{&point, 1},
+                                    unscaledTextFrameOrigin, displayScaleValue,
+                                    ArrayRef<GraphemeClusterRange>{&result, 1});
   return result;
 }
 
-auto TextFrameLine::rangeOfGraphemeClusterAtXOffset(Float64 xOffset) const
-  -> TextFrame::GraphemeClusterRange
+void TextFrame::rangesOfGraphemeClustersClosestTo(ArrayRef<const Point<Float64>> points,
+                                                  TextFrameOrigin unscaledTextFrameOrigin,
+                                                  CGFloat displayScaleValue,
+                                                  ArrayRef<GraphemeClusterRange> results) const
+{
+  STU_PRECONDITION(points.count() == results.count());
+  const Int n = points.count();
+  if (n == 0) return;
+
+  const auto emptyResult = [&]() -> GraphemeClusterRange {
+    const TextFrameIndex index = range().start;
+    return {.range = {index, index},
+            .bounds = CGRectZero,
+            .writingDirection = paragraphs().isEmpty() ? STUWritingDirectionLeftToRight
+                              : paragraphs()[0].baseWritingDirection,
+            .isLigatureFraction = false};
+  };
+
+  if (this->lineCount == 0 || this->maxX <= this->minX) {
+    for (auto& result : results) {
+      result = emptyResult();
+    }
+    return;
+  }
+
+  Point<Float64> origin = unscaledTextFrameOrigin.value;
+  Float64 inverseScaleFactor = 1;
+  if (this->textScaleFactor < 1) {
+    displayScaleValue *= this->textScaleFactor;
+    inverseScaleFactor = 1.0/this->textScaleFactor;
+    origin.x *= inverseScaleFactor;
+    origin.y *= inverseScaleFactor;
+  }
+  const Optional<DisplayScale> displayScale = DisplayScale::create(displayScaleValue);
+
+  // The points are first mapped to their closest lines. Then all points that map to the same line
+  // are processed together, so that we iterate over the glyph spans of each line only once.
+
+  TempArray<Int> lineIndices{uninitialized, Count{n}};
+  TempArray<Float64> xs{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    Point<Float64> point = points[i];
+    if (inverseScaleFactor != 1) {
+      point.x *= inverseScaleFactor;
+      point.y *= inverseScaleFactor;
+    }
+    xs[i] = point.x;
+    lineIndices[i] = indexOfLineClosestTo(*this, point, origin, displayScale);
+    if (lineIndices[i] < 0) {
+      results[i] = emptyResult();
+    }
+  }
+
+  // Sorting the point indices by line index groups the points of each line together.
+  TempArray<Int> pointIndices{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    pointIndices[i] = i;
+  }
+  pointIndices.sort([&](Int i, Int j) {
+    return lineIndices[i] < lineIndices[j] || (lineIndices[i] == lineIndices[j] && i < j);
+  });
+  TempArray<Float64> xOffsets{uninitialized, Count{n}};
+  TempArray<GraphemeClusterRange> lineResults{Count{n}};
+  for (Int groupStart = 0, groupEnd; groupStart < n; groupStart = groupEnd) {
+    const Int lineIndex = lineIndices[pointIndices[groupStart]];
+    groupEnd = groupStart + 1;
+    while (groupEnd < n && lineIndices[pointIndices[groupEnd]] == lineIndex) {
+      ++groupEnd;
+    }
+    if (lineIndex < 0) continue;
+    const TextFrameLine& line = lines()[lineIndex];
+    const Int m = groupEnd - groupStart;
+    for (Int k = 0; k < m; ++k) {
+      xOffsets[k] = xs[pointIndices[groupStart + k]] - origin.x - line.originX;
+    }
+    line.rangesOfGraphemeClustersAtXOffsets(xOffsets[{0, m}], lineResults[{0, m}]);
+    Float64 baseline = line.originY;
+    if (displayScale) {
+      baseline = ceilToScale(baseline, *displayScale);
+    }
+    for (Int k = 0; k < m; ++k) {
+      GraphemeClusterRange result = lineResults[k];
+      result.bounds.x += line.originX;
+      result.bounds.y += baseline;
+      result.bounds *= this->textScaleFactor;
+      result.bounds += unscaledTextFrameOrigin.value;
+      results[pointIndices[groupStart + k]] = result;
+    }
+  }
+}
+
+namespace {
+  struct GraphemeClusterAtXOffset {
+    Float64 xOffset;
+    Range<Int32> rangeInOriginalString;
+    Range<TextFrameCompactIndex> range;
+    STUWritingDirection writingDirection;
+    Range<Float64> xOffsetBounds;
+  };
+}
+
+static GraphemeClusterAtXOffset unresolvedGraphemeClusterAtXOffset(const TextFrameLine& line,
+                                                                   Float64 xOffset)
 {
-  const CGFloat width = this->width;
   // Currently we always ignore any trailing whitespace.
-  xOffset = clamp(0, xOffset, width);
-  const TextFrame& tf = this->textFrame();
-  const TextFrameParagraph& para = tf.paragraphs()[this->paragraphIndex];
-
-  Range<Int32> rangeInOriginalString = this->rangeInOriginalString;
-  Range<TextFrameCompactIndex> range{};
-  STUWritingDirection writingDirection;
-  Range<Float64> xOffsetBounds = Range<CGFloat>::infinitelyEmpty();
-  bool isLigatureFraction = false;
+  return {.xOffset = clamp(0, xOffset, line.width),
+          .rangeInOriginalString = line.rangeInOriginalString,
+          .range = Range<TextFrameCompactIndex>{},
+          .writingDirection = line.paragraphBaseWritingDirection,
+          .xOffsetBounds = Range<CGFloat>::infinitelyEmpty()};
+}
 
-  forEachStyledGlyphSpan(none,
-    [&](const StyledGlyphSpan& span, const TextStyle&, Range<Float64> spanXOffset) -> ShouldStop
+/// Returns the index of the glyph in the span whose typographic extent contains the X offset.
+static Int glyphIndexAtXOffset(GlyphSpan glyphSpan, Float64 spanXOffset, Float64 xOffset,
+                               Out<Float64> outGlyphXOffset)
+{
+  if (const StoredGlyphRun* const run = glyphSpan.run().storedRun()) {
+    return TextFrameGlyphStorage::glyphIndexAtXOffset(*run, glyphSpan.glyphRange(), spanXOffset,
+                                                      xOffset, outGlyphXOffset);
+  }
+  Int glyphIndex = 0;
+  Float64 glyphXOffset = spanXOffset;
+  const Int lastGlyphIndex = glyphSpan.count() - 1;
+  for (Float64 nextGlyphXOffset; glyphIndex < lastGlyphIndex;
+       ++glyphIndex, glyphXOffset = nextGlyphXOffset)
   {
-    // We only need to look at a single span.
-    if (!spanXOffset.contains(xOffset) && (xOffset < width || spanXOffset.end < width)) return {};
-    const GlyphSpan glyphSpan = span.glyphSpan;
-    if (glyphSpan.isEmpty()) return {};
-    if (span.part == TextLinePart::insertedHyphen) {
-      const Int32 index = rangeInTruncatedString.end - 1;
-      range.start = TextFrameCompactIndex{index, IsIndexOfInsertedHyphen{true}};
-      range.end = TextFrameCompactIndex{index + 1, IsIndexOfInsertedHyphen{false}};
-      rangeInOriginalString.start = rangeInOriginalString.end;
-      writingDirection = paragraphBaseWritingDirection;
-      xOffsetBounds = spanXOffset;
-      return stop;
-    }
-    writingDirection = glyphSpan.run().writingDirection();
-
-    Int glyphIndex = 0;
-    Float64 glyphXOffset = spanXOffset.start;
+    nextGlyphXOffset = glyphXOffset + glyphSpan[{glyphIndex, Count{1}}].typographicWidth();
+    if (xOffset < nextGlyphXOffset) break;
+  }
+  outGlyphXOffset = glyphXOffset;
+  return glyphIndex;
+}
+
+/// Resolves the string range of the grapheme cluster at `c.xOffset`, which must lie in the span.
+static void resolveGraphemeClusterInSpan(const TextFrameLine& line, const TextFrameParagraph& para,
+                                         const StyledGlyphSpan& span, Range<Float64> spanXOffset,
+                                         GraphemeClusterAtXOffset& c)
+{
+  if (span.part == TextLinePart::insertedHyphen) {
+    const Int32 index = line.rangeInTruncatedString.end - 1;
+    c.range.start = TextFrameCompactIndex{index, IsIndexOfInsertedHyphen{true}};
+    c.range.end = TextFrameCompactIndex{index + 1, IsIndexOfInsertedHyphen{false}};
+    c.rangeInOriginalString.start = c.rangeInOriginalString.end;
+    c.writingDirection = line.paragraphBaseWritingDirection;
+    c.xOffsetBounds = spanXOffset;
+    return;
+  }
+  const Float64 xOffset = c.xOffset;
+  c.writingDirection = span.glyphSpan.run().writingDirection();
+
+  Float64 glyphXOffset;
+  const Int glyphIndex = glyphIndexAtXOffset(span.glyphSpan, spanXOffset.start, xOffset,
+                                             Out{glyphXOffset});
+  Range<Int> stringRange = span.glyphSpan[{glyphIndex, glyphIndex + 1}].stringRange();
+
+  const auto string = NSStringRef{span.attributedString.string};
+
+  const int maxInnerOffsetCount = 15;
+  Array<Range<Int>, Fixed, maxInnerOffsetCount + 1> graphemeClusterStringRanges;
+
+  const Int graphemeClusterCount = string.copyRangesOfGraphemeClustersSkippingTrailingIgnorables(
+                                            stringRange, graphemeClusterStringRanges);
+  if (graphemeClusterCount == 1) {
+    stringRange = graphemeClusterStringRanges[0];
+  } else if (graphemeClusterStringRanges[0].start < stringRange.start
+             || stringRange.end < graphemeClusterStringRanges[graphemeClusterCount - 1].end)
+  { // There's likely another glyph whose string range overlaps with stringRange.
+    stringRange.start = graphemeClusterStringRanges[0].start;
+    stringRange.end = graphemeClusterStringRanges[graphemeClusterCount - 1].end;
+  } if (1 < graphemeClusterCount && graphemeClusterCount - 1 <= maxInnerOffsetCount) {
+    Array<CGFloat, Fixed, maxInnerOffsetCount> ligatureInnerOffsets;
+    if (span.glyphSpan.copyInnerCaretOffsetsForLigatureGlyphAtIndex(
+                         glyphIndex, ligatureInnerOffsets[{0, graphemeClusterCount - 1}]))
     {
-      const Int lastGlyphIndex = glyphSpan.count() - 1;
-      for (Float64 nextGlyphXOffset; glyphIndex < lastGlyphIndex;
-           ++glyphIndex, glyphXOffset = nextGlyphXOffset)
-      {
-        nextGlyphXOffset = glyphXOffset + glyphSpan[{glyphIndex, Count{1}}].typographicWidth();
-        if (xOffset < nextGlyphXOffset) break;
+      const Float64 innerOffset = xOffset - glyphXOffset;
+      Int i = 0;
+      for (; i < graphemeClusterCount - 1; ++i) {
+        if (innerOffset < ligatureInnerOffsets[i]) break;
       }
+      stringRange = graphemeClusterStringRanges[i];
     }
+  }
 
-    Range<Int> stringRange = span.glyphSpan[{glyphIndex, glyphIndex + 1}].stringRange();
+  // For simplicity we don't try to determine the outer X bounds for the grapheme cluster here.
+  // Instead we calculate the bounds in graphemeClusterRange by iterating over the line again
+  // (with the iteration restricted to the grapheme cluster's string range).
 
-    const auto string = NSStringRef{span.attributedString.string};
+  Int offsetInTruncatedString;
+  if (span.part == TextLinePart::originalString) {
+    if (stringRange.start < para.excisedRangeInOriginalString().start) {
+      stringRange.intersect(Range{c.rangeInOriginalString.start,
+                                  para.excisedRangeInOriginalString().start});
+      offsetInTruncatedString = line.rangeInTruncatedString.start
+                              - line.rangeInOriginalString.start;
+    } else {
+      stringRange.intersect(Range{para.excisedRangeInOriginalString().end,
+                                  c.rangeInOriginalString.end});
+      offsetInTruncatedString = line.rangeInTruncatedString.end
+                              - line.rangeInOriginalString.end;
+    }
+    c.rangeInOriginalString = Range<Int32>{stringRange};
+  } else {
+    STU_DEBUG_ASSERT(span.part == TextLinePart::truncationToken);
+    c.rangeInOriginalString = para.excisedRangeInOriginalString();
+    offsetInTruncatedString = span.startIndexOfTruncationTokenInTruncatedString;
+  }
 
-    const int maxInnerOffsetCount = 15;
-    Array<Range<Int>, Fixed, maxInnerOffsetCount + 1> graphemeClusterStringRanges;
+  stringRange += offsetInTruncatedString;
+  c.range.start = TextFrameCompactIndex(narrow_cast<Int32>(stringRange.start));
+  c.range.end = TextFrameCompactIndex(narrow_cast<Int32>(stringRange.end));
+}
 
-    const Int graphemeClusterCount = string.copyRangesOfGraphemeClustersSkippingTrailingIgnorables(
-                                              stringRange, graphemeClusterStringRanges);
-    if (graphemeClusterCount == 1) {
-      stringRange = graphemeClusterStringRanges[0];
-    } else if (graphemeClusterStringRanges[0].start < stringRange.start
-               || stringRange.end < graphemeClusterStringRanges[graphemeClusterCount - 1].end)
-    { // There's likely another glyph whose string range overlaps with stringRange.
-      stringRange.start = graphemeClusterStringRanges[0].start;
-      stringRange.end = graphemeClusterStringRanges[graphemeClusterCount - 1].end;
-    } if (1 < graphemeClusterCount && graphemeClusterCount - 1 <= maxInnerOffsetCount) {
-      Array<CGFloat, Fixed, maxInnerOffsetCount> ligatureInnerOffsets;
-      if (span.glyphSpan.copyInnerCaretOffsetsForLigatureGlyphAtIndex(
-                           glyphIndex, ligatureInnerOffsets[{0, graphemeClusterCount - 1}]))
+/// @param previous The preceding offset in sorted order, whose bounds are reused if it maps to the
+///                 same grapheme cluster.
+static TextFrame::GraphemeClusterRange
+  graphemeClusterRange(const TextFrameLine& line, GraphemeClusterAtXOffset& c,
+                       Optional<const GraphemeClusterAtXOffset&> previous = none,
+                       bool previousIsLigatureFraction = false)
+{
+  if (STU_UNLIKELY(c.range.isEmpty())) {
+    return {.range = line.range(),
+            .bounds = {},
+            .writingDirection = line.paragraphBaseWritingDirection,
+            .isLigatureFraction = false};
+  }
+  bool isLigatureFraction = false;
+  if (c.xOffsetBounds.isEmpty()) {
+    // Coalesced touches often map to the same grapheme cluster, in which case we can reuse the
+    // bounds calculated for the preceding offset in sorted order.
+    if (previous && previous->range == c.range
+        && previous->rangeInOriginalString == c.rangeInOriginalString
+        && !previous->xOffsetBounds.isEmpty())
+    {
+      c.xOffsetBounds = previous->xOffsetBounds;
+      isLigatureFraction = previousIsLigatureFraction;
+    } else {
+      bool leftEndOfLigatureIsClipped = false;
+      bool rightEndOfLigatureIsClipped = false;
+      TextStyleOverride styleOverride{Range{line.lineIndex, Count{1}}, c.rangeInOriginalString,
+                                      c.range};
+      line.forEachStyledGlyphSpan(styleOverride,
+        [&](const StyledGlyphSpan& span, const TextStyle&, Range<Float64> xOffset)
       {
-        const Float64 innerOffset = xOffset - glyphXOffset;
-        Int i = 0;
-        for (; i < graphemeClusterCount - 1; ++i) {
-          if (innerOffset < ligatureInnerOffsets[i]) break;
+        if (c.xOffsetBounds.isEmpty()) {
+          leftEndOfLigatureIsClipped = span.leftEndOfLigatureIsClipped;
         }
-        stringRange = graphemeClusterStringRanges[i];
-      }
+        rightEndOfLigatureIsClipped = span.rightEndOfLigatureIsClipped;
+        c.xOffsetBounds = c.xOffsetBounds.convexHull(xOffset);
+      });
+      isLigatureFraction = leftEndOfLigatureIsClipped || rightEndOfLigatureIsClipped;
     }
+  }
+  return {.range = {c.range.start.withLineIndex(line.lineIndex),
+                    c.range.end.withLineIndex(line.lineIndex)},
+          .bounds = {c.xOffsetBounds, {-(line.ascent + line.leading/2),
+                                       (line.descent + line.leading/2)}},
+          .writingDirection = c.writingDirection,
+          .isLigatureFraction = isLigatureFraction};
+}
 
-    // For simplicity we don't try to determine the outer X bounds for the grapheme cluster here.
-    // Instead we will calculate the bounds below by iterating over the line again (with the
-    // iteration restricted to the grapheme cluster's string range).
-
-    Int offsetInTruncatedString;
-    if (span.part == TextLinePart::originalString) {
-      if (stringRange.start < para.excisedRangeInOriginalString().start) {
-        stringRange.intersect(Range{rangeInOriginalString.start,
-                                    para.excisedRangeInOriginalString().start});
-        offsetInTruncatedString = this->rangeInTruncatedString.start
-                                - this->rangeInOriginalString.start;
-      } else {
-        stringRange.intersect(Range{para.excisedRangeInOriginalString().end,
-                                    rangeInOriginalString.end});
-        offsetInTruncatedString = this->rangeInTruncatedString.end
-                                - this->rangeInOriginalString.end;
-      }
-      rangeInOriginalString = Range<Int32>{stringRange};
-    } else {
-      STU_DEBUG_ASSERT(span.part == TextLinePart::truncationToken);
-      rangeInOriginalString = para.excisedRangeInOriginalString();
-      offsetInTruncatedString = span.startIndexOfTruncationTokenInTruncatedString;
+auto TextFrameLine::rangeOfGraphemeClusterAtXOffset(Float64 xOffset) const
+  -> TextFrame::GraphemeClusterRange
+{
+  const CGFloat width = this->width;
+  const TextFrameParagraph& para = textFrame().paragraphs()[this->paragraphIndex];
+  GraphemeClusterAtXOffset c = unresolvedGraphemeClusterAtXOffset(*this, xOffset);
+  forEachStyledGlyphSpan(none,
+    [&](const StyledGlyphSpan& span, const TextStyle&, Range<Float64> spanXOffset) -> ShouldStop
+  {
+    if (span.glyphSpan.isEmpty()) return {};
+    if (!spanXOffset.contains(c.xOffset) && (c.xOffset < width || spanXOffset.end < width)) {
+      return {};
     }
+    resolveGraphemeClusterInSpan(*this, para, span, spanXOffset, c);
+    return ShouldStop{true};
+  });
+  return graphemeClusterRange(*this, c);
+}
 
-    stringRange += offsetInTruncatedString;
-    range.start = TextFrameCompactIndex(narrow_cast<Int32>(stringRange.start));
-    range.end = TextFrameCompactIndex(narrow_cast<Int32>(stringRange.end));
+void TextFrameLine::rangesOfGraphemeClustersAtXOffsets(
+                      ArrayRef<const Float64> xOffsets,
+                      ArrayRef<GraphemeClusterRange> results) const
+{
+  STU_PRECONDITION(xOffsets.count() == results.count());
+  const Int n = xOffsets.count();
+  if (n == 0) return;
+  const CGFloat width = this->width;
+  const TextFrameParagraph& para = textFrame().paragraphs()[this->paragraphIndex];
 
-    return stop;
+  TempArray<GraphemeClusterAtXOffset> clusters{Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    clusters[i] = unresolvedGraphemeClusterAtXOffset(*this, xOffsets[i]);
+  }
+  // The glyph spans are iterated from left to right, so with the offsets sorted in increasing
+  // order we can resolve them in a single sweep.
+  TempArray<Int> order{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    order[i] = i;
+  }
+  order.sort([&](Int i, Int j) {
+    return clusters[i].xOffset < clusters[j].xOffset
+        || (clusters[i].xOffset == clusters[j].xOffset && i < j);
   });
+  Int nextIndex = 0;
 
-  if (STU_UNLIKELY(range.isEmpty())) {
-    return {.range = this->range(),
-            .bounds = {},
-            .writingDirection = paragraphBaseWritingDirection,
-            .isLigatureFraction = false};
-  }
+  forEachStyledGlyphSpan(none,
+    [&](const StyledGlyphSpan& span, const TextStyle&, Range<Float64> spanXOffset) -> ShouldStop
+  {
+    if (span.glyphSpan.isEmpty()) return {};
+    for (; nextIndex < n; ++nextIndex) {
+      GraphemeClusterAtXOffset& c = clusters[order[nextIndex]];
+      const Float64 xOffset = c.xOffset;
+      // An offset left of the span lies in an empty span and remains unresolved.
+      if (xOffset < spanXOffset.start && xOffset < width) continue;
+      // The remaining offsets lie right of the span.
+      if (!spanXOffset.contains(xOffset) && (xOffset < width || spanXOffset.end < width)) break;
+      resolveGraphemeClusterInSpan(*this, para, span, spanXOffset, c);
+    }
+    return ShouldStop{nextIndex == n};
+  });
 
-  if (xOffsetBounds.isEmpty()) {
-    bool leftEndOfLigatureIsClipped = false;
-    bool rightEndOfLigatureIsClipped = false;
-    TextStyleOverride styleOverride{Range{lineIndex, Count{1}}, rangeInOriginalString, range};
-    forEachStyledGlyphSpan(styleOverride,
-      [&](const StyledGlyphSpan& span, const TextStyle&, Range<Float64> xOffset)
-    {
-      if (xOffsetBounds.isEmpty()) {
-        leftEndOfLigatureIsClipped = span.leftEndOfLigatureIsClipped;
-      }
-      rightEndOfLigatureIsClipped = span.rightEndOfLigatureIsClipped;
-      xOffsetBounds = xOffsetBounds.convexHull(xOffset);
-    });
-    isLigatureFraction = leftEndOfLigatureIsClipped || rightEndOfLigatureIsClipped;
+  for (Int k = 0; k < n; ++k) {
+    const Int i = order[k];
+    if (k == 0) {
+      results[i] = graphemeClusterRange(*this, clusters[i]);
+    } else {
+      const Int j = order[k - 1];
+      results[i] = graphemeClusterRange(*this, clusters[i], clusters[j],
+                                        results[j].isLigatureFraction);
+    }
   }
-
-  return {.range = {range.start.withLineIndex(lineIndex), range.end.withLineIndex(lineIndex)},
-          .bounds = {xOffsetBounds, {-(ascent + leading/2), (descent + leading/2)}},
-          .writingDirection = writingDirection,
-          .isLigatureFraction = isLigatureFraction};
 }
 
 } // namespace stu_label
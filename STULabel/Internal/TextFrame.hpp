@@ -10,6 +10,7 @@
 #import "DisplayScaleRounding.hpp"
 #import "IntervalSearchTable.hpp"
 #import "TextFrameDrawingOptions.hpp"
+#import "TextFrameGlyphStorage.hpp"
 #import "TextLineSpan.hpp"
 #import "StyledStringRangeIteration.hpp"
 #import "Rect.hpp"
@@ -224,6 +225,19 @@ struct TextFrame : STUTextFrameData {
             - _colorCount, _colorCount};
   }
 
+  /// The compact copy of the glyph data of the lines, or null if the lines reference their
+  /// glyph data through `_ctLine` and `_tokenCTLine`.
+  STU_INLINE
+  const TextFrameGlyphStorage* __nullable glyphStorage() const { return _glyphStorage; }
+
+  /// The sparse index over the original string styles, with offsets relative to
+  /// `_textStylesData`. Empty if the text frame has only few styles.
+  STU_INLINE
+  ArrayRef<const TextStyleIndexEntry> textStyleIndex() const {
+    return {(const TextStyleIndexEntry*)((const Byte*)this + _dataSize - sanitizerGap)
+            - _textStyleIndexCount, _textStyleIndexCount, unchecked};
+  }
+
   STU_INLINE
   TextFrameIndex endIndex() const { return STUTextFrameDataGetEndIndex(this); }
 
@@ -252,6 +266,9 @@ struct TextFrame : STUTextFrameData {
                                      Optional<Out<TruncationTokenIndex>> = none) const;
   Range<Int32> rangeInOriginalString(STUTextFrameRange) const;
 
+  /// The index range of the lines that contain at least part of the specified range.
+  Range<Int32> lineIndexRange(Range<TextFrameIndex>) const;
+
   TruncationTokenIndex truncationTokenIndex(TextFrameIndex index) const {
     TruncationTokenIndex result;
     rangeInOriginalString(index, Out{result});
@@ -265,12 +282,39 @@ struct TextFrame : STUTextFrameData {
                                     Optional<FunctionRef<bool(const TextStyle&)>> = none)
                              const;
 
+  /// Returns the line spans of all the specified ranges, grouped by range. The spans of
+  /// `ranges[i]` have the `rangeIndex` `i` and are equal to the spans returned by
+  /// `lineSpans(ranges[i])`.
+  ///
+  /// Walks over the lines only once and iterates over the glyph spans of each line that is
+  /// fully contained in some of the ranges only once.
+  ///
+  /// @pre The ranges must be sorted by their start index.
+  TempArray<TextLineSpan> lineSpans(ArrayRef<const STUTextFrameRange> ranges) const;
+
+  /// Equivalent to `!lineSpans(range).isEmpty()`, but stops at the first span.
+  bool hasLineSpans(STUTextFrameRange range) const;
+
   STU_INLINE
   const TextStyle& firstNonTokenTextStyleForLineAtIndex(Int lineIndex) const;
 
   STU_INLINE
   const TextStyle& firstTokenTextStyleForLineAtIndex(Int lineIndex) const;
 
+  /// Equivalent to `cursor.styleForStringIndex(stringIndex)`, except that the lookup uses
+  /// `textStyleIndex()` if the style isn't among the next `TextStyleIndexEntry::stride` styles
+  /// after `cursor`.
+  ///
+  /// @pre `cursor` must be an original string style, not a truncation token style.
+  STU_INLINE
+  const TextStyle& originalStringStyleForStringIndex(Int32 stringIndex,
+                                                     const TextStyle& cursor) const
+  {
+    return TextStyleIndexEntry::styleForStringIndex(
+             stringIndex, cursor, reinterpret_cast<const TextStyle*>(_textStylesData),
+             textStyleIndex());
+  }
+
   struct GraphemeClusterRange {
     Range<TextFrameIndex> range;
     Rect<Float64> bounds;
@@ -287,6 +331,14 @@ struct TextFrame : STUTextFrameData {
                                                        TextFrameOrigin,
                                                        CGFloat displayScale) const;
 
+  /// Equivalent to calling `rangeOfGraphemeClusterClosestTo` for every point, except that the
+  /// glyph spans of each line are only iterated once for all points closest to that line.
+  /// @pre `points.count() == results.count()`
+  // Defined in TextFrame-PointToindex.mm
+  void rangesOfGraphemeClustersClosestTo(ArrayRef<const Point<Float64>> points,
+                                         TextFrameOrigin, CGFloat displayScale,
+                                         ArrayRef<GraphemeClusterRange> results) const;
+
   Rect<CGFloat> calculateImageBounds(TextFrameOrigin, const ImageBoundsContext&) const;
 
   static CGFloat assumedScaleForCTM(const CGAffineTransform& ctm) {
@@ -302,6 +354,11 @@ struct TextFrame : STUTextFrameData {
 
   ~TextFrame();
 
+  /// Returns the layout info of the text frame that would be constructed from the layouter,
+  /// without allocating the text frame or copying any of the layouter's data.
+  static STUTextFrameLayoutInfo layoutInfo(const TextFrameLayouter& layouter,
+                                           CGPoint frameOrigin);
+
 private:
   friend STUTextFrame* ::STUTextFrameCreateWithShapedStringRange(Class, STUShapedString*, NSRange,
                                                                  CGSize, CGFloat,
@@ -313,12 +370,18 @@ private:
   struct SizeAndOffset {
     UInt size;
     UInt offset;
+    Optional<TextFrameGlyphStorage::Counts> glyphStorageCounts;
   };
   static SizeAndOffset objectSizeAndThisOffset(const TextFrameLayouter& layouter);
 
-  explicit TextFrame(TextFrameLayouter&& layouter, UInt dataSize);
+  explicit TextFrame(TextFrameLayouter&& layouter, UInt dataSize,
+                     Optional<TextFrameGlyphStorage::Counts> glyphStorageCounts);
 };
 
+/// Implements -[STUTextFrame layoutInfoForFrameOrigin:displayScale:].
+STUTextFrameLayoutInfo stuTextFrameLayoutInfo(const STUTextFrameData& data, CGPoint frameOrigin,
+                                              CGFloat displayScale);
+
 
 STU_INLINE const TextFrame& textFrameRef(const STUTextFrameData& data) {
   return down_cast<const TextFrame&>(data);
@@ -487,6 +550,27 @@ struct TextFrameLine : STUTextFrameLine {
     return reinterpret_cast<const TextFrameParagraph*>(this - lineIndex)[-1].textFrame();
   }
 
+  /// The text frame's compact glyph storage, or null if the line references its glyph data
+  /// through `_ctLine` and `_tokenCTLine`.
+  STU_INLINE
+  const TextFrameGlyphStorage* __nullable glyphStorage() const {
+    return _initStep == 0 ? textFrame().glyphStorage() : nullptr;
+  }
+
+  /// The runs of the original string part of the line.
+  STU_INLINE
+  GlyphRuns nonTokenGlyphRuns(const TextFrameGlyphStorage* __nullable glyphStorage) const {
+    if (glyphStorage) return GlyphRuns{glyphStorage->nonTokenRuns(lineIndex)};
+    return _ctLine ? GlyphRuns{_ctLine} : GlyphRuns{};
+  }
+
+  /// The runs of the truncation token or inserted hyphen of the line.
+  STU_INLINE
+  GlyphRuns tokenGlyphRuns(const TextFrameGlyphStorage* __nullable glyphStorage) const {
+    if (glyphStorage) return GlyphRuns{glyphStorage->tokenRuns(lineIndex)};
+    return _tokenCTLine ? GlyphRuns{_tokenCTLine} : GlyphRuns{};
+  }
+
   STU_INLINE
   const TextFrameParagraph& paragraph() const {
     STU_DEBUG_ASSERT(!_initStep);
@@ -511,6 +595,12 @@ struct TextFrameLine : STUTextFrameLine {
   // Defined in TextFrame-PointToindex.mm
   GraphemeClusterRange rangeOfGraphemeClusterAtXOffset(Float64 xOffset) const;
 
+  /// @param xOffsets The X offsets from the line's origin.
+  /// @pre `xOffsets.count() == results.count()`
+  // Defined in TextFrame-PointToindex.mm
+  void rangesOfGraphemeClustersAtXOffsets(ArrayRef<const Float64> xOffsets,
+                                          ArrayRef<GraphemeClusterRange> results) const;
+
   STU_INLINE
   TextFlags textFlags()         const { return static_cast<TextFlags>(Base::textFlags); }
   STU_INLINE
@@ -534,16 +624,16 @@ struct TextFrameLine : STUTextFrameLine {
 
   ShouldStop forEachCTLineSegment(
                FlagsRequiringIndividualRunIteration mask,
-               FunctionRef<ShouldStop(TextLinePart, CTLineXOffset, CTLine&,
+               FunctionRef<ShouldStop(TextLinePart, CTLineXOffset, CTLine* __nullable,
                                       Optional<GlyphSpan>)> body)
              const;
 
   template <typename Body,
-            EnableIf<isCallable<Body, void(TextLinePart, CTLineXOffset, CTLine&,
+            EnableIf<isCallable<Body, void(TextLinePart, CTLineXOffset, CTLine* __nullable,
                                            Optional<GlyphSpan>)>> = 0>
   STU_INLINE
   void forEachCTLineSegment(FlagsRequiringIndividualRunIteration mask, Body&& body) const {
-    forEachCTLineSegment(mask, [&](TextLinePart part, CTLineXOffset offset, CTLine& line,
+    forEachCTLineSegment(mask, [&](TextLinePart part, CTLineXOffset offset, CTLine* line,
                                    Optional<GlyphSpan> span) STU_INLINE_LAMBDA -> ShouldStop
                                {
                                  body(part, offset, line, span);
@@ -556,7 +646,7 @@ struct TextFrameLine : STUTextFrameLine {
   STU_INLINE
   ShouldStop forEachGlyphSpan(Body&& body) const {
     return forEachCTLineSegment(FlagsRequiringIndividualRunIteration{detail::everyRunFlag},
-           [&](TextLinePart part, CTLineXOffset offset, CTLine&, Optional<GlyphSpan> span)
+           [&](TextLinePart part, CTLineXOffset offset, CTLine*, Optional<GlyphSpan> span)
              STU_INLINE_LAMBDA
            {
              return body(part, offset, *span);
@@ -568,7 +658,7 @@ struct TextFrameLine : STUTextFrameLine {
   STU_INLINE
   void forEachGlyphSpan(Body&& body) const {
     forEachCTLineSegment(FlagsRequiringIndividualRunIteration{detail::everyRunFlag},
-      [&](TextLinePart part, CTLineXOffset offset, CTLine&, Optional<GlyphSpan> span)
+      [&](TextLinePart part, CTLineXOffset offset, CTLine*, Optional<GlyphSpan> span)
         STU_INLINE_LAMBDA -> ShouldStop
       {
         body(part, offset, *span);
@@ -6,10 +6,33 @@
 #import "CoreGraphicsUtils.hpp"
 #import "TextFrameLayouter.hpp"
 
+#import "stu/BinarySearch.hpp"
+
 #include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
 namespace stu_label {
 
+/// The entries of the shaped string's style index for the styles that are copied into the
+/// text frame. The offsets are relative to the shaped string's first style.
+static ArrayRef<const TextStyleIndexEntry>
+         originalStringStyleIndexEntries(const TextFrameLayouter& layouter)
+{
+  const TextStyleSpan shapedStringStyles = layouter.shapedStringStyles();
+  const ArrayRef<const TextStyleIndexEntry> index = shapedStringStyles.index;
+  if (index.isEmpty()) return {};
+  const TextStyleSpan styles = layouter.originalStringStyles();
+  const UInt startOffset = sign_cast(styles.dataBegin() - shapedStringStyles.dataBegin());
+  const UInt endOffset = startOffset + sign_cast(styles.dataExcludingTerminator().count());
+  const Int start = binarySearchFirstIndexWhere(index, [&](const TextStyleIndexEntry& entry) {
+                      return entry.offset >= startOffset;
+                    }).indexOrArrayCount;
+  const Int end = binarySearchFirstIndexWhere(index, [&](const TextStyleIndexEntry& entry) {
+                    return entry.offset >= endOffset;
+                  }).indexOrArrayCount;
+  if (end - start < TextStyleIndexEntry::minStyleCount/TextStyleIndexEntry::stride) return {};
+  return index[{start, end}];
+}
+
 TextFrame::SizeAndOffset TextFrame::objectSizeAndThisOffset(const TextFrameLayouter& layouter) {
   // The data layout must be kept in-sync with
   //   TextFrame::verticalSearchTable
@@ -17,7 +40,9 @@ TextFrame::SizeAndOffset TextFrame::objectSizeAndThisOffset(const TextFrameLayou
   //   STUTextFrameDataGetParagraphs
   //   STUTextFrameDataGetLines
   //   STUTextFrameLineGetParagraph
+  //   STUTextFrameData::_glyphStorage
   //   TextFrame::colors()
+  //   TextFrame::textStyleIndex()
   //   stu_label_lldb_formatters.STUTextFrameData_ChildrenProvider
 
   static_assert(IntervalSearchTable::arrayElementSize%alignof(STUTextFrameData) == 0
@@ -25,7 +50,8 @@ TextFrame::SizeAndOffset TextFrame::objectSizeAndThisOffset(const TextFrameLayou
                 && alignof(STUTextFrameData) == alignof(STUTextFrameLine)
                 && alignof(STUTextFrameData) == alignof(STUTextFrameParagraph)
                 && alignof(STUTextFrameData) == alignof(ColorRef)
-                && alignof(STUTextFrameData) >= alignof(TextStyle));
+                && alignof(STUTextFrameData) >= alignof(TextStyle)
+                && alignof(TextStyle) >= alignof(TextStyleIndexEntry));
 
   const Int lineCount = layouter.lines().count();
 
@@ -35,6 +61,14 @@ TextFrame::SizeAndOffset TextFrame::objectSizeAndThisOffset(const TextFrameLayou
                                                 layouter.rangeInOriginalString().end);
   const ArrayRef<const ColorRef> colors = layouter.colors();
 
+  Optional<TextFrameGlyphStorage::Counts> glyphStorageCounts;
+  UInt glyphStorageSize = 0;
+  if (layouter.usesCompactGlyphStorage() && lineCount > 0) {
+    glyphStorageCounts = TextFrameGlyphStorage::countsForCTLines(layouter.lines());
+    static_assert(alignof(STUTextFrameData) == 8);
+    glyphStorageSize = TextFrameGlyphStorage::sizeInBytes(*glyphStorageCounts) + sanitizerGap;
+  }
+
   return {.offset = verticalSearchTableSize + sanitizerGap
                   + lineStringIndicesTableSize + sanitizerGap,
           .size = verticalSearchTableSize
@@ -45,15 +79,143 @@ TextFrame::SizeAndOffset TextFrame::objectSizeAndThisOffset(const TextFrameLayou
                 + layouter.paragraphs().arraySizeInBytes()
                 + layouter.lines().arraySizeInBytes()
                 + sanitizerGap
+                + glyphStorageSize
                 + colors.arraySizeInBytes()
                 + sanitizerGap
                 + layouter.originalStringStyles().dataExcludingTerminator().arraySizeInBytes()
                 + sign_cast(stylesTerminatorSize)
                 + layouter.truncationTokenTextStyleData().arraySizeInBytes()
-                + sanitizerGap};
+                + originalStringStyleIndexEntries(layouter).arraySizeInBytes()
+                + sanitizerGap,
+          .glyphStorageCounts = glyphStorageCounts};
+}
+
+static UInt8 layoutIterationCount(const TextFrameLayouter& layouter) {
+  return narrow_cast<UInt8>(min(layouter.layoutCallCount(), UInt32{maxValue<UInt8>}));
+}
+
+namespace {
+
+/// The horizontal indentation of the lines of an indented paragraph in the inversely scaled
+/// coordinate system of the text frame.
+struct ParagraphIndents {
+  Float64 initialLeft;
+  Float64 initialRight;
+  Float64 nonInitialLeft;
+  Float64 nonInitialRight;
+
+  ParagraphIndents(const ShapedString::Paragraph& p, Float64 inverseScale) {
+    initialLeft  = p.commonLeftIndent*inverseScale;
+    initialRight = p.commonRightIndent*inverseScale;
+    nonInitialLeft  = initialLeft;
+    nonInitialRight = initialRight;
+    if (p.initialExtraLeftIndent > 0) {
+      initialLeft += p.initialExtraLeftIndent;
+    } else if (p.initialExtraLeftIndent < 0) {
+      nonInitialLeft -= p.initialExtraLeftIndent;
+    }
+    if (p.initialExtraRightIndent > 0) {
+      initialRight += p.initialExtraRightIndent;
+    } else if (p.initialExtraRightIndent < 0) {
+      nonInitialRight -= p.initialExtraRightIndent;
+    }
+  }
+
+  Range<Float64> lineXBounds(const TextFrameParagraph& para, const TextFrameLine& line) const {
+    const bool isInitialLine = line.lineIndex < para.initialLinesEndIndex;
+    Range<Float64> x = line.originX + Range{0., line.width};
+    x.start -= isInitialLine ? initialLeft : nonInitialLeft;
+    x.end += isInitialLine ? initialRight : nonInitialRight;
+    return x;
+  }
+};
+
+} // namespace
+
+/// Initializes the members of the STUTextFrameData that are part of the STUTextFrameLayoutInfo
+/// and that depend on the individual lines.
+///
+/// @param xBounds The convex hull of the horizontal layout bounds of the lines, including the
+///                paragraph indentation, in the inversely scaled coordinate system.
+/// @param firstBaseline The (display scale rounded) Y-coordinate of the first baseline in the
+///                      inversely scaled coordinate system.
+/// @param lastBaseline The (display scale rounded) Y-coordinate of the last baseline in the
+///                     inversely scaled coordinate system.
+static void initializeLayoutSummary(STUTextFrameData& data, const TextFrameLayouter& layouter,
+                                    Range<Float64> xBounds, TextFlags flags, bool isTruncated,
+                                    Float64 firstBaseline, Float64 lastBaseline)
+{
+  const ArrayRef<const TextFrameParagraph> paragraphs = layouter.paragraphs();
+  const ArrayRef<const TextFrameLine> lines = layouter.lines();
+  const CGFloat textScaleFactor = data.textScaleFactor;
+
+  data.minX = textScaleFactor*xBounds.start;
+  data.maxX = textScaleFactor*xBounds.end;
+
+  const auto& firstLine = lines[0];
+  const auto& lastLine = lines[$ - 1];
+
+  data.firstBaseline = textScaleFactor*firstBaseline;
+  data.lastBaseline = textScaleFactor*lastBaseline;
+
+  const Float32 firstLineHeight = firstLine._heightAboveBaseline + firstLine._heightBelowBaseline;
+  const Float32 lastLineHeight = lastLine._heightAboveBaseline + lastLine._heightBelowBaseline;
+  const Float32 firstLineMinBaselineDistance =
+                  layouter.originalStringParagraphs()[0].minBaselineDistance;
+  const Float32 lastLineMinBaselineDistance =
+                  layouter.originalStringParagraphs()[lastLine.paragraphIndex].minBaselineDistance;
+
+  const Float32 scale32 = narrow_cast<Float32>(textScaleFactor);
+
+  data.firstLineHeight = scale32*max(firstLineHeight, firstLineMinBaselineDistance);
+  data.firstLineHeightAboveBaseline =
+    scale32*(firstLine._heightAboveBaseline
+             + max(0.f, (firstLineMinBaselineDistance - firstLineHeight)/2));
+
+  data.lastLineHeight = scale32*max(lastLineHeight, lastLineMinBaselineDistance);
+  data.lastLineHeightBelowBaselineWithoutSpacing =
+    scale32*lastLine._heightBelowBaselineWithoutSpacing;
+  data.lastLineHeightBelowBaselineWithMinimalSpacing =
+    scale32*min(lastLine._heightBelowBaseline,
+                lastLine._heightBelowBaselineWithoutSpacing
+                + layouter.minimalSpacingBelowLastLine());
+  data.lastLineHeightBelowBaseline =
+    scale32*(lastLine._heightBelowBaseline
+             + max(0.f, (lastLineMinBaselineDistance - lastLineHeight)/2));
+
+  STUTextFrameConsistentAlignment consistentAlignment = stuTextFrameConsistentAlignment(
+                                                          paragraphs[0].alignment);
+  for (const TextFrameParagraph& para : paragraphs[{1, $}]) {
+    if (consistentAlignment != stuTextFrameConsistentAlignment(para.alignment)) {
+      consistentAlignment = STUTextFrameConsistentAlignmentNone;
+      break;
+    }
+  }
+
+  const bool isScaled = textScaleFactor < 1;
+
+  bool hasMaxTypographicWidth = consistentAlignment != STUTextFrameConsistentAlignmentNone
+                             && !isTruncated
+                             && !isScaled;
+  if (hasMaxTypographicWidth) {
+    Int32 i = 0;
+    for (const TextFrameParagraph& para : paragraphs) {
+      if (para.lineIndexRange().end == ++i) continue;
+      hasMaxTypographicWidth = false;
+      break;
+    }
+  }
+
+  data.consistentAlignment = consistentAlignment;
+  data.flags = static_cast<STUTextFrameFlags>(
+                 static_cast<STUTextFrameFlags>(flags)
+                 | (isTruncated ? STUTextFrameIsTruncated : 0)
+                 | (isScaled ? STUTextFrameIsScaled : 0)
+                 | (hasMaxTypographicWidth ? STUTextFrameHasMaxTypographicWidth : 0));
 }
 
-TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
+TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize,
+                     Optional<TextFrameGlyphStorage::Counts> glyphStorageCounts)
 : STUTextFrameData{
     .paragraphCount = narrow_cast<Int32>(layouter.paragraphs().count()),
     .lineCount = narrow_cast<Int32>(layouter.lines().count()),
@@ -63,7 +225,7 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
     .textScaleFactor = layouter.scaleInfo().scale,
     .displayScale = layouter.scaleInfo().originalDisplayScale,
     .rangeInOriginalStringIsFullString = layouter.rangeInOriginalStringIsFullString(),
-    ._layoutIterationCount = narrow_cast<UInt8>(layouter.layoutCallCount()),
+    ._layoutIterationCount = layoutIterationCount(layouter),
     .rangeInOriginalString = layouter.rangeInOriginalString(),
     .truncatedStringLength = layouter.truncatedStringLength(),
     .originalAttributedString = layouter.attributedString().attributedString,
@@ -77,9 +239,13 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
   const UInt originalStringTextStyleDataSize = sign_cast(layouter.originalStringStyles()
                                                          .dataExcludingTerminator().count()
                                                          + originalStylesTerminatorSize);
+  const ArrayRef<const TextStyleIndexEntry> styleIndexEntries =
+                                              originalStringStyleIndexEntries(layouter);
+  _textStyleIndexCount = narrow_cast<Int32>(styleIndexEntries.count());
   _textStylesData = reinterpret_cast<const uint8_t*>(this)
                   + dataSize
                   - sanitizerGap
+                  - styleIndexEntries.arraySizeInBytes()
                   - layouter.truncationTokenTextStyleData().count()
                   - originalStringTextStyleDataSize;
 
@@ -103,6 +269,22 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
     p += layouter.lines().arraySizeInBytes();
     p += sanitizerGap;
 
+    if (glyphStorageCounts) {
+      _glyphStorage = &TextFrameGlyphStorage::createFromCTLines(this->lines(),
+                                                                *glyphStorageCounts, p);
+      p += _glyphStorage->sizeInBytes();
+#if STU_USE_ADDRESS_SANITIZER
+      sanitizer::poison(p, sanitizerGap);
+#endif
+      p += sanitizerGap;
+      // Once their _initStep is 0, the lines reference the glyph data in the storage.
+      for (TextFrameLine& line : const_array_cast(this->lines())) {
+        line.releaseCTLines();
+        line._ctLine = nullptr;
+        line._tokenCTLine = nullptr;
+      }
+    }
+
     const ArrayRef<const ColorRef> colors = layouter.colors();
     for (auto& color : colors) {
       CFRetain(color.cgColor());
@@ -124,9 +306,19 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
                                               p - originalStyles.lastStyleSizeInBytes(),
                                               ArrayRef{p, originalStylesTerminatorSize});
     p += originalStylesTerminatorSize;
-    STU_DEBUG_ASSERT(p + layouter.truncationTokenTextStyleData().count() + sanitizerGap
-                     == reinterpret_cast<Byte*>(this) + dataSize);
     copyConstructArray(layouter.truncationTokenTextStyleData(), p);
+    p += layouter.truncationTokenTextStyleData().count();
+
+    STU_ASSERT(p == reinterpret_cast<const Byte*>(textStyleIndex().begin()));
+    // Rebase the offsets from the shaped string's first style to the text frame's first style.
+    const UInt32 offset = narrow_cast<UInt32>(originalStyles.dataBegin()
+                                              - layouter.shapedStringStyles().dataBegin());
+    for (const TextStyleIndexEntry& entry : styleIndexEntries) {
+      new (p) TextStyleIndexEntry{.stringIndex = entry.stringIndex,
+                                  .offset = entry.offset - offset};
+      p += sizeof(TextStyleIndexEntry);
+    }
+    STU_DEBUG_ASSERT(p + sanitizerGap == reinterpret_cast<Byte*>(this) + dataSize);
   }
 
   const ArrayRef<TextFrameParagraph> paragraphs = const_array_cast(this->paragraphs());
@@ -155,29 +347,20 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
   for (TextFrameParagraph& para : paragraphs) {
     isTruncated |= !para.excisedRangeInOriginalString().isEmpty();
 
-    bool isIndented = para.isIndented;
-    Float64 initialLeftIndent;
-    Float64 initialRightIndent;
-    Float64 nonInitialLeftIndent;
-    Float64 nonInitialRightIndent;
-    if (isIndented) {
+    Optional<ParagraphIndents> indents;
+    if (para.isIndented) {
       const ShapedString::Paragraph& p = layouter.originalStringParagraphs()[para.paragraphIndex];
-      initialLeftIndent  = p.commonLeftIndent*inverseScale;
-      initialRightIndent = p.commonRightIndent*inverseScale;
-      nonInitialLeftIndent  = initialLeftIndent;
-      nonInitialRightIndent = initialRightIndent;
+      indents = ParagraphIndents{p, inverseScale};
       if (p.initialExtraLeftIndent == 0) {
         para.initialLinesLeftIndent    = p.commonLeftIndent;
         para.nonInitialLinesLeftIndent = p.commonLeftIndent;
       } else {
         if (p.initialExtraLeftIndent > 0) {
-          initialLeftIndent += p.initialExtraLeftIndent;
           para.nonInitialLinesLeftIndent = p.commonLeftIndent;
           para.initialLinesLeftIndent = p.commonLeftIndent
                                       + textScaleFactor*p.initialExtraLeftIndent;
 
         } else {
-          nonInitialLeftIndent -= p.initialExtraLeftIndent;
           para.initialLinesLeftIndent = p.commonLeftIndent;
           para.nonInitialLinesLeftIndent = p.commonLeftIndent
                                          - textScaleFactor*p.initialExtraLeftIndent;
@@ -188,13 +371,11 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
         para.nonInitialLinesRightIndent = p.commonRightIndent;
       } else {
         if (p.initialExtraRightIndent > 0) {
-          initialRightIndent += p.initialExtraRightIndent;
           para.nonInitialLinesRightIndent = p.commonRightIndent;
           para.initialLinesRightIndent = p.commonRightIndent
                                        + textScaleFactor*p.initialExtraRightIndent;
 
         } else {
-          nonInitialRightIndent -= p.initialExtraRightIndent;
           para.initialLinesRightIndent = p.commonRightIndent;
           para.nonInitialLinesRightIndent = p.commonRightIndent
                                           - textScaleFactor*p.initialExtraRightIndent;
@@ -214,18 +395,8 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
       lineIndices[lineIndex].startIndexInOriginalString = line.rangeInOriginalString.start;
       lineIndices[lineIndex].startIndexInTruncatedString = line.rangeInTruncatedString.start;
 
-      Range<Float64> x = line.originX + Range{0., line.width};
-      if (isIndented) {
-        STU_DISABLE_CLANG_WARNING("-Wconditional-uninitialized")
-        const Float64 leftIndent = lineIndex < para.initialLinesEndIndex
-                                 ? initialLeftIndent : nonInitialLeftIndent;
-        const Float64 rightIndent = lineIndex < para.initialLinesEndIndex
-                                  ? initialRightIndent : nonInitialRightIndent;
-        STU_REENABLE_CLANG_WARNING
-        x.start -= leftIndent;
-        x.end += rightIndent;
-      }
-      xBounds = xBounds.convexHull(x);
+      xBounds = xBounds.convexHull(indents ? indents->lineXBounds(para, line)
+                                   : line.originX + Range{0., line.width});
 
       if (const auto& displayScale = layouter.scaleInfo().displayScale) {
         line.originY = ceilToScale(line.originY, *displayScale);
@@ -260,71 +431,87 @@ TextFrame::TextFrame(TextFrameLayouter&& layouter, UInt dataSize)
     }
   }
 
-  this->minX = textScaleFactor*xBounds.start;
-  this->maxX = textScaleFactor*xBounds.end;
-
-  const auto& firstLine = lines[0];
-  const auto& lastLine = lines[$ - 1];
-
-  this->firstBaseline = textScaleFactor*firstLine.originY;
-  this->lastBaseline = textScaleFactor*lastLine.originY;
-
-  const Float32 firstLineHeight = firstLine._heightAboveBaseline + firstLine._heightBelowBaseline;
-  const Float32 lastLineHeight = lastLine._heightAboveBaseline + lastLine._heightBelowBaseline;
-  const Float32 firstLineMinBaselineDistance =
-                  layouter.originalStringParagraphs()[0].minBaselineDistance;
-  const Float32 lastLineMinBaselineDistance =
-                  layouter.originalStringParagraphs()[lastLine.paragraphIndex].minBaselineDistance;
-
-  const Float32 scale32 = narrow_cast<Float32>(textScaleFactor);
-
-  this->firstLineHeight = scale32*max(firstLineHeight, firstLineMinBaselineDistance);
-  this->firstLineHeightAboveBaseline =
-    scale32*(firstLine._heightAboveBaseline
-             + max(0.f, (firstLineMinBaselineDistance - firstLineHeight)/2));
-
-  this->lastLineHeight = scale32*max(lastLineHeight, lastLineMinBaselineDistance);
-  this->lastLineHeightBelowBaselineWithoutSpacing =
-    scale32*lastLine._heightBelowBaselineWithoutSpacing;
-  this->lastLineHeightBelowBaselineWithMinimalSpacing =
-    scale32*min(lastLine._heightBelowBaseline,
-                lastLine._heightBelowBaselineWithoutSpacing
-                + layouter.minimalSpacingBelowLastLine());
-  this->lastLineHeightBelowBaseline =
-    scale32*(lastLine._heightBelowBaseline
-             + max(0.f, (lastLineMinBaselineDistance - lastLineHeight)/2));
+  initializeLayoutSummary(*this, layouter, xBounds, flags, isTruncated,
+                          lines[0].originY, lines[$ - 1].originY);
+}
 
-  STUTextFrameConsistentAlignment consistentAlignment = stuTextFrameConsistentAlignment(
-                                                          paragraphs[0].alignment);
-  for (const TextFrameParagraph& para : paragraphs[{1, $}]) {
-    if (consistentAlignment != stuTextFrameConsistentAlignment(para.alignment)) {
-      consistentAlignment = STUTextFrameConsistentAlignmentNone;
-      break;
+STUTextFrameLayoutInfo TextFrame::layoutInfo(const TextFrameLayouter& layouter,
+                                             CGPoint frameOrigin)
+{
+  STUTextFrameData data{
+    .lineCount = narrow_cast<Int32>(layouter.lines().count()),
+    .layoutMode = layouter.layoutMode(),
+    ._layoutIterationCount = layoutIterationCount(layouter),
+    .size = narrow_cast<CGSize>(layouter.scaleInfo().scale*layouter.inverselyScaledFrameSize()),
+    .displayScale = layouter.scaleInfo().originalDisplayScale,
+    .textScaleFactor = layouter.scaleInfo().scale
+  };
+  if (layouter.lines().isEmpty()) {
+    data.consistentAlignment = STUTextFrameConsistentAlignmentLeft;
+    data.flags = STUTextFrameHasMaxTypographicWidth;
+  } else {
+    const Float64 inverseScale = layouter.scaleInfo().inverseScale;
+    const ArrayRef<const TextFrameLine> lines = layouter.lines();
+    bool isTruncated = false;
+    TextFlags flags{};
+    Range<Float64> xBounds = Range<Float64>::infinitelyEmpty();
+    for (const TextFrameParagraph& para : layouter.paragraphs()) {
+      isTruncated |= !para.excisedRangeInOriginalString().isEmpty();
+      Optional<ParagraphIndents> indents;
+      if (para.isIndented) {
+        indents = ParagraphIndents{layouter.originalStringParagraphs()[para.paragraphIndex],
+                                   inverseScale};
+      }
+      TextFlags paraFlags{};
+      for (const TextFrameLine& line : lines[para.lineIndexRange()]) {
+        paraFlags = paraFlags | TextFlags{line.textFlags()};
+        xBounds = xBounds.convexHull(indents ? indents->lineXBounds(para, line)
+                                     : line.originX + Range{0., line.width});
+      }
+      flags |= paraFlags;
     }
-  }
-
-  const bool isScaled = this->textScaleFactor < 1;
-
-  bool hasMaxTypographicWidth = consistentAlignment != STUTextFrameConsistentAlignmentNone
-                             && !isTruncated
-                             && !isScaled;
-  if (hasMaxTypographicWidth) {
-    Int32 i = 0;
-    for (const TextFrameParagraph& para : paragraphs) {
-      if (para.lineIndexRange().end == ++i) continue;
-      hasMaxTypographicWidth = false;
-      break;
+    Float64 firstBaseline = lines[0].originY;
+    Float64 lastBaseline = lines[$ - 1].originY;
+    if (const auto& displayScale = layouter.scaleInfo().displayScale) {
+      firstBaseline = ceilToScale(firstBaseline, *displayScale);
+      lastBaseline = ceilToScale(lastBaseline, *displayScale);
     }
+    initializeLayoutSummary(data, layouter, xBounds, flags, isTruncated,
+                            firstBaseline, lastBaseline);
   }
-
-  this->consistentAlignment = consistentAlignment;
-  this->flags = static_cast<STUTextFrameFlags>(
-                  static_cast<STUTextFrameFlags>(flags)
-                  | (isTruncated ? STUTextFrameIsTruncated : 0)
-                  | (isScaled ? STUTextFrameIsScaled : 0)
-                  | (hasMaxTypographicWidth ? STUTextFrameHasMaxTypographicWidth : 0));
+  return stuTextFrameLayoutInfo(data, frameOrigin, data.displayScale);
 }
 
+STUTextFrameLayoutInfo stuTextFrameLayoutInfo(const STUTextFrameData& data, CGPoint frameOrigin,
+                                              CGFloat displayScale)
+{
+  Float64 firstBaseline = frameOrigin.y + data.firstBaseline;
+  Float64 lastBaseline = frameOrigin.y + data.lastBaseline;
+  if (const Optional<DisplayScale> scale = DisplayScale::create(displayScale)) {
+    firstBaseline = ceilToScale(firstBaseline, *scale);
+    lastBaseline = ceilToScale(lastBaseline, *scale);
+  }
+  return {
+    .lineCount = data.lineCount,
+    .flags = data.flags,
+    .layoutMode = data.layoutMode,
+    .consistentAlignment = data.consistentAlignment,
+    .minX = frameOrigin.x + data.minX,
+    .maxX = frameOrigin.x + data.maxX,
+    .firstBaseline = firstBaseline,
+    .lastBaseline = lastBaseline,
+    .firstLineHeight = data.firstLineHeight,
+    .firstLineHeightAboveBaseline = data.firstLineHeightAboveBaseline,
+    .lastLineHeight = data.lastLineHeight,
+    .lastLineHeightBelowBaseline = data.lastLineHeightBelowBaseline,
+    .lastLineHeightBelowBaselineWithoutSpacing = data.lastLineHeightBelowBaselineWithoutSpacing,
+    .lastLineHeightBelowBaselineWithMinimalSpacing =
+       data.lastLineHeightBelowBaselineWithMinimalSpacing,
+    .size = data.size,
+    .textScaleFactor = data.textScaleFactor,
+    .layoutIterationCount = data._layoutIterationCount
+  };
+}
 
 TextFrame::~TextFrame() {
   if (const void* const bs = atomic_load_explicit(&_backgroundSegments, memory_order_relaxed)) {
@@ -345,6 +532,9 @@ TextFrame::~TextFrame() {
   for (const TextFrameLine& line : lines().reversed()) {
     line.releaseCTLines();
   }
+  if (_glyphStorage) {
+    _glyphStorage->releaseFonts();
+  }
   for (ColorRef color : colors()) {
     decrementRefCount(color.cgColor());
   }
@@ -354,6 +544,9 @@ TextFrame::~TextFrame() {
   sanitizer::unpoison((Byte*)verticalSearchTable().startValues().end(), sanitizerGap);
   sanitizer::unpoison((Byte*)lineStringIndices().end(), sanitizerGap);
   sanitizer::unpoison((Byte*)lines().end(), sanitizerGap);
+  if (_glyphStorage) {
+    sanitizer::unpoison((Byte*)_glyphStorage + _glyphStorage->sizeInBytes(), sanitizerGap);
+  }
   sanitizer::unpoison((Byte*)colors().end(), sanitizerGap);
   sanitizer::unpoison((Byte*)this + _dataSize - sanitizerGap, sanitizerGap);
 #endif
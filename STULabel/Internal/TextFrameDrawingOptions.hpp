@@ -101,6 +101,18 @@ public:
     setOverrideColorsMaskFlag(TextFlags::hasLink, color != nil);
   }
 
+  bool contextShouldAntialias() const { return contextShouldAntialias_; }
+  void setContextShouldAntialias(bool value) {
+    checkNotFrozen();
+    contextShouldAntialias_ = value;
+  }
+
+  bool contextShouldSmoothFonts() const { return contextShouldSmoothFonts_; }
+  void setContextShouldSmoothFonts(bool value) {
+    checkNotFrozen();
+    contextShouldSmoothFonts_ = value;
+  }
+
 private:
 
   void checkNotFrozen() {
@@ -119,6 +131,8 @@ private:
   bool isFrozen_{};
   bool hasHighlightTextFrameRange_{};
   bool overrideColorsApplyToHighlightedText_{true};
+  bool contextShouldAntialias_{true};
+  bool contextShouldSmoothFonts_{true};
   TextFlags overrideColorsTextFlagsMask_{};
   STUTextFrameDrawingMode drawingMode_{};
   union {
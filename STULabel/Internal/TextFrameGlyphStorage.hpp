@@ -0,0 +1,169 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#pragma once
+
+#import "GlyphSpan.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label { struct TextFrameLine; }
+
+/// A compact copy of the glyph data of the CTLines of a text frame's lines, stored in flat
+/// arrays. A text frame created with the `usesCompactGlyphStorage` option constructs the storage
+/// inside its own allocation and releases the CTLines afterwards. The glyph spans of the lines then
+/// reference the `StoredGlyphRun`s of the storage instead of CTRuns.
+///
+/// The storage doesn't own its memory. Instances are immutable and hence thread-safe.
+struct STUTextFrameGlyphStorage {
+  using Int = stu::Int;
+  using UInt = stu::UInt;
+  using Int32 = stu::Int32;
+  using Float64 = stu::Float64;
+  template <typename T> using ArrayRef = stu::ArrayRef<T>;
+  template <typename T> using Range = stu::Range<T>;
+  using CTFont = stu_label::CTFont;
+  using CTRun = stu_label::CTRun;
+  using StoredGlyphRun = stu_label::StoredGlyphRun;
+
+  struct Counts {
+    Int lineCount;
+    Int runCount;
+    Int glyphCount;
+  };
+
+  /// The size of a storage with the specified counts, rounded up to a multiple of 8.
+  static UInt sizeInBytes(Counts counts);
+
+  /// The counts of a storage for the runs of the `_ctLine` and `_tokenCTLine` of the lines.
+  static Counts countsForCTLines(ArrayRef<const stu_label::TextFrameLine> lines);
+
+  /// Constructs a storage in the specified memory and copies the glyph data of the `_ctLine` and
+  /// `_tokenCTLine` of the lines into it. Retains the fonts of the runs.
+  ///
+  /// @param memory At least `sizeInBytes(counts)` bytes of 8-byte-aligned memory.
+  /// @pre `counts` equals `countsForCTLines(lines)`.
+  static const STUTextFrameGlyphStorage& createFromCTLines(
+                                           ArrayRef<const stu_label::TextFrameLine> lines,
+                                           Counts counts, stu::Byte* memory);
+
+  /// Constructs a storage in caller-provided memory from runs that are added one by one.
+  class Builder {
+  public:
+    struct RunData {
+      CTFont* __nullable font;
+      CGAffineTransform textMatrix;
+      CTRunStatus status;
+      Range<Int32> stringRange;
+      Float64 typographicWidth;
+      ArrayRef<const CGGlyph> glyphs;
+      ArrayRef<const CGPoint> positions;
+      ArrayRef<const CGSize> advances;
+      ArrayRef<const Int> stringIndices;
+    };
+
+    /// @param memory At least `sizeInBytes(counts)` bytes of 8-byte-aligned memory.
+    Builder(Counts counts, stu::Byte* memory);
+
+    /// Appends a run to the current line and retains the run's font.
+    /// @pre All arrays in `run` have the same number of elements.
+    void addRun(const RunData& run);
+
+    /// Marks the start of the current line's truncation token or hyphen runs.
+    void startTokenRuns();
+
+    /// Ends the current line.
+    void endLine();
+
+    /// @pre All lines, runs and glyphs specified by the counts have been added.
+    const STUTextFrameGlyphStorage& storage() const;
+
+  private:
+    STUTextFrameGlyphStorage& storage_;
+    Int lineIndex_{};
+    Int runIndex_{};
+    Int glyphIndex_{};
+    bool hasTokenRuns_{};
+  };
+
+  STUTextFrameGlyphStorage(const STUTextFrameGlyphStorage&) = delete;
+  STUTextFrameGlyphStorage& operator=(const STUTextFrameGlyphStorage&) = delete;
+
+  /// Releases the fonts of the runs. The storage must not be used afterwards.
+  void releaseFonts() const;
+
+  Counts counts() const { return {lineCount_, runCount_, glyphCount_}; }
+
+  UInt sizeInBytes() const { return sizeInBytes(counts()); }
+
+  ArrayRef<const StoredGlyphRun> runs() const {
+    return {reinterpret_cast<const StoredGlyphRun*>(this + 1), runCount_, stu::unchecked};
+  }
+
+  /// The copies of the runs of the line's `_ctLine`.
+  ArrayRef<const StoredGlyphRun> nonTokenRuns(Int lineIndex) const {
+    STU_PRECONDITION(0 <= lineIndex && lineIndex < lineCount_);
+    const Int32* const indices = lineRunStartIndices() + 2*lineIndex;
+    return runs()[{indices[0], indices[1]}];
+  }
+
+  /// The copies of the runs of the line's `_tokenCTLine`.
+  ArrayRef<const StoredGlyphRun> tokenRuns(Int lineIndex) const {
+    STU_PRECONDITION(0 <= lineIndex && lineIndex < lineCount_);
+    const Int32* const indices = lineRunStartIndices() + 2*lineIndex;
+    return runs()[{indices[1], indices[2]}];
+  }
+
+  /// Returns the index of the glyph in the glyph range whose typographic extent contains the
+  /// specified X offset, relative to the start of the glyph range. Offsets before the first glyph
+  /// are mapped to the first glyph and offsets after the last glyph are mapped to the last glyph.
+  /// Uses a binary search over the `glyphXOffsets` of the run.
+  ///
+  /// @param startXOffset The X offset of the first glyph in the glyph range.
+  /// @param outGlyphXOffset The X offset of the returned glyph.
+  /// @pre `!glyphRange.isEmpty()`
+  static Int glyphIndexAtXOffset(const StoredGlyphRun& run, Range<Int> glyphRange,
+                                 Float64 startXOffset, Float64 xOffset,
+                                 stu::Out<Float64> outGlyphXOffset);
+
+private:
+  explicit STUTextFrameGlyphStorage(Counts counts);
+  ~STUTextFrameGlyphStorage() = default;
+
+  // The storage is followed in memory by the following arrays (ordered by decreasing alignment):
+  //   StoredGlyphRun runs[runCount_];
+  //   CGPoint positions[glyphCount_];
+  //   Float64 glyphXOffsets[glyphCount_ + runCount_];
+  //   Int stringIndices[glyphCount_];
+  //   Int32 lineRunStartIndices[2*lineCount_ + 1];
+  //   CGGlyph glyphs[glyphCount_];
+
+  CGPoint* positions() const {
+    return reinterpret_cast<CGPoint*>(const_cast<StoredGlyphRun*>(runs().end()));
+  }
+  Float64* glyphXOffsets() const {
+    return reinterpret_cast<Float64*>(positions() + glyphCount_);
+  }
+  Int* stringIndices() const {
+    return reinterpret_cast<Int*>(glyphXOffsets() + (glyphCount_ + runCount_));
+  }
+  /// For each line the start index of the line's non-token runs and of the line's token runs,
+  /// followed by the total run count.
+  Int32* lineRunStartIndices() const {
+    return reinterpret_cast<Int32*>(stringIndices() + glyphCount_);
+  }
+  CGGlyph* glyphs() const {
+    return reinterpret_cast<CGGlyph*>(lineRunStartIndices() + (2*lineCount_ + 1));
+  }
+
+  Int lineCount_;
+  Int runCount_;
+  Int glyphCount_;
+};
+
+namespace stu_label {
+
+using TextFrameGlyphStorage = STUTextFrameGlyphStorage;
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -0,0 +1,198 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TextFrameGlyphStorage.hpp"
+
+#import "TextFrame.hpp"
+
+#import "stu/BinarySearch.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+using namespace stu;
+using namespace stu_label;
+
+static_assert(sizeof(TextFrameGlyphStorage)%alignof(StoredGlyphRun) == 0);
+static_assert(alignof(StoredGlyphRun) >= alignof(CGPoint) && alignof(CGPoint) >= alignof(Float64)
+              && alignof(Float64) >= alignof(Int) && alignof(Int) >= alignof(Int32)
+              && alignof(Int32) >= alignof(CGGlyph) && alignof(StoredGlyphRun) <= 8);
+
+UInt TextFrameGlyphStorage::sizeInBytes(Counts counts) {
+  const UInt runCount = sign_cast(counts.runCount);
+  const UInt glyphCount = sign_cast(counts.glyphCount);
+  return roundUpToMultipleOf<8>(sizeof(TextFrameGlyphStorage)
+                                + runCount*(sizeof(StoredGlyphRun) + sizeof(Float64))
+                                + glyphCount*(sizeof(CGPoint) + sizeof(Float64) + sizeof(Int)
+                                              + sizeof(CGGlyph))
+                                + sign_cast(2*counts.lineCount + 1)*sizeof(Int32));
+}
+
+TextFrameGlyphStorage::STUTextFrameGlyphStorage(Counts counts)
+: lineCount_{counts.lineCount}, runCount_{counts.runCount}, glyphCount_{counts.glyphCount}
+{
+  STU_PRECONDITION(lineCount_ >= 0 && runCount_ >= 0 && glyphCount_ >= 0);
+}
+
+TextFrameGlyphStorage::Builder::Builder(Counts counts, Byte* memory)
+: storage_{*new (memory) TextFrameGlyphStorage{counts}}
+{
+  STU_DEBUG_ASSERT(reinterpret_cast<UInt>(memory)%8 == 0);
+  storage_.lineRunStartIndices()[0] = 0;
+}
+
+void TextFrameGlyphStorage::Builder::addRun(const RunData& run) {
+  const Int n = run.glyphs.count();
+  STU_PRECONDITION(run.positions.count() == n && run.advances.count() == n
+                   && run.stringIndices.count() == n);
+  STU_PRECONDITION(lineIndex_ < storage_.lineCount_ && runIndex_ < storage_.runCount_
+                   && n <= storage_.glyphCount_ - glyphIndex_);
+  CGGlyph* const glyphs = storage_.glyphs() + glyphIndex_;
+  CGPoint* const positions = storage_.positions() + glyphIndex_;
+  Int* const stringIndices = storage_.stringIndices() + glyphIndex_;
+  Float64* const xOffsets = storage_.glyphXOffsets() + (glyphIndex_ + runIndex_);
+  array_utils::copyConstructArray(run.glyphs, glyphs);
+  array_utils::copyConstructArray(run.positions, positions);
+  array_utils::copyConstructArray(run.stringIndices, stringIndices);
+  // We derive the glyph offsets from the advances instead of calling CTRunGetTypographicBounds
+  // for every glyph. Since an advance may be negative (see the note in GlyphSpan.hpp), the partial
+  // sums are clamped to keep the offsets non-decreasing and within the run's typographic width.
+  const Float64 width = max(0, run.typographicWidth);
+  Float64 sum = 0;
+  xOffsets[0] = 0;
+  for (Int i = 0; i < n; ++i) {
+    sum += run.advances[i].width;
+    xOffsets[i + 1] = clamp(xOffsets[i], sum, width);
+  }
+  xOffsets[n] = width;
+  if (run.font) {
+    CFRetain(run.font);
+  }
+  new (reinterpret_cast<StoredGlyphRun*>(&storage_ + 1) + runIndex_)
+    StoredGlyphRun{.font = run.font,
+                   .glyphs = glyphs,
+                   .positions = positions,
+                   .stringIndices = stringIndices,
+                   .glyphXOffsets = xOffsets,
+                   .textMatrix = run.textMatrix,
+                   .stringRange = run.stringRange,
+                   .glyphCount = narrow_cast<Int32>(n),
+                   .status = run.status};
+  runIndex_ += 1;
+  glyphIndex_ += n;
+}
+
+void TextFrameGlyphStorage::Builder::startTokenRuns() {
+  STU_PRECONDITION(!hasTokenRuns_);
+  storage_.lineRunStartIndices()[2*lineIndex_ + 1] = narrow_cast<Int32>(runIndex_);
+  hasTokenRuns_ = true;
+}
+
+void TextFrameGlyphStorage::Builder::endLine() {
+  STU_PRECONDITION(lineIndex_ < storage_.lineCount_);
+  if (!hasTokenRuns_) {
+    startTokenRuns();
+  }
+  storage_.lineRunStartIndices()[2*lineIndex_ + 2] = narrow_cast<Int32>(runIndex_);
+  lineIndex_ += 1;
+  hasTokenRuns_ = false;
+}
+
+const TextFrameGlyphStorage& TextFrameGlyphStorage::Builder::storage() const {
+  STU_PRECONDITION(lineIndex_ == storage_.lineCount_ && runIndex_ == storage_.runCount_
+                   && glyphIndex_ == storage_.glyphCount_);
+  return storage_;
+}
+
+void TextFrameGlyphStorage::releaseFonts() const {
+  for (const StoredGlyphRun& run : runs()) {
+    if (run.font) {
+      CFRelease(run.font);
+    }
+  }
+}
+
+auto TextFrameGlyphStorage::countsForCTLines(ArrayRef<const TextFrameLine> lines) -> Counts {
+  Counts counts{.lineCount = lines.count()};
+  for (const TextFrameLine& line : lines) {
+    for (CTLine* const ctLine : {line._ctLine, line._tokenCTLine}) {
+      if (!ctLine) continue;
+      counts.runCount += glyphRuns(ctLine).count();
+      counts.glyphCount += CTLineGetGlyphCount(ctLine);
+    }
+  }
+  return counts;
+}
+
+/// Returns the run's internal array if CoreText provides one and otherwise copies the elements
+/// into the buffer.
+template <typename T>
+static ArrayRef<const T> runArray(CTRun* run, Int count,
+                                  const T* __nullable (* getPointer)(CTRunRef),
+                                  void (* copy)(CTRunRef, CFRange, T*),
+                                  TempArray<T>& buffer)
+{
+  if (count == 0) return {};
+  if (const T* const p = getPointer(run)) return {p, count, unchecked};
+  buffer = TempArray<T>{uninitialized, Count{count}, buffer.allocator()};
+  copy(run, CFRange{0, count}, buffer.begin());
+  return {buffer.begin(), count, unchecked};
+}
+
+static void addRuns(TextFrameGlyphStorage::Builder& builder, CTLine* line) {
+  TempArray<CGGlyph> glyphs;
+  TempArray<CGPoint> positions;
+  TempArray<CGSize> advances;
+  TempArray<Int> stringIndices;
+  for (CTRun* const ctRun : glyphRuns(line)) {
+    const GlyphRunRef run{ctRun};
+    const Int n = run.count();
+    builder.addRun({.font = run.font(),
+                    .textMatrix = run.textMatrix(),
+                    .status = run.status(),
+                    .stringRange = Range<Int32>{run.stringRange()},
+                    .typographicWidth = run.typographicWidth(),
+                    .glyphs = runArray(ctRun, n, CTRunGetGlyphsPtr, CTRunGetGlyphs, glyphs),
+                    .positions = runArray(ctRun, n, CTRunGetPositionsPtr, CTRunGetPositions,
+                                          positions),
+                    .advances = runArray(ctRun, n, CTRunGetAdvancesPtr, CTRunGetAdvances,
+                                         advances),
+                    .stringIndices = runArray(ctRun, n, CTRunGetStringIndicesPtr,
+                                              CTRunGetStringIndices, stringIndices)});
+  }
+}
+
+const TextFrameGlyphStorage&
+  TextFrameGlyphStorage::createFromCTLines(ArrayRef<const TextFrameLine> lines, Counts counts,
+                                           Byte* memory)
+{
+  STU_DEBUG_ASSERT(lines.count() == counts.lineCount);
+  Builder builder{counts, memory};
+  for (const TextFrameLine& line : lines) {
+    if (line._ctLine) {
+      addRuns(builder, line._ctLine);
+    }
+    builder.startTokenRuns();
+    if (line._tokenCTLine) {
+      addRuns(builder, line._tokenCTLine);
+    }
+    builder.endLine();
+  }
+  return builder.storage();
+}
+
+Int TextFrameGlyphStorage::glyphIndexAtXOffset(const StoredGlyphRun& run, Range<Int> glyphRange,
+                                               Float64 startXOffset, Float64 xOffset,
+                                               Out<Float64> outGlyphXOffset)
+{
+  STU_PRECONDITION(!glyphRange.isEmpty() && Range(0, Int{run.glyphCount}).contains(glyphRange));
+  const Float64* const offsets = run.glyphXOffsets + glyphRange.start;
+  const Float64 x = xOffset - startXOffset + offsets[0];
+  // The end offsets of all glyphs in the range except the last one.
+  const ArrayRef<const Float64> endOffsets{offsets + 1, glyphRange.count() - 1, unchecked};
+  const Int glyphIndex = binarySearchFirstIndexWhere(endOffsets, [x](Float64 endOffset) {
+                           return x < endOffset;
+                         }).indexOrArrayCount;
+  outGlyphXOffset.get() = startXOffset + (offsets[glyphIndex] - offsets[0]);
+  return glyphIndex;
+}
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
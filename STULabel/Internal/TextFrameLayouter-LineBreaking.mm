@@ -7,6 +7,10 @@
 #import "UnicodeCodePointProperties.hpp"
 
 #import "stu/Assert.h"
+#import "stu/BinarySearch.hpp"
+
+#include <algorithm>
+#include <atomic>
 
 namespace stu_label {
 
@@ -107,8 +111,9 @@ auto TextFrameLayouter
           } else {
             leftPartWidth = typographicOffset(runs, leftPartEnd);
           }
-          const TextStyle* const style = &firstOriginalStringStyle(line)
-                                          ->styleForStringIndex(narrow_cast<Int32>(stringIndex - 1));
+          const TextStyle* const style = &originalStringStyleForStringIndex(
+                                            narrow_cast<Int32>(stringIndex - 1),
+                                            *firstOriginalStringStyle(line));
           STU_ASSUME(hyphenLine.line != nullptr);
           line.init_step2(TextFrameLine::InitStep2Params{
             .rangeInOriginalStringEnd = stringIndex,
@@ -224,36 +229,90 @@ bool TextFrameLayouter::hyphenateLineInRange(TextFrameLine& line, Range<Int> str
     }
     return false;
   }
-  const Int stringLength = attributedString_.string.count();
-  const Int outerEnd = stringRange.end >= stringLength ? stringRange.end
-                     : attributedString_.string
-                       .indexOfFirstUTF16CharWhere({stringRange.end,
-                                                    min(stringRange.end + 16, stringLength)},
-                                                   isUnicodeWhitespace);
-  __block bool result = false;
+  const ArrayRef<const HyphenationLocation> locations = hyphenationLocations(line.paragraphIndex,
+                                                                             stringRange.end);
+  Int i = binarySearchFirstIndexWhere(locations, [&](const HyphenationLocation& location) {
+            return location.stringIndex >= stringRange.end;
+          }).indexOrArrayCount;
+  while (--i >= 0) {
+    const HyphenationLocation& location = locations[i];
+    if (location.stringIndex <= stringRange.start) break;
+    if (breakLineAt(line, location.stringIndex, Hyphen{location.hyphen},
+                    TrailingWhitespaceStringLength{0}).success)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// The minimum length of the string range for which the hyphenation locations are computed in one
+/// go. (Computing the locations for a whole paragraph would be wasteful if only its first few lines
+/// fit into the frame.) Each further chunk of a paragraph is at least as long as the range that has
+/// already been processed, so that the number of chunks only grows logarithmically with the
+/// paragraph length, while the locations are computed for at most about twice the needed length.
+static constexpr Int minHyphenationChunkLength = 64;
+
+auto TextFrameLayouter::hyphenationLocations(Int32 paraIndex, Int stringEndIndex)
+  -> ArrayRef<const HyphenationLocation>
+{
+  if (paraHyphenationLocations_.isEmpty()) {
+    ParagraphHyphenationLocations* const p =
+      paraHyphenationLocations_.append(repeat(uninitialized, paras_.count()));
+    for (Int i = 0; i < paras_.count(); ++i) {
+      p[i] = ParagraphHyphenationLocations{
+               .indexRange = Range<Int32>{0, 0},
+               .stringEndIndex = max(stringParas()[i].stringRange.start, stringRange_.start)};
+    }
+  }
+  ParagraphHyphenationLocations& para = paraHyphenationLocations_[paraIndex];
+  if (para.stringEndIndex < stringEndIndex) {
+    const Int paraEnd = min(stringParas()[paraIndex].stringRange.end, stringRange_.end);
+    const Int paraStart = max(stringParas()[paraIndex].stringRange.start, stringRange_.start);
+    const Int chunkLength = max(para.stringEndIndex - paraStart, minHyphenationChunkLength);
+    Int end = min(max(stringEndIndex, para.stringEndIndex + chunkLength), paraEnd);
+    if (end < paraEnd) { // Try to avoid splitting a word.
+      end = attributedString_.string.indexOfFirstUTF16CharWhere({end, min(end + 64, paraEnd)},
+                                                                isUnicodeWhitespace);
+    }
+    // The locations of the paragraph must be stored contiguously.
+    if (para.indexRange.end != hyphenationLocations_.count()) {
+      const Int32 n = para.indexRange.count();
+      const Int32 newStart = narrow_cast<Int32>(hyphenationLocations_.count());
+      HyphenationLocation* const p = hyphenationLocations_.append(repeat(uninitialized, n));
+      array_utils::copyConstructArray(hyphenationLocations_[{para.indexRange.start,
+                                                             para.indexRange.end}], p);
+      para.indexRange = Range{newStart, newStart + n};
+    }
+    appendHyphenationLocations(Range<Int>{para.stringEndIndex, end});
+    para.indexRange.end = narrow_cast<Int32>(hyphenationLocations_.count());
+    para.stringEndIndex = narrow_cast<Int32>(end);
+  }
+  return hyphenationLocations_[{para.indexRange.start, para.indexRange.end}];
+}
+
+void TextFrameLayouter::appendHyphenationLocations(Range<Int> stringRange) {
   [attributedString_.attributedString
      enumerateAttribute:STUHyphenationLocaleIdentifierAttributeName
-                inRange:NSRange(Range{stringRange.start, outerEnd})
-                options:NSAttributedStringEnumerationReverse // We want the longest effective range.
-             usingBlock:^(__unsafe_unretained id value, NSRange nsRange, BOOL* shouldStop)
+                inRange:NSRange(stringRange)
+                options:0
+             usingBlock:^(__unsafe_unretained id value, NSRange nsRange, BOOL*)
   {
     const auto range = Range<Int>(nsRange);
-    if (range.start >= stringRange.end) return;
     CFString* const localeId = (__bridge CFStringRef)value;
     if (!localeId) return;
     if (localeId != cachedLocaleId_ && CFStringGetLength(localeId) == 0) return;
-    if (localeId == cachedLocaleId_ || (cachedLocaleId_ && CFEqual(localeId, cachedLocaleId_))) {
-      if (!cachedLocale_) return;
-    } else {
-      cachedLocaleId_ = localeId;
-      cachedLocale_ = RC<CFLocale>{CFLocaleCreate(nil, localeId), ShouldIncrementRefCount{false}};
-      if (!cachedLocale_) return;
-      if (!CFStringIsHyphenationAvailableForLocale(cachedLocale_.get())) {
-        cachedLocale_ = nullptr;
-        return;
-      }
+    if (!updateCachedHyphenationLocale(localeId)) return;
+    if (cachedHyphenator_) {
+      findHyphenationLocations(*cachedHyphenator_, attributedString_.string, range,
+                               [&](Int index) {
+        hyphenationLocations_.append(HyphenationLocation{narrow_cast<Int32>(index),
+                                                         hyphenCodePoint});
+      });
+      return;
     }
-    for (Int i = min(stringRange.end, range.end); i > range.start + 1;) {
+    const Int start = hyphenationLocations_.count();
+    for (Int i = range.end; i > range.start + 1;) {
       UTF32Char hyphen;
       i = CFStringGetHyphenationLocationBeforeIndex(
             attributedString_.string, i, range, 0, cachedLocale_.get(), &hyphen);
@@ -261,14 +320,27 @@ bool TextFrameLayouter::hyphenateLineInRange(TextFrameLine& line, Range<Int> str
       if (hyphen == 0x2D) { // We prefer a proper hyphen, not a hyphen-minus.
         hyphen = hyphenCodePoint;
       }
-      if (breakLineAt(line, i, Hyphen{hyphen}, TrailingWhitespaceStringLength{0}).success) {
-        result = true;
-        *shouldStop = true;
-        return;
-      }
+      hyphenationLocations_.append(HyphenationLocation{narrow_cast<Int32>(i), hyphen});
     }
+    std::reverse(hyphenationLocations_.begin() + start, hyphenationLocations_.end());
   }];
-  return result;
+}
+
+bool TextFrameLayouter::updateCachedHyphenationLocale(CFString* localeId) {
+  if (localeId == cachedLocaleId_ || (cachedLocaleId_ && CFEqual(localeId, cachedLocaleId_))) {
+    return cachedHyphenator_ || cachedLocale_;
+  }
+  cachedLocaleId_ = localeId;
+  cachedLocale_ = nullptr;
+  cachedHyphenator_ = hyphenatorForLocaleIdentifier(localeId);
+  if (cachedHyphenator_) return true;
+  cachedLocale_ = RC<CFLocale>{CFLocaleCreate(nil, localeId), ShouldIncrementRefCount{false}};
+  if (!cachedLocale_) return false;
+  if (!CFStringIsHyphenationAvailableForLocale(cachedLocale_.get())) {
+    cachedLocale_ = nullptr;
+    return false;
+  }
+  return true;
 }
 
 STU_NO_INLINE
@@ -320,10 +392,75 @@ bool isLikelyGoodLineBreakLocation(const NSAttributedStringRef& attributedString
   }
 }
 
+/// Paragraphs are terminated by "\r", "\n", "\r\n" or "\u2029", but the typesetter also breaks
+/// lines after these code points.
+static bool isLineBreakingCodeUnitThatDoesNotTerminateParagraph(Char16 ch) {
+  return ch == 0x000B || ch == 0x000C || ch == 0x0085 || ch == 0x2028;
+}
+
+static std::atomic<bool> singleLineFastPathIsEnabled{true};
+
+void TextFrameLayouter::setSingleLineFastPathIsEnabled(bool isEnabled) {
+  singleLineFastPathIsEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+bool TextFrameLayouter::breakLineAtParagraphEndIfItFits(TextFrameLine& line,
+                                                        Int paraStringEndIndex)
+{
+  const Int start = line.rangeInOriginalString.start;
+  const NSStringRef& string = attributedString_.string;
+  const Char16 lastChar = string[paraStringEndIndex - 1];
+  if (lastChar == softHyphenCodePoint) return false;
+  const Int end = string.indexOfTrailingWhitespaceIn({start, paraStringEndIndex});
+  // breakLineAt would have to correct the advance of the last glyph if there's no trailing
+  // whitespace and the line isn't at the end of the string.
+  if (end == start || (end == paraStringEndIndex && end < string.count())) return false;
+  if (string.indexOfFirstUTF16CharWhere({start, end},
+                                        isLineBreakingCodeUnitThatDoesNotTerminateParagraph)
+      != end)
+  {
+    return false;
+  }
+  if (paraSingleLineWidths_.isEmpty()) {
+    paraSingleLineWidths_.append(repeat(ParagraphSingleLineWidth{.headIndent = 0, .width = -1},
+                                        paras_.count()));
+  }
+  ParagraphSingleLineWidth& cachedWidth = paraSingleLineWidths_[line.paragraphIndex];
+  if (cachedWidth.width > lineMaxWidth_ && cachedWidth.headIndent == lineHeadIndent_) {
+    return false;
+  }
+  CTLine* const ctLine = CTTypesetterCreateLineWithOffset(typesetter_, Range{start, end},
+                                                          lineHeadIndent_);
+  const Float64 width = typographicWidth(ctLine);
+  cachedWidth = ParagraphSingleLineWidth{.headIndent = lineHeadIndent_, .width = width};
+  if (!(0 < width && width <= lineMaxWidth_)) {
+    CFRelease(ctLine);
+    return false;
+  }
+  line.isFollowedByTerminatorInOriginalString = isLineTerminator(lastChar);
+  line.init_step2(TextFrameLine::InitStep2Params{
+    .rangeInOriginalStringEnd = end,
+    .rangeInTruncatedStringCount = end - start,
+    .trailingWhitespaceInTruncatedStringLength = paraStringEndIndex - end,
+    .ctLine = ctLine,
+    .width = width,
+  });
+  return true;
+}
+
 void TextFrameLayouter::breakLine(TextFrameLine& line, Int paraStringEndIndex) {
   STU_DEBUG_ASSERT(line._ctLine == nil);
   const Int start = line.rangeInOriginalString.start;
   STU_DEBUG_ASSERT(paraStringEndIndex > start);
+  // If the paragraph fits on a single line, we don't need to ask the typesetter for a line break
+  // location. If it doesn't fit, the wasted work is bounded by the width cache in
+  // breakLineAtParagraphEndIfItFits. (TextFrameLayouterTests measures both cases.)
+  if (line.isFirstLineInParagraph
+      && singleLineFastPathIsEnabled.load(std::memory_order_relaxed)
+      && breakLineAtParagraphEndIfItFits(line, paraStringEndIndex))
+  {
+    return;
+  }
   const Float64 maxWidth = lineMaxWidth_;
   const Float64 headIndent = lineHeadIndent_;
   Int end = min(paraStringEndIndex, start + CTTypesetterSuggestLineBreakWithOffset(
@@ -4,6 +4,8 @@
 
 #import "STULabel/STUTextFrameOptions-Internal.hpp"
 
+#import "stu/BinarySearch.hpp"
+
 namespace stu_label {
 
 static auto firstLineOffsetForBaselineAdjustment(const TextFrameLine& firstLine,
@@ -238,9 +240,12 @@ void TextFrameLayouter::layoutAndScale(Size<Float64> frameSize,
                     (state.lowerBound + state.upperBound)/2);
   } else {
     if (!updateUpperBound()) return;
-    if (hasStepSize) {
-      updateScaleInfoAndLayout(state.upperBound - accuracy);
-      if (fits()) return;
+    // The estimate is usually close to the optimal scale, so before bisecting we check whether
+    // the next smaller scale fits.
+    updateScaleInfoAndLayout(max(state.lowerBound, roundScale(state.upperBound - accuracy)));
+    if (fits()) {
+      if (hasStepSize || !updateLowerBound()) return;
+    } else {
       if (!updateUpperBound()) return;
     }
     nextScale = max(state.upperBound - max(1/64.f, 2*accuracy),
@@ -310,10 +315,42 @@ struct ScalingPara {
   const CGFloat initialExtraHeadIndent;
   const CGFloat initialExtraTailIndent;
   const Float64 maxWidthMinusCommonIndent;
+  const Float32 hyphenationFactor;
+  /// Empty if the paragraph isn't hyphenated or if the hyphenation locations are determined by a
+  /// custom finder block.
+  const ArrayRef<const TextFrameLayouter::HyphenationLocation> hyphenationLocations;
+
+  /// Approximates the line breaking in TextFrameLayouter::breakLine, including the hyphenation
+  /// of lines that are filled less than the hyphenation factor.
+  Int32 lineEndIndex(Int32 index, Float64 maxWidth, Float64 headIndent,
+                     CTTypesetter* const typesetter, const NSStringRef& string) const
+  {
+    Int32 endIndex = index + narrow_cast<Int32>(CTTypesetterSuggestLineBreakWithOffset(
+                                                  typesetter, index, maxWidth, headIndent));
+    if (STU_UNLIKELY(endIndex <= index)) {
+      endIndex = narrow_cast<Int32>(string.endIndexOfGraphemeClusterAt(index));
+    }
+    if (hyphenationLocations.isEmpty() || endIndex >= stringRange.end || maxWidth <= 0) {
+      return endIndex;
+    }
+    const Int32 maxEndIndex = min(stringRange.end,
+                                  index + narrow_cast<Int32>(
+                                            CTTypesetterSuggestClusterBreakWithOffset(
+                                              typesetter, index, maxWidth, headIndent)));
+    if (maxEndIndex <= endIndex) return endIndex;
+    // We only consider hyphenation locations strictly before maxEndIndex, so that the hyphen
+    // likely fits too.
+    const Int i = binarySearchFirstIndexWhere(hyphenationLocations,
+                    [&](const TextFrameLayouter::HyphenationLocation& location) {
+                      return location.stringIndex >= maxEndIndex;
+                    }).indexOrArrayCount - 1;
+    if (i < 0 || hyphenationLocations[i].stringIndex <= endIndex) return endIndex;
+    const Int32 end1 = narrow_cast<Int32>(string.indexOfTrailingWhitespaceIn({index, endIndex}));
+    const Float64 width = computeWidth(typesetter, Range{index, end1}, headIndent);
+    if (width >= hyphenationFactor*maxWidth) return endIndex;
+    return hyphenationLocations[i].stringIndex;
+  }
 
-  /// This function currently does not account for hyphenation opportunities. Implementing that
-  /// currently doesn't seem worth the effort (as long as CTTypesetter has no built-in support
-  /// for hyphenation).
   void bisectInverseScaleInterval(bool lineCountIsLowerBound, Float64 inverseScale,
                                   CTTypesetter* const typesetter, const NSStringRef& string)
   {
@@ -361,11 +398,7 @@ struct ScalingPara {
     for (Int32 n = 1, index = stringRange.start, endIndex;; ++n, index = endIndex) {
       const Float64 maxWidth = n <= initialLinesCount ? initialMaxWidth : nonInitialMaxWidth;
       const Float64 headIndent = n <= initialLinesCount ? initialHeadIndent : nonInitialHeadIndent;
-      endIndex = index + narrow_cast<Int32>(CTTypesetterSuggestLineBreakWithOffset(
-                                              typesetter, index, maxWidth, headIndent));
-      if (STU_UNLIKELY(endIndex <= index)) {
-        endIndex = narrow_cast<Int32>(string.endIndexOfGraphemeClusterAt(index));
-      }
+      endIndex = lineEndIndex(index, maxWidth, headIndent, typesetter, string);
       if (endIndex >= stringRange.end) {
         lineCount = n;
         return;
@@ -386,7 +419,7 @@ namespace stu_label {
 auto TextFrameLayouter::estimateScaleFactorNeededToFit(Float64 frameHeight, Int32 maxLineCount,
                                                        NSAttributedString* __unsafe_unretained
                                                          truncationToken,
-                                                       Float64 minScale, Float64 accuracy) const
+                                                       Float64 minScale, Float64 accuracy)
 -> ScaleFactorEstimate
 {
   ArrayRef<const TextFrameLine> lines = lines_;
@@ -544,11 +577,25 @@ auto TextFrameLayouter::estimateScaleFactorNeededToFit(Float64 frameHeight, Int3
 
   minScale = max(minScale, frameHeight/height);
 
+  const bool modelsHyphenation = !lastHyphenationLocationInRangeFinder_;
+  if (modelsHyphenation) {
+    // We compute the hyphenation locations before the free capacity of the thread-local allocator
+    // buffer is reserved for the `paras` vector below.
+    for (Int32 i0 = 0, i = 0; i < lines.count(); i0 = i) {
+      while (!lines[i++].isFollowedByTerminatorInOriginalString && i < lines.count()) {
+        continue;
+      }
+      if (i - i0 == 1 || lines[i - 1].hasTruncationToken) continue;
+      const Int32 paraIndex = lines[i0].paragraphIndex;
+      if (stringParas()[paraIndex].hyphenationFactor > 0) {
+        hyphenationLocations(paraIndex, lines[i - 1].rangeInOriginalString.end);
+      }
+    }
+  }
+
   TempVector<ScalingPara> paras{freeCapacityInCurrentThreadLocalAllocatorBuffer,
                                 paras_.allocator()};
 
-  STU_APPEARS_UNUSED
-  bool multiLineParaHasHyphenation = false;
   for (Int32 i0 = 0, i = 0; i < lines.count(); i0 = i) {
     while (!lines[i++].isFollowedByTerminatorInOriginalString && i < lines.count()) {
       continue;
@@ -562,7 +609,6 @@ auto TextFrameLayouter::estimateScaleFactorNeededToFit(Float64 frameHeight, Int3
     if (lastLine.hasTruncationToken) continue;
     const Int32 initialLinesEndIndex = paras_[firstLine.paragraphIndex].initialLinesEndIndex;
     const ShapedString::Paragraph& p = stringParas()[firstLine.paragraphIndex];
-    multiLineParaHasHyphenation |= p.hyphenationFactor > 0;
     Float64 commonHeadIndent = 0;
     CGFloat initialExtraHeadIndent = 0;
     CGFloat initialExtraTailIndent = 0;
@@ -594,7 +640,13 @@ auto TextFrameLayouter::estimateScaleFactorNeededToFit(Float64 frameHeight, Int3
                              .commonHeadIndent = commonHeadIndent,
                              .initialExtraHeadIndent = initialExtraHeadIndent,
                              .initialExtraTailIndent = initialExtraTailIndent,
-                             .maxWidthMinusCommonIndent = maxWidthMinusCommonIndent});
+                             .maxWidthMinusCommonIndent = maxWidthMinusCommonIndent,
+                             .hyphenationFactor = p.hyphenationFactor,
+                             .hyphenationLocations =
+                                modelsHyphenation && p.hyphenationFactor > 0
+                                ? hyphenationLocations(firstLine.paragraphIndex,
+                                                       lastLine.rangeInOriginalString.end)
+                                : ArrayRef<const HyphenationLocation>{}});
     if (isCancelled()) break;
   }
   paras.trimFreeCapacity();
@@ -623,7 +675,7 @@ auto TextFrameLayouter::estimateScaleFactorNeededToFit(Float64 frameHeight, Int3
         return false;
       } else {
         lineCount -= lineCountDiff;
-        height -= lineCountDiff;
+        height -= heighDiff;
         return true;
       }
     });
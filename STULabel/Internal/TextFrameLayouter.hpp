@@ -1,5 +1,6 @@
 // Copyright 2017–2018 Stephan Tolksdorf
 
+#import "Hyphenation.hpp"
 #import "ShapedString.hpp"
 #import "TextFrame.hpp"
 #import "TextStyleBuffer.hpp"
@@ -49,6 +50,8 @@ public:
 
   STUTextLayoutMode layoutMode() const { return layoutMode_; }
 
+  bool usesCompactGlyphStorage() const { return usesCompactGlyphStorage_; }
+
   struct ScaleFactorAndNeedsRealignment {
     Float64 scaleFactor;
     bool needsRealignment;
@@ -65,13 +68,14 @@ public:
 
   /// Usually returns an exact value or a lower bound that is quite close to the exact value.
   /// Paragraphs with varying line heights affect the accuracy negatively.
-  /// Hyphenation opportunities are currently ignored, so the estimate can be farther off if the
-  /// text involves multiline paragraphs with hyphenation factors greater 0.
+  /// The line count of multiline paragraphs is modelled as a step function of the scale, which
+  /// accounts for the (cached) hyphenation locations of paragraphs with hyphenation factors
+  /// greater 0, unless the hyphenation locations are determined by a custom finder block.
   ///
   /// @param accuracy The desired absolute accuracy of the returned estimate.
   ScaleFactorEstimate estimateScaleFactorNeededToFit(Float64 frameHeight, Int32 maxLineCount,
                                                      NSAttributedString* attributedString,
-                                                     Float64 minScale, Float64 accuracy) const;
+                                                     Float64 minScale, Float64 accuracy);
 
   bool needToJustifyLines() const { return needToJustifyLines_; }
 
@@ -125,6 +129,9 @@ public:
     return {originalStringStyles_.firstStyle, clippedOriginalStringTerminatorStyle_};
   }
 
+  /// The text styles of the full shaped string, including the optional style index.
+  const TextStyleSpan& shapedStringStyles() const { return shapedStringStyles_; }
+
   ArrayRef<const Byte> truncationTokenTextStyleData() const { return tokenStyleBuffer_.data(); }
 
   void relinquishOwnershipOfCTLinesAndParagraphTruncationTokens() {
@@ -143,6 +150,8 @@ public:
 
 
 private:
+  friend struct ScalingPara;
+
   struct Indentations {
     Float64 left;
     Float64 right;
@@ -194,6 +203,15 @@ private:
 
   void breakLine(TextFrameLine& line, Int paraStringEndIndex);
 
+  /// The single-line fast path is enabled by default. If it is enabled, the first line of every
+  /// paragraph is first checked for whether it fits the line width without any line break.
+  /// (Used by the performance tests that compare the layout with and without the fast path.)
+  static void setSingleLineFastPathIsEnabled(bool);
+
+  /// Initializes the line with the full remaining paragraph and returns true, if it fits the line
+  /// width. Otherwise doesn't mutate the line and returns false.
+  bool breakLineAtParagraphEndIfItFits(TextFrameLine& line, Int paraStringEndIndex);
+
   struct BreakLineAtStatus {
     bool success;
     Float64 ctLineWidthWithoutHyphen;
@@ -204,6 +222,22 @@ private:
 
   bool hyphenateLineInRange(TextFrameLine& line, Range<Int> stringRange);
 
+  struct HyphenationLocation {
+    Int32 stringIndex;
+    Char32 hyphen;
+  };
+
+  /// Returns the (sorted) hyphenation locations in the paragraph, which are computed at least up
+  /// to the specified string index. The locations are cached for the lifetime of the layouter, so
+  /// that repeated layout calls (e.g. for different text scale factors) don't have to query the
+  /// hyphenator again.
+  ArrayRef<const HyphenationLocation> hyphenationLocations(Int32 paraIndex, Int stringEndIndex);
+
+  void appendHyphenationLocations(Range<Int> stringRange);
+
+  /// Returns false if hyphenation is not available for the locale.
+  bool updateCachedHyphenationLocale(CFString* localeId);
+
   void truncateLine(TextFrameLine& line, Int32 stringEndIndex, Range<Int32> truncatableRange,
                     CTLineTruncationType, NSAttributedString* __nullable token,
                     __nullable STUTruncationRangeAdjuster,
@@ -217,6 +251,15 @@ private:
     return reinterpret_cast<const TextStyle*>(originalStringStyles_.dataBegin()
                                               + line._textStylesOffset);
   }
+
+  /// Equivalent to `cursor.styleForStringIndex(stringIndex)`, but uses the shaped string's style
+  /// index for long jumps.
+  STU_INLINE
+  const TextStyle& originalStringStyleForStringIndex(Int32 stringIndex,
+                                                     const TextStyle& cursor) const
+  {
+    return shapedStringStyles_.styleForStringIndex(stringIndex, cursor);
+  }
   const TextStyle* __nullable firstTruncationTokenStyle(const STUTextFrameLine& line) const {
     STU_DEBUG_ASSERT(line._initStep != 1);
     if (!line.hasTruncationToken) return nullptr;
@@ -276,6 +319,7 @@ private:
     ArrayRef<const ShapedString::Paragraph> stringParas;
     TempArray<TextFrameParagraph> paras;
     TextStyleSpan stringStyles;
+    TextStyleSpan shapedStringStyles;
     ArrayRef<const FontMetrics> stringFontMetrics;
     ArrayRef<const ColorRef> stringColorInfos;
     ArrayRef<const TextStyleBuffer::ColorHashBucket> stringColorHashBuckets;
@@ -298,6 +342,10 @@ private:
   CTTypesetter* const typesetter_;
   const NSAttributedStringRef attributedString_;
   const TextStyleSpan originalStringStyles_;
+  /// The text styles of the full shaped string, including the optional index, which
+  /// `originalStringStyles_` lacks if the layout range is only part of the string.
+  /// Used for string index lookups with a cursor, see `originalStringStyleForStringIndex`.
+  const TextStyleSpan shapedStringStyles_;
   const ArrayRef<const FontMetrics> originalStringFontMetrics_;
   const ArrayRef<const TruncationScope> truncationScopes_;
   const ShapedString::Paragraph* stringParasPtr_;
@@ -308,6 +356,7 @@ private:
   Size<Float64> inverselyScaledFrameSize_{};
   const bool stringRangeIsFullString_;
   STUTextLayoutMode layoutMode_{};
+  bool usesCompactGlyphStorage_{};
   bool needToJustifyLines_{};
   bool mayExceedMaxWidth_{};
   bool ownsCTLinesAndParagraphTruncationTokens_{true};
@@ -318,6 +367,8 @@ private:
   const TextStyle* clippedOriginalStringTerminatorStyle_;
   /// A cached CFLocale instance for hyphenation purposes.
   RC<CFLocale> cachedLocale_;
+  /// The hyphenator registered for the cached locale ID. If non-null, `cachedLocale_` is null.
+  RC<Hyphenator> cachedHyphenator_;
   CFString* cachedLocaleId_{};
   Float64 lineMaxWidth_;
   Float64 lineHeadIndent_;
@@ -327,6 +378,23 @@ private:
   LocalFontInfoCache localFontInfoCache_;
   TextStyleBuffer tokenStyleBuffer_;
   TempVector<FontMetrics> tokenFontMetrics_;
+  struct ParagraphHyphenationLocations {
+    /// The index range of the paragraph's locations in `hyphenationLocations_`.
+    Range<Int32> indexRange;
+    /// The locations have been computed for the paragraph's string range up to this index.
+    Int32 stringEndIndex;
+  };
+  struct ParagraphSingleLineWidth {
+    Float64 headIndent;
+    /// The typographic width of the paragraph laid out as a single line with the head indent,
+    /// or a negative value if the width hasn't been computed yet.
+    Float64 width;
+  };
+  /// Empty until `breakLineAtParagraphEndIfItFits` is first called.
+  TempVector<ParagraphSingleLineWidth> paraSingleLineWidths_;
+  /// Empty until the first paragraph is hyphenated.
+  TempVector<ParagraphHyphenationLocations> paraHyphenationLocations_;
+  TempVector<HyphenationLocation> hyphenationLocations_;
 };
 
 } // namespace stu_label
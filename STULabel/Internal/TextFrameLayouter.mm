@@ -137,7 +137,9 @@ auto TextFrameLayouter::InitData::create(const ShapedString& shapedString, Range
                           sas.textStyles.dataBegin() + firstPara.textStylesOffset);
     STU_DEBUG_ASSERT(styles.firstStyle->stringIndex() <= stringRange.start);
     if (stringRange.start > firstPara.stringRange.start) {
-      styles.firstStyle = &styles.firstStyle->styleForStringIndex(stringRange.start);
+      styles.firstStyle = sas.textStyles.index.isEmpty()
+                        ? &styles.firstStyle->styleForStringIndex(stringRange.start)
+                        : &sas.textStyles.styleForStringIndex(stringRange.start);
     }
 
     if (stringParas.end() < sas.paragraphs.end()) {
@@ -148,8 +150,12 @@ auto TextFrameLayouter::InitData::create(const ShapedString& shapedString, Range
     }
     STU_DEBUG_ASSERT(styles.terminatorStyle->stringIndex() >= stringRange.end);
     if (stringRange.end < styles.terminatorStyle->stringIndex()) {
-      do styles.terminatorStyle = &styles.terminatorStyle->previous();
-      while (stringRange.end < styles.terminatorStyle->stringIndex());
+      if (sas.textStyles.index.isEmpty()) {
+        do styles.terminatorStyle = &styles.terminatorStyle->previous();
+        while (stringRange.end < styles.terminatorStyle->stringIndex());
+      } else {
+        styles.terminatorStyle = &sas.textStyles.styleForStringIndex(stringRange.end);
+      }
       if (stringRange.end > styles.terminatorStyle->stringIndex()) {
         styles.terminatorStyle = &styles.terminatorStyle->next();
       }
@@ -168,6 +174,7 @@ auto TextFrameLayouter::InitData::create(const ShapedString& shapedString, Range
           .stringParas = stringParas,
           .paras = std::move(paras),
           .stringStyles = styles,
+          .shapedStringStyles = sas.textStyles,
           .stringFontMetrics = sas.fontMetrics,
           .stringColorInfos = sas.colors,
           .stringColorHashBuckets = sas.colorHashBuckets,
@@ -180,6 +187,7 @@ TextFrameLayouter::TextFrameLayouter(InitData init)
   typesetter_{init.typesetter},
   attributedString_{init.attributedString},
   originalStringStyles_{init.stringStyles},
+  shapedStringStyles_{init.shapedStringStyles},
   originalStringFontMetrics_{init.stringFontMetrics},
   truncationScopes_{init.truncationScopes},
   stringParasPtr_{init.stringParas.begin()},
@@ -192,7 +200,10 @@ TextFrameLayouter::TextFrameLayouter(InitData init)
   clippedOriginalStringTerminatorStyle_{init.stringStyles.terminatorStyle},
   tokenStyleBuffer_{Ref{localFontInfoCache_}, paras_.allocator(),
                     pair(init.stringColorInfos, init.stringColorHashBuckets)},
-  tokenFontMetrics_{paras_.allocator()}
+  tokenFontMetrics_{paras_.allocator()},
+  paraSingleLineWidths_{paras_.allocator()},
+  paraHyphenationLocations_{paras_.allocator()},
+  hyphenationLocations_{paras_.allocator()}
 {
   STU_DEBUG_ASSERT(init.stringParas.count() == paras_.count());
 }
@@ -628,6 +639,7 @@ void TextFrameLayouter::layout(const Size<Float64> inverselyScaledFrameSize,
   const Float64 frameHeightPlusEpsilon = frameHeight + 1/1024.;
   scaleInfo_ = scaleInfo;
   layoutMode_ = options.textLayoutMode;
+  usesCompactGlyphStorage_ = options.usesCompactGlyphStorage;
   if (STU_UNLIKELY(paras_.isEmpty())) return;
   if (!lines_.isEmpty()) {
     STU_ASSERT(ownsCTLinesAndParagraphTruncationTokens_);
@@ -689,7 +701,7 @@ NewParagraph:;
 
     const bool isFirstLineInParagraph = lines_.count() == para->lineIndexRange.start;
     const bool isInitialLineInParagraph = lines_.count() < para->initialLinesEndIndex;
-    style = &style->styleForStringIndex(stringIndex);
+    style = &originalStringStyleForStringIndex(stringIndex, *style);
     TextFrameLine* line = &lines_.append(uninitialized);
     line->init_step1(TextFrameLine::InitStep1Params{
       .lineIndex = lines_.count() - 1,
@@ -900,7 +912,8 @@ NewParagraph:;
     break;
   } // for (;;)
   clippedStringRangeEnd_ = stringIndex;
-  clippedOriginalStringTerminatorStyle_ = &style->styleForStringIndex(stringIndex - 1).next();
+  clippedOriginalStringTerminatorStyle_ = &originalStringStyleForStringIndex(stringIndex - 1,
+                                                                             *style).next();
   clippedParagraphCount_ = para->paragraphIndex + 1;
   para->isLastParagraph = true;
   lines_[$ - 1].isLastLine = true;
@@ -912,6 +925,7 @@ struct FontMetricsAndStyleFlags {
   const TextStyle* nextStyle;
 };
 
+/// @pre `style` is the style for `range.start`.
 static FontMetricsAndStyleFlags calculateOriginalFontsMetricsForLineRange(
                                   STUStartEndRangeI32 range,
                                   const TextStyle* __nonnull style,
@@ -920,8 +934,8 @@ static FontMetricsAndStyleFlags calculateOriginalFontsMetricsForLineRange(
   if (STU_UNLIKELY(range.start == range.end)) {
     return FontMetricsAndStyleFlags{.nextStyle = style};
   }
-  Int32 stringIndex = range.start;
-  style = &style->styleForStringIndex(stringIndex);
+  STU_DEBUG_ASSERT(style->stringIndex() <= range.start);
+  Int32 stringIndex;
   TextFlags flags = style->flags();
   FontMetrics metrics = !style->hasAttachment()
                       ? fontMetrics[style->fontIndex().value]
@@ -968,6 +982,7 @@ const TextStyle* TextFrameLayouter::initializeTypographicMetricsOfLine(TextFrame
   {
     const TextStyle* style = firstOriginalStringStyle(line);
     if (!stringRange1.isEmpty()) {
+      style = &originalStringStyleForStringIndex(stringRange1.start, *style);
       const FontMetricsAndStyleFlags fsi = calculateOriginalFontsMetricsForLineRange(
                                              stringRange1, style, originalStringFontMetrics_.begin());
       style = fsi.nextStyle;
@@ -975,6 +990,8 @@ const TextStyle* TextFrameLayouter::initializeTypographicMetricsOfLine(TextFrame
       metrics = fsi.metrics;
     }
     if (!stringRange2.isEmpty()) {
+      // The truncation may have excised many styles between the two ranges.
+      style = &originalStringStyleForStringIndex(stringRange2.start, *style);
       const FontMetricsAndStyleFlags fsi = calculateOriginalFontsMetricsForLineRange(
                                              stringRange2, style, originalStringFontMetrics_.begin());
       style = fsi.nextStyle;
@@ -989,7 +1006,8 @@ const TextStyle* TextFrameLayouter::initializeTypographicMetricsOfLine(TextFrame
     const TextStyle* const tokenStyles = firstTruncationTokenStyle(line);
     const FontMetricsAndStyleFlags fsi = calculateOriginalFontsMetricsForLineRange(
                                             Range{0, tokenLength},
-                                            tokenStyles, tokenFontMetrics_.begin());
+                                            &tokenStyles->styleForStringIndex(0),
+                                            tokenFontMetrics_.begin());
     metrics.aggregate(fsi.metrics);
     // The tokenTextFlags have already been set in init_step2.
   }
@@ -1025,7 +1043,8 @@ const TextStyle* TextFrameLayouter::initializeTypographicMetricsOfLine(TextFrame
       if (part == TextLinePart::originalString) {
         if (nonTokenPartHasBaselineOffsetOrAttachment) {
           const Int32 stringIndex = narrow_cast<Int32>(glyphSpan.run().stringRange().start);
-          style = originalStringStyle = &originalStringStyle->styleForStringIndex(stringIndex);
+          style = originalStringStyle = &originalStringStyleForStringIndex(stringIndex,
+                                                                           *originalStringStyle);
         }
       } else {
         if (tokenPartHasBaselineOffsetOrAttachment) {
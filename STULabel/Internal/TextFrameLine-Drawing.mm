@@ -33,8 +33,10 @@ static void drawRunGlyphsDirectly(GlyphSpan span, const TextStyle& style, Drawin
 }
 
 
+/// @param isClipped Indicates whether the glyphs are drawn with a clip rect that cuts through the
+///                  glyphs, in which case the shadow can't be drawn with the `ShadowMaskCache`.
 static void drawRunGlyphs(GlyphSpan glyphSpan, const TextStyle& style,
-                          CGFloat ctLineXOffset, DrawingContext& context)
+                          CGFloat ctLineXOffset, DrawingContext& context, bool isClipped = false)
 {
   CGAffineTransform matrix = glyphSpan.run().textMatrix();
   matrix.tx = context.lineOrigin().x + ctLineXOffset;
@@ -45,7 +47,35 @@ static void drawRunGlyphs(GlyphSpan glyphSpan, const TextStyle& style,
     matrix.ty += style.baselineOffset();
   }
   CGContextSetTextMatrix(context.cgContext(), matrix);
-  if (!context.needToDrawGlyphsDirectly(style)) {
+  if (context.usesShadowMaskCache() && context.shadowInfo() && !style.strokeInfo() && !isClipped) {
+    const FontRef font = glyphSpan.run().font();
+    const CGAffineTransform ctm = CGContextGetCTM(context.cgContext());
+    // Core Graphics multiplies the shadow color with the alpha of the fill color.
+    if (ShadowMaskCache::canDraw(font.ctFont(), context.fontInfo(font.ctFont()), matrix, ctm)
+        && CGColorGetAlpha(context.cgColor(context.textColorIndex(style))) == 1)
+    {
+      const GlyphsWithPositions gwp = glyphSpan.getGlyphsWithPositions();
+      if (context.drawShadowUsingShadowMaskCache(font.ctFont(), gwp, matrix, ctm)
+          && context.drawsOnlyShadows())
+      {
+        return;
+      }
+    }
+  }
+  if (context.usesGlyphRasterCache() && !style.strokeInfo() && !context.hasShadow()) {
+    const FontRef font = glyphSpan.run().font();
+    const CGAffineTransform ctm = CGContextGetCTM(context.cgContext());
+    if (GlyphRasterCache::canDraw(font.ctFont(), context.fontInfo(font.ctFont()), matrix, ctm)) {
+      const GlyphsWithPositions gwp = glyphSpan.getGlyphsWithPositions();
+      context.setFillColor(context.textColorIndex(style));
+      GlyphRasterCache::drawGlyphs(font.ctFont(), gwp.glyphs(), gwp.positions().begin(),
+                                   matrix, ctm, context.glyphRasterCacheContextSettings(),
+                                   context.cgContext());
+      return;
+    }
+  }
+  // A stored run has no CTRun that could be passed to CTRunDraw.
+  if (!context.needToDrawGlyphsDirectly(style) && !glyphSpan.run().storedRun()) {
     glyphSpan.draw(context.cgContext());
     context.currentCGContextColorsMayHaveChanged();
   } else {
@@ -90,7 +120,7 @@ static void drawGlyphs(const TextFrameLine& line, bool drawShadow, DrawingContex
         CGContextSaveGState(context.cgContext());
         CGContextClipToRect(context.cgContext(), clipRect);
       }
-      drawRunGlyphs(span.glyphSpan, style, span.ctLineXOffset, context);
+      drawRunGlyphs(span.glyphSpan, style, span.ctLineXOffset, context, span.isPartialLigature);
       if (STU_UNLIKELY(span.isPartialLigature)) {
         CGContextRestoreGState(context.cgContext());
         if (shadow) {
@@ -108,9 +138,9 @@ static void drawGlyphs(const TextFrameLine& line, bool drawShadow, DrawingContex
   const TextStyle* tokenStyle = &textFrame.firstTokenTextStyleForLineAtIndex(line.lineIndex);
   line.forEachCTLineSegment(
     FlagsRequiringIndividualRunIteration{
-      context.hasCancellationFlag() ? detail::everyRunFlag
+      context.hasCancellationFlag() || context.usesGlyphRasterCache() ? detail::everyRunFlag
       : context.textFlagsNecessitatingDirectGlyphDrawingOfNonHighlightedText()},
-    [&](TextLinePart part, CTLineXOffset ctLineXOffset, CTLine& ctLine,
+    [&](TextLinePart part, CTLineXOffset ctLineXOffset, CTLine* ctLine,
         Optional<GlyphSpan> optGlyphSpan) -> ShouldStop
   {
     if (!optGlyphSpan) {
@@ -120,19 +150,20 @@ static void drawGlyphs(const TextFrameLine& line, bool drawShadow, DrawingContex
                              CGAffineTransform{.a = 1, .d = 1,
                                                .tx = context.lineOrigin().x + ctLineXOffset.value,
                                                .ty = context.lineOrigin().y});
-      CTLineDraw(&ctLine, cgContext);
+      CTLineDraw(ctLine, cgContext);
       context.currentCGContextColorsMayHaveChanged();
       return ShouldStop{context.isCancelled()};
     }
     const GlyphSpan glyphSpan = *optGlyphSpan;
-    const CFRange range = CTRunGetStringRange(glyphSpan.run().ctRun());
+    const Range<Int> range = glyphSpan.run().stringRange();
     const TextStyle* style;
     if (part == TextLinePart::originalString) {
-      nonTokenStyle = &nonTokenStyle->styleForStringIndex(narrow_cast<Int32>(range.location));
+      nonTokenStyle = &textFrame.originalStringStyleForStringIndex(
+                         narrow_cast<Int32>(range.start), *nonTokenStyle);
       style = nonTokenStyle;
     } else {
       if (part == TextLinePart::truncationToken) {
-        tokenStyle = &tokenStyle->styleForStringIndex(narrow_cast<Int32>(range.location));
+        tokenStyle = &tokenStyle->styleForStringIndex(narrow_cast<Int32>(range.start));
       } // We don't need to search for a hyphen token's style.
       style = tokenStyle;
     }
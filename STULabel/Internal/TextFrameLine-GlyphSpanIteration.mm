@@ -11,77 +11,85 @@ using detail::everyRunFlag;
 
 ShouldStop TextFrameLine::forEachCTLineSegment(
              FlagsRequiringIndividualRunIteration mask,
-             FunctionRef<ShouldStop(TextLinePart, CTLineXOffset, CTLine&, Optional<GlyphSpan>)> body)
+             FunctionRef<ShouldStop(TextLinePart, CTLineXOffset, CTLine* __nullable,
+                                    Optional<GlyphSpan>)> body)
   const
 {
   CTLine* const ctLine = _ctLine;
-  NSArrayRef<CTRun*> runs;
-  const bool shouldIterNonTokenRunsIndividually{(nonTokenTextFlags() | everyRunFlag) & mask.flags};
-  if (ctLine) {
+  // Without CTLines we can only iterate over the individual runs.
+  const TextFrameGlyphStorage* const glyphStorage = this->glyphStorage();
+  GlyphRuns runs;
+  const bool shouldIterNonTokenRunsIndividually = glyphStorage
+                                               || ((nonTokenTextFlags() | everyRunFlag)
+                                                   & mask.flags);
+  if (ctLine || glyphStorage) {
     if (!shouldIterNonTokenRunsIndividually && _leftPartEnd.runIndex < 0) {
-      const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, *ctLine, none);
+      const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, ctLine, none);
       if (shouldStop) return shouldStop;
     } else {
-      runs = glyphRuns(ctLine);
+      runs = nonTokenGlyphRuns(glyphStorage);
       Int endRunIndex = _leftPartEnd.runIndex;
       Int endGlyphIndex = _leftPartEnd.glyphIndex;
       if (endRunIndex < 0) {
         endRunIndex = runs.count();
         endGlyphIndex = 0;
       };
-      for (CTRun* const run : runs[{0, endRunIndex}]) {
-        const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, *ctLine, run);
+      for (Int i = 0; i < endRunIndex; ++i) {
+        const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, ctLine,
+                                     runs[i]);
         if (shouldStop) return shouldStop;
       }
       if (endGlyphIndex > 0) {
-        const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, *ctLine,
+        const auto shouldStop = body(TextLinePart::originalString, CTLineXOffset{0}, ctLine,
                                      GlyphSpan{runs[endRunIndex], {0, endGlyphIndex}, unchecked});
         if (shouldStop) return shouldStop;
       }
     }
   }
   CTLine* const tokenCTLine = _tokenCTLine;
-  if (!tokenCTLine) return {};
+  if (glyphStorage ? !(this->hasTruncationToken || this->hasInsertedHyphen) : !tokenCTLine) {
+    return {};
+  }
   const Int hyphenRunIndex = _hyphenRunIndex;
   STU_DEBUG_ASSERT(hyphenRunIndex < 0 ? this->hasTruncationToken : this->hasInsertedHyphen);
-  if (hyphenRunIndex < 0 && !((tokenTextFlags() | everyRunFlag) & mask.flags)) {
+  if (!glyphStorage && hyphenRunIndex < 0 && !((tokenTextFlags() | everyRunFlag) & mask.flags)) {
     const auto shouldStop = body(TextLinePart::truncationToken, CTLineXOffset{this->leftPartWidth},
-                                 *tokenCTLine, none);
+                                 tokenCTLine, none);
     if (shouldStop) return shouldStop;
   } else {
-    const NSArraySpan<CTRun*> tokenRuns = glyphRuns(tokenCTLine);
+    const GlyphRuns tokenRuns = tokenGlyphRuns(glyphStorage);
     if (hyphenRunIndex < 0) {
-      for (CTRun* const run : tokenRuns) {
+      for (Int i = 0; i < tokenRuns.count(); ++i) {
         const auto shouldStop = body(TextLinePart::truncationToken,
-                                     CTLineXOffset{this->leftPartWidth}, *tokenCTLine, run);
+                                     CTLineXOffset{this->leftPartWidth}, tokenCTLine, tokenRuns[i]);
         if (shouldStop) return shouldStop;
       }
     } else if (hyphenRunIndex < tokenRuns.count()) {
-      const GlyphRunRef run{tokenRuns[hyphenRunIndex]};
+      const GlyphRunRef run = tokenRuns[hyphenRunIndex];
       const GlyphSpan span = _hyphenGlyphIndex < 0 ? GlyphSpan{run}
                            : GlyphSpan{run, {_hyphenGlyphIndex, Count{1}}, unchecked};
       const auto shouldStop = body(TextLinePart::insertedHyphen,
                                    CTLineXOffset{this->leftPartWidth - _hyphenXOffset},
-                                   *tokenCTLine, span);
+                                   tokenCTLine, span);
       if (shouldStop) return shouldStop;
     }
   }
   Int startRunIndex = _rightPartStart.runIndex;
   if (startRunIndex < 0) return {};
-  STU_DEBUG_ASSERT(ctLine != nullptr);
+  STU_DEBUG_ASSERT(ctLine != nullptr || glyphStorage != nullptr);
   const Int startGlyphIndex = _rightPartStart.glyphIndex;
   const CTLineXOffset rightPartXOffset{_rightPartXOffset};
   if (!shouldIterNonTokenRunsIndividually && startRunIndex == 0 && startGlyphIndex <= 0) {
-    return body(TextLinePart::originalString, rightPartXOffset, *ctLine, none);
+    return body(TextLinePart::originalString, rightPartXOffset, ctLine, none);
   }
   if (startGlyphIndex > 0) {
-    const auto shouldStop = body(TextLinePart::originalString, rightPartXOffset, *ctLine,
+    const auto shouldStop = body(TextLinePart::originalString, rightPartXOffset, ctLine,
                                  GlyphSpan{runs[startRunIndex], {startGlyphIndex, $}});
     if (shouldStop) return shouldStop;
     startRunIndex += 1;
   }
-  for (CTRun* const run : runs[{startRunIndex, $}]) {
-    const auto shouldStop = body(TextLinePart::originalString, rightPartXOffset, *ctLine, run);
+  for (Int i = startRunIndex; i < runs.count(); ++i) {
+    const auto shouldStop = body(TextLinePart::originalString, rightPartXOffset, ctLine, runs[i]);
     if (shouldStop) return shouldStop;
   }
   return {};
@@ -126,7 +134,11 @@ ShouldStop forEachStyledGlyphSpanSubspan(
              TextFlags flagsTestMask,
              FunctionRef<ShouldStop(const StyledGlyphSpan&, const TextStyle&, Range<Float64>)> body)
 {
-  const TextStyle* style = inOutStyle = &inOutStyle->styleForStringIndex(span.stringRange.start);
+  const TextStyle* style = inOutStyle =
+    span.part == TextLinePart::originalString
+    ? &span.line->textFrame().originalStringStyleForStringIndex(span.stringRange.start,
+                                                                *inOutStyle)
+    : &inOutStyle->styleForStringIndex(span.stringRange.start);
   if (STU_UNLIKELY(styleOverride)) {
     const Range<Int32> drawnRange = soOffsetRanges
                                   ? soOffsetRanges->drawnRangeInOriginalString
@@ -168,18 +180,18 @@ ShouldStop TextFrameLine::forEachStyledGlyphSpan(
                           para.rangeOfTruncationTokenInTruncatedString().start,
                        .line = this,
                        .paragraph = &para};
-  CTLine* const ctLine = _ctLine;
-  NSArrayRef<CTRun*> runs;
+  const TextFrameGlyphStorage* const glyphStorage = textFrame.glyphStorage();
+  GlyphRuns runs;
   const TextStyle* style;
   Float64 x;
-  if (ctLine) {
+  if (_ctLine || glyphStorage) {
     const Float64 leftPartWidth = this->leftPartWidth;
     TextFlags flags = this->nonTokenTextFlags() | everyRunFlag;
     if (STU_UNLIKELY(styleOverride)) {
       flags = stu_label::effectiveTextFlags(flags, this->range(), *styleOverride);
     }
     if (flagsFilterMask & flags) {
-      runs = glyphRuns(ctLine);
+      runs = nonTokenGlyphRuns(glyphStorage);
       style = &textFrame.firstNonTokenTextStyleForLineAtIndex(this->lineIndex);
       span.part = TextLinePart::originalString;
       span.attributedString = textFrame.originalAttributedString;
@@ -223,8 +235,9 @@ ShouldStop TextFrameLine::forEachStyledGlyphSpan(
     x = 0;
   }
 
-  CTLine* const tokenCTLine = _tokenCTLine;
-  if (!tokenCTLine) return {};
+  if (glyphStorage ? !(this->hasTruncationToken || this->hasInsertedHyphen) : !_tokenCTLine) {
+    return {};
+  }
   const Float64 tokenEndX = x + this->tokenWidth;
   TextFlags tokenFlags = this->tokenTextFlags() | everyRunFlag;
   if (this->hasTruncationToken) {
@@ -247,7 +260,7 @@ ShouldStop TextFrameLine::forEachStyledGlyphSpan(
       span.attributedString = para.truncationToken;
       span.ctLineXOffset = this->leftPartWidth;
       const TextStyle* tokenStyle = &textFrame.firstTokenTextStyleForLineAtIndex(this->lineIndex);
-      const NSArrayRef<CTRun*> tokenRuns = glyphRuns(tokenCTLine);
+      const GlyphRuns tokenRuns = tokenGlyphRuns(glyphStorage);
       const Int lastTokenRunIndex = tokenRuns.count() - 1;
       for (Int i = 0; i <= lastTokenRunIndex; ++i) {
         const GlyphRunRef run = tokenRuns[i];
@@ -282,7 +295,7 @@ ShouldStop TextFrameLine::forEachStyledGlyphSpan(
       span.attributedString = textFrame.originalAttributedString;
       span.stringRange = Range{rangeInOriginalString.end, Count{0}};
       span.ctLineXOffset = this->leftPartWidth - _hyphenXOffset;
-      const NSArrayRef<CTRun*> tokenRuns = glyphRuns(tokenCTLine);
+      const GlyphRuns tokenRuns = tokenGlyphRuns(glyphStorage);
       if (tokenRuns.isValidIndex(_hyphenRunIndex)) {
         const GlyphRunRef run = tokenRuns[_hyphenRunIndex];
         span.glyphSpan = _hyphenGlyphIndex < 0 ? GlyphSpan{run}
@@ -177,7 +177,7 @@ Rect<CGFloat> calculateLineGlyphPathBoundsLLO(const TextFrameLine& line,
 {
   Rect<CGFloat> bounds = Rect<CGFloat>::infinitelyEmpty();
   line.forEachCTLineSegment(FlagsRequiringIndividualRunIteration{detail::everyRunFlag},
-    [&](TextLinePart part __unused, CTLineXOffset ctLineXOffset, CTLine& ctLine __unused,
+    [&](TextLinePart part __unused, CTLineXOffset ctLineXOffset, CTLine* ctLine __unused,
         Optional<GlyphSpan> glyphSpan) -> ShouldStop
   {
     const GlyphSpan span = *glyphSpan;
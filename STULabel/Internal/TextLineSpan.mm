@@ -37,6 +37,42 @@ struct LineSpanBuffer {
   operator TempVector<TextLineSpan>() && { return std::move(spans); }
 };
 
+static void addLineSpans(LineSpanBuffer& spans, const TextFrameLine& line,
+                         Range<Int32> rangeInTruncatedString,
+                         Optional<TextStyleOverride&> styleOverride,
+                         Optional<FunctionRef<bool(const TextStyle&)>> predicate,
+                         UInt32 rangeIndex = 0)
+{
+  const auto lineX = line.originX;
+  const auto lineWidth = line.width;
+  if (lineWidth > 0) {
+    line.forEachStyledGlyphSpan(styleOverride,
+      [&](const StyledGlyphSpan&, const TextStyle& style, Range<Float64> x)
+    {
+      if (STU_UNLIKELY(x.isEmpty())) return;
+      if (predicate && !predicate(style)) return;
+      spans.add(TextLineSpan{.x = {lineX + x.start, lineX + x.end},
+                             .isLeftEndOfLine = x.start == 0,
+                             .lineIndex = sign_cast(line.lineIndex),
+                             .isRightEndOfLine = x.end == lineWidth,
+                             .rangeIndex = rangeIndex});
+    });
+  } else { // lineWidth <= 0
+    const Range<Int32> r = line.rangeInTruncatedStringIncludingTrailingWhitespace();
+    if (!rangeInTruncatedString.contains(r)) return;
+    if (predicate
+        && !predicate(line.textFrame().firstNonTokenTextStyleForLineAtIndex(line.lineIndex)))
+    {
+      return;
+    }
+    spans.add(TextLineSpan{.x = {lineX, lineX},
+                           .isLeftEndOfLine = true,
+                           .lineIndex = sign_cast(line.lineIndex),
+                           .isRightEndOfLine = true,
+                           .rangeIndex = rangeIndex});
+  }
+}
+
 TempArray<TextLineSpan>
   TextFrame::lineSpans(STUTextFrameRange range,
                        Optional<FunctionRef<bool(const TextStyle&)>> predicate) const
@@ -45,30 +81,125 @@ TempArray<TextLineSpan>
   const Range<Int32> rangeInTruncatedString = styleOverride.drawnRange.rangeInTruncatedString();
   LineSpanBuffer spans;
   for (auto& line : lines()[styleOverride.drawnLineRange]) {
-      const auto lineX = line.originX;
-      const auto lineWidth = line.width;
-      if (lineWidth > 0) {
-        line.forEachStyledGlyphSpan(&styleOverride,
-          [&](const StyledGlyphSpan&, const TextStyle& style, Range<Float64> x)
-        {
-          if (STU_UNLIKELY(x.isEmpty())) return;
-          if (predicate && !predicate(style)) return;
+    addLineSpans(spans, line, rangeInTruncatedString, &styleOverride, predicate);
+  }
+  return std::move(spans);
+}
+
+TempArray<TextLineSpan> TextFrame::lineSpans(ArrayRef<const STUTextFrameRange> ranges) const {
+  const Int n = ranges.count();
+  STU_CHECK(n <= IntegerTraits<Int32>::max);
+  if (n == 0) return {};
+  TempArray<Range<Int32>> lineIndexRanges{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    STU_DEBUG_ASSERT(i == 0 || ranges[i - 1].start <= ranges[i].start);
+    lineIndexRanges[i] = lineIndexRange(ranges[i]);
+  }
+  // The spans of all ranges, ordered by line index and then by range index.
+  TempVector<TextLineSpan> allSpans{MaxInitialCapacity{256}};
+  // The spans of a single range on the current line.
+  LineSpanBuffer spans;
+  // The x ranges of the glyph spans of the current line, relative to the line's origin, or the
+  // empty range for a line with a non-positive width. Only computed if the current line is fully
+  // contained in one of the ranges.
+  TempVector<Range<Float64>> lineXs;
+  // The indices of the ranges that overlap the current line, in ascending order.
+  TempVector<Int32> activeRangeIndices;
+  Int32 nextRangeIndex = 0;
+  Int32 lineIndex = lineIndexRanges[0].start;
+  for (;;) {
+    // Remove the ranges that end before the current line.
+    Int k = 0;
+    for (const Int32 r : activeRangeIndices) {
+      if (lineIndex < lineIndexRanges[r].end) {
+        activeRangeIndices[k++] = r;
+      }
+    }
+    activeRangeIndices.removeLast(activeRangeIndices.count() - k);
+    if (activeRangeIndices.isEmpty()) {
+      if (nextRangeIndex == n) break;
+      lineIndex = max(lineIndex, lineIndexRanges[nextRangeIndex].start);
+    }
+    while (nextRangeIndex < n && lineIndexRanges[nextRangeIndex].start <= lineIndex) {
+      if (lineIndex < lineIndexRanges[nextRangeIndex].end) {
+        activeRangeIndices.append(nextRangeIndex);
+      }
+      ++nextRangeIndex;
+    }
+    if (activeRangeIndices.isEmpty()) continue;
+    const TextFrameLine& line = lines()[lineIndex];
+    bool lineXsAreValid = false;
+    for (const Int32 r : activeRangeIndices) {
+      const STUTextFrameRange& range = ranges[r];
+      spans.spans.removeAll();
+      if (sign_cast(range.start.lineIndex) < lineIndex
+          && lineIndex < sign_cast(range.end.lineIndex))
+      { // The range contains the full line, which is the case for all lines between the first and
+        // the last line of a range. The glyph spans of such lines are shared between ranges.
+        if (!lineXsAreValid) {
+          lineXsAreValid = true;
+          lineXs.removeAll();
+          if (line.width > 0) {
+            line.forEachStyledGlyphSpan(none,
+              [&](const StyledGlyphSpan&, const TextStyle&, Range<Float64> x)
+            {
+              if (STU_UNLIKELY(x.isEmpty())) return;
+              lineXs.append(x);
+            });
+          } else {
+            lineXs.append(Range<Float64>{0, 0});
+          }
+        }
+        const auto lineX = line.originX;
+        const auto lineWidth = line.width;
+        for (const Range<Float64> x : lineXs) {
           spans.add(TextLineSpan{.x = {lineX + x.start, lineX + x.end},
                                  .isLeftEndOfLine = x.start == 0,
-                                 .lineIndex = sign_cast(line.lineIndex),
-                                 .isRightEndOfLine = x.end == lineWidth});
-        });
-      } else { // lineWidth <= 0
-        const Range<Int32> r = line.rangeInTruncatedStringIncludingTrailingWhitespace();
-        if (!rangeInTruncatedString.contains(r)) continue;
-        if (predicate && !predicate(firstNonTokenTextStyleForLineAtIndex(line.lineIndex))) continue;
-        spans.add(TextLineSpan{.x = {lineX, lineX},
-                               .isLeftEndOfLine = true,
-                               .lineIndex = sign_cast(line.lineIndex),
-                               .isRightEndOfLine = true});
+                                 .lineIndex = sign_cast(lineIndex),
+                                 .isRightEndOfLine = lineWidth <= 0 || x.end == lineWidth,
+                                 .rangeIndex = sign_cast(r)});
+        }
+      } else {
+        TextStyleOverride styleOverride{*this, range, nil};
+        addLineSpans(spans, line, styleOverride.drawnRange.rangeInTruncatedString(),
+                     &styleOverride, none, sign_cast(r));
       }
+      allSpans.append(spans.spans);
+    }
+    ++lineIndex;
   }
-  return std::move(spans);
+  // Group the spans by range with a (stable) counting sort.
+  TempArray<Int> offsets{zeroInitialized, Count{n + 1}};
+  for (const TextLineSpan& span : allSpans) {
+    ++offsets[span.rangeIndex + 1];
+  }
+  for (Int i = 1; i <= n; ++i) {
+    offsets[i] += offsets[i - 1];
+  }
+  TempArray<TextLineSpan> result{uninitialized, Count{allSpans.count()}};
+  for (const TextLineSpan& span : allSpans) {
+    result[offsets[span.rangeIndex]++] = span;
+  }
+  return result;
+}
+
+bool TextFrame::hasLineSpans(STUTextFrameRange range) const {
+  TextStyleOverride styleOverride{*this, range, nil};
+  const Range<Int32> rangeInTruncatedString = styleOverride.drawnRange.rangeInTruncatedString();
+  for (auto& line : lines()[styleOverride.drawnLineRange]) {
+    if (line.width > 0) {
+      const ShouldStop hasSpan = line.forEachStyledGlyphSpan(&styleOverride,
+                                   [&](const StyledGlyphSpan&, const TextStyle&, Range<Float64> x)
+                                   {
+                                     return ShouldStop{!x.isEmpty()};
+                                   });
+      if (hasSpan) return true;
+    } else { // line.width <= 0
+      const Range<Int32> r = line.rangeInTruncatedStringIncludingTrailingWhitespace();
+      if (rangeInTruncatedString.contains(r)) return true;
+    }
+  }
+  return false;
 }
   
 Int adjustTextLineSpansByHorizontalInsetsAndReturnNewCount(ArrayRef<TextLineSpan> spans,
@@ -584,9 +584,48 @@ const void* TextStyle::nonnullInfoFromOverride(TextFlags component) const {
   return pointer;
 }
 
+/// An entry of a sparse index over a TextStyle sequence.
+struct TextStyleIndexEntry {
+  /// Only every `stride`-th style of a sequence gets an index entry.
+  static constexpr Int stride = 16;
+  /// Sequences with fewer styles are not indexed.
+  static constexpr Int minStyleCount = 4*stride;
+
+  Int32 stringIndex;
+  /// The byte offset of the style from the first style in the sequence.
+  UInt32 offset;
+
+  /// Equivalent to `cursor.styleForStringIndex(stringIndex)`, except that the lookup only scans
+  /// forward over up to `stride` styles from `cursor` and otherwise does a binary search in
+  /// `index`, whose offsets are relative to `firstStyle`.
+  ///
+  /// @pre `cursor` must be a style in the sequence starting with `firstStyle`.
+  static const TextStyle& styleForStringIndex(Int32 stringIndex, const TextStyle& cursor,
+                                              const TextStyle* firstStyle,
+                                              ArrayRef<const TextStyleIndexEntry> index);
+};
+
 struct TextStyleSpan {
   const TextStyle* firstStyle;
   const TextStyle* terminatorStyle;
+  /// An optional sparse index with the offsets relative to `firstStyle`.
+  ArrayRef<const TextStyleIndexEntry> index;
+
+  /// Equivalent to `firstStyle->styleForStringIndex(stringIndex)`, except that the lookup is
+  /// a binary search plus a scan over less than `TextStyleIndexEntry::stride` styles if the span
+  /// has a non-empty index.
+  const TextStyle& styleForStringIndex(Int32 stringIndex) const;
+
+  /// Equivalent to `cursor.styleForStringIndex(stringIndex)`, except that the lookup uses the
+  /// index if the style isn't among the next `TextStyleIndexEntry::stride` styles after `cursor`.
+  /// This makes the lookup efficient both for a cursor that moves forward in small steps and for
+  /// jumps over many styles.
+  ///
+  /// @pre `cursor` must be a style in this span.
+  STU_INLINE
+  const TextStyle& styleForStringIndex(Int32 stringIndex, const TextStyle& cursor) const {
+    return TextStyleIndexEntry::styleForStringIndex(stringIndex, cursor, firstStyle, index);
+  }
 
   STU_INLINE
   const Byte* dataBegin() const { return reinterpret_cast<const Byte*>(firstStyle); };
@@ -9,6 +9,7 @@
 #import "TextFrameDrawingOptions.hpp"
 
 #import "stu/Assert.h"
+#import "stu/BinarySearch.hpp"
 
 namespace stu_label {
 
@@ -75,6 +76,37 @@ const TextStyle& TextStyle::styleForStringIndex(Int32 stringIndex) const {
   return *style;
 }
 
+const TextStyle& TextStyleSpan::styleForStringIndex(Int32 stringIndex) const {
+  const TextStyle* style = firstStyle;
+  if (!index.isEmpty()) {
+    const Int i = binarySearchFirstIndexWhere(index, [&](const TextStyleIndexEntry& entry) {
+                    return entry.stringIndex > stringIndex;
+                  }).indexOrArrayCount - 1;
+    if (i >= 0) {
+      style = reinterpret_cast<const TextStyle*>(dataBegin() + index[i].offset);
+    }
+  }
+  return style->styleForStringIndex(stringIndex);
+}
+
+const TextStyle& TextStyleIndexEntry::styleForStringIndex(
+                   Int32 stringIndex, const TextStyle& cursor, const TextStyle* firstStyle,
+                   ArrayRef<const TextStyleIndexEntry> index)
+{
+  if (index.isEmpty()) return cursor.styleForStringIndex(stringIndex);
+  const TextStyle* style = &cursor;
+  if (style->stringIndex() <= stringIndex) {
+    for (Int n = 0; n < stride; ++n) {
+      const TextStyle& next = style->next();
+      if (next.stringIndex() > stringIndex) return *style;
+      if (&next == style) break;
+      style = &next;
+    }
+  }
+  return TextStyleSpan{.firstStyle = firstStyle, .terminatorStyle = nullptr, .index = index}
+         .styleForStringIndex(stringIndex);
+}
+
 void TextStyleOverride::applyTo(const TextStyle& style) {
   const TextFlags styleFlags = style.flags();
   const TextFlags preservedFlags = styleFlags & this->flagsMask;
@@ -218,15 +250,7 @@ TextStyleOverride TextStyleOverride::create(
       }
     }
   }
-  Range<Int32> drawnLineRange = {sign_cast(drawnRange.start.lineIndex),
-                                 sign_cast(drawnRange.end.lineIndex)};
-  if (drawnLineRange.end < textFrame.lines().count()
-      && (drawnRange.end.isIndexOfInsertedHyphen
-          || (drawnRange.end.indexInTruncatedString
-              != textFrame.lineStringIndices()[drawnLineRange.end].startIndexInTruncatedString)))
-  {
-    drawnLineRange.end += 1;
-  }
+  const Range<Int32> drawnLineRange = textFrame.lineIndexRange(drawnRange);
 
   if (!highlightStyle) {
     return {drawnLineRange, drawnRangeInOriginalString, drawnRange};
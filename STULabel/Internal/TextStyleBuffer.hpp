@@ -13,6 +13,8 @@ namespace stu_label {
 
 extern NSString* const STUOriginalFontAttributeName;
 
+struct TextStyleTemplate;
+
 /// @note
 ///  The TextStyle data may contain non-owning references to attributes of the
 ///  NSAttributedString(s). Hence, the attributed strings (or a copy of them) must be kept alive
@@ -54,6 +56,8 @@ public:
     nextUTF16Index_ = 0;
     lastStyleSize_ = 0;
     lastStyle_ = nil;
+    styleCount_ = 0;
+    styleIndex_.removeAll();
   }
 
   void setData(ArrayRef<const Byte> data) {
@@ -61,8 +65,31 @@ public:
     STU_DEBUG_ASSERT(nextUTF16Index_ == 0 && lastStyleSize_ == 0 && lastStyle_ == nullptr);
     data_.removeAll();
     data_.append(data);
+    // We don't know the style offsets of the new data.
+    styleCount_ = 0;
+    styleIndex_.removeAll();
+  }
+
+  /// Enables the construction of a sparse index for the style data encoded after this call,
+  /// cf. `styleIndex()`.
+  STU_INLINE
+  void enableStyleIndex() {
+    STU_DEBUG_ASSERT(data_.isEmpty());
+    buildsStyleIndex_ = true;
+  }
+
+  /// The sparse index for the encoded style data, or an empty array if the index wasn't enabled
+  /// or if fewer than `TextStyleIndexEntry::minStyleCount` styles have been encoded.
+  STU_INLINE
+  ArrayRef<const TextStyleIndexEntry> styleIndex() const {
+    if (styleCount_ < TextStyleIndexEntry::minStyleCount) return {};
+    return styleIndex_;
   }
 
+  /// The memory overhead of the style index in bytes.
+  STU_INLINE
+  UInt styleIndexSizeInBytes() const { return styleIndex().arraySizeInBytes(); }
+
   STU_INLINE_T
   ArrayRef<const ColorRef> colors() const {
     return !oldColors_.first.isEmpty() ? oldColors_.first : colors_;
@@ -105,18 +132,39 @@ public:
   // codes.
   static constexpr Int maxFontCount = 43690;
 
+  /// Removes all entries from the process-wide cache of encoded attribute dictionaries.
+  /// (The cache is also cleared automatically when the app receives a memory warning or
+  ///  enters the background.)
+  static void clearGlobalStyleTemplateCache();
+
+  /// The cache is enabled by default. Disabling the cache also clears it.
+  /// (Used by the performance tests that compare the encoding with and without the cache.)
+  static void setGlobalStyleTemplateCacheIsEnabled(bool);
+
+  /// The number of dictionaries in the cache. Only used for testing.
+  static Int globalStyleTemplateCacheEntryCount();
+
 private:
   FontIndex addFont(FontRef);
   ColorIndex addColor(UIColor*);
   TextFlags colorFlags(ColorIndex) const;
 
+  Byte* appendStyleCapacity();
+  TextFlags encodeStyleTemplate(Range<Int> stringRange, const TextStyleTemplate&);
+  bool finishStyle(Range<Int> stringRange, TextStyle* style, Int size, Int firstInfoOffset,
+                   bool isBig, TextFlags flags, FontIndex fontIndex, ColorIndex textColorIndex);
+
   TempVector<FontRef> fonts_;
   TempVector<ColorRef> colors_;
   TempVector<Byte> data_;
 
+  TempVector<TextStyleIndexEntry> styleIndex_;
+
   Int32 nextUTF16Index_{};
+  Int32 styleCount_{};
   UInt8 lastStyleSize_{};
   bool needToFixAttachmentAttributes_{};
+  bool buildsStyleIndex_{};
 
   const stu_label::TextStyle* __nullable lastStyle_{};
 
@@ -3,6 +3,7 @@
 #import "TextStyleBuffer.hpp"
 
 #import "STULabel/STUTextAttributes-Internal.hpp"
+#import "STULabel/stu_mutex.h"
 
 #import "Color.hpp"
 #import "InputClamping.hpp"
@@ -13,6 +14,8 @@
 
 #import <stddef.h>
 
+#include <atomic>
+
 #include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
 namespace stu_label {
@@ -435,6 +438,317 @@ TextFlags TextStyleBuffer::colorFlags(ColorIndex colorIndex) const {
        : colors()[colorIndex.value - ColorIndex::fixedColorIndexRange.end].textFlags();
 }
 
+/// A pre-encoded style for an attributes dictionary without a text attachment or a possibly
+/// mutable attribute value.
+///
+/// Font and color indices are local to a TextStyleBuffer, so the template stores the font and
+/// color objects instead and the color indices in the info data are patched when the template is
+/// used.
+///
+/// The unretained references point to values of the dictionary the template was created from.
+/// A template is only used for a dictionary with identical key and value pointers, so the
+/// references are also kept alive by the dictionary that is currently being encoded.
+struct TextStyleTemplate {
+  static constexpr Int maxColorCount = 5;
+  static constexpr Int maxInfoSize = TextStyle::maxSize - sizeof(TextStyle);
+
+  UIFont* __unsafe_unretained font;
+  UIColor* __unsafe_unretained __nullable foregroundColor;
+  TextStyleBuffer::ParagraphAttributes paraAttributes;
+  /// Doesn't include any `TextFlags::colorFlags`.
+  TextFlags flags;
+  UInt8 infoSize;
+  UInt8 colorCount;
+  /// The offsets of the color index fields in `infos`.
+  UInt8 colorIndexOffsets[maxColorCount];
+  UIColor* __unsafe_unretained colors[maxColorCount];
+  alignas(4) Byte infos[maxInfoSize];
+};
+
+/// A process-wide, bounded cache of `TextStyleTemplate`s for attribute dictionaries.
+///
+/// The entries are stored in a direct-mapped table indexed by a hash of the dictionary's key and
+/// value pointers. A second direct-mapped table indexed by the dictionary pointer lets us skip the
+/// content hashing when a dictionary instance is encoded repeatedly, which is the common case when
+/// many attributed strings are created with a few shared attribute dictionaries.
+struct TextStyleTemplateCache {
+  static constexpr UInt entryCount = 128;
+
+  struct Entry {
+    /// Retained. Null if the entry is unused.
+    CFDictionaryRef attributes;
+    HashCode<UInt64> contentHash;
+    TextStyleTemplate style;
+  };
+
+  Entry entries[entryCount];
+  /// 1 + the index of the entry for the dictionary with the pointer hash, or 0.
+  UInt8 entryIndexPlus1ByAttributesPointer[entryCount];
+
+  STU_INLINE
+  static UInt pointerSlot(CFDictionaryRef attributes) {
+    return hashPointer(attributes).value%entryCount;
+  }
+
+  void clear() {
+    for (Entry& entry : entries) {
+      if (entry.attributes) {
+        CFRelease(entry.attributes);
+        entry.attributes = nullptr;
+      }
+    }
+    memset(entryIndexPlus1ByAttributesPointer, 0, sizeof(entryIndexPlus1ByAttributesPointer));
+  }
+};
+static_assert(TextStyleTemplateCache::entryCount <= maxValue<UInt8>);
+
+static stu_mutex styleTemplateCacheMutex = STU_MUTEX_INIT;
+static bool styleTemplateCacheIsInitialized = false;
+static TextStyleTemplateCache styleTemplateCache; // Zero-initialized.
+static std::atomic<bool> styleTemplateCacheIsEnabled{true};
+
+static HashCode<UInt64> hashKeyAndValuePointers(CFDictionaryRef attributes) {
+  UInt64 sum = 0;
+  CFDictionaryApplyFunction(attributes, [](const void* key, const void* value, void* context) {
+    // The addition makes the hash independent of the iteration order.
+    *static_cast<UInt64*>(context) += hash(reinterpret_cast<UInt64>(key),
+                                           reinterpret_cast<UInt64>(value)).value;
+  }, &sum);
+  return hash(sum, static_cast<UInt64>(CFDictionaryGetCount(attributes)));
+}
+
+static bool haveIdenticalKeyAndValuePointers(CFDictionaryRef attributes, CFDictionaryRef other) {
+  if (CFDictionaryGetCount(attributes) != CFDictionaryGetCount(other)) return false;
+  struct Context {
+    CFDictionaryRef other;
+    bool isIdentical;
+  } context = {other, true};
+  CFDictionaryApplyFunction(attributes, [](const void* key, const void* value, void* ctx) {
+    Context& context = *static_cast<Context*>(ctx);
+    if (CFDictionaryGetValue(context.other, key) != value) {
+      context.isIdentical = false;
+    }
+  }, &context);
+  return context.isIdentical;
+}
+
+/// Returns true if the value may be mutated after it was added to the dictionary, in which case
+/// the style data derived from it mustn't be cached (e.g. an NSMutableParagraphStyle or an
+/// NSShadow). Like the shared STUShapedString cache, we treat a value as immutable if `copy`
+/// returns the value itself. Values that don't support copying are assumed to be immutable.
+static bool isPossiblyMutableAttributeValue(id __unsafe_unretained value) {
+  if (![value respondsToSelector:@selector(copyWithZone:)]) return false;
+  const id copy = [value copy];
+  return copy != value;
+}
+
+static bool hasPossiblyMutableAttributeValue(NSDictionary* __unsafe_unretained attributes) {
+  bool result = false;
+  CFDictionaryApplyFunction((__bridge CFDictionaryRef)attributes,
+                            [](const void*, const void* value, void* context) {
+    bool& result = *static_cast<bool*>(context);
+    if (!result && isPossiblyMutableAttributeValue((__bridge id)value)) {
+      result = true;
+    }
+  }, &result);
+  return result;
+}
+
+/// Returns true if a template for the attributes was found. Otherwise computes the content hash
+/// needed for inserting a new template.
+static bool findStyleTemplate(NSDictionary* __unsafe_unretained nsAttributes,
+                              Out<TextStyleTemplate> outStyle,
+                              Out<HashCode<UInt64>> outContentHash)
+{
+  CFDictionaryRef const attributes = (__bridge CFDictionaryRef)nsAttributes;
+  TextStyleTemplateCache& cache = styleTemplateCache;
+  stu_mutex_lock(&styleTemplateCacheMutex);
+  if (const UInt8 i = cache.entryIndexPlus1ByAttributesPointer[cache.pointerSlot(attributes)];
+      i != 0 && cache.entries[i - 1].attributes == attributes)
+  {
+    outStyle = cache.entries[i - 1].style;
+    stu_mutex_unlock(&styleTemplateCacheMutex);
+    return true;
+  }
+  stu_mutex_unlock(&styleTemplateCacheMutex);
+  const HashCode<UInt64> contentHash = hashKeyAndValuePointers(attributes);
+  outContentHash = contentHash;
+  bool found = false;
+  stu_mutex_lock(&styleTemplateCacheMutex);
+  const TextStyleTemplateCache::Entry& entry =
+    cache.entries[contentHash.value%TextStyleTemplateCache::entryCount];
+  if (entry.attributes && entry.contentHash == contentHash
+      && haveIdenticalKeyAndValuePointers(attributes, entry.attributes))
+  {
+    outStyle = entry.style;
+    found = true;
+  }
+  stu_mutex_unlock(&styleTemplateCacheMutex);
+  return found;
+}
+
+static void insertStyleTemplate(NSDictionary* __unsafe_unretained nsAttributes,
+                                HashCode<UInt64> contentHash, const TextStyleTemplate& style)
+{
+  // For an immutable dictionary `copy` just returns the retained instance. A mutable dictionary
+  // has to be copied, since the cache must not observe later mutations.
+  CFDictionaryRef const attributes = (__bridge_retained CFDictionaryRef)[nsAttributes copy];
+  TextStyleTemplateCache& cache = styleTemplateCache;
+  stu_mutex_lock(&styleTemplateCacheMutex);
+  if (STU_UNLIKELY(!styleTemplateCacheIsInitialized)) {
+    styleTemplateCacheIsInitialized = true;
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearCacheBlock = ^(NSNotification*) {
+      TextStyleBuffer::clearGlobalStyleTemplateCache();
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+  }
+  const UInt index = contentHash.value%TextStyleTemplateCache::entryCount;
+  TextStyleTemplateCache::Entry& entry = cache.entries[index];
+  CFDictionaryRef const oldAttributes = entry.attributes;
+  if (oldAttributes) {
+    UInt8& oldSlot = cache.entryIndexPlus1ByAttributesPointer[cache.pointerSlot(oldAttributes)];
+    if (oldSlot == index + 1) {
+      oldSlot = 0;
+    }
+  }
+  entry.attributes = attributes;
+  entry.contentHash = contentHash;
+  entry.style = style;
+  cache.entryIndexPlus1ByAttributesPointer[cache.pointerSlot(attributes)] =
+    narrow_cast<UInt8>(index + 1);
+  stu_mutex_unlock(&styleTemplateCacheMutex);
+  if (oldAttributes) {
+    CFRelease(oldAttributes);
+  }
+}
+
+void TextStyleBuffer::clearGlobalStyleTemplateCache() {
+  stu_mutex_lock(&styleTemplateCacheMutex);
+  styleTemplateCache.clear();
+  stu_mutex_unlock(&styleTemplateCacheMutex);
+}
+
+Int TextStyleBuffer::globalStyleTemplateCacheEntryCount() {
+  Int count = 0;
+  stu_mutex_lock(&styleTemplateCacheMutex);
+  for (const TextStyleTemplateCache::Entry& entry : styleTemplateCache.entries) {
+    count += entry.attributes != nullptr;
+  }
+  stu_mutex_unlock(&styleTemplateCacheMutex);
+  return count;
+}
+
+void TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(bool isEnabled) {
+  styleTemplateCacheIsEnabled.store(isEnabled, std::memory_order_relaxed);
+  if (!isEnabled) {
+    clearGlobalStyleTemplateCache();
+  }
+}
+
+STU_INLINE
+Byte* TextStyleBuffer::appendStyleCapacity() {
+  if (STU_UNLIKELY(data_.capacity() == 0)) {
+    fonts_.setCapacity(8);
+    colors_.setCapacity(8);
+    data_.setCapacity(256);
+  }
+
+  STU_DEBUG_ASSERT(lastStyleSize_ == 0
+                   || reinterpret_cast<const Byte*>(lastStyle_) + lastStyleSize_ == data().end());
+  Byte* const p = data_.append(repeat(uninitialized, TextStyle::maxSize));
+  lastStyle_ = reinterpret_cast<const TextStyle*>(p - lastStyleSize_);
+  return p;
+}
+
+/// Removes the unused capacity appended by `appendStyleCapacity` and links the new style into the
+/// style list, unless it is equal to the last style, in which case the whole capacity is removed
+/// and false is returned.
+STU_INLINE
+bool TextStyleBuffer::finishStyle(Range<Int> range, TextStyle* style, Int size,
+                                  Int firstInfoOffset, bool isBig, TextFlags flags,
+                                  FontIndex fontIndex, ColorIndex textColorIndex)
+{
+  STU_ASSERT(size <= TextStyle::maxSize);
+  if (size == lastStyleSize_
+      && flags == lastStyle_->flags()
+      && fontIndex == lastStyle_->fontIndex()
+      && textColorIndex == lastStyle_->colorIndex())
+  {
+    if (firstInfoOffset == size
+        || memcmp(reinterpret_cast<Byte*>(style) + firstInfoOffset,
+                  reinterpret_cast<const Byte*>(lastStyle_) + firstInfoOffset,
+                  sign_cast(size - firstInfoOffset)) == 0)
+    {
+      data_.removeLast(TextStyle::maxSize);
+      return false;
+    }
+  }
+  data_.removeLast(TextStyle::maxSize - size);
+
+  const UInt offsetToNextDiv4 = sign_cast(size)/4;
+  const UInt offsetFromPreviousDiv4 = lastStyleSize_/4;
+
+  style->bits = isBig
+              | (static_cast<UInt64>(flags) << TextStyle::BitIndex::flags)
+              | (UInt64{offsetFromPreviousDiv4} << TextStyle::BitIndex::offsetFromPreviousDiv4)
+              | (UInt64{offsetToNextDiv4} << TextStyle::BitIndex::offsetToNextDiv4)
+              | (UInt64(range.start) << TextStyle::BitIndex::stringIndex)
+              | (isBig ? 0 : (UInt64{fontIndex.value} << TextStyle::BitIndex::Small::font))
+              | (isBig ? 0 : (UInt64{textColorIndex.value} << TextStyle::BitIndex::Small::color));
+
+  lastStyle_ = style;
+  lastStyleSize_ = narrow_cast<UInt8>(size);
+
+  if (buildsStyleIndex_) {
+    if (styleCount_%TextStyleIndexEntry::stride == 0) {
+      styleIndex_.append(TextStyleIndexEntry{
+                           .stringIndex = narrow_cast<Int32>(range.start),
+                           .offset = narrow_cast<UInt32>(reinterpret_cast<const Byte*>(style)
+                                                         - data_.begin())});
+    }
+    styleCount_ += 1;
+  }
+
+  return true;
+}
+
+TextFlags TextStyleBuffer::encodeStyleTemplate(Range<Int> range, const TextStyleTemplate& t) {
+  Byte* next = appendStyleCapacity();
+  const FontIndex fontIndex = addFont(t.font);
+  const ColorIndex textColorIndex = !t.foregroundColor ? ColorIndex::black
+                                  : addColor(t.foregroundColor);
+  TextFlags flags = t.flags | colorFlags(textColorIndex);
+  const bool isBig = range.end > TextStyle::maxSmallStringIndex
+                  || fontIndex.value > TextStyle::maxSmallFontIndex
+                  || textColorIndex.value > TextStyle::maxSmallColorIndex;
+  TextStyle* style;
+  if (!isBig) {
+    style = new (next) TextStyle{0};
+    next = reinterpret_cast<Byte*>(style + 1);
+  } else {
+    TextStyle::Big* const bigStyle = new (next) TextStyle::Big{0, fontIndex, textColorIndex};
+    style = bigStyle;
+    next = reinterpret_cast<Byte*>(bigStyle + 1);
+  }
+  const Int firstInfoOffset = next - reinterpret_cast<Byte*>(style);
+  memcpy(next, t.infos, t.infoSize);
+  for (Int i = 0; i < t.colorCount; ++i) {
+    const ColorIndex colorIndex = addColor(t.colors[i]);
+    flags |= colorFlags(colorIndex);
+    // Optional<ColorIndex> has the same representation as ColorIndex.
+    static_assert(sizeof(Optional<ColorIndex>) == sizeof(ColorIndex));
+    memcpy(next + t.colorIndexOffsets[i], &colorIndex, sizeof(ColorIndex));
+  }
+  finishStyle(range, style, firstInfoOffset + t.infoSize, firstInfoOffset, isBig, flags,
+              fontIndex, textColorIndex);
+  return flags;
+}
+
 TextFlags TextStyleBuffer::encodeStringRangeStyle(
             Range<Int> range,
             NSDictionary<NSAttributedStringKey, id>* __unsafe_unretained __nullable attributes,
@@ -445,32 +759,39 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
 
   ensureConstantsAreInitialized();
 
+  HashCode<UInt64> contentHash{uninitialized};
+  const bool useStyleTemplateCache = attributes
+                                  && styleTemplateCacheIsEnabled.load(std::memory_order_relaxed);
+  if (useStyleTemplateCache) {
+    TextStyleTemplate styleTemplate;
+    if (findStyleTemplate(attributes, Out{styleTemplate}, Out{contentHash})) {
+      if (outParaAttributes) {
+        *outParaAttributes = styleTemplate.paraAttributes;
+      }
+      return encodeStyleTemplate(range, styleTemplate);
+    }
+  }
+
   using Context = AttributeScanContext;
 
   Context context;
   // Only zero-initialize fields that may be accessed without checking the corresponding flag.
   context.flags = Context::Flags{};
-  context.paraAttributes = static_cast<ParagraphAttributes*>(outParaAttributes);
+  // A template must contain the paragraph attributes even if the caller doesn't need them.
+  ParagraphAttributes templateParaAttributes;
+  context.paraAttributes = outParaAttributes ? static_cast<ParagraphAttributes*>(outParaAttributes)
+                         : useStyleTemplateCache ? &templateParaAttributes
+                         : nullptr;
   context.background = nil;
   context.link = nil;
   context.textAttachment = nil;
-  if (outParaAttributes) {
-    *outParaAttributes = ParagraphAttributes{};
+  if (context.paraAttributes) {
+    *context.paraAttributes = ParagraphAttributes{};
   }
 
   context.scan(attributes);
 
-  if (STU_UNLIKELY(data_.capacity() == 0)) {
-    fonts_.setCapacity(8);
-    colors_.setCapacity(8);
-    data_.setCapacity(256);
-  }
-
-  STU_DEBUG_ASSERT(lastStyleSize_ == 0
-                   || reinterpret_cast<const Byte*>(lastStyle_) + lastStyleSize_ == data().end());
-  void* next = data_.append(repeat(uninitialized, TextStyle::maxSize));
-  lastStyle_ = reinterpret_cast<const TextStyle*>(reinterpret_cast<const Byte*>(next)
-                                                  - lastStyleSize_);
+  void* next = appendStyleCapacity();
 
   UIFont* __unsafe_unretained font = STU_LIKELY(context.flags & Context::hasFont)
                                    ? context.font : (__bridge UIFont*)defaultCoreTextFont();
@@ -494,6 +815,31 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
     next = bigStyle + 1;
   }
   const Int firstInfoOffset = reinterpret_cast<Byte*>(next) - reinterpret_cast<Byte*>(style);
+
+  // Styles with attachments need special handling (see below). The style data derived from a
+  // mutable attribute value (e.g. an NSShadow) can't be cached.
+  const bool recordsTemplate = useStyleTemplateCache
+                            && !(context.flags & (Context::hasTextAttachment
+                                                  | Context::hasNSTextAttachment
+                                                  | Context::hasShadow))
+                            && !hasPossiblyMutableAttributeValue(attributes);
+  TextStyleTemplate styleTemplate;
+  if (recordsTemplate) {
+    styleTemplate.font = font;
+    styleTemplate.foregroundColor = context.flags & Context::hasForegroundColor
+                                  ? context.foregroundColor : nil;
+    styleTemplate.paraAttributes = *context.paraAttributes;
+    styleTemplate.colorCount = 0;
+  }
+  const auto recordColor = [&](const void* colorIndexField, UIColor* __unsafe_unretained color) {
+    if (!recordsTemplate) return;
+    const UInt8 i = styleTemplate.colorCount++;
+    styleTemplate.colors[i] = color;
+    styleTemplate.colorIndexOffsets[i] = narrow_cast<UInt8>(
+                                           static_cast<const Byte*>(colorIndexField)
+                                           - (reinterpret_cast<Byte*>(style) + firstInfoOffset));
+  };
+
   if (context.flags & ~(Context::hasFont | Context::hasForegroundColor)) {
 
     if (context.flags & Context::hasLink) {
@@ -528,6 +874,12 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
                                         .stuAttribute = context.background,
                                         .colorIndex = colorIndex,
                                         .borderColorIndex = borderColorIndex};
+        if (colorIndex) {
+          recordColor(&info->colorIndex, context.background->_color);
+        }
+        if (borderColorIndex) {
+          recordColor(&info->borderColorIndex, context.background->_borderColor);
+        }
         next = info + 1;
       }
     } else if (context.flags & Context::hasBackgroundColor) {
@@ -535,6 +887,7 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
       const ColorIndex colorIndex = addColor(context.backgroundColor);
       flags |= colorFlags(colorIndex);
       auto* const info = new (next) TextStyle::BackgroundInfo{.colorIndex = colorIndex};
+      recordColor(&info->colorIndex, context.backgroundColor);
       next = info + 1;
     }
 
@@ -573,6 +926,9 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
       }
       auto* const info = new (next) TextStyle::UnderlineInfo{context.underlineStyle, colorIndex,
                                                              *cachedFontInfo};
+      if (colorIndex) {
+        recordColor(&info->colorIndex, context.underlineColor);
+      }
       next = info + 1;
     }
 
@@ -591,6 +947,9 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
                                       .originalFontStrikethroughThickness =
                                          cachedFontInfo->strikethroughThickness
                                     };
+      if (colorIndex) {
+        recordColor(&info->colorIndex, context.strikethroughColor);
+      }
       next = info + 1;
     }
 
@@ -612,6 +971,9 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
                                         .strokeWidth = doNotFill ? strokeWidth : -strokeWidth,
                                         .doNotFill = doNotFill,
                                         .colorIndex = colorIndex};
+        if (colorIndex) {
+          recordColor(&info->colorIndex, context.strokeColor);
+        }
         next = info + 1;
       }
     }
@@ -665,40 +1027,18 @@ TextFlags TextStyleBuffer::encodeStringRangeStyle(
 
   }
   const Int size = reinterpret_cast<Byte*>(next) - reinterpret_cast<Byte*>(style);
-  STU_ASSERT(size <= TextStyle::maxSize);
-  if (size == lastStyleSize_
-      && flags == lastStyle_->flags()
-      && fontIndex == lastStyle_->fontIndex()
-      && textColorIndex == lastStyle_->colorIndex())
-  {
-    if (firstInfoOffset == size
-        || memcmp(reinterpret_cast<Byte*>(style) + firstInfoOffset,
-                  reinterpret_cast<const Byte*>(lastStyle_) + firstInfoOffset,
-                  sign_cast(size - firstInfoOffset)) == 0)
-    {
-      data_.removeLast(TextStyle::maxSize);
-      if ((flags & TextFlags::hasAttachment) && !context.hasFixForRdar36622225) {
-        needToFixAttachmentAttributes_ = true; // rdar://36622225
-      }
-      return flags;
+  if (recordsTemplate) {
+    styleTemplate.flags = flags & ~TextFlags::colorFlags;
+    styleTemplate.infoSize = narrow_cast<UInt8>(size - firstInfoOffset);
+    memcpy(styleTemplate.infos, reinterpret_cast<Byte*>(style) + firstInfoOffset,
+           styleTemplate.infoSize);
+    insertStyleTemplate(attributes, contentHash, styleTemplate);
+  }
+  if (!finishStyle(range, style, size, firstInfoOffset, isBig, flags, fontIndex, textColorIndex)) {
+    if ((flags & TextFlags::hasAttachment) && !context.hasFixForRdar36622225) {
+      needToFixAttachmentAttributes_ = true; // rdar://36622225
     }
   }
-  data_.removeLast(TextStyle::maxSize - size);
-
-  const UInt offsetToNextDiv4 = sign_cast(size)/4;
-  const UInt offsetFromPreviousDiv4 = lastStyleSize_/4;
-
-  style->bits = isBig
-              | (static_cast<UInt64>(flags) << TextStyle::BitIndex::flags)
-              | (UInt64{offsetFromPreviousDiv4} << TextStyle::BitIndex::offsetFromPreviousDiv4)
-              | (UInt64{offsetToNextDiv4} << TextStyle::BitIndex::offsetToNextDiv4)
-              | (UInt64(range.start) << TextStyle::BitIndex::stringIndex)
-              | (isBig ? 0 : (UInt64{fontIndex.value} << TextStyle::BitIndex::Small::font))
-              | (isBig ? 0 : (UInt64{textColorIndex.value} << TextStyle::BitIndex::Small::color));
-
-  lastStyle_ = style;
-  lastStyleSize_ = narrow_cast<UInt8>(size);
-
   return flags;
 }
 
@@ -0,0 +1,113 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "PurgeableImage.hpp"
+#import "Rect.hpp"
+
+#import "stu/Vector.hpp"
+
+#include "DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
+
+namespace stu_label {
+
+/// A purgeable image of a tile that was removed from the tile rect of a tiled layer.
+struct RetainedTileImage {
+  const void* owner;
+  Rect<Int32> frame;
+  PurgeableImage image;
+  UInt byteCount;
+};
+
+} // namespace stu_label
+
+template <> struct stu::IsBitwiseMovable<stu_label::RetainedTileImage> : True {};
+
+namespace stu_label {
+
+/// An LRU cache with a memory budget for the images of tiles that were removed from the tile rect
+/// of a tiled layer. The images are keyed by the tiled layer that rendered them and the tile frame.
+/// They are made purgeable when they are inserted.
+///
+/// The cache is not thread-safe.
+class TileImageCache {
+public:
+  explicit TileImageCache(UInt memoryBudget)
+  : memoryBudget_{memoryBudget}
+  {}
+
+  TileImageCache(const TileImageCache&) = delete;
+  TileImageCache& operator=(const TileImageCache&) = delete;
+
+  STU_INLINE Int count() const { return images_.count(); }
+
+  STU_INLINE UInt byteCount() const { return byteCount_; }
+
+  STU_INLINE UInt memoryBudget() const { return memoryBudget_; }
+
+  void setMemoryBudget(UInt memoryBudget) {
+    memoryBudget_ = memoryBudget;
+    evict(memoryBudget);
+  }
+
+  /// Inserts the image as the most recently used one and evicts the least recently used images
+  /// that no longer fit into the budget. Replaces any older image for the same owner and frame.
+  /// Does nothing if the image is larger than a quarter of the budget.
+  void insert(const void* owner, Rect<Int32> frame, PurgeableImage&& image, UInt byteCount) {
+    if (!image || byteCount > memoryBudget_/4) return;
+    discard(take(owner, frame));
+    evict(memoryBudget_ - byteCount);
+    image.makePurgeableOnceAllCGImagesAreDestroyed();
+    images_.append(RetainedTileImage{.owner = owner, .frame = frame, .image = std::move(image),
+                                     .byteCount = byteCount});
+    byteCount_ += byteCount;
+  }
+
+  /// Removes the image for the specified owner and frame from the cache and returns it.
+  /// Returns an empty image if the cache contains no such image.
+  PurgeableImage take(const void* owner, Rect<Int32> frame) {
+    for (Int i = images_.count() - 1; i >= 0; --i) {
+      RetainedTileImage& entry = images_[i];
+      if (entry.owner != owner || entry.frame != frame) continue;
+      PurgeableImage image = std::move(entry.image);
+      byteCount_ -= entry.byteCount;
+      images_.removeRange({i, i + 1});
+      return image;
+    }
+    return PurgeableImage();
+  }
+
+  void removeAll(const void* owner) {
+    if (byteCount_ == 0) return;
+    images_.removeWhere([&](RetainedTileImage& entry) {
+      if (entry.owner != owner) return false;
+      byteCount_ -= entry.byteCount;
+      return true;
+    });
+  }
+
+  void removeAll() {
+    images_.removeAll();
+    byteCount_ = 0;
+  }
+
+private:
+  /// Removes the least recently used images until the total size is not greater than the
+  /// specified number of bytes.
+  void evict(UInt maxByteCount) {
+    if (byteCount_ <= maxByteCount) return;
+    Int n = 0;
+    while (byteCount_ > maxByteCount) {
+      byteCount_ -= images_[n].byteCount;
+      ++n;
+    }
+    images_.removeRange({0, n});
+  }
+
+  /// Ordered from least to most recently used.
+  Vector<RetainedTileImage> images_;
+  UInt byteCount_{};
+  UInt memoryBudget_;
+};
+
+} // namespace stu_label
+
+#include "UndefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -169,6 +169,18 @@ STU_EXPORT
 /// Default value: @c .textLayoutBoundsPlusInsets
 @property (nonatomic) STULabelDrawingBounds drawingBlockImageBounds;
 
+/// Indicates whether the label should render text that is drawn in a single color (after
+/// applying the override colors) as an 8-bit alpha mask for a sublayer whose background color is
+/// the text color. Changing the @c overrideTextColor or @c overrideLinkColor then only updates the
+/// sublayer's background color instead of rerendering the text, as long as the text stays
+/// single-colored. Alpha masks also need only a quarter of the memory of RGB images.
+///
+/// Text with decorations, backgrounds, shadows, strokes, attachments or color glyphs (e.g. emoji)
+/// is always rendered normally, as is highlighted text and text drawn with a @c drawingBlock.
+///
+/// Default value: false
+@property (nonatomic) bool usesAlphaMaskForSingleColorText;
+
 /// Default value: false
 @property (nonatomic) bool neverUsesGrayscaleBitmapFormat;
 
@@ -3,9 +3,6 @@
 #import "STULabel.h"
 #import "STULabelSwiftExtensions.h"
 
-#import "NSAttributedString+STUDynamicTypeFontScaling.h"
-#import "UIFont+STUDynamicTypeFontScaling.h"
-
 #import "STULabelLayoutInfo-Internal.hpp"
 
 #import "Internal/LabelParameters.hpp"
@@ -1020,20 +1017,7 @@ static_assert((int)UIUserInterfaceLayoutDirectionRightToLeft == (int)STUWritingD
     const UIContentSizeCategory newCategory = preferredContentSizeCategory(self);
     if (![newCategory isEqualToString:_contentSizeCategory]) {
       _contentSizeCategory = newCategory;
-      if (STULabelLayerIsAttributed(_layer)) {
-        if (NSAttributedString* const text = _layer.attributedText) {
-          auto* const newText = [text stu_copyWithFontsAdjustedForContentSizeCategory:newCategory];
-          if (text != newText) {
-            _layer.attributedText = newText;
-          }
-        }
-      } else {
-        UIFont* const font = _layer.font;
-        UIFont* const newFont = [font stu_fontAdjustedForContentSizeCategory:newCategory];
-        if (newFont != font) {
-          _layer.font = newFont;
-        }
-      }
+      STULabelLayerAdjustFontsForContentSizeCategory(_layer, newCategory);
     }
   }
 }
@@ -2276,6 +2260,13 @@ didMoveDisplayedTextToRect:(CGRect)contentBounds
   _layer.clipsContentToBounds = clipsContentToBounds;
 }
 
+- (bool)usesAlphaMaskForSingleColorText {
+  return _layer.usesAlphaMaskForSingleColorText;
+}
+- (void)setUsesAlphaMaskForSingleColorText:(bool)usesAlphaMaskForSingleColorText {
+  _layer.usesAlphaMaskForSingleColorText = usesAlphaMaskForSingleColorText;
+}
+
 - (bool)neverUsesGrayscaleBitmapFormat {
   return _layer.neverUsesGrayscaleBitmapFormat;
 }
@@ -29,6 +29,12 @@ CGFloat STULabelLayerGetScreenScale(const STULabelLayer* __nonnull);
 
 bool STULabelLayerIsAttributed(const STULabelLayer* __nonnull);
 
+/// Adjusts the font of the label's text, or, if the label is attributed, all fonts of the
+/// attributed text, for the specified content size category.
+void STULabelLayerAdjustFontsForContentSizeCategory(STULabelLayer* __nonnull,
+                                                    UIContentSizeCategory __nonnull)
+       API_AVAILABLE(ios(10.0), tvos(10.0));
+
 const stu_label::LabelParameters& STULabelLayerGetParams(const STULabelLayer* __nonnull);
 
 NSInteger STULabelLayerGetMaximumNumberOfLines(const STULabelLayer* __nonnull);
@@ -8,6 +8,20 @@
 
 @protocol STULabelLayerDelegate;
 
+typedef struct STULabelImageBufferPoolStatistics {
+  /// The number of bitmap buffers requested for label images while the pool was enabled.
+  uint64_t requestCount;
+  /// The number of requests that were satisfied by reusing a pooled buffer.
+  /// The reuse rate is @c reuseCount/requestCount.
+  uint64_t reuseCount;
+  /// The number of pooled buffers that had been purged by the system when they were needed.
+  uint64_t purgedCount;
+  size_t bufferCount;
+  /// The total size of the pooled buffers in bytes.
+  size_t memoryUsage;
+} NS_SWIFT_NAME(STULabelLayer.ImageBufferPoolStatistics)
+  STULabelImageBufferPoolStatistics;
+
 /// @note This class must only be used on the main thread.
 /// @note
 /// @c encodeWithCoder: (@c encode(with:)) only calls the superclass method and doesn't encode
@@ -169,6 +183,18 @@ STU_REENABLE_CLANG_WARNING
 @property (nonatomic) STULabelDrawingBounds drawingBlockImageBounds;
 
 
+/// Indicates whether the label should render text that is drawn in a single color (after
+/// applying the override colors) as an 8-bit alpha mask for a sublayer whose background color is
+/// the text color. Changing the @c overrideTextColor or @c overrideLinkColor then only updates the
+/// sublayer's background color instead of rerendering the text, as long as the text stays
+/// single-colored. Alpha masks also need only a quarter of the memory of RGB images.
+///
+/// Text with decorations, backgrounds, shadows, strokes, attachments or color glyphs (e.g. emoji)
+/// is always rendered normally, as is highlighted text and text drawn with a @c drawingBlock.
+///
+/// Default value: false
+@property (nonatomic) bool usesAlphaMaskForSingleColorText;
+
 /// Default value: false
 @property (nonatomic) bool neverUsesGrayscaleBitmapFormat;
 
@@ -181,6 +207,43 @@ STU_REENABLE_CLANG_WARNING
 /// Default value: false
 @property (nonatomic) bool releasesTextFrameAfterRendering;
 
+/// The memory budget in bytes of a global pool of purgeable bitmap buffers that label layers
+/// reuse for their rendered images (including the tiles of large labels).
+///
+/// When a label image is destroyed, its buffer is returned to the pool, so that e.g. cells of the
+/// same size in a scrolling list can render into the buffers of previously discarded images
+/// instead of allocating new memory. Pooled buffers remain purgeable, i.e. the system can reclaim
+/// their memory at any time. The pool is cleared when the app enters the background or receives a
+/// memory warning.
+///
+/// The default value is 8 MiB. Setting the budget to 0 disables the pool.
+///
+/// This property can be accessed from any thread.
+@property (class) size_t imageBufferPoolMemoryBudget;
+
+/// The request and reuse counts and the current size of the pool described in the documentation
+/// for @c imageBufferPoolMemoryBudget. This property can be accessed from any thread.
+@property (class, readonly) STULabelImageBufferPoolStatistics imageBufferPoolStatistics;
+
+/// Removes all buffers from the pool described in the documentation for
+/// @c imageBufferPoolMemoryBudget and resets the statistics. This method is thread-safe.
++ (void)clearImageBufferPool;
+
+/// The memory budget in bytes of a cache shared by all label layers that display their text in
+/// tiles (which they do when the text is too large for a single image). When tiles scroll far
+/// enough out of view to be removed, their rendered images are kept in this cache, so that
+/// scrolling back doesn't require rendering the text again. The least recently removed images are
+/// evicted first. Cached images are purgeable, and the cache is cleared when the app enters the
+/// background or receives a memory warning.
+///
+/// The budget is process-global: this class property forwards to the single cache instance, so
+/// it is neither a per-layer nor a per-subclass setting.
+///
+/// The default value is 32 MiB. Setting the budget to 0 disables the cache.
+///
+/// This property can be accessed from any thread.
+@property (class) size_t tileImageCacheMemoryBudget;
+
 - (CGSize)sizeThatFits:(CGSize)size;
 
 @property (nonatomic, readonly) STULabelLayoutInfo layoutInfo;
@@ -3,6 +3,9 @@
 #import "STULabelLayer-Internal.hpp"
 #import "STULabelSwiftExtensions.h"
 
+#import "NSAttributedString+STUDynamicTypeFontScaling.h"
+#import "UIFont+STUDynamicTypeFontScaling.h"
+
 #import "STUMainScreenProperties.h"
 
 #import "STULabelDrawingBlock-Internal.hpp"
@@ -24,6 +27,8 @@
 #import "Internal/STULabelTiledLayer.h"
 #import "Internal/TextFrame.hpp"
 
+#import "stu/Vector.hpp"
+
 #import <objc/runtime.h>
 
 #include "Internal/DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -111,10 +116,19 @@ class LabelLayer : public LabelPropertiesCRTPBase<LabelLayer> {
   bool contentsIsNotNil_ : 1;
   bool isRegisteredAsLayerThatMayHaveImage_ : 1;
   bool imageMayHaveBeenPurged_ : 1;
+  bool isRegisteredAsLayerWithPendingRenderTask_ : 1;
+  bool hasPendingHighlightRedraw_ : 1;
+  /// Identifies the most recent highlight redraw task.
+  UInt32 highlightRedrawID_;
+  /// Identifies the most recent content size category adjustment.
+  UInt32 contentSizeCategoryAdjustmentID_;
 
   LabelLayer* previousLayerThatHasImage_;
   LabelLayer* nextLayerThatHasImage_;
 
+  LabelLayer* previousLayerWithPendingRenderTask_;
+  LabelLayer* nextLayerWithPendingRenderTask_;
+
   CGSize size_;
   UIEdgeInsets contentInsets_;
   LabelParameters params_;
@@ -153,6 +167,8 @@ class LabelLayer : public LabelPropertiesCRTPBase<LabelLayer> {
   STUTextFrame* textFrame_;
   STUTextFrame* measuringTextFrame_;
   CALayer* contentLayer_;
+  /// Only set if `renderMode_ == LabelRenderMode::alphaMaskInSublayer`.
+  LabelAlphaMaskTextColors alphaMaskTextColors_;
 
   LabelRenderTask* task_;
   LabelPrerenderer::WaitingLabelSetNode waitingSetNode_;
@@ -231,6 +247,22 @@ private:
     updateScreenProperties(window(self));
   }
 
+  /// Visible labels should be rendered within the next frame, while labels further away from
+  /// the visible window bounds can be rendered later.
+  CFTimeInterval renderTaskDeadline() const {
+    const CFTimeInterval now = CACurrentMediaTime();
+    UIWindow* const labelWindow = hasWindow() ? window(self) : nil;
+    if (!labelWindow) {
+      return LabelRenderScheduler::deadline(now, infinity<CGFloat>, 0);
+    }
+    CALayer* const windowLayer = labelWindow.layer;
+    const Rect<CGFloat> windowBounds = windowLayer.bounds;
+    const Rect<CGFloat> frame = [self convertRect:self.bounds toLayer:windowLayer];
+    const CGFloat dx = max(windowBounds.x.start - frame.x.end, frame.x.start - windowBounds.x.end);
+    const CGFloat dy = max(windowBounds.y.start - frame.y.end, frame.y.start - windowBounds.y.end);
+    return LabelRenderScheduler::deadline(now, max(0.f, dx, dy), windowBounds.height());
+  }
+
 public:
   CGFloat screenScale() const { return screenScale_; }
 
@@ -614,8 +646,9 @@ public:
         return emptyShapedString(params_.defaultBaseWritingDirection);
       }
       updateAttributedStringIfNecessary();
-      shapedString_ = STUShapedStringCreate(nil, attributedString_,
-                                            params_.defaultBaseWritingDirection, nullptr);
+      shapedString_ = STUShapedStringCreateUsingSharedCache(attributedString_,
+                                                            params_.defaultBaseWritingDirection,
+                                                            nullptr);
     }
     return shapedString_;
   }
@@ -632,6 +665,130 @@ public:
     invalidateLayout();
   }
 
+  API_AVAILABLE(ios(10.0), tvos(10.0))
+  void adjustFontsForContentSizeCategory(UIContentSizeCategory __unsafe_unretained category) {
+    STU_ASSERT(is_main_thread());
+    // Discards the result of any pending adjustment for a previous category.
+    contentSizeCategoryAdjustmentID_ += 1;
+    if (!isAttributed()) {
+      UIFont* const font = this->font();
+      UIFont* const newFont = [font stu_fontAdjustedForContentSizeCategory:category];
+      if (newFont != font) {
+        setFont(newFont);
+      }
+      return;
+    }
+    updateAttributedStringIfNecessary();
+    ContentSizeCategoryAdjustmentTask::add(*this, category);
+  }
+
+private:
+  /// Creates the shaped strings with the fonts adjusted for a new content size category for all
+  /// attributed labels whose category changed in the same main run loop iteration. The shaping is
+  /// done in a single task on a worker thread; the results are assigned on the main thread.
+  class ContentSizeCategoryAdjustmentTask {
+    struct Entry {
+      STULabelLayer* __weak layer;
+      LabelLayer* label;
+      UInt32 id;
+      UIContentSizeCategory category;
+      STUWritingDirection defaultBaseWritingDirection;
+      NSAttributedString* attributedString;
+      /// May be nil.
+      STUShapedString* shapedString;
+      /// Nil if no font needs to be adjusted.
+      STUShapedString* result;
+    };
+
+    LabelRenderScheduler::TaskHandle schedulerHandle_;
+    CFTimeInterval deadline_{infinity<CFTimeInterval>};
+    Vector<Entry, 8> entries_;
+
+    /// The batch that is still collecting labels. Only accessed on the main thread.
+    static ContentSizeCategoryAdjustmentTask*& openBatch() {
+      static ContentSizeCategoryAdjustmentTask* batch;
+      return batch;
+    }
+
+    API_AVAILABLE(ios(10.0), tvos(10.0))
+    static void dispatch_onMainThread(void* taskPointer) {
+      STU_DEBUG_ASSERT(is_main_thread());
+      auto* const task = static_cast<ContentSizeCategoryAdjustmentTask*>(taskPointer);
+      STU_DEBUG_ASSERT(openBatch() == task);
+      openBatch() = nullptr;
+      LabelRenderScheduler::dispatchAsync(task->schedulerHandle_, task, run, task->deadline_);
+    }
+
+    API_AVAILABLE(ios(10.0), tvos(10.0))
+    static void run(void* taskPointer) {
+      auto& task = *static_cast<ContentSizeCategoryAdjustmentTask*>(taskPointer);
+      for (Entry& e : task.entries_) {
+        if (e.shapedString) {
+          // Adjusting the fonts of the existing shaped string is much cheaper than shaping the
+          // adjusted attributed string from scratch, since the encoded text styles can be reused.
+          e.result = STUShapedStringCreateWithFontsAdjustedForContentSizeCategory(
+                       e.shapedString, e.category, nullptr);
+        } else {
+          NSAttributedString* const text = e.attributedString;
+          NSAttributedString* const newText = [text stu_copyWithFontsAdjustedForContentSizeCategory:
+                                                      e.category];
+          if (newText != text) {
+            e.result = STUShapedStringCreateUsingSharedCache(newText, e.defaultBaseWritingDirection,
+                                                             nullptr);
+          }
+        }
+      }
+      dispatch_async_f(dispatch_get_main_queue(), taskPointer, finish_onMainThread);
+    }
+
+    static void finish_onMainThread(void* taskPointer) {
+      STU_DEBUG_ASSERT(is_main_thread());
+      auto* const task = static_cast<ContentSizeCategoryAdjustmentTask*>(taskPointer);
+      for (Entry& e : task->entries_) {
+        if (!e.result) continue;
+        if (STULabelLayer* const layer = e.layer) {
+          LabelLayer& label = *e.label;
+          STU_DEBUG_ASSERT(label.self == layer);
+          // The result is obsolete if the text or the relevant label properties were changed in
+          // the meantime.
+          if (label.contentSizeCategoryAdjustmentID_ == e.id
+              && label.attributedString_ == e.attributedString
+              && !label.invalidatedStringAttributes_
+              && label.params_.defaultBaseWritingDirection == e.defaultBaseWritingDirection)
+          {
+            label.setShapedText(e.result);
+          }
+        }
+      }
+      task->~ContentSizeCategoryAdjustmentTask();
+      free(task);
+    }
+
+  public:
+    API_AVAILABLE(ios(10.0), tvos(10.0))
+    static void add(LabelLayer& label, UIContentSizeCategory __unsafe_unretained category) {
+      STU_DEBUG_ASSERT(is_main_thread());
+      ContentSizeCategoryAdjustmentTask* task = openBatch();
+      if (!task) {
+        task = new (Malloc().allocate<ContentSizeCategoryAdjustmentTask>(1))
+                 ContentSizeCategoryAdjustmentTask{};
+        openBatch() = task;
+        // All labels of a view hierarchy receive the trait collection change in the same run loop
+        // iteration, so we only close the batch when the main queue gets to run this block.
+        dispatch_async_f(dispatch_get_main_queue(), task, dispatch_onMainThread);
+      }
+      task->deadline_ = min(task->deadline_, label.renderTaskDeadline());
+      task->entries_.append(Entry{.layer = label.self, .label = &label,
+                                  .id = label.contentSizeCategoryAdjustmentID_,
+                                  .category = category,
+                                  .defaultBaseWritingDirection =
+                                    label.params_.defaultBaseWritingDirection,
+                                  .attributedString = label.attributedString_,
+                                  .shapedString = label.shapedString_});
+    }
+  };
+
+public:
   /// MARK: - Size, content insets and vertical alignment
 private:
   void setContentInsets(bool directional, UIEdgeInsets contentInsets) {
@@ -710,8 +867,8 @@ public:
         } else {
           if (!shapedString_) {
             updateAttributedStringIfNecessary();
-            shapedString_ = STUShapedStringCreate(nil, attributedString_,
-                                                  params_.defaultBaseWritingDirection, nullptr);
+            shapedString_ = STUShapedStringCreateUsingSharedCache(
+                              attributedString_, params_.defaultBaseWritingDirection, nullptr);
           }
           measuringTextFrame_ = STUTextFrameCreateWithShapedString(nil, shapedString_, innerSize,
                                                                    params_.displayScale(),
@@ -873,31 +1030,173 @@ public:
 
   void setIsHighlighted(bool highlighted) {
     if (highlighted == params_.isHighlighted()) return;
+    if (isInvalidated_ || !params_.highlightStyle()) {
+      params_.setIsHighlighted(highlighted);
+      return;
+    }
+    const HighlightChange change = beginHighlightChange();
     params_.setIsHighlighted(highlighted);
-    if (!isInvalidated_ && params_.highlightStyle()) {
-      if (hasContent_ && displaysAsynchronously_) {
-        prefersSynchronousDrawingForNextDisplay_ = true;
-      }
-      invalidateImage();
+    if (tryRedrawChangedHighlightLines(change)) return;
+    if (hasContent_ && displaysAsynchronously_) {
+      prefersSynchronousDrawingForNextDisplay_ = true;
     }
+    invalidateImage();
   }
 
   void setHighlightStyle(STUTextHighlightStyle* __unsafe_unretained highlightStyle) {
-    if (params_.setHighlightStyle(highlightStyle)) {
-      if (!isInvalidated_ && params_.isHighlighted()) {
-        invalidateImage();
-      }
+    if (highlightStyle == params_.highlightStyle()) return;
+    if (isInvalidated_ || !params_.isHighlighted()) {
+      params_.setHighlightStyle(highlightStyle);
+      return;
     }
+    const HighlightChange change = beginHighlightChange();
+    params_.setHighlightStyle(highlightStyle);
+    if (tryRedrawChangedHighlightLines(change)) return;
+    invalidateImage();
   }
 
   void setHighlightRange(NSRange range, STUTextRangeType rangeType) {
-    if (params_.setHighlightRange(range, rangeType)) {
-      if (!isInvalidated_ && params_.isHighlighted()) {
-        invalidateImage();
+    if (params_.highlightRange() == STUTextRange{range, clampTextRangeType(rangeType)}) return;
+    if (isInvalidated_ || !params_.isHighlighted()) {
+      params_.setHighlightRange(range, rangeType);
+      return;
+    }
+    const HighlightChange change = beginHighlightChange();
+    params_.setHighlightRange(range, rangeType);
+    if (tryRedrawChangedHighlightLines(change)) return;
+    invalidateImage();
+  }
+
+private:
+  struct HighlightChange {
+    /// The drawing options the current image was drawn with, or nil if the image can't be
+    /// partially redrawn.
+    STUTextFrameDrawingOptions* oldOptions;
+    bool canRedrawLines;
+  };
+
+  /// Must be called before the highlight parameters are changed, and only if they actually change.
+  HighlightChange beginHighlightChange() {
+    const bool canRedrawLines = hasContent_ && !isInvalidated_ && !task_ && textFrame_ && image_
+                             && !imageMayHaveBeenPurged_ && !hasPendingHighlightRedraw_
+                             && (   renderMode_ == LabelRenderMode::image
+                                 || renderMode_ == LabelRenderMode::imageInSublayer)
+                             && !params_.drawingBlock;
+    if (!canRedrawLines) return {};
+    // Freezing the options ensures that the highlight change modifies a copy.
+    return {params_.frozenDrawingOptions().unretained, true};
+  }
+
+  /// Tries to update the image after a change of the highlight parameters by redrawing only the
+  /// lines whose highlighting changed into a copy of the current image. If the label displays
+  /// asynchronously, the image is redrawn by a render task and the old image stays in place until
+  /// the task has finished. Returns false if the image has to be invalidated instead.
+  bool tryRedrawChangedHighlightLines(const HighlightChange& change) {
+    if (!change.canRedrawLines) return false;
+    const bool allowExtendedRGBBitmapFormat = screenDisplayGamut_ != STUDisplayGamutSRGB;
+    const LabelTextFrameRenderInfo renderInfo =
+      labelTextFrameRenderInfo(textFrame_, textFrameInfo_, textFrameOrigin_, params_,
+                               allowExtendedRGBBitmapFormat, true, nullptr);
+    // If the highlight changes how the label has to be rendered, we have to redraw everything.
+    if (renderInfo.mode != renderMode_
+        || renderInfo.bounds != contentBoundsInTextFrame_
+        || renderInfo.imageFormat != imageFormat_
+        || renderInfo.shouldDrawBackgroundColor != contentHasBackgroundColor_
+        || renderInfo.mayBeClipped != contentMayBeClipped_)
+    {
+      return false;
+    }
+    params_.freezeDrawingOptions();
+    const Rect<CGFloat> bounds = labelTextFrameHighlightChangeBounds(
+                                   textFrame_, params_.displayScale(), change.oldOptions,
+                                   params_.drawingOptions);
+    if (displaysAsynchronously_ && !enteredBackground) {
+      HighlightRedrawTask::dispatchAsync(renderTaskDeadline(), *this, renderInfo, bounds);
+      return true;
+    }
+    return trySetRedrawnHighlightImage(redrawLabelTextFrameImageBounds(image_, textFrame_,
+                                                                       renderInfo, params_,
+                                                                       bounds));
+  }
+
+  bool trySetRedrawnHighlightImage(PurgeableImage image) {
+    if (!image) return false;
+    image_ = std::move(image);
+    const RC<CGImage> cgImage = image_.createCGImage();
+    if (!cgImage) return false;
+    if (renderMode_ == LabelRenderMode::image) {
+      self.contents = (__bridge id)cgImage.get();
+    } else {
+      contentLayer_.contents = (__bridge id)cgImage.get();
+    }
+    return true;
+  }
+
+  /// Redraws the changed highlight lines into a copy of the label's image on a worker thread.
+  class HighlightRedrawTask {
+    LabelRenderScheduler::TaskHandle schedulerHandle_;
+    STULabelLayer* __weak layer_;
+    LabelLayer* label_;
+    UInt32 id_;
+    PurgeableImage image_;
+    STUTextFrame* textFrame_;
+    LabelTextFrameRenderInfo renderInfo_;
+    LabelParameters params_;
+    Rect<CGFloat> bounds_;
+
+    HighlightRedrawTask(LabelLayer& label, const LabelTextFrameRenderInfo& renderInfo,
+                        Rect<CGFloat> bounds)
+    : layer_{label.self}, label_{&label}, id_{label.highlightRedrawID_},
+      image_{label.image_}, textFrame_{label.textFrame_}, renderInfo_{renderInfo},
+      params_{label.params_}, bounds_{bounds}
+    {}
+
+    static void run(void* taskPointer) {
+      HighlightRedrawTask& task = *static_cast<HighlightRedrawTask*>(taskPointer);
+      task.image_ = redrawLabelTextFrameImageBounds(task.image_, task.textFrame_,
+                                                    task.renderInfo_, task.params_, task.bounds_);
+      dispatch_async_f(dispatch_get_main_queue(), taskPointer, finish_onMainThread);
+    }
+
+    static void finish_onMainThread(void* taskPointer) {
+      STU_DEBUG_ASSERT(is_main_thread());
+      HighlightRedrawTask* const task = static_cast<HighlightRedrawTask*>(taskPointer);
+      if (STULabelLayer* const layer = task->layer_) {
+        LabelLayer& label = *task->label_;
+        STU_DEBUG_ASSERT(label.self == layer);
+        if (label.hasPendingHighlightRedraw_ && label.highlightRedrawID_ == task->id_) {
+          label.hasPendingHighlightRedraw_ = false;
+          if (!label.trySetRedrawnHighlightImage(std::move(task->image_))) {
+            label.invalidateImage();
+          }
+        }
       }
+      task->~HighlightRedrawTask();
+      free(task);
+    }
+
+  public:
+    static void dispatchAsync(CFTimeInterval deadline, LabelLayer& label,
+                              const LabelTextFrameRenderInfo& renderInfo, Rect<CGFloat> bounds)
+    {
+      STU_DEBUG_ASSERT(!label.hasPendingHighlightRedraw_);
+      label.hasPendingHighlightRedraw_ = true;
+      auto* const task = new (Malloc().allocate<HighlightRedrawTask>(1))
+                           HighlightRedrawTask{label, renderInfo, bounds};
+      LabelRenderScheduler::dispatchAsync(task->schedulerHandle_, task, run, deadline);
     }
+  };
+
+  /// Discards the result of a pending highlight redraw task, e.g. because the image was
+  /// invalidated.
+  void cancelPendingHighlightRedraw() {
+    if (!hasPendingHighlightRedraw_) return;
+    hasPendingHighlightRedraw_ = false;
+    highlightRedrawID_ += 1;
   }
 
+public:
+
   void setOverrideColorsApplyToHighlightedText(bool value) {
     if (params_.setOverrideColorsApplyToHighlightedText(value)) {
       if (!isInvalidated_ && params_.isEffectivelyHighlighted()) {
@@ -908,18 +1207,30 @@ public:
 
   void setOverrideTextColor(UIColor* __unsafe_unretained color) {
     if (params_.setOverrideTextColor(color)) {
-      invalidateImage();
+      if (!tryUpdateAlphaMaskTintColor()) {
+        invalidateImage();
+      }
     }
   }
 
   void setOverrideLinkColor(UIColor* __unsafe_unretained color) {
     if (params_.setOverrideLinkColor(color)) {
       if (textFrameInfoIsValidForCurrentSize_ && (textFrameInfo_.flags & STUTextFrameHasLink)) {
-        invalidateImage();
+        if (!tryUpdateAlphaMaskTintColor()) {
+          invalidateImage();
+        }
       }
     }
   }
 
+  void setUsesAlphaMaskForSingleColorText(bool value) {
+    if (params_.usesAlphaMaskForSingleColorText == value) return;
+    params_.usesAlphaMaskForSingleColorText = value;
+    if (hasContent_ && (value || renderMode_ == LabelRenderMode::alphaMaskInSublayer)) {
+      invalidateImage();
+    }
+  }
+
   void setReleasesShapedStringAfterRendering(bool releasesShapedStringAfterRendering) {
     params_.releasesShapedStringAfterRendering = releasesShapedStringAfterRendering;
     params_.releasesShapedStringAfterRenderingWasExplicitlySet = true;
@@ -1133,6 +1444,7 @@ public:
       }
       removeTask();
     }
+    cancelPendingHighlightRedraw();
     isInvalidated_ = false;
     prefersSynchronousDrawingForNextDisplay_ = enteredBackground;
     if (!async || stringIsEmpty_) {
@@ -1184,23 +1496,24 @@ public:
     taskIsStale_ = false;
     setHasBackgroundColor(true);
     params_.freezeDrawingOptions();
-    const dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0);
+    const CFTimeInterval deadline = renderTaskDeadline();
     if (textFrameInfoIsValidForCurrentSize_) {
-      task_ = LabelRenderTask::dispatchAsync(queue, *this, params_, allowExtendedRGBBitmapFormat,
+      task_ = LabelRenderTask::dispatchAsync(deadline, *this, params_, allowExtendedRGBBitmapFormat,
                                              textFrame_, textFrameInfo_, textFrameOrigin_);
     } else {
       textFrameOptionsIsPrivate_ = false;
       if (!shapedString_) {
         updateAttributedStringIfNecessary();
         task_ = LabelTextShapingAndLayoutAndRenderTask::dispatchAsync(
-                  queue, *this, params_, allowExtendedRGBBitmapFormat, textFrameOptions_,
+                  deadline, *this, params_, allowExtendedRGBBitmapFormat, textFrameOptions_,
                   attributedString_);
       } else {
         task_ = LabelLayoutAndRenderTask::dispatchAsync(
-                  queue, *this, params_, allowExtendedRGBBitmapFormat, textFrameOptions_,
+                  deadline, *this, params_, allowExtendedRGBBitmapFormat, textFrameOptions_,
                   shapedString_);
       }
     }
+    registerAsLabelLayerWithPendingRenderTask();
   }
 
   void drawInContext(CGContext* context) const {
@@ -1248,6 +1561,8 @@ private:
       }
       super_display();
     } else if (renderInfo.mode != LabelRenderMode::tiledSublayer) {
+      STU_DEBUG_ASSERT((renderInfo.mode == LabelRenderMode::alphaMaskInSublayer)
+                       == (renderInfo.imageFormat == alphaMaskCGImageFormat));
       bool needToReleaseImage = false;
       if (!image && textFrame_) {
         image_ = createLabelTextFrameImage(textFrame_, renderInfo, params_, nullptr);
@@ -1261,9 +1576,11 @@ private:
         setHasBackgroundColor(!contentHasBackgroundColor_);
         self.contents = (__bridge id)image;
         contentsIsNotNil_ = true;
-      } else {
-        STU_ASSERT(renderInfo.mode == LabelRenderMode::imageInSublayer);
+      } else if (renderInfo.mode == LabelRenderMode::imageInSublayer) {
         setContentLayerContents((__bridge id)image);
+      } else {
+        STU_ASSERT(renderInfo.mode == LabelRenderMode::alphaMaskInSublayer);
+        setAlphaMaskContentLayerContents((__bridge id)image, renderInfo.alphaMaskTextColors);
       }
       if (needToReleaseImage) {
         decrementRefCount(image);
@@ -1331,6 +1648,7 @@ private:
   STU_NO_INLINE
   void clearContent_slowPath() {
     hasContent_ = false;
+    cancelPendingHighlightRedraw();
     switch (renderMode_) {
     case LabelRenderMode::drawInCAContext:
       break;
@@ -1352,6 +1670,12 @@ private:
     case LabelRenderMode::tiledSublayer:
       ((STULabelTiledLayer*)contentLayer_).drawingBlock = nil;
       break;
+    case LabelRenderMode::alphaMaskInSublayer:
+      contentLayer_.mask.contents = nil;
+      image_ = PurgeableImage();
+      imageMayHaveBeenPurged_ = false;
+      deregisterAsLabelLayerThatHasImage();
+      break;
     }
   }
 
@@ -1367,6 +1691,7 @@ private:
   void removeContentLayer() {
     [contentLayer_ removeFromSuperlayer];
     contentLayer_ = nil;
+    alphaMaskTextColors_ = LabelAlphaMaskTextColors{};
   }
 
   void installTiledContentLayer(const LabelTextFrameRenderInfo& renderInfo) {
@@ -1424,6 +1749,50 @@ private:
     contentLayer_.contents = contents;
   }
 
+  void setAlphaMaskContentLayerContents(id mask, const LabelAlphaMaskTextColors& colors) {
+    if (contentLayer_ && renderMode_ != LabelRenderMode::alphaMaskInSublayer) {
+      removeContentLayer();
+    }
+    if (!contentLayer_) {
+      contentLayer_ = [[STULayerWithNullDefaultActions alloc] init];
+      contentLayer_.mask = [[STULayerWithNullDefaultActions alloc] init];
+      contentLayerClipsToBounds_ = false;
+    }
+    if (renderMode_ != LabelRenderMode::alphaMaskInSublayer) {
+      renderMode_ = LabelRenderMode::alphaMaskInSublayer;
+      self.contents = nil;
+      contentsIsNotNil_ = false;
+      [self insertSublayer:contentLayer_ atIndex:0];
+    }
+    alphaMaskTextColors_ = colors;
+    CALayer* const maskLayer = contentLayer_.mask;
+    maskLayer.contentsScale = params_.displayScale();
+    maskLayer.contentsGravity = (__bridge NSString*)contentsGravity(
+                                                      textFrameInfo_.horizontalAlignment,
+                                                      textFrameInfo_.verticalAlignment);
+    setContentLayerFrame();
+    maskLayer.contents = mask;
+    CGColor* const tintColor = alphaMaskTextColors_.tintColor(params_.drawingOptions);
+    STU_DEBUG_ASSERT(tintColor != nil);
+    contentLayer_.backgroundColor = tintColor;
+  }
+
+  /// Updates the background color of the alpha mask content layer instead of rerendering the
+  /// mask, if possible.
+  bool tryUpdateAlphaMaskTintColor() {
+    // If there is a task, the text colors of its render info may not match the current drawing
+    // options.
+    if (renderMode_ != LabelRenderMode::alphaMaskInSublayer || !hasContent_ || isInvalidated_
+        || task_)
+    {
+      return false;
+    }
+    CGColor* const tintColor = alphaMaskTextColors_.tintColor(params_.drawingOptions);
+    if (!tintColor) return false;
+    contentLayer_.backgroundColor = tintColor;
+    return true;
+  }
+
   void setContentLayerFrame() {
     STU_ASSERT(textFrameInfoIsValidForCurrentSize_);
     const CGRect bounds = {{}, params_.size()};
@@ -1441,6 +1810,9 @@ private:
       }
     }
     contentLayer_.frame = contentFrame;
+    if (renderMode_ == LabelRenderMode::alphaMaskInSublayer) {
+      contentLayer_.mask.frame = CGRect{{}, contentFrame.size};
+    }
     setHasBackgroundColor(!contentHasBackgroundColor_
                           || contentFrame.size.width  < params_.size().width
                           || contentFrame.size.height < params_.size().height);
@@ -1484,6 +1856,7 @@ private:
     LabelRenderTask& task = *task_;
     task.abandonedByLabel(*this);
     task_ = nullptr;
+    deregisterAsLabelLayerWithPendingRenderTask();
   }
 
 
@@ -1499,6 +1872,7 @@ private:
   STU_NO_INLINE
   void invalidateImage_slowPath() {
     cancelAsyncRendering();
+    cancelPendingHighlightRedraw();
     [self setNeedsDisplay];
   }
 
@@ -1527,6 +1901,7 @@ private:
   STU_NO_INLINE
   void invalidateLayout_slowPath_main(bool preserveTextFrames) {
     removeTask();
+    cancelPendingHighlightRedraw();
     if (!preserveTextFrames) {
       links_ = nil;
       textFrame_ = nil;
@@ -1589,6 +1964,7 @@ private:
         }
         [[fallthrough]];
       case LabelRenderMode::imageInSublayer:
+      case LabelRenderMode::alphaMaskInSublayer:
         setContentLayerFrame();
         break;
       }
@@ -1634,6 +2010,82 @@ private:
     invalidateLayout_slowPath(true);
   }
 
+  /// MARK: - Tracking of layers with pending render tasks
+
+  /// The deadline of a pending render task depends on the position of the label relative to the
+  /// visible window bounds, which changes e.g. when the label is scrolled. Hence we update the
+  /// deadlines of the pending tasks once per frame.
+  static LabelLayer* lastLabelLayerWithPendingRenderTask;
+
+  void registerAsLabelLayerWithPendingRenderTask() {
+    if (isRegisteredAsLayerWithPendingRenderTask_) return;
+    registerAsLabelLayerWithPendingRenderTask_slowPath();
+  }
+  STU_NO_INLINE
+  void registerAsLabelLayerWithPendingRenderTask_slowPath() {
+    static bool didAddRunLoopObserver = false;
+    if (STU_UNLIKELY(!didAddRunLoopObserver)) {
+      STU_ASSERT(is_main_thread());
+      didAddRunLoopObserver = true;
+      // The observer is called before Core Animation commits the current transaction.
+      const CFRunLoopObserverRef observer = CFRunLoopObserverCreateWithHandler(
+        nullptr, kCFRunLoopBeforeWaiting, true, 0,
+        ^(CFRunLoopObserverRef __unused observer, CFRunLoopActivity __unused activity) {
+          updateDeadlinesOfPendingRenderTasks();
+        });
+      CFRunLoopAddObserver(CFRunLoopGetMain(), observer, kCFRunLoopCommonModes);
+      CFRelease(observer);
+    }
+    if (lastLabelLayerWithPendingRenderTask) {
+      STU_ASSERT(lastLabelLayerWithPendingRenderTask->nextLayerWithPendingRenderTask_ == nil);
+      lastLabelLayerWithPendingRenderTask->nextLayerWithPendingRenderTask_ = this;
+      previousLayerWithPendingRenderTask_ = lastLabelLayerWithPendingRenderTask;
+    }
+    STU_ASSERT(nextLayerWithPendingRenderTask_ == nil);
+    lastLabelLayerWithPendingRenderTask = this;
+    isRegisteredAsLayerWithPendingRenderTask_ = true;
+  }
+
+  void deregisterAsLabelLayerWithPendingRenderTask() {
+    if (!isRegisteredAsLayerWithPendingRenderTask_) return;
+    deregisterAsLabelLayerWithPendingRenderTask_slowPath();
+  }
+  STU_NO_INLINE
+  void deregisterAsLabelLayerWithPendingRenderTask_slowPath() {
+    LabelLayer* const previous = previousLayerWithPendingRenderTask_;
+    LabelLayer* const next = nextLayerWithPendingRenderTask_;
+    if (previous) {
+      previous->nextLayerWithPendingRenderTask_ = next;
+    }
+    if (next) {
+      next->previousLayerWithPendingRenderTask_ = previous;
+    } else {
+      STU_ASSERT(lastLabelLayerWithPendingRenderTask == this);
+      lastLabelLayerWithPendingRenderTask = previous;
+    }
+    previousLayerWithPendingRenderTask_ = nil;
+    nextLayerWithPendingRenderTask_ = nil;
+    isRegisteredAsLayerWithPendingRenderTask_ = false;
+  }
+
+  static void updateDeadlinesOfPendingRenderTasks() {
+    STU_ASSERT(is_main_thread());
+    if (!lastLabelLayerWithPendingRenderTask) return;
+    static CFTimeInterval lastUpdateTime;
+    const CFTimeInterval now = CACurrentMediaTime();
+    if (now - lastUpdateTime < LabelRenderScheduler::frameDuration) return;
+    lastUpdateTime = now;
+    LabelLayer* layer = lastLabelLayerWithPendingRenderTask;
+    while (layer) {
+      LabelLayer* const previous = layer->previousLayerWithPendingRenderTask_;
+      // Tasks that were already started don't need further updates.
+      if (!layer->task_->tryUpdateDeadline(layer->renderTaskDeadline())) {
+        layer->deregisterAsLabelLayerWithPendingRenderTask();
+      }
+      layer = previous;
+    }
+  }
+
   /// MARK: - Tracking of layers with content images
 
   static LabelLayer* lastLabelLayerThatHasImage;
@@ -1727,9 +2179,11 @@ private:
       if (layer->renderMode_ == LabelRenderMode::image) {
         layer->self.contents = nil;
         layer->contentsIsNotNil_ = false;
-      } else {
-        STU_ASSERT(layer->renderMode_ == LabelRenderMode::imageInSublayer);
+      } else if (layer->renderMode_ == LabelRenderMode::imageInSublayer) {
         layer->contentLayer_.contents = nil;
+      } else {
+        STU_ASSERT(layer->renderMode_ == LabelRenderMode::alphaMaskInSublayer);
+        layer->contentLayer_.mask.contents = nil;
       }
       layer->imageMayHaveBeenPurged_ = true;
     }
@@ -1746,9 +2200,11 @@ private:
           if (layer->renderMode_ == LabelRenderMode::image) {
             layer->self.contents = (__bridge id)cgImage.get();
             layer->contentsIsNotNil_ = true;
-          } else {
-            STU_ASSERT(layer->renderMode_ == LabelRenderMode::imageInSublayer);
+          } else if (layer->renderMode_ == LabelRenderMode::imageInSublayer) {
             layer->contentLayer_.contents = (__bridge id)cgImage.get();
+          } else {
+            STU_ASSERT(layer->renderMode_ == LabelRenderMode::alphaMaskInSublayer);
+            layer->contentLayer_.mask.contents = (__bridge id)cgImage.get();
           }
         } else { // The image was purged.
           layer->clearContent(); // Also removes layer from labelLayerThatHasImage list.
@@ -1763,6 +2219,7 @@ private:
 
 UInt LabelLayer::enteredBackground;
 LabelLayer* LabelLayer::lastLabelLayerThatHasImage;
+LabelLayer* LabelLayer::lastLabelLayerWithPendingRenderTask;
 
 void LabelRenderTask::copyLayoutInfoTo(LabelLayer& label) const {
   STU_ASSERT(textFrameInfo_.isValid);
@@ -1856,6 +2313,7 @@ void LabelRenderTask::finish_onMainThread(void* taskPointer) {
   const auto assignTaskTo = [&task](LabelLayer& label) {
     STU_ASSERT(&task == label.task_);
     label.task_ = nullptr;
+    label.deregisterAsLabelLayerWithPendingRenderTask();
     if (!label.taskIsStale_) {
       STULabelLayer* NS_VALID_UNTIL_END_OF_SCOPE layer = label.self;
       task.assignResultTo(label);
@@ -1902,6 +2360,12 @@ auto LabelPrerenderer::WaitingLabelSetNode::get(LabelLayer& layer) -> WaitingLab
   impl.didMoveToWindow(window);
 }
 
+void STULabelLayerAdjustFontsForContentSizeCategory(STULabelLayer* self,
+                                                    UIContentSizeCategory category)
+{
+  self->impl.adjustFontsForContentSizeCategory(category);
+}
+
 const CGSize& STULabelLayerGetSize(const STULabelLayer* self) {
   return self->impl.size_;
 }
@@ -1934,6 +2398,35 @@ Unretained<STUTextFrameOptions* __nonnull> stu_label::defaultLabelTextFrameOptio
   return defaultOptions;
 }
 
++ (size_t)imageBufferPoolMemoryBudget {
+  return PurgeableImageBufferPool::memoryBudget();
+}
+
++ (void)setImageBufferPoolMemoryBudget:(size_t)memoryBudget {
+  PurgeableImageBufferPool::setMemoryBudget(memoryBudget);
+}
+
++ (STULabelImageBufferPoolStatistics)imageBufferPoolStatistics {
+  const PurgeableImageBufferPool::Statistics stats = PurgeableImageBufferPool::statistics();
+  return STULabelImageBufferPoolStatistics{.requestCount = stats.requestCount,
+                                           .reuseCount = stats.reuseCount,
+                                           .purgedCount = stats.purgedCount,
+                                           .bufferCount = sign_cast(stats.bufferCount),
+                                           .memoryUsage = stats.memoryUsage};
+}
+
++ (void)clearImageBufferPool {
+  PurgeableImageBufferPool::clear();
+}
+
++ (size_t)tileImageCacheMemoryBudget {
+  return STULabelTiledLayer.retainedTileImagesMemoryBudget;
+}
+
++ (void)setTileImageCacheMemoryBudget:(size_t)memoryBudget {
+  STULabelTiledLayer.retainedTileImagesMemoryBudget = memoryBudget;
+}
+
 - (bool)stu_alwaysUsesContentSublayer {
   return impl.params().alwaysUsesContentSublayer;
 }
@@ -2253,6 +2746,13 @@ STU_REENABLE_CLANG_WARNING
   impl.setDrawingBlockImageBounds(drawingBounds);
 }
 
+- (bool)usesAlphaMaskForSingleColorText {
+  return impl.params().usesAlphaMaskForSingleColorText;
+}
+- (void)setUsesAlphaMaskForSingleColorText:(bool)usesAlphaMaskForSingleColorText {
+  impl.setUsesAlphaMaskForSingleColorText(usesAlphaMaskForSingleColorText);
+}
+
 - (bool)neverUsesGrayscaleBitmapFormat {
   return impl.params().neverUseGrayscaleBitmapFormat;
 }
@@ -23,6 +23,23 @@ STUShapedString* __nullable STUShapedStringCreate(__nullable Class cls,
                                                   const STUCancellationFlag* __nullable)
                               NS_RETURNS_RETAINED;
 
+/// Returns a new shaped string with the fonts adjusted for the content size category, or null if
+/// no font needs to be adjusted or the cancellation flag was set.
+STUShapedString* __nullable STUShapedStringCreateWithFontsAdjustedForContentSizeCategory(
+                              STUShapedString* __nonnull,
+                              UIContentSizeCategory __nonnull,
+                              const STUCancellationFlag* __nullable)
+                              NS_RETURNS_RETAINED API_AVAILABLE(ios(10.0), tvos(10.0));
+
+/// Returns a shaped string from the cache described in the documentation for
+/// @c STUShapedString.sharedCacheMemoryBudget, or creates a new one and adds it to the cache.
+/// Equivalent to `STUShapedStringCreate(nil, ...)` if the cache is disabled.
+STUShapedString* __nullable STUShapedStringCreateUsingSharedCache(
+                              NSAttributedString* __nonnull,
+                              STUWritingDirection,
+                              const STUCancellationFlag* __nullable)
+                              NS_RETURNS_RETAINED;
+
 NSAttributedString* __nonnull stu_emptyAttributedString();
 
 STU_EXTERN_C_END
@@ -71,11 +71,43 @@ STU_EXPORT
 /// string.
 @property (readonly) bool defaultBaseWritingDirectionWasUsed;
 
+/// Returns a shaped string for a copy of the attributed string with all fonts adjusted for the
+/// specified content size category (as by
+/// @c -[NSAttributedString stu_copyWithFontsAdjustedForContentSizeCategory:]),
+/// or @c self if no font needs to be adjusted.
+///
+/// This is considerably faster than creating a new shaped string from the adjusted attributed
+/// string, because the text style data of this shaped string is reused and only the typesetter has
+/// to be recreated.
+///
+/// This method is thread-safe.
+- (STUShapedString *)copyWithFontsAdjustedForContentSizeCategory:(UIContentSizeCategory)category
+  API_AVAILABLE(ios(10.0), tvos(10.0));
+
 - (nonnull instancetype)init NS_UNAVAILABLE;
 
 + (nonnull STUShapedString *)emptyShapedStringWithDefaultBaseWritingDirection:
                                (STUWritingDirection)baseWritingDirection;
 
+/// The memory budget in bytes of a global cache that @c STULabel and @c STULabelLayer instances
+/// use to share a single immutable @c STUShapedString between labels displaying equal attributed
+/// strings with the same default base writing direction. A label whose string is found in the
+/// cache doesn't need to create a new typesetter.
+///
+/// The default value is 0, which disables the cache. When the estimated memory usage of the cached
+/// shaped strings exceeds the budget, the least recently used entries are evicted. Strings whose
+/// estimated memory usage exceeds a quarter of the budget are not cached. Strings with attribute
+/// values that may be mutable, i.e. values whose @c copy is a different object (e.g. an
+/// @c NSMutableParagraphStyle), are not cached either. The cache is also cleared when the app
+/// enters the background or receives a memory warning.
+///
+/// This property can be accessed from any thread.
+@property (class) size_t sharedCacheMemoryBudget;
+
+/// Removes all entries from the cache described in the documentation for
+/// @c sharedCacheMemoryBudget. This method is thread-safe.
++ (void)clearSharedCache;
+
 @end
 
 /// Determines the writing direction of the specified string range using the Unicode Bidi algorithm
@@ -6,8 +6,11 @@
 #import "STUObjCRuntimeWrappers.h"
 #import "STUTextAttributes-Internal.hpp"
 #import "stu/Assert.h"
+#import "stu/Vector.hpp"
+#import "stu_mutex.h"
 
 #import "Internal/CancellationFlag.hpp"
+#import "Internal/Hash.hpp"
 #import "Internal/InputClamping.hpp"
 #import "Internal/Once.hpp"
 #import "Internal/ShapedString.hpp"
@@ -15,6 +18,8 @@
 #import "Internal/TextStyleBuffer.hpp"
 #import "Internal/UnicodeCodePointProperties.hpp"
 
+#include <atomic>
+
 #include "Internal/DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
 using namespace stu;
@@ -46,6 +51,297 @@ NSAttributedString* stu_emptyAttributedString() {
   return instance;
 }
 
+static STUShapedString* __nullable
+  createShapedString(__nullable Class cls,
+                     NSAttributedString* __unsafe_unretained attributedString,
+                     STUWritingDirection baseWritingDirection,
+                     const STUCancellationFlag* __nullable cancellationFlag,
+                     UInt* __nullable outAllocationSize)
+    NS_RETURNS_RETAINED;
+
+namespace stu_label {
+
+/// A global cache of shaped strings keyed by the content of the attributed string and the default
+/// base writing direction. The entries are evicted in least-recently-used order when the estimated
+/// memory usage exceeds the budget.
+///
+/// The entries are indexed by a chained hash table over the content hash codes, so that a lookup
+/// only has to look at the entries with a matching hash code. The expensive equality comparison of
+/// the attributed strings is done by the caller without holding the cache mutex.
+struct ShapedStringCache {
+  struct Entry {
+    HashCode<UInt64> hashCode;
+    UInt64 lastUse;
+    UInt cost;
+    /// 1 + the index of the next entry in the same hash bucket, or 0.
+    Int32 nextIndexPlus1;
+    STUWritingDirection baseWritingDirection;
+    /// Retained. An immutable copy of the attributed string that was used to create the shaped
+    /// string. (The attributedString of the ShapedString may contain fixed-up attributes.)
+    NSAttributedString* __unsafe_unretained attributedString;
+    /// Retained.
+    STUShapedString* __unsafe_unretained shapedString;
+  };
+
+  static constexpr Int maxEntryCount = 512;
+  static constexpr Int bucketCount = 1024;
+  static_assert(isPowerOfTwo(bucketCount) && bucketCount >= 2*maxEntryCount);
+
+  /// The maximum number of entries with the same hash code that a lookup compares.
+  static constexpr Int maxCandidateCount = 4;
+
+  Vector<Entry> entries;
+  UInt64 useCounter{};
+  UInt totalCost{};
+  /// 1 + the index of the first entry in the bucket, or 0.
+  Int32 bucketHeadIndicesPlus1[bucketCount]{};
+
+  STU_INLINE
+  static Int bucketIndex(HashCode<UInt64> hashCode) {
+    return static_cast<Int>(hashCode.value & (bucketCount - 1));
+  }
+
+  /// Calls `body(Entry&)` for the entries with the specified hash code and writing direction.
+  template <typename Body>
+  void forEachEntryWithHashCode(HashCode<UInt64> hashCode,
+                                STUWritingDirection baseWritingDirection, Body&& body)
+  {
+    for (Int32 i = bucketHeadIndicesPlus1[bucketIndex(hashCode)]; i != 0;) {
+      Entry& entry = entries[i - 1];
+      i = entry.nextIndexPlus1;
+      if (entry.hashCode == hashCode && entry.baseWritingDirection == baseWritingDirection) {
+        body(entry);
+      }
+    }
+  }
+
+  void append(Entry entry) {
+    Int32& head = bucketHeadIndicesPlus1[bucketIndex(entry.hashCode)];
+    entry.nextIndexPlus1 = head;
+    entries.append(entry);
+    head = narrow_cast<Int32>(entries.count());
+  }
+
+  void unlink(Int index) {
+    Int32* p = &bucketHeadIndicesPlus1[bucketIndex(entries[index].hashCode)];
+    while (*p != index + 1) {
+      STU_DEBUG_ASSERT(*p != 0);
+      p = &entries[*p - 1].nextIndexPlus1;
+    }
+    *p = entries[index].nextIndexPlus1;
+  }
+
+  void removeEntry(Int index) {
+    const Entry entry = entries[index];
+    totalCost -= entry.cost;
+    decrementRefCount(entry.attributedString);
+    decrementRefCount(entry.shapedString);
+    unlink(index);
+    const Int lastIndex = entries.count() - 1;
+    if (index != lastIndex) {
+      unlink(lastIndex);
+      Entry last = entries[lastIndex];
+      entries.removeLast();
+      entries[index] = last;
+      Int32& head = bucketHeadIndicesPlus1[bucketIndex(last.hashCode)];
+      entries[index].nextIndexPlus1 = head;
+      head = narrow_cast<Int32>(index + 1);
+    } else {
+      entries.removeLast();
+    }
+  }
+
+  void evictEntries(UInt budget) {
+    while (!entries.isEmpty() && (totalCost > budget || entries.count() > maxEntryCount)) {
+      Int lruIndex = 0;
+      for (Int i = 1; i < entries.count(); ++i) {
+        if (entries[i].lastUse < entries[lruIndex].lastUse) {
+          lruIndex = i;
+        }
+      }
+      removeEntry(lruIndex);
+    }
+  }
+
+  STU_NO_INLINE
+  void clear() {
+    for (const Entry& entry : entries) {
+      decrementRefCount(entry.attributedString);
+      decrementRefCount(entry.shapedString);
+    }
+    entries.removeAll();
+    entries.trimFreeCapacity();
+    totalCost = 0;
+    memset(bucketHeadIndicesPlus1, 0, sizeof(bucketHeadIndicesPlus1));
+  }
+};
+
+static stu_mutex shapedStringCacheMutex = STU_MUTEX_INIT;
+static bool shapedStringCacheIsInitialized = false;
+static std::atomic<UInt> shapedStringCacheMemoryBudget{0};
+alignas(ShapedStringCache)
+static Byte shapedStringCacheStorage[sizeof(ShapedStringCache)];
+
+/// Must be called while holding the shapedStringCacheMutex.
+static ShapedStringCache& shapedStringCache() {
+  if (STU_UNLIKELY(!shapedStringCacheIsInitialized)) {
+    shapedStringCacheIsInitialized = true;
+    ShapedStringCache& cache = *new (shapedStringCacheStorage) ShapedStringCache{};
+
+    NSNotificationCenter* const notificationCenter = NSNotificationCenter.defaultCenter;
+    NSOperationQueue* const mainQueue = NSOperationQueue.mainQueue;
+    const auto clearCacheBlock = ^(NSNotification*) {
+      stu_mutex_lock(&shapedStringCacheMutex);
+      cache.clear();
+      stu_mutex_unlock(&shapedStringCacheMutex);
+    };
+    [notificationCenter addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+    [notificationCenter addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                    object:nil queue:mainQueue usingBlock:clearCacheBlock];
+  }
+  return reinterpret_cast<ShapedStringCache&>(shapedStringCacheStorage);
+}
+
+/// Returns true if the value may be mutated after it was added to an attributed string. A cached
+/// shaped string for such a value could become stale, e.g. when an NSMutableParagraphStyle is
+/// modified after the string was shaped. We treat a value as immutable if `copy` returns the value
+/// itself, which is the convention for immutable Foundation and UIKit classes. Values that don't
+/// support copying (like STUTextAttachment instances) are assumed to be immutable.
+static bool isPossiblyMutableAttributeValue(id __unsafe_unretained value) {
+  if (![value respondsToSelector:@selector(copyWithZone:)]) return false;
+  const id copy = [value copy];
+  return copy != value;
+}
+
+/// A cheap hash of the string and the attribute run structure. Attribute values other than the
+/// font aren't hashed, since computing their hashes would be relatively expensive and collisions
+/// are resolved by the full equality comparison anyway.
+///
+/// Returns none if the string has a possibly mutable attribute value and hence mustn't be cached.
+static Optional<HashCode<UInt64>> shapedStringCacheHash(
+                                    NSAttributedString* __unsafe_unretained string,
+                                    STUWritingDirection baseWritingDirection)
+{
+  const NSUInteger length = string.length;
+  __block UInt64 h = hash(static_cast<UInt64>(string.string.hash),
+                          (static_cast<UInt64>(length) << 1) | baseWritingDirection).value;
+  __block bool hasMutableValue = false;
+  [string enumerateAttributesInRange:NSRange{0, length}
+                             options:NSAttributedStringEnumerationLongestEffectiveRangeNotRequired
+                          usingBlock:^(NSDictionary<NSAttributedStringKey, id>* attributes,
+                                       NSRange range, BOOL* stop)
+  {
+    [attributes enumerateKeysAndObjectsUsingBlock:^(NSAttributedStringKey, id value,
+                                                    BOOL* stopInner)
+    {
+      if (isPossiblyMutableAttributeValue(value)) {
+        hasMutableValue = true;
+        *stopInner = true;
+      }
+    }];
+    if (hasMutableValue) {
+      *stop = true;
+      return;
+    }
+    const UInt64 fontHash = static_cast<UInt64>([attributes[NSFontAttributeName] hash]);
+    h = hash(h, hash((static_cast<UInt64>(range.location) << 32) | attributes.count,
+                     fontHash).value).value;
+  }];
+  if (hasMutableValue) return none;
+  return HashCode{h};
+}
+
+/// A rough estimate of the memory used by the CTTypesetter per UTF-16 code unit.
+static constexpr UInt typesetterBytesPerCodeUnit = 64;
+
+} // namespace stu_label
+
+STUShapedString* __nullable
+  STUShapedStringCreateUsingSharedCache(NSAttributedString* __unsafe_unretained attributedString,
+                                        STUWritingDirection baseWritingDirection,
+                                        const STUCancellationFlag* __nullable cancellationFlag)
+    NS_RETURNS_RETAINED
+{
+  const UInt budget = shapedStringCacheMemoryBudget.load(std::memory_order_relaxed);
+  if (budget == 0 || !attributedString) {
+    return createShapedString(nil, attributedString, baseWritingDirection, cancellationFlag,
+                              nullptr);
+  }
+  baseWritingDirection = clampBaseWritingDirection(baseWritingDirection);
+  // Make sure the key is immutable. (This is just a retain for immutable strings.)
+  NSAttributedString* const key = [attributedString copy];
+  const Optional<HashCode<UInt64>> optHashCode = shapedStringCacheHash(key, baseWritingDirection);
+  if (!optHashCode) {
+    return createShapedString(nil, key, baseWritingDirection, cancellationFlag, nullptr);
+  }
+  const HashCode<UInt64> hashCode = *optHashCode;
+
+  // We retain the candidates with a matching hash code while holding the lock and then compare
+  // them with the key after releasing the lock, since isEqualToAttributedString can be expensive.
+  NSAttributedString* candidateStrings[ShapedStringCache::maxCandidateCount];
+  STUShapedString* candidateShapedStrings[ShapedStringCache::maxCandidateCount];
+  Int candidateCount = 0;
+  stu_mutex_lock(&shapedStringCacheMutex);
+  ShapedStringCache& cache = shapedStringCache();
+  cache.forEachEntryWithHashCode(hashCode, baseWritingDirection,
+                                 [&](ShapedStringCache::Entry& entry)
+  {
+    if (candidateCount == ShapedStringCache::maxCandidateCount) return;
+    candidateStrings[candidateCount] = entry.attributedString;
+    candidateShapedStrings[candidateCount] = entry.shapedString;
+    ++candidateCount;
+  });
+  stu_mutex_unlock(&shapedStringCacheMutex);
+  for (Int i = 0; i < candidateCount; ++i) {
+    NSAttributedString* const candidate = candidateStrings[i];
+    if (candidate != key && ![candidate isEqualToAttributedString:key]) continue;
+    STUShapedString* const shapedString = candidateShapedStrings[i];
+    stu_mutex_lock(&shapedStringCacheMutex);
+    // The entry may have been evicted in the meantime, in which case this does nothing.
+    cache.forEachEntryWithHashCode(hashCode, baseWritingDirection,
+                                   [&](ShapedStringCache::Entry& entry)
+    {
+      if (entry.shapedString == shapedString) {
+        entry.lastUse = ++cache.useCounter;
+      }
+    });
+    stu_mutex_unlock(&shapedStringCacheMutex);
+    return shapedString;
+  }
+
+  UInt allocationSize;
+  STUShapedString* const shapedString = createShapedString(nil, key, baseWritingDirection,
+                                                           cancellationFlag, &allocationSize);
+  if (!shapedString) return nil;
+  const UInt cost = allocationSize
+                  + sign_cast(shapedString->shapedString->stringLength)*typesetterBytesPerCodeUnit;
+  // Large strings are unlikely to be repeated and would evict many smaller entries.
+  if (cost > budget/4) return shapedString;
+
+  stu_mutex_lock(&shapedStringCacheMutex);
+  // Another thread may have inserted an equal string in the meantime. We don't compare the strings
+  // under the lock and instead skip the insertion if there already is an entry with the same hash.
+  bool hasEntryWithSameHash = false;
+  cache.forEachEntryWithHashCode(hashCode, baseWritingDirection,
+                                 [&](ShapedStringCache::Entry&) { hasEntryWithSameHash = true; });
+  if (!hasEntryWithSameHash) {
+    incrementRefCount(key);
+    incrementRefCount(shapedString);
+    cache.append(ShapedStringCache::Entry{
+                   .hashCode = hashCode,
+                   .lastUse = ++cache.useCounter,
+                   .cost = cost,
+                   .baseWritingDirection = baseWritingDirection,
+                   .attributedString = key,
+                   .shapedString = shapedString});
+    cache.totalCost += cost;
+    cache.evictEntries(shapedStringCacheMemoryBudget.load(std::memory_order_relaxed));
+  }
+  stu_mutex_unlock(&shapedStringCacheMutex);
+  return shapedString;
+}
+
 @implementation STUShapedString
 
 - (NSAttributedString*)attributedString {
@@ -69,6 +365,27 @@ size_t STUShapedStringGetLength(STUShapedString* self) {
   return shapedString->defaultBaseWritingDirectionWasUsed;
 }
 
++ (size_t)sharedCacheMemoryBudget {
+  return shapedStringCacheMemoryBudget.load(std::memory_order_relaxed);
+}
+
++ (void)setSharedCacheMemoryBudget:(size_t)budget {
+  stu_mutex_lock(&shapedStringCacheMutex);
+  shapedStringCacheMemoryBudget.store(budget, std::memory_order_relaxed);
+  if (shapedStringCacheIsInitialized) {
+    shapedStringCache().evictEntries(budget);
+  }
+  stu_mutex_unlock(&shapedStringCacheMutex);
+}
+
++ (void)clearSharedCache {
+  stu_mutex_lock(&shapedStringCacheMutex);
+  if (shapedStringCacheIsInitialized) {
+    shapedStringCache().clear();
+  }
+  stu_mutex_unlock(&shapedStringCacheMutex);
+}
+
 + (nonnull instancetype)allocWithZone:(struct _NSZone* __unused)zone {
   static Class shapedStringClass;
   static STUShapedString* shapedStringPlaceholder;
@@ -117,11 +434,12 @@ size_t STUShapedStringGetLength(STUShapedString* self) {
 }
 
 
-STUShapedString* __nullable
-  STUShapedStringCreate(__nullable Class cls,
-                        NSAttributedString* __unsafe_unretained attributedString,
-                        STUWritingDirection baseWritingDirection,
-                        const STUCancellationFlag* __nullable cancellationFlag)
+static STUShapedString* __nullable
+  createShapedString(__nullable Class cls,
+                     NSAttributedString* __unsafe_unretained attributedString,
+                     STUWritingDirection baseWritingDirection,
+                     const STUCancellationFlag* __nullable cancellationFlag,
+                     UInt* __nullable outAllocationSize)
     NS_RETURNS_RETAINED
 {
   STU_CHECK_MSG(attributedString != nil, "NSAttributedString argument is null.");
@@ -141,10 +459,12 @@ STUShapedString* __nullable
   const UInt instanceSize = roundUpToMultipleOf<alignof(ShapedString)>(class_getInstanceSize(cls));
 
   Byte* p;
+  UInt allocationSize = 0;
   ShapedString* const shapedString = ShapedString::create(
                                        attributedString, baseWritingDirection, cancellationFlag,
                                        [&](UInt size) -> void* {
-                                         p = static_cast<Byte*>(malloc(instanceSize + size));
+                                         allocationSize = instanceSize + size;
+                                         p = static_cast<Byte*>(malloc(allocationSize));
                                          if (!p) __builtin_trap();
                                          return p + instanceSize;
                                        });
@@ -155,9 +475,53 @@ STUShapedString* __nullable
   STU_DEBUG_ASSERT([instance isKindOfClass:shapedStringClass]);
   const_cast<ShapedString*&>(instance->shapedString) = shapedString;
 
+  if (outAllocationSize) {
+    *outAllocationSize = allocationSize;
+  }
   return instance;
 }
 
+- (STUShapedString*)copyWithFontsAdjustedForContentSizeCategory:(UIContentSizeCategory)category {
+  return STUShapedStringCreateWithFontsAdjustedForContentSizeCategory(self, category, nullptr)
+         ?: self;
+}
+
+STUShapedString* __nullable
+  STUShapedStringCreateWithFontsAdjustedForContentSizeCategory(
+    STUShapedString* __unsafe_unretained original,
+    UIContentSizeCategory __unsafe_unretained category,
+    const STUCancellationFlag* __nullable cancellationFlag)
+{
+  const Class cls = object_getClass(original);
+  const UInt instanceSize = roundUpToMultipleOf<alignof(ShapedString)>(class_getInstanceSize(cls));
+  Byte* p;
+  ShapedString* const shapedString =
+    ShapedString::createWithFontsAdjustedForContentSizeCategory(
+                    *original->shapedString, category, cancellationFlag,
+                    [&](UInt size) -> void* {
+                      p = static_cast<Byte*>(malloc(instanceSize + size));
+                      if (!p) __builtin_trap();
+                      return p + instanceSize;
+                    });
+  if (!shapedString) return nil;
+
+  memset(p, 0, instanceSize);
+  STUShapedString* const instance = stu_constructClassInstance(cls, p);
+  const_cast<ShapedString*&>(instance->shapedString) = shapedString;
+  return instance;
+}
+
+STUShapedString* __nullable
+  STUShapedStringCreate(__nullable Class cls,
+                        NSAttributedString* __unsafe_unretained attributedString,
+                        STUWritingDirection baseWritingDirection,
+                        const STUCancellationFlag* __nullable cancellationFlag)
+    NS_RETURNS_RETAINED
+{
+  return createShapedString(cls, attributedString, baseWritingDirection, cancellationFlag,
+                            nullptr);
+}
+
 - (void)dealloc {
   if (shapedString) {
     shapedString->~ShapedString();
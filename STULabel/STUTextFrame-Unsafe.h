@@ -22,6 +22,7 @@ STU_EXTERN_C_BEGIN
 @end
 
 typedef struct STUTextBackgroundSegment STUTextBackgroundSegment;
+typedef struct STUTextFrameGlyphStorage STUTextFrameGlyphStorage;
 
 /// @note All functions accepting a pointer to a @c STUTextFrameData instance assume that the
 ///       instance is owned by a @c STUTextFrame. Never pass a pointer to a copied or manually
@@ -30,6 +31,9 @@ typedef struct STUTextFrameData {
   int32_t paragraphCount;
   int32_t lineCount;
   const uint8_t * __nonnull _textStylesData;
+  /// Non-null if the text frame was created with the @c usesCompactGlyphStorage option, in which
+  /// case the @c _ctLine and @c _tokenCTLine fields of the lines are null.
+  const STUTextFrameGlyphStorage * __nullable _glyphStorage;
   uint16_t _colorCount;
   STUTextFrameFlags flags;
   STUTextFrameConsistentAlignment consistentAlignment;
@@ -44,6 +48,7 @@ typedef struct STUTextFrameData {
   int32_t truncatedStringLength NS_SWIFT_NAME(truncatedStringUTF16Length);
   /// The range in the original string from which the @c STUTextFrame was created.
   STUStartEndRangeI32 rangeInOriginalString;
+  int32_t _textStyleIndexCount;
   /// The size that was specified when the @c STUTextFrame instance was initialized. This size can
   /// be much larger than the layout bounds of the text, particularly if the text frame was created
   ///  by a label view, which may create text frames with e.g. a height of CGFLOAT_MAX.
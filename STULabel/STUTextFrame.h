@@ -107,9 +107,35 @@ typedef struct STUTextFrameLayoutInfo {
   /// is always between 0 (exclusive) and 1 (inclusive). It only can be less than 1 if the
   /// @c STUTextFrameOptions.minimumTextScaleFactor was less than 1.
   CGFloat textScaleFactor;
+  /// The number of text layout iterations that were necessary to determine the
+  /// @c textScaleFactor. If no text scaling was necessary, this value is 1.
+  int32_t layoutIterationCount;
 } NS_SWIFT_NAME(STUTextFrame.LayoutInfo)
   STUTextFrameLayoutInfo;
 
+typedef struct STUGlyphRasterCacheStatistics {
+  /// The number of glyphs that were drawn from a cached mask.
+  uint64_t hitCount;
+  /// The number of glyphs that had to be rasterized because no cached mask was found.
+  uint64_t missCount;
+  size_t entryCount;
+  /// The estimated memory usage of the cached glyph masks in bytes.
+  size_t memoryUsage;
+} NS_SWIFT_NAME(STUTextFrame.GlyphRasterCacheStatistics)
+  STUGlyphRasterCacheStatistics;
+
+typedef struct STUShadowMaskCacheStatistics {
+  /// The number of glyph run shadows that were drawn from a cached mask.
+  uint64_t hitCount;
+  /// The number of glyph run shadows whose mask had to be rendered because no cached mask was
+  /// found.
+  uint64_t missCount;
+  size_t entryCount;
+  /// The estimated memory usage of the cached shadow masks in bytes.
+  size_t memoryUsage;
+} NS_SWIFT_NAME(STUTextFrame.ShadowMaskCacheStatistics)
+  STUShadowMaskCacheStatistics;
+
 STU_EXPORT
 @interface STUTextFrame : NSObject
 
@@ -129,6 +155,24 @@ STU_EXPORT
   NS_SWIFT_NAME(init(_:stringRange:size:displayScaleOrZero:options:cancellationFlag:))
   NS_DESIGNATED_INITIALIZER;
 
+/// Returns the same value as
+/// @code
+/// [[[STUTextFrame alloc] initWithShapedString:shapedString stringRange:stringRange size:size
+///                                displayScale:displayScale options:options cancellationFlag:nil]
+///  layoutInfoForFrameOrigin:CGPointZero]
+/// @endcode
+/// but doesn't create a text frame object.
+///
+/// This method is considerably cheaper than creating a text frame when only the size, line count
+/// or baselines of the laid out text are needed, e.g. when calculating row heights for a table
+/// view.
++ (STUTextFrameLayoutInfo)layoutInfoForShapedString:(STUShapedString *)shapedString
+                                         stringRange:(NSRange)stringRange
+                                                size:(CGSize)size
+                                        displayScale:(CGFloat)displayScale
+                                             options:(nullable STUTextFrameOptions *)options
+  NS_SWIFT_NAME(layoutInfo(_:stringRange:size:displayScaleOrZero:options:));
+
 /// The attributed string of the @c STUShapedString from which the text frame was created.
 @property (readonly) NSAttributedString *originalAttributedString;
 
@@ -293,6 +337,30 @@ STU_EXPORT
   //                             frameOrigin: CGPoint)
   //   -> STUTextFrameGraphemeClusterRange
 
+/// Equivalent to calling @c rangeOfGraphemeClusterClosestToPoint for each of the @c count points,
+/// except that the temporary state and the glyph iteration for each line are shared between all
+/// points, which makes this method much faster for e.g. a batch of coalesced touches.
+/// Trailing whitespace is ignored, as with `ignoringTrailingWhitespace == true`.
+- (void)getRangesOfGraphemeClusters:(STUTextFrameGraphemeClusterRange *)outRanges
+                    closestToPoints:(const CGPoint *)points
+                              count:(NSUInteger)count
+                        frameOrigin:(CGPoint)frameOrigin
+                       displayScale:(CGFloat)displayScale
+  NS_REFINED_FOR_SWIFT NS_SWIFT_NAME(__getRangesOfGraphemeClusters(_:closestTo:count:frameOrigin:displayScale:));
+  // func rangesOfGraphemeClusters(closestTo points: [CGPoint],
+  //                               frameOrigin: CGPoint, displayScale: CGFloat?)
+  //   -> [STUTextFrameGraphemeClusterRange]
+
+/// Equivalent to the other @c getRangesOfGraphemeClusters overload
+/// with @c self.displayScale as the @c displayScale argument.
+- (void)getRangesOfGraphemeClusters:(STUTextFrameGraphemeClusterRange *)outRanges
+                    closestToPoints:(const CGPoint *)points
+                              count:(NSUInteger)count
+                        frameOrigin:(CGPoint)frameOrigin
+  NS_REFINED_FOR_SWIFT STU_SWIFT_UNAVAILABLE;
+  // func rangesOfGraphemeClusters(closestTo points: [CGPoint], frameOrigin: CGPoint)
+  //   -> [STUTextFrameGraphemeClusterRange]
+
 
 - (STUTextRectArray *)rectsForRange:(STUTextFrameRange)range
                         frameOrigin:(CGPoint)frameOrigin
@@ -308,6 +376,25 @@ STU_EXPORT
   NS_REFINED_FOR_SWIFT STU_SWIFT_UNAVAILABLE;
   // func rects(for range: Range<Index>, frameOrigin: CGPoint) -> STUTextRectArray
 
+/// Equivalent to calling @c rectsForRange for each of the @c count ranges, except that the
+/// temporary state is shared between the calls and that equal ranges are mapped to the same
+/// @c STUTextRectArray instance.
+- (NSArray<STUTextRectArray *> *)rectsForRanges:(const STUTextFrameRange *)ranges
+                                          count:(NSUInteger)count
+                                    frameOrigin:(CGPoint)frameOrigin
+                                   displayScale:(CGFloat)displayScale
+  NS_REFINED_FOR_SWIFT NS_SWIFT_NAME(__rects(_:count:frameOrigin:displayScale:));
+  // func rects(for ranges: [Range<Index>], frameOrigin: CGPoint, displayScale: CGFloat?)
+  //   -> [STUTextRectArray]
+
+/// Equivalent to the other @c rectsForRanges overload
+/// with @c self.displayScale as the @c displayScale argument.
+- (NSArray<STUTextRectArray *> *)rectsForRanges:(const STUTextFrameRange *)ranges
+                                          count:(NSUInteger)count
+                                    frameOrigin:(CGPoint)frameOrigin
+  NS_REFINED_FOR_SWIFT STU_SWIFT_UNAVAILABLE;
+  // func rects(for ranges: [Range<Index>], frameOrigin: CGPoint) -> [STUTextRectArray]
+
 
 - (STUTextLinkArray *)rectsForAllLinksInTruncatedStringWithFrameOrigin:(CGPoint)frameOrigin
                                                           displayScale:(CGFloat)displayScale
@@ -435,6 +522,64 @@ pixelAlignBaselines:(bool)pixelAlignBaselines
 
 @property (class, readonly) STUTextFrame *emptyTextFrame;
 
+/// The memory budget in bytes of a global cache of rasterized glyph masks that is used when drawing
+/// text frames into bitmap contexts.
+///
+/// When the cache is enabled, glyphs of plain, fill-only text are rasterized once per font, glyph,
+/// quarter-pixel horizontal offset, display scale and antialiasing and font smoothing setting, and
+/// are subsequently drawn by blitting the cached coverage mask with the text color. Since Core
+/// Graphics has no API for querying the latter settings of a context, the cache assumes the values
+/// specified by the @c contextShouldAntialias and @c contextShouldSmoothFonts properties of the
+/// @c STUTextFrameDrawingOptions, which default to the Core Graphics defaults. This can speed up
+/// the repeated rendering of labels that use the same few fonts, e.g. in table or collection view
+/// cells. Text with a stroke or a shadow, color glyphs (like emoji), and text drawn into a rotated
+/// or non-uniformly scaled context are always drawn directly with Core Text.
+///
+/// The default value is 0, which disables the cache. When the estimated memory usage exceeds the
+/// budget, the least recently used masks are evicted. The cache is also cleared when the app
+/// enters the background or receives a memory warning.
+///
+/// This property can be accessed from any thread.
+@property (class) size_t glyphRasterCacheMemoryBudget;
+
+/// The hit and miss counts and the current size of the cache described in the documentation for
+/// @c glyphRasterCacheMemoryBudget. This property can be accessed from any thread.
+@property (class, readonly) STUGlyphRasterCacheStatistics glyphRasterCacheStatistics;
+
+/// Removes all entries from the cache described in the documentation for
+/// @c glyphRasterCacheMemoryBudget and resets the hit and miss counts. This method is thread-safe.
++ (void)clearGlyphRasterCache;
+
+/// The memory budget in bytes of a global cache of blurred shadow masks that is used when drawing
+/// text frames into bitmap contexts.
+///
+/// When the cache is enabled, the shadow of a run of plain, fill-only glyphs is rendered and
+/// blurred once per font, glyph sequence, relative glyph positions, blur radius and display scale,
+/// and is subsequently drawn by blitting the cached mask with the shadow color. Since the shadow
+/// color is not part of the cache key, a mask can also be reused when only the colors of the text
+/// change, e.g. when a label is highlighted. Text with a stroke or a non-opaque text color, color
+/// glyphs (like emoji), text drawn into a rotated or non-uniformly scaled context or into a
+/// context whose base CTM is not the identity, and runs whose shadow would exceed the maximum mask
+/// size are always drawn with a Core Graphics shadow.
+///
+/// The blur of the cached masks approximates the Gaussian blur of Core Graphics with three box
+/// blur passes, so the rendered shadows may differ very slightly from Core Graphics shadows.
+///
+/// The default value is 0, which disables the cache. When the estimated memory usage exceeds the
+/// budget, the least recently used masks are evicted. The cache is also cleared when the app
+/// enters the background or receives a memory warning.
+///
+/// This property can be accessed from any thread.
+@property (class) size_t shadowMaskCacheMemoryBudget;
+
+/// The hit and miss counts and the current size of the cache described in the documentation for
+/// @c shadowMaskCacheMemoryBudget. This property can be accessed from any thread.
+@property (class, readonly) STUShadowMaskCacheStatistics shadowMaskCacheStatistics;
+
+/// Removes all entries from the cache described in the documentation for
+/// @c shadowMaskCacheMemoryBudget and resets the hit and miss counts. This method is thread-safe.
++ (void)clearShadowMaskCache;
+
 - (instancetype)init NS_UNAVAILABLE;
 
 @end
@@ -15,8 +15,10 @@
 #import "Internal/TextFrame.hpp"
 #import "Internal/TextFrameLayouter.hpp"
 
+#import "Internal/GlyphRasterCache.hpp"
 #import "Internal/InputClamping.hpp"
 #import "Internal/STUPlaceholderObjects.h"
+#import "Internal/ShadowMaskCache.hpp"
 #import "Internal/TextLineSpan.hpp"
 
 #include "Internal/DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
@@ -55,6 +57,46 @@ Unretained<STUTextFrame* __nonnull> stu_label::emptySTUTextFrame() {
   return emptySTUTextFrame().unretained;
 }
 
++ (size_t)glyphRasterCacheMemoryBudget {
+  return GlyphRasterCache::memoryBudget();
+}
+
++ (void)setGlyphRasterCacheMemoryBudget:(size_t)memoryBudget {
+  GlyphRasterCache::setMemoryBudget(memoryBudget);
+}
+
++ (STUGlyphRasterCacheStatistics)glyphRasterCacheStatistics {
+  const GlyphRasterCache::Statistics stats = GlyphRasterCache::statistics();
+  return STUGlyphRasterCacheStatistics{.hitCount = stats.hitCount,
+                                       .missCount = stats.missCount,
+                                       .entryCount = sign_cast(stats.entryCount),
+                                       .memoryUsage = stats.memoryUsage};
+}
+
++ (void)clearGlyphRasterCache {
+  GlyphRasterCache::clear();
+}
+
++ (size_t)shadowMaskCacheMemoryBudget {
+  return ShadowMaskCache::memoryBudget();
+}
+
++ (void)setShadowMaskCacheMemoryBudget:(size_t)memoryBudget {
+  ShadowMaskCache::setMemoryBudget(memoryBudget);
+}
+
++ (STUShadowMaskCacheStatistics)shadowMaskCacheStatistics {
+  const ShadowMaskCache::Statistics stats = ShadowMaskCache::statistics();
+  return STUShadowMaskCacheStatistics{.hitCount = stats.hitCount,
+                                      .missCount = stats.missCount,
+                                      .entryCount = sign_cast(stats.entryCount),
+                                      .memoryUsage = stats.memoryUsage};
+}
+
++ (void)clearShadowMaskCache {
+  ShadowMaskCache::clear();
+}
+
 + (nonnull instancetype)allocWithZone:(struct _NSZone* __unused)zone {
   static Class textFrameClass;
   static STUUninitializedTextFrame* textFramePlaceholder;
@@ -114,6 +156,16 @@ STUTextFrame* __nonnull
            frameSize, displayScale, options, nullptr);
 }
 
+static STUTextFrameOptions* defaultTextFrameOptions() {
+  static STUTextFrameOptions* defaultOptions;
+  static dispatch_once_t once;
+  dispatch_once_f(&once, nullptr, [](void*){
+    defaultOptions = [[STUTextFrameOptions alloc] init];
+  });
+  STU_ANALYZER_ASSUME(defaultOptions != nil);
+  return defaultOptions;
+}
+
 STU_NO_INLINE
 STUTextFrame* __nullable
   STUTextFrameCreateWithShapedStringRange(
@@ -134,19 +186,16 @@ STUTextFrame* __nullable
                 "Invalid string range.");
 
   static Class textFrameClass;
-  static STUTextFrameOptions* defaultOptions;
   static dispatch_once_t once;
   dispatch_once_f(&once, nullptr, [](void*){
     textFrameClass = STUTextFrame.class;
-    defaultOptions = [[STUTextFrameOptions alloc] init];
   });
   if (!cls) {
     STU_ANALYZER_ASSUME(textFrameClass != nil);
     cls = textFrameClass;
   }
   if (!options) {
-    STU_ANALYZER_ASSUME(defaultOptions != nil);
-    options = defaultOptions;
+    options = defaultTextFrameOptions();
   }
 
   ThreadLocalArenaAllocator::InitialBuffer<4096> buffer;
@@ -169,10 +218,42 @@ STUTextFrame* __nullable
   STUTextFrame* const instance = stu_constructClassInstance(cls, p);
   STU_DEBUG_ASSERT([instance isKindOfClass:textFrameClass]);
   const_cast<STUTextFrameData*&>(instance->data) =
-    new (p + instanceSize + oso.offset) TextFrame(std::move(layouter), oso.size - oso.offset);
+    new (p + instanceSize + oso.offset) TextFrame(std::move(layouter), oso.size - oso.offset,
+                                                 oso.glyphStorageCounts);
   return instance;
 }
 
++ (STUTextFrameLayoutInfo)layoutInfoForShapedString:(STUShapedString*)stuShapedString
+                                         stringRange:(NSRange)stringRange
+                                                size:(CGSize)frameSize
+                                        displayScale:(CGFloat)displayScale
+                                             options:(nullable STUTextFrameOptions*)options
+{
+  STU_CHECK_MSG(stuShapedString != nil, "The shaped string must not be nil.");
+  const ShapedString& shapedString = *stuShapedString->shapedString;
+  STU_CHECK_MSG(stringRange.location <= sign_cast(shapedString.stringLength)
+                && stringRange.length <= sign_cast(shapedString.stringLength)
+                                         - stringRange.location,
+                "Invalid string range.");
+  if (!options) {
+    options = defaultTextFrameOptions();
+  }
+
+  ThreadLocalArenaAllocator::InitialBuffer<4096> buffer;
+  ThreadLocalArenaAllocator alloc{Ref{buffer}};
+
+  // The layouter owns the CTLines of the laid out lines and releases them when it is destroyed
+  // at the end of this method.
+  TextFrameLayouter layouter{shapedString, Range<Int32>(stringRange),
+                             options->_options.defaultTextAlignment, nullptr};
+  layouter.layoutAndScale(frameSize, DisplayScale::create(displayScale), options->_options);
+  // Justification affects the line widths.
+  if (layouter.needToJustifyLines()) {
+    layouter.justifyLinesWhereNecessary();
+  }
+  return TextFrame::layoutInfo(layouter, CGPoint{});
+}
+
 - (void)dealloc {
   if (const STUTextFrameData* const frame = data) {
     down_cast<const TextFrame&>(*frame).~TextFrame();
@@ -193,32 +274,7 @@ STUTextFrame* __nullable
 - (STUTextFrameLayoutInfo)layoutInfoForFrameOrigin:(CGPoint)frameOrigin
                                       displayScale:(CGFloat)displayScale
 {
-  const TextFrame& tf = textFrameRef(self);
-  Float64 firstBaseline = frameOrigin.y + tf.firstBaseline;
-  Float64 lastBaseline = frameOrigin.y + tf.lastBaseline;
-  if (const Optional<DisplayScale> scale = DisplayScale::create(displayScale)) {
-    firstBaseline = ceilToScale(firstBaseline, *scale);
-    lastBaseline = ceilToScale(lastBaseline, *scale);
-  }
-  return {
-    .lineCount = tf.lineCount,
-    .flags = tf.flags,
-    .layoutMode = tf.layoutMode,
-    .consistentAlignment = tf.consistentAlignment,
-    .minX = frameOrigin.x + tf.minX,
-    .maxX = frameOrigin.x + tf.maxX,
-    .firstBaseline = firstBaseline,
-    .lastBaseline = lastBaseline,
-    .firstLineHeight = tf.firstLineHeight,
-    .firstLineHeightAboveBaseline = tf.firstLineHeightAboveBaseline,
-    .lastLineHeight = tf.lastLineHeight,
-    .lastLineHeightBelowBaseline = tf.lastLineHeightBelowBaseline,
-    .lastLineHeightBelowBaselineWithoutSpacing = tf.lastLineHeightBelowBaselineWithoutSpacing,
-    .lastLineHeightBelowBaselineWithMinimalSpacing =
-       tf.lastLineHeightBelowBaselineWithMinimalSpacing,
-    .size = tf.size,
-    .textScaleFactor = tf.textScaleFactor
-  };
+  return stuTextFrameLayoutInfo(*data, frameOrigin, displayScale);
 }
 
 - (CGFloat)displayScale {
@@ -330,6 +386,38 @@ STUTextFrame* __nullable
            tf.rangeOfGraphemeClusterClosestTo(point, TextFrameOrigin{frameOrigin}, displayScale));
 }
 
+- (void)getRangesOfGraphemeClusters:(STUTextFrameGraphemeClusterRange*)outRanges
+                    closestToPoints:(const CGPoint*)points
+                              count:(NSUInteger)count
+                        frameOrigin:(CGPoint)frameOrigin
+{
+  [self getRangesOfGraphemeClusters:outRanges closestToPoints:points count:count
+                        frameOrigin:frameOrigin displayScale:data->displayScale];
+}
+
+- (void)getRangesOfGraphemeClusters:(STUTextFrameGraphemeClusterRange*)outRanges
+                    closestToPoints:(const CGPoint*)points
+                              count:(NSUInteger)count
+                        frameOrigin:(CGPoint)frameOrigin
+                       displayScale:(CGFloat)displayScale
+{
+  if (count == 0) return;
+  const Int n = sign_cast(count);
+  ThreadLocalArenaAllocator::InitialBuffer<4096> buffer;
+  ThreadLocalArenaAllocator alloc{Ref{buffer}};
+
+  const TextFrame& tf = textFrameRef(self);
+  TempArray<Point<Float64>> ps{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    ps[i] = points[i];
+  }
+  TempArray<TextFrame::GraphemeClusterRange> results{Count{n}};
+  tf.rangesOfGraphemeClustersClosestTo(ps, TextFrameOrigin{frameOrigin}, displayScale, results);
+  for (Int i = 0; i < n; ++i) {
+    outRanges[i] = narrow_cast<STUTextFrameGraphemeClusterRange>(results[i]);
+  }
+}
+
 - (nonnull STUTextRectArray*)rectsForRange:(STUTextFrameRange)range
                                frameOrigin:(CGPoint)frameOrigin
 {
@@ -352,6 +440,69 @@ STUTextFrame* __nullable
   return array;
 }
 
+- (nonnull NSArray<STUTextRectArray*>*)rectsForRanges:(const STUTextFrameRange*)ranges
+                                                count:(NSUInteger)count
+                                          frameOrigin:(CGPoint)frameOrigin
+{
+  return [self rectsForRanges:ranges count:count frameOrigin:frameOrigin
+                 displayScale:data->displayScale];
+}
+
+- (nonnull NSArray<STUTextRectArray*>*)rectsForRanges:(const STUTextFrameRange*)ranges
+                                                count:(NSUInteger)count
+                                          frameOrigin:(CGPoint)frameOrigin
+                                         displayScale:(CGFloat)displayScale
+{
+  if (count == 0) return @[];
+  const Int n = sign_cast(count);
+  ThreadLocalArenaAllocator::InitialBuffer<4096> buffer;
+  ThreadLocalArenaAllocator alloc{Ref{buffer}};
+
+  const TextFrame& tf = textFrameRef(self);
+  const TextFrameScaleAndDisplayScale scaleFactors{tf, displayScale};
+  const TextFrameOrigin origin{frameOrigin};
+  // We sort the range indices by range in order to find equal ranges and to compute the line
+  // spans of all unique ranges in a single pass over the lines.
+  TempArray<Int> order{uninitialized, Count{n}};
+  for (Int i = 0; i < n; ++i) {
+    order[i] = i;
+  }
+  order.sort([&](Int i, Int j) {
+    const STUTextFrameRange& r1 = ranges[i];
+    const STUTextFrameRange& r2 = ranges[j];
+    if (r1.start != r2.start) return r1.start < r2.start;
+    if (r1.end != r2.end) return r1.end < r2.end;
+    return i < j;
+  });
+  // uniqueIndices[i] is the index of ranges[i] in uniqueRanges.
+  TempArray<Int> uniqueIndices{uninitialized, Count{n}};
+  TempVector<STUTextFrameRange> uniqueRanges{MaxInitialCapacity{n}};
+  for (Int k = 0; k < n; ++k) {
+    const Int i = order[k];
+    if (k == 0 || ranges[order[k - 1]] != ranges[i]) {
+      uniqueRanges.append(ranges[i]);
+    }
+    uniqueIndices[i] = uniqueRanges.count() - 1;
+  }
+  const TempArray<TextLineSpan> spans = tf.lineSpans(uniqueRanges);
+  NSMutableArray<STUTextRectArray*>* const uniqueArrays =
+    [[NSMutableArray alloc] initWithCapacity:sign_cast(uniqueRanges.count())];
+  for (Int i0 = 0, u = 0; u < uniqueRanges.count(); ++u) {
+    Int i1 = i0;
+    while (i1 < spans.count() && Int{spans[i1].rangeIndex} == u) {
+      ++i1;
+    }
+    [uniqueArrays addObject:STUTextRectArrayCreate(nil, spans[{i0, i1}], tf.lines(), origin,
+                                                   scaleFactors)];
+    i0 = i1;
+  }
+  NSMutableArray<STUTextRectArray*>* const arrays = [[NSMutableArray alloc] initWithCapacity:count];
+  for (Int i = 0; i < n; ++i) {
+    [arrays addObject:uniqueArrays[sign_cast(uniqueIndices[i])]];
+  }
+  return arrays;
+}
+
 - (nonnull STUTextLinkArray*)rectsForAllLinksInTruncatedStringWithFrameOrigin:(CGPoint)frameOrigin {
   const TextFrame& tf = textFrameRef(self);
   return STUTextLinkArrayCreateWithTextFrameOriginAndDisplayScale(
@@ -20,8 +20,15 @@ using namespace stu_label;
   UIView* __weak _accessibilityContainer;
   CGRect _frame;
   __nullable STUTextLinkRangePredicate _linkActivationHandler;
+  // The following fields are used for the lazy initialization of the subelements and their
+  // geometry and accessibility labels.
+  STUTextFrame* _textFrame;
+  NSAttributedString* _attributedString;
+  __nullable STUTextLinkRangePredicate _isDraggableLink;
+  Vector<TextLineVerticalPosition> _verticalPositions;
 @private
   CGFloat _displayScale;
+  /// Null until the subelements are first accessed.
   NSArray<STUTextFrameAccessibilitySubelement*>* _elements;
   bool _isAccessibilityElement;
   bool _representsUntruncatedText;
@@ -37,19 +44,15 @@ namespace stu_label {
     NSAttributedString* attributedString;
     NSStringRef string;
     bool isTruncatedString;
-    bool separateParagraphs;
     bool separateLinkElements;
-    TextFrameScaleAndDisplayScale scaleFactors;
-    ArrayRef<const TextLineVerticalPosition> verticalPositions;
-    Point<CGFloat> textFrameOrigin;
-    __nullable STUTextLinkRangePredicate isDraggableLink;
   };
 }
 
 @interface STUTextFrameAccessibilitySubelement : UIAccessibilityElement
+/// Returns nil if the text in the string range has no line spans, e.g. because it was truncated.
 - (instancetype)initWithParams:(const InitParams&)params
                    stringRange:(NSRange)stringRange
-    mutableAttributedSubstring:(nullable NSMutableAttributedString*)mutableAttributedSubstring
+        containsInvisibleLinks:(bool)containsInvisibleLinks
                      linkCount:(UInt)linkCount
                  fullRangeLink:(nullable id)linkValue
            fullRangeAttachment:(nullable STUTextAttachment*)attachment
@@ -60,19 +63,28 @@ namespace stu_label {
 - (instancetype)init NS_UNAVAILABLE;
 @end
 
+/// The line spans, bounds, path and activation point of a subelement and the accessibility label of
+/// a text subelement are only calculated when they are first accessed, so that VoiceOver only pays
+/// for the elements it actually visits.
 @implementation STUTextFrameAccessibilitySubelement {
 @package // fileprivate
   const STUTextFrameAccessibilityElement* __unsafe_unretained _textFrameElement;
-  CGRect _boundsInTextFrame;
 @private
   UILabel* _uiLabel;
   id _accessibilityLabel;
   id _linkValue;
   CGPathRef _path;
+  CGRect _boundsInTextFrame;
   UIAccessibilityTraits _accessibilityTraits;
   CGPoint _activationPoint;
+  Range<TextFrameIndex> _textFrameRange;
   Range<stu::UInt32> _stringRange;
+  UInt _linkCount;
   STUTextRangeType _stringRangeType;
+  bool _hasGeometry;
+  bool _hasLabel;
+  /// Whether the link attributes of the label have to be checked for links without line spans.
+  bool _containsInvisibleLinks;
   bool _accessibilityLabelIsAttributed;
   bool _isDraggable;
 @protected
@@ -85,7 +97,17 @@ namespace stu_label {
   }
 }
 
-@synthesize accessibilityFrameInContainerSpace = _boundsInTextFrame;
+static void loadGeometry(STUTextFrameAccessibilitySubelement* self);
+static void loadLabel(STUTextFrameAccessibilitySubelement* self);
+
+- (CGRect)accessibilityFrameInContainerSpace {
+  if (!_hasGeometry) loadGeometry(self);
+  return _boundsInTextFrame;
+}
+- (void)setAccessibilityFrameInContainerSpace:(CGRect)frame {
+  if (!_hasGeometry) loadGeometry(self);
+  _boundsInTextFrame = frame;
+}
 
 - (const STUTextFrameAccessibilityElement*)accessibilityContainer {
   return _textFrameElement;
@@ -113,6 +135,7 @@ namespace stu_label {
 }
 
 - (CGRect)accessibilityFrame {
+  if (!_hasGeometry) loadGeometry(self);
   if (!_textFrameElement) return _boundsInTextFrame;
   const CGRect frame = _boundsInTextFrame + _textFrameElement->_frame.origin;
   UIView* const view = _textFrameElement->_accessibilityContainer;
@@ -125,6 +148,7 @@ namespace stu_label {
 }
 
 - (nullable UIBezierPath*)accessibilityPath {
+  if (!_hasGeometry) loadGeometry(self);
   if (!_path) return nil;
   const CGPoint origin = !_textFrameElement ? CGPoint{}
                        : _textFrameElement->_frame.origin;
@@ -146,6 +170,7 @@ namespace stu_label {
 }
 
 - (CGPoint)accessibilityActivationPoint {
+  if (!_hasGeometry) loadGeometry(self);
   if (!_textFrameElement) return _activationPoint;
   const CGPoint point = _activationPoint + _textFrameElement->_frame.origin;
   UIView* const view = _textFrameElement.accessibilityContainer;
@@ -162,6 +187,7 @@ namespace stu_label {
 - (BOOL)accessibilityActivate {
   if (_linkValue && _textFrameElement) {
     if (_textFrameElement->_linkActivationHandler) {
+      if (!_hasGeometry) loadGeometry(self);
       const CGPoint point = _activationPoint + _textFrameElement->_frame.origin;
       return _textFrameElement->_linkActivationHandler(STUTextRange{_stringRange, _stringRangeType},
                                                        _linkValue, point);
@@ -171,7 +197,9 @@ namespace stu_label {
 }
 
 - (NSArray<UIAccessibilityLocationDescriptor*>*)accessibilityDragSourceDescriptors {
-  if (!_isDraggable || !_textFrameElement) return nil;
+  if (!_linkValue || !_textFrameElement) return nil;
+  if (!_hasGeometry) loadGeometry(self);
+  if (!_isDraggable) return nil;
   return @[[[UIAccessibilityLocationDescriptor alloc]
               initWithName:localizedForSystemLocale(@"Drag Item")
                      point:_activationPoint + _textFrameElement->_frame.origin
@@ -179,24 +207,34 @@ namespace stu_label {
 }
 
 - (nullable NSString*)accessibilityLabel {
+  if (!_hasLabel) loadLabel(self);
   return !_accessibilityLabel || !_accessibilityLabelIsAttributed
        ? _accessibilityLabel
        : static_cast<NSAttributedString*>(_accessibilityLabel).string;
 }
 - (nullable NSAttributedString*)accessibilityAttributedLabel {
+  if (!_hasLabel) loadLabel(self);
   return !_accessibilityLabel || _accessibilityLabelIsAttributed
        ? _accessibilityLabel
        : [[NSAttributedString alloc] initWithString:_accessibilityLabel];
 }
 - (void)setAccessibilityLabel:(NSString*)accessibilityLabel {
+  _hasLabel = true;
   _accessibilityLabelIsAttributed = false;
   _accessibilityLabel = accessibilityLabel;
 }
 - (void)setAccessibilityAttributedLabel:(NSAttributedString*)accessibilityAttributedLabel {
+  _hasLabel = true;
   _accessibilityLabelIsAttributed = true;
   _accessibilityLabel = accessibilityAttributedLabel;
 }
 
+- (nullable NSString*)accessibilityLanguage {
+  // The language of a text element is determined by the attributes of its label.
+  if (!_hasLabel) loadLabel(self);
+  return [super accessibilityLanguage];
+}
+
 struct ActivationPoint {
   Float64 x;
   int32_t lineIndex;
@@ -229,115 +267,58 @@ static ActivationPoint findActivationPoint(const ArrayRef<const TextLineSpan> sp
   __builtin_trap();
 }
 
-- (instancetype)initWithParams:(const InitParams&)params
-                   stringRange:(NSRange)stringRange
-    mutableAttributedSubstring:(nullable NSMutableAttributedString* __unsafe_unretained)
-                                 mutableAttributedSubstring
-                     linkCount:(UInt)linkCount
-                 fullRangeLink:(nullable __unsafe_unretained id)fullRangeLinkValue
-           fullRangeAttachment:(nullable STUTextAttachment* __unsafe_unretained)attachment
+/// Strips any trailing whitespace ending with a line terminator from the string range (to prevent
+/// Voice Over from saying "new line") and returns the corresponding text frame range, or an empty
+/// range if the text has no line spans.
+static Range<TextFrameIndex> visibleTextFrameRange(const TextFrame& tf, const NSStringRef& string,
+                                                   bool isTruncatedString,
+                                                   InOut<NSRange> inOutStringRange)
 {
-  // Strip any trailing whitespace ending with a line terminator (to prevent Voice Over from saying
-  // "new line".)
+  NSRange& stringRange = inOutStringRange;
   if (stringRange.length != 0) {
     Range<Int> r = sign_cast(Range{stringRange});
-    if (isLineTerminator(params.string[r.end - 1])) {
-      r.end = params.string.indexOfEndOfLastCodePointWhere(r, isNotIgnorableAndNotWhitespace);
+    if (isLineTerminator(string[r.end - 1])) {
+      r.end = string.indexOfEndOfLastCodePointWhere(r, isNotIgnorableAndNotWhitespace);
       stringRange.length = sign_cast(r.end) - stringRange.location;
     }
   }
-  if (stringRange.length == 0) return nil;
-  const TextFrame& tf = params.textFrame;
-  const Range<TextFrameIndex> range = params.isTruncatedString
+  if (stringRange.length == 0) return {};
+  const Range<TextFrameIndex> range = isTruncatedString
                                     ? tf.range(RangeInTruncatedString{stringRange})
                                     : tf.range(RangeInOriginalString{stringRange});
-  TempArray<TextLineSpan> spans = tf.lineSpans(range);
-  if (spans.isEmpty()) return nil;
+  // The line spans themselves are only calculated when the geometry is first accessed.
+  if (range.isEmpty() || !tf.hasLineSpans(range)) return {};
+  return range;
+}
+
+- (instancetype)initWithParams:(const InitParams&)params
+                   stringRange:(NSRange)stringRange
+        containsInvisibleLinks:(bool)containsInvisibleLinks
+                     linkCount:(UInt)linkCount
+                 fullRangeLink:(nullable __unsafe_unretained id)fullRangeLinkValue
+           fullRangeAttachment:(nullable STUTextAttachment* __unsafe_unretained)attachment
+{
+  const Range<TextFrameIndex> range = visibleTextFrameRange(params.textFrame, params.string,
+                                                            params.isTruncatedString,
+                                                            InOut{stringRange});
+  if (range.isEmpty()) return nil;
   self = [super initWithAccessibilityContainer:params.textFrameAccessibilityElement];
   if (!self) return self;
   _textFrameElement = params.textFrameAccessibilityElement;
   _linkValue = fullRangeLinkValue;
+  _textFrameRange = range;
   _stringRange = narrow_cast<Range<stu::UInt32>>(stringRange);
   _stringRangeType = params.isTruncatedString ? STURangeInTruncatedString
                                               : STURangeInOriginalString;
-
-  const auto lines = tf.lines();
-
-  ActivationPoint ap = findActivationPoint(spans, lines);
-  ap.x *= tf.textScaleFactor;
-
-  _activationPoint = CGPoint{narrow_cast<CGFloat>(ap.x),
-                             narrow_cast<CGFloat>(params.verticalPositions[ap.lineIndex]
-                                                  .y().center())};
-  STU_DISABLE_LOOP_UNROLL
-  for (auto& span : spans) {
-    span.x *= tf.textScaleFactor;
-  }
-  const TextLineSpansPathBounds bounds = calculateTextLineSpansPathBounds(spans,
-                                                                          params.verticalPositions);
-  _boundsInTextFrame = narrow_cast<CGRect>(bounds.rect);
-
-  if (bounds.pathExtendedToCommonHorizontalTextLineBoundsIsRect == false) {
-    CGPath* const path = CGPathCreateMutable();
-    _path = path;
-    addLineSpansPath(*path, spans, params.verticalPositions, ShouldFillTextLineGaps{true},
-                     ShouldExtendTextLinesToCommonHorizontalBounds{true});
-  }
-
   if (!attachment){
     _accessibilityTraits = UIAccessibilityTraitStaticText;
     if (fullRangeLinkValue) {
       _accessibilityTraits |= UIAccessibilityTraitLink;
     }
-    NSAttributedString* label = mutableAttributedSubstring
-                                ?: [params.attributedString attributedSubstringFromRange:stringRange];
-    if (fullRangeLinkValue || NSFoundationVersionNumber <= NSFoundationVersionNumber_iOS_9_x_Max) {
-      NSMutableAttributedString* const mutableLabel = mutableAttributedSubstring
-                                                      ?: [label mutableCopy];
-      [mutableLabel removeAttribute:NSLinkAttributeName range:NSRange{0, stringRange.length}];
-      label = mutableLabel;
-    }
-    label = [[label stu_attributedStringByReplacingSTUAttachmentsWithStringRepresentations] copy];
-    { // Copy UIAccessibilitySpeechAttributeLanguage attribute to accessibilityLanguage property
-      // if the attribute is effective over the full string range.
-      const NSUInteger labelLength = label.length;
-      NSRange effectiveRange;
-      NSString* const language = [label attribute:UIAccessibilitySpeechAttributeLanguage
-                                          atIndex:0 longestEffectiveRange:&effectiveRange
-                                          inRange:NSRange{0, labelLength}];
-      if (language && effectiveRange == NSRange{0, labelLength}) {
-        self.accessibilityLanguage = language;
-      }
-    }
-    if (linkCount > 0 && !fullRangeLinkValue && !TARGET_OS_SIMULATOR) {
-      // We want VoiceOver to announce the presence of links when reading text, like it does for
-      // UILabel and UITextView. Unfortunately, UIAccessibility doesn't do this for normal
-      // accessibilityAttributedLabel values with NSLinkAttributeName attributes and there's no
-      // other public API for this purpose. To work around this limitation we let an UILabel
-      // create the appropriately attributed accessibility label for us.
-
-      // In iOS 11.3, -[UILabelAccessibility _accessibilityLabel:] started to aggressively cache the
-      // accessibility label by unretained pointer address of the UILabel instance, which forces us
-      // to create fresh UILabel instances for every accessibility element with embedded links and
-      // to keep the instance alive for the lifetime of the element. We don't do this on the
-      // simulator to conserve resources in automated UI tests.
-      _uiLabel = [[UILabel alloc] init];
-      _uiLabel.attributedText = label;
-      if (@available(iOS 11, tvOS 11, *)) {
-        _accessibilityLabelIsAttributed = true;
-        _accessibilityLabel = _uiLabel.accessibilityAttributedLabel;
-      } else {
-        _accessibilityLabel = _uiLabel.accessibilityLabel;
-      }
-    } else {
-      if (@available(iOS 11, tvOS 11, *)) {
-        _accessibilityLabelIsAttributed = true;
-        _accessibilityLabel = label;
-      } else {
-        _accessibilityLabel = label.string;
-      }
-    }
+    _containsInvisibleLinks = containsInvisibleLinks;
+    _linkCount = linkCount;
   } else { // attachment
+    _hasLabel = true;
     UIAccessibilityTraits traits = attachment.accessibilityTraits;
     if (!(traits & (UIAccessibilityTraitStaticText | UIAccessibilityTraitButton))) {
       traits |= UIAccessibilityTraitImage;
@@ -376,20 +357,126 @@ static ActivationPoint findActivationPoint(const ArrayRef<const TextLineSpan> sp
       self.accessibilityLanguage = language;
     }
   }
-  if (params.isDraggableLink
-      && fullRangeLinkValue
+  return self;
+}
+
+STU_NO_INLINE
+static void loadGeometry(STUTextFrameAccessibilitySubelement* self) {
+  const STUTextFrameAccessibilityElement* const container = self->_textFrameElement;
+  if (!container) return;
+  self->_hasGeometry = true;
+  const TextFrame& tf = textFrameRef(container->_textFrame);
+  TempArray<TextLineSpan> spans = tf.lineSpans(self->_textFrameRange);
+  if (spans.isEmpty()) return;
+  const ArrayRef<const TextLineVerticalPosition> verticalPositions = container->_verticalPositions;
+
+  ActivationPoint ap = findActivationPoint(spans, tf.lines());
+  ap.x *= tf.textScaleFactor;
+
+  self->_activationPoint = CGPoint{narrow_cast<CGFloat>(ap.x),
+                                   narrow_cast<CGFloat>(verticalPositions[ap.lineIndex]
+                                                        .y().center())};
+  STU_DISABLE_LOOP_UNROLL
+  for (auto& span : spans) {
+    span.x *= tf.textScaleFactor;
+  }
+  const TextLineSpansPathBounds bounds = calculateTextLineSpansPathBounds(spans,
+                                                                          verticalPositions);
+  self->_boundsInTextFrame = narrow_cast<CGRect>(bounds.rect);
+
+  if (bounds.pathExtendedToCommonHorizontalTextLineBoundsIsRect == false) {
+    CGPath* const path = CGPathCreateMutable();
+    self->_path = path;
+    addLineSpansPath(*path, spans, verticalPositions, ShouldFillTextLineGaps{true},
+                     ShouldExtendTextLinesToCommonHorizontalBounds{true});
+  }
+
+  const id linkValue = self->_linkValue;
+  if (container->_isDraggableLink
+      && linkValue
       && (!ap.isTruncationToken
-          || [fullRangeLinkValue isEqual: [tf.attributesAt(range.start)
-                                             objectForKey:NSLinkAttributeName]])
-      && params.isDraggableLink(STUTextRange{stringRange,
-                                             params.isTruncatedString ? STURangeInTruncatedString
-                                                                      : STURangeInOriginalString},
-                                fullRangeLinkValue,
-                                _activationPoint + params.textFrameOrigin))
+          || [linkValue isEqual:[tf.attributesAt(self->_textFrameRange.start)
+                                   objectForKey:NSLinkAttributeName]])
+      && container->_isDraggableLink(STUTextRange{self->_stringRange,
+                                                  self->_stringRangeType},
+                                     linkValue,
+                                     self->_activationPoint + container->_frame.origin))
   {
-    _isDraggable = true;
+    self->_isDraggable = true;
+  }
+}
+
+STU_NO_INLINE
+static void loadLabel(STUTextFrameAccessibilitySubelement* self) {
+  const STUTextFrameAccessibilityElement* const container = self->_textFrameElement;
+  if (!container) return;
+  self->_hasLabel = true;
+  const NSRange stringRange = self->_stringRange;
+  const id linkValue = self->_linkValue;
+  NSAttributedString* const attributedString = container->_attributedString;
+  NSAttributedString* label = [attributedString attributedSubstringFromRange:stringRange];
+  if (linkValue || NSFoundationVersionNumber <= NSFoundationVersionNumber_iOS_9_x_Max) {
+    NSMutableAttributedString* const mutableLabel = [label mutableCopy];
+    [mutableLabel removeAttribute:NSLinkAttributeName range:NSRange{0, stringRange.length}];
+    label = mutableLabel;
+  } else if (self->_containsInvisibleLinks) {
+    // Links without a link element (e.g. because they were truncated) must not be announced.
+    const TextFrame& tf = textFrameRef(container->_textFrame);
+    const NSStringRef string{attributedString.string};
+    const bool isTruncatedString = self->_stringRangeType == STURangeInTruncatedString;
+    NSMutableAttributedString* const mutableLabel = [label mutableCopy];
+    [attributedString enumerateAttribute:NSLinkAttributeName inRange:stringRange
+                                 options:0 // We need the longest effective range.
+                              usingBlock:^(id value, const NSRange linkRange, BOOL*)
+    {
+      if (!value) return;
+      NSRange r = linkRange;
+      if (!visibleTextFrameRange(tf, string, isTruncatedString, InOut{r}).isEmpty()) return;
+      [mutableLabel removeAttribute:NSLinkAttributeName
+                              range:Range{linkRange} - stringRange.location];
+    }];
+    label = mutableLabel;
+  }
+  label = [[label stu_attributedStringByReplacingSTUAttachmentsWithStringRepresentations] copy];
+  { // Copy UIAccessibilitySpeechAttributeLanguage attribute to accessibilityLanguage property
+    // if the attribute is effective over the full string range.
+    const NSUInteger labelLength = label.length;
+    NSRange effectiveRange;
+    NSString* const language = [label attribute:UIAccessibilitySpeechAttributeLanguage
+                                        atIndex:0 longestEffectiveRange:&effectiveRange
+                                        inRange:NSRange{0, labelLength}];
+    if (language && effectiveRange == NSRange{0, labelLength}) {
+      self.accessibilityLanguage = language;
+    }
+  }
+  if (self->_linkCount > 0 && !linkValue && !TARGET_OS_SIMULATOR) {
+    // We want VoiceOver to announce the presence of links when reading text, like it does for
+    // UILabel and UITextView. Unfortunately, UIAccessibility doesn't do this for normal
+    // accessibilityAttributedLabel values with NSLinkAttributeName attributes and there's no
+    // other public API for this purpose. To work around this limitation we let an UILabel
+    // create the appropriately attributed accessibility label for us.
+
+    // In iOS 11.3, -[UILabelAccessibility _accessibilityLabel:] started to aggressively cache the
+    // accessibility label by unretained pointer address of the UILabel instance, which forces us
+    // to create fresh UILabel instances for every accessibility element with embedded links and
+    // to keep the instance alive for the lifetime of the element. We don't do this on the
+    // simulator to conserve resources in automated UI tests.
+    self->_uiLabel = [[UILabel alloc] init];
+    self->_uiLabel.attributedText = label;
+    if (@available(iOS 11, tvOS 11, *)) {
+      self->_accessibilityLabelIsAttributed = true;
+      self->_accessibilityLabel = self->_uiLabel.accessibilityAttributedLabel;
+    } else {
+      self->_accessibilityLabel = self->_uiLabel.accessibilityLabel;
+    }
+  } else {
+    if (@available(iOS 11, tvOS 11, *)) {
+      self->_accessibilityLabelIsAttributed = true;
+      self->_accessibilityLabel = label;
+    } else {
+      self->_accessibilityLabel = label.string;
+    }
   }
-  return self;
 }
 
 @end
@@ -400,15 +487,14 @@ static ActivationPoint findActivationPoint(const ArrayRef<const TextLineSpan> sp
 
 - (instancetype)initWithParams:(const InitParams&)params
                    stringRange:(NSRange)stringRange
-    mutableAttributedSubstring:(nullable NSMutableAttributedString* __unsafe_unretained)
-                                 mutableAttributedSubstring
+        containsInvisibleLinks:(bool)containsInvisibleLinks
                      linkCount:(UInt)linkCount
                  fullRangeLink:(nullable __unsafe_unretained id)linkValue
            fullRangeAttachment:(nullable STUTextAttachment* __unsafe_unretained)attachment
 {
   if ((self = [super initWithParams:params
                         stringRange:stringRange
-         mutableAttributedSubstring:mutableAttributedSubstring
+             containsInvisibleLinks:containsInvisibleLinks
                           linkCount:(UInt)linkCount
                       fullRangeLink:linkValue
                 fullRangeAttachment:attachment]))
@@ -512,19 +598,15 @@ static UIAccessibilityCustomRotor* createLinkRotorForAccessibilityContainer(
   _representsUntruncatedText = representUntruncatedText;
   _separatesParagraphs = separateParagraphs;
   _separatesLinkElements = separateLinkElements;
-  if (NSFoundationVersionNumber <= NSFoundationVersionNumber_iOS_9_x_Max) {
-    separateLinkElements = true; // There's no way to provide a custom link rotor on iOS 9.
-  }
   if (!textFrame) {
     _elements = @[];
     return self;
   }
-  ThreadLocalArenaAllocator::InitialBuffer<4096> buffer;
-  ThreadLocalArenaAllocator alloc{Ref{buffer}};
   const TextFrame& tf = textFrameRef(textFrame);
   const auto scaleFactors = TextFrameScaleAndDisplayScale{tf, displayScale};
   const auto lines = tf.lines();
-  TempArray<TextLineVerticalPosition> verticalPositions{uninitialized, Count{lines.count()}, alloc};
+  TextLineVerticalPosition* const verticalPositions =
+    _verticalPositions.append(repeat(uninitialized, lines.count()));
   for (Int i = 0; i < lines.count(); ++i) {
     const TextFrameLine& line = lines[i];
     TextLineVerticalPosition vp = textLineVerticalPosition(line, scaleFactors.displayScale);
@@ -538,38 +620,24 @@ static UIAccessibilityCustomRotor* createLinkRotorForAccessibilityContainer(
   } else {
     isDraggableLink = nil;
   }
-  const InitParams params = {
-    .textFrameAccessibilityElement = self,
-    .textFrame = tf,
-    .attributedString = attributedString,
-    .string = NSStringRef{attributedString.string},
-    .isTruncatedString = !representUntruncatedText,
-    .separateParagraphs = separateParagraphs,
-    .separateLinkElements = separateLinkElements,
-    .scaleFactors = scaleFactors,
-    .verticalPositions = verticalPositions,
-    .textFrameOrigin = originInContainerSpace,
-    .isDraggableLink = isDraggableLink
-  };
-  NSMutableArray<STUTextFrameAccessibilitySubelement*>* const elements = [[NSMutableArray alloc]
-                                                                            init];
-  if (!separateParagraphs) {
-    const Range<Int> fullRange = representUntruncatedText ? tf.rangeInOriginalString()
-                                                          : tf.rangeInTruncatedString();
-    addAccessibilityElementsForRange(params, Range<UInt>{fullRange}, elements);
-  } else {
-    for (const TextFrameParagraph& para : tf.paragraphs()) {
-      const Range<Int> range = representUntruncatedText ? para.rangeInOriginalString
-                                                        : para.rangeInTruncatedString;
-      addAccessibilityElementsForRange(params, Range<UInt>{range}, elements);
-    }
+  // The subelements are created lazily with the help of these fields.
+  _textFrame = textFrame;
+  _attributedString = attributedString;
+  _isDraggableLink = isDraggableLink;
+  // We approximate the convex hull of the subelement frames with the bounds of the nonempty text
+  // lines, since the subelements are only created when first accessed.
+  bool hasNonemptyLine = false;
+  stu_label::Rect<Float64> bounds = {};
+  for (Int i = 0; i < lines.count(); ++i) {
+    const TextFrameLine& line = lines[i];
+    if (!(line.width > 0)) continue;
+    hasNonemptyLine = true;
+    const Range<Float64> x = Range{line.originX, line.originX + line.width}*tf.textScaleFactor;
+    bounds = bounds.convexHull(stu_label::Rect{x, verticalPositions[i].y()});
   }
-  stu_label::Rect<CGFloat> bounds = {};
-  for (STUTextFrameAccessibilitySubelement* const subelement in elements) {
-    bounds = bounds.convexHull(subelement.accessibilityFrameInContainerSpace);
+  if (hasNonemptyLine) {
+    _frame.size = narrow_cast<CGSize>(Size<Float64>{bounds.x.end, bounds.y.end});
   }
-  _frame.size = CGSize{bounds.x.end, bounds.y.end};
-  _elements = [elements copy];
   return self;
 }
 
@@ -597,14 +665,27 @@ static UIAccessibilityCustomRotor* createLinkRotorForAccessibilityContainer(
 }
 
 - (NSArray<STUTextFrameAccessibilitySubelement*>*)accessibilityElements {
-  return _elements;
+  return elements(self);
 }
 - (void)setAccessibilityElements:(NSArray*)elements {
-  if (elements == _elements) return;
+  if (elements && elements == _elements) return;
   [self doesNotRecognizeSelector:_cmd];
   __builtin_trap();
 }
 
+- (NSInteger)accessibilityElementCount {
+  return sign_cast(elements(self).count);
+}
+- (nullable id)accessibilityElementAtIndex:(NSInteger)index {
+  NSArray* const elements = ::elements(self);
+  if (index < 0 || sign_cast(index) >= elements.count) return nil;
+  return elements[sign_cast(index)];
+}
+- (NSInteger)indexOfAccessibilityElement:(id)element {
+  const NSUInteger index = [elements(self) indexOfObjectIdenticalTo:element];
+  return index == NSNotFound ? NSNotFound : sign_cast(index);
+}
+
 @synthesize accessibilityFrameInContainerSpace = _frame;
 
 - (CGPoint)textFrameOriginInContainerSpace {
@@ -653,7 +734,7 @@ static void addElementsForRangeThatMayContainLinks(
       if (auto* const e = [[STUTextFrameAccessibilitySubelement alloc]
                              initWithParams:params
                                stringRange:linkValue ? trimmedStringRange : stringRange
-                mutableAttributedSubstring:nil
+                    containsInvisibleLinks:false
                                  linkCount:linkValue ? 1 : 0
                              fullRangeLink:linkValue
                        fullRangeAttachment:nil])
@@ -667,7 +748,7 @@ static void addElementsForRangeThatMayContainLinks(
   const bool createRotorLinks = NSFoundationVersionNumber > NSFoundationVersionNumber_iOS_9_x_Max;
 
   const UInt index = array.count;
-  NSMutableAttributedString* __block mutableSubtring = nil;
+  bool __block containsInvisibleLinks = false;
   [params.attributedString enumerateAttribute:NSLinkAttributeName inRange:stringRange
                                       options:0 // We need the longest effective range.
                                    usingBlock:^(id linkValue, NSRange linkRange, BOOL*)
@@ -678,7 +759,7 @@ static void addElementsForRangeThatMayContainLinks(
                               : STUTextFrameAccessibilitySubelement.class) alloc]
              initWithParams:params
                 stringRange:linkRange
- mutableAttributedSubstring:nil
+     containsInvisibleLinks:false
                   linkCount:1
               fullRangeLink:linkValue
         fullRangeAttachment:nil])
@@ -686,19 +767,14 @@ static void addElementsForRangeThatMayContainLinks(
       [array addObject:linkElement];
       return;
     }
-    if (!mutableSubtring) {
-      mutableSubtring = [[NSMutableAttributedString alloc]
-                           initWithAttributedString:[params.attributedString
-                                                       attributedSubstringFromRange:stringRange]];
-    }
-    [mutableSubtring removeAttribute:NSLinkAttributeName
-                               range:Range{linkRange} - stringRange.location];
+    // The link attribute is removed from the label of the text element when the label is loaded.
+    containsInvisibleLinks = true;
   }];
   const UInt linkCount = array.count - index;
   auto* const textElement = [[STUTextFrameAccessibilitySubelement alloc]
                                initWithParams:params
                                   stringRange:stringRange
-                   mutableAttributedSubstring:mutableSubtring
+                       containsInvisibleLinks:containsInvisibleLinks
                                     linkCount:linkCount
                                 fullRangeLink:nil
                           fullRangeAttachment:nil];
@@ -767,7 +843,7 @@ static void addAccessibilityElementsForRange(
       if (auto* const e = [[STUTextFrameAccessibilitySubelement alloc]
                              initWithParams:params
                                 stringRange:range
-                 mutableAttributedSubstring:nil
+                     containsInvisibleLinks:false
                                   linkCount:0
                               fullRangeLink:linkValue
                         fullRangeAttachment:attachment])
@@ -795,7 +871,7 @@ static void addAccessibilityElementsForRange(
       if (auto* const e = [[STUTextFrameAccessibilitySubelement alloc]
                              initWithParams:params
                                 stringRange:subrange
-                 mutableAttributedSubstring:nil
+                     containsInvisibleLinks:false
                                   linkCount:linkValue ? 1 : 0
                               fullRangeLink:linkValue
                         fullRangeAttachment:attachment])
@@ -806,5 +882,53 @@ static void addAccessibilityElementsForRange(
   }];
 }
 
+/// Creates the subelements, one paragraph after another. The elements can't be created lazily
+/// per paragraph, since the element count and the element indices used by the link rotors depend
+/// on all paragraphs.
+STU_NO_INLINE
+static NSArray<STUTextFrameAccessibilitySubelement*>*
+  createElements(STUTextFrameAccessibilityElement* self)
+{
+  const TextFrame& tf = textFrameRef(self->_textFrame);
+  NSAttributedString* const attributedString = self->_attributedString;
+  const bool representUntruncatedText = self->_representsUntruncatedText;
+  // There's no way to provide a custom link rotor on iOS 9.
+  const bool separateLinkElements = self->_separatesLinkElements
+                                 || NSFoundationVersionNumber
+                                    <= NSFoundationVersionNumber_iOS_9_x_Max;
+  const InitParams params = {
+    .textFrameAccessibilityElement = self,
+    .textFrame = tf,
+    .attributedString = attributedString,
+    .string = NSStringRef{attributedString.string},
+    .isTruncatedString = !representUntruncatedText,
+    .separateLinkElements = separateLinkElements
+  };
+  NSMutableArray<STUTextFrameAccessibilitySubelement*>* const elements = [[NSMutableArray alloc]
+                                                                            init];
+  if (!self->_separatesParagraphs) {
+    const Range<Int> fullRange = representUntruncatedText ? tf.rangeInOriginalString()
+                                                          : tf.rangeInTruncatedString();
+    addAccessibilityElementsForRange(params, Range<UInt>{fullRange}, elements);
+  } else {
+    for (const TextFrameParagraph& para : tf.paragraphs()) {
+      const Range<Int> range = representUntruncatedText ? para.rangeInOriginalString
+                                                        : para.rangeInTruncatedString;
+      addAccessibilityElementsForRange(params, Range<UInt>{range}, elements);
+    }
+  }
+  return [elements copy];
+}
+
+STU_INLINE
+static NSArray<STUTextFrameAccessibilitySubelement*>*
+  elements(STUTextFrameAccessibilityElement* self)
+{
+  if (!self->_elements) {
+    self->_elements = createElements(self);
+  }
+  return self->_elements;
+}
+
 @end
 
@@ -55,6 +55,20 @@ NS_SWIFT_NAME(STUTextFrame.DrawingOptions) STU_EXPORT
 /// Default value: `nil`
 @property (nonatomic, nullable) UIColor *overrideLinkColor;
 
+/// Must equal the value last passed to @c CGContextSetShouldAntialias for the context that the
+/// text frame is drawn into. Core Graphics has no public API for querying this setting, so the
+/// glyph raster cache (see @c STUTextFrame.glyphRasterCacheMemoryBudget) relies on this value when
+/// rasterizing glyphs, and caches the glyphs separately for each value.
+///
+/// Default value: true (the Core Graphics default)
+@property (nonatomic) bool contextShouldAntialias;
+
+/// Must equal the value last passed to @c CGContextSetShouldSmoothFonts for the context that the
+/// text frame is drawn into. See @c contextShouldAntialias.
+///
+/// Default value: true (the Core Graphics default)
+@property (nonatomic) bool contextShouldSmoothFonts;
+
 @end
 
 STU_ASSUME_NONNULL_AND_STRONG_END
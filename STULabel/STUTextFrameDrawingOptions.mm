@@ -87,6 +87,20 @@ STUTextFrameDrawingOptions*
   impl.setOverrideColorsApplyToHighlightedText(overrideColorsApplyToHighlightedText);
 }
 
+- (bool)contextShouldAntialias {
+  return impl.contextShouldAntialias();
+}
+- (void)setContextShouldAntialias:(bool)contextShouldAntialias {
+  impl.setContextShouldAntialias(contextShouldAntialias);
+}
+
+- (bool)contextShouldSmoothFonts {
+  return impl.contextShouldSmoothFonts();
+}
+- (void)setContextShouldSmoothFonts:(bool)contextShouldSmoothFonts {
+  impl.setContextShouldSmoothFonts(contextShouldSmoothFonts);
+}
+
 - (UIColor*)overrideTextColor {
   return impl.overrideTextUIColor().unretained;
 }
@@ -19,6 +19,7 @@ namespace stu_label {
     CGFloat textScaleFactorStepSize;
     STUBaselineAdjustment textScalingBaselineAdjustment;
     __nullable STULastHyphenationLocationInRangeFinder lastHyphenationLocationInRangeFinder;
+    bool usesCompactGlyphStorage;
   };
 }
 
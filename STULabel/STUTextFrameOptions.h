@@ -137,6 +137,26 @@ STU_EXPORT
 
 - (instancetype)copyWithUpdates:(void (^ STU_NOESCAPE)(STUTextFrameOptionsBuilder *builder))block;
 
+/// Registers TeX hyphenation patterns for the specified locale identifier.
+///
+/// If patterns are registered for the value of a @c STUHyphenationLocaleIdentifierAttributeName
+/// attribute (or for the language code of the value), the text in the attribute range is
+/// hyphenated with STULabel's implementation of Liang's pattern-based hyphenation algorithm
+/// instead of the system hyphenator. A @c lastHyphenationLocationInRangeFinder takes precedence
+/// over both.
+///
+/// @param patterns Hyphenation patterns in the TeX format, e.g. @c ".hy3p" or @c "4m1p".
+///                 Passing nil removes the patterns registered for the locale identifier.
+/// @param exceptions Words with explicit hyphens marking the hyphenation locations,
+///                   e.g. @c "as-so-ciate".
+/// @returns False, without changing the registration, if a pattern or exception is malformed.
+///
+/// This method is thread-safe. Text frames that were created before the registration changed are
+/// not affected.
++ (BOOL)registerHyphenationPatterns:(nullable NSArray<NSString *> *)patterns
+                         exceptions:(nullable NSArray<NSString *> *)exceptions
+                forLocaleIdentifier:(NSString *)localeIdentifier;
+
 /// Default value: @c .default
 @property (readonly) STUTextLayoutMode textLayoutMode;
 
@@ -174,6 +194,9 @@ STU_EXPORT
 @property (readonly, nullable) STULastHyphenationLocationInRangeFinder
                                  lastHyphenationLocationInRangeFinder;
 
+/// Default value: false
+@property (readonly) bool usesCompactGlyphStorage;
+
 @end
 
 /// Equality for @c STUTextFrameOptionsBuilder instances is defined as pointer equality.
@@ -227,6 +250,15 @@ STU_EXPORT
 @property (nonatomic, nullable) STULastHyphenationLocationInRangeFinder
                                   lastHyphenationLocationInRangeFinder;
 
+/// Indicates whether the text frame should copy the glyph data of its lines into its own
+/// allocation and release the underlying @c CTLine objects after the layout.
+///
+/// The compact copy typically needs less memory than the @c CTLine objects and makes hit testing
+/// cheaper. The text frame then always draws glyphs with @c CTFontDrawGlyphs.
+///
+/// Default value: false
+@property (nonatomic) bool usesCompactGlyphStorage;
+
 @end
 
 STU_ASSUME_NONNULL_AND_STRONG_END
@@ -5,6 +5,7 @@
 #import "STULabel/STUObjCRuntimeWrappers.h"
 #import "STULabel/STUShapedString.h"
 
+#import "Internal/Hyphenation.hpp"
 #import "Internal/InputClamping.hpp"
 #import "Internal/Once.hpp"
 
@@ -21,7 +22,8 @@ using namespace stu_label;
   f(CGFloat, minimumTextScaleFactor) \
   f(CGFloat, textScaleFactorStepSize) \
   f(STUBaselineAdjustment, textScalingBaselineAdjustment) \
-  f(__nullable STULastHyphenationLocationInRangeFinder, lastHyphenationLocationInRangeFinder)
+  f(__nullable STULastHyphenationLocationInRangeFinder, lastHyphenationLocationInRangeFinder) \
+  f(bool, usesCompactGlyphStorage)
 
 #define DEFINE_FIELD(Type, name) Type _##name;
 
@@ -149,4 +151,18 @@ STUTextFrameOptions*
   return [(STUTextFrameOptions*)[self.class alloc] initWithBuilder:builder];
 }
 
++ (BOOL)registerHyphenationPatterns:(nullable NSArray<NSString*>*)patterns
+                         exceptions:(nullable NSArray<NSString*>*)exceptions
+                forLocaleIdentifier:(NSString*)localeIdentifier
+{
+  RC<Hyphenator> hyphenator;
+  if (patterns) {
+    hyphenator = createHyphenator(patterns, exceptions);
+    if (!hyphenator) return false;
+  }
+  setHyphenatorForLocaleIdentifier((__bridge CFStringRef)localeIdentifier,
+                                   std::move(hyphenator));
+  return true;
+}
+
 @end
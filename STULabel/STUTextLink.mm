@@ -12,6 +12,7 @@
 #import "Internal/InputClamping.hpp"
 #import "Internal/IntervalSearchTable.hpp"
 #import "Internal/Once.hpp"
+#import "Internal/RectGridIndex.hpp"
 #import "Internal/TextFrame.hpp"
 
 #import "stu/BinarySearch.hpp"
@@ -190,6 +191,8 @@ CGPoint STUTextLinkArrayGetTextFrameOrigin(const STUTextLinkArrayWithTextFrameOr
 @implementation STUTextLinkArrayWithOriginalTextFrameOrigin {
   STUTextLink* __unsafe_unretained * _array;
   Int _count;
+  /// Lazily created by `rectIndex`.
+  std::atomic<const RectGridIndex*> _rectIndex;
 }
 
 STU_INLINE
@@ -309,6 +312,7 @@ STUTextLinkArrayWithTextFrameOrigin* __nonnull
   for (STUTextLink* __unsafe_unretained p : links(self)) {
     decrementRefCount(p);
   }
+  delete _rectIndex.load(std::memory_order_relaxed);
 }
 
 - (size_t)count {
@@ -332,11 +336,48 @@ STUTextLinkArrayWithTextFrameOrigin* __nonnull
   return sign_cast(_count);
 }
 
+/// For arrays with fewer links the vertical search table is sufficient for finding the link
+/// closest to a point.
+static constexpr Int minLinkCountForRectIndex = 8;
+
+static const RectGridIndex& rectIndex(const STUTextLinkArrayWithOriginalTextFrameOrigin* self) {
+  std::atomic<const RectGridIndex*>& ap =
+    const_cast<std::atomic<const RectGridIndex*>&>(self->_rectIndex);
+  if (ap.load(std::memory_order_relaxed)) {
+    return *ap.load(std::memory_order_acquire);
+  }
+  Vector<RectGridIndex::TaggedRect> rects;
+  Int32 linkIndex = 0;
+  for (STUTextLink* __unsafe_unretained link : links(self)) {
+    STUTextRectArrayForEachRect(link, [&](stu_label::Rect<Float64> rect) {
+      rects.append(RectGridIndex::TaggedRect{rect, linkIndex});
+    });
+    ++linkIndex;
+  }
+  const RectGridIndex* index = new RectGridIndex{rects};
+  const RectGridIndex* expected = nullptr;
+  if (!ap.compare_exchange_strong(expected, index,
+                                  std::memory_order_release, std::memory_order_acquire))
+  {
+    delete index;
+    index = expected;
+  }
+  return *index;
+}
+
 static Optional<Int> indexOfLinkClosestToPoint(
                        const STUTextLinkArrayWithOriginalTextFrameOrigin* self,
                        CGPoint point, CGFloat maxDistance)
 {
   const ArrayRef<STUTextLink* __unsafe_unretained> array = links(self);
+  if (array.count() >= minLinkCountForRectIndex) {
+    if (!(maxDistance >= 0)) {
+      maxDistance = 0;
+    }
+    const Int32 index = rectIndex(self).findRectClosestTo(point, maxDistance).tag;
+    if (index < 0) return none;
+    return Int{index};
+  }
   const Range<Int> indexRange = verticalSearchTable(self)
                                 .indexRange({narrow_cast<Float32>(point.y - maxDistance),
                                              narrow_cast<Float32>(point.y + maxDistance)});
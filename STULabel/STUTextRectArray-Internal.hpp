@@ -21,6 +21,10 @@ STUTextRectArray* __nonnull STUTextRectArrayCopyWithOffset(
 
 stu_label::Rect<CGFloat> STUTextRectArrayGetBounds(STUTextRectArray*);
 
+/// Calls `body` with the rects of the array in index order.
+void STUTextRectArrayForEachRect(STUTextRectArray*,
+                                 stu::FunctionRef<void(stu_label::Rect<stu::Float64>)> body);
+
 STUIndexAndDistance STUTextRectArrayFindRectClosestToPoint(
                       const STUTextRectArray* self, CGPoint point, CGFloat maxDistance);
 
@@ -85,6 +85,10 @@ STU_EXPORT
 /// @param transform
 ///  A pointer to an affine transformation matrix, or null if no transformation is needed.
 ///  If non-null, this transformation is applied to the path before it is returned.
+///
+/// @note The array caches the most recently created untransformed paths, so repeated calls with
+///       the same edge insets, corner radius and flags only need to copy the cached path.
+///       The returned path is always a new @c CGMutablePath object owned by the caller.
 -   (CGPathRef)createPathWithEdgeInsets:(UIEdgeInsets)edgeInsets
                            cornerRadius:(CGFloat)cornerRadius
 extendTextLinesToCommonHorizontalBounds:(bool)extendTextLinesToCommonHorizontalBounds
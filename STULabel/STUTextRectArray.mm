@@ -3,11 +3,14 @@
 #import "STUTextRectArray-Internal.hpp"
 
 #import "STUObjCRuntimeWrappers.h"
+#import "stu_mutex.h"
 
 #import "Internal/InputClamping.hpp"
 #import "Internal/Once.hpp"
 #import "Internal/TextLineSpansPath.hpp"
 
+#include <algorithm>
+
 #include "Internal/DefineUIntOnCatalystToWorkAroundGlobalNamespacePollution.h"
 
 using namespace stu;
@@ -81,8 +84,46 @@ struct STUTextRectArrayData {
 };
 
 
+namespace {
+
+struct PathCacheKey {
+  UIEdgeInsets edgeInsets;
+  CGFloat cornerRadius;
+  bool extendLinesToCommonBounds;
+  bool fillTextLineGaps;
+
+  bool operator==(const PathCacheKey& other) const {
+    return edgeInsets == other.edgeInsets
+        && cornerRadius == other.cornerRadius
+        && extendLinesToCommonBounds == other.extendLinesToCommonBounds
+        && fillTextLineGaps == other.fillTextLineGaps;
+  }
+};
+
+/// Caches the most recently created untransformed paths of a STUTextRectArray, so that e.g.
+/// repeatedly displaying the overlay for the same link doesn't rebuild the same path geometry.
+struct PathCache {
+  static constexpr Int capacity = 2;
+
+  struct Entry {
+    PathCacheKey key;
+    CGPathRef path;
+  };
+
+  Int count;
+  /// Ordered from most to least recently used.
+  Entry entries[capacity];
+};
+
+} // namespace
+
+/// Protects the path caches of all STUTextRectArray instances. The critical sections only look up
+/// or insert an entry.
+static stu_mutex pathCacheMutex = STU_MUTEX_INIT;
+
 @implementation STUTextRectArray {
   UInt taggedPointer_; // TODO: debug viewer
+  PathCache* pathCache_;
 }
 
 struct DataOrOtherArray {
@@ -122,6 +163,12 @@ struct DataOrOtherArray {
   if (d.otherArray) {
     decrementRefCount(d.otherArray);
   }
+  if (pathCache_) {
+    for (Int i = 0; i < pathCache_->count; ++i) {
+      CFRelease(pathCache_->entries[i].path);
+    }
+    free(pathCache_);
+  }
 }
 
 - (nonnull id)copyWithZone:(nullable NSZone* __unused)zone {
@@ -302,6 +349,23 @@ STU_INLINE stu_label::Rect<Float64> rectAtIndex(const STUTextRectArrayData& data
   return {span.x, vpos.y()};
 }
 
+void STUTextRectArrayForEachRect(STUTextRectArray* __unsafe_unretained self,
+                                 FunctionRef<void(stu_label::Rect<Float64>)> body)
+{
+  const DataOrOtherArray d{self};
+  if (d.data) {
+    for (Int i = 0; i < d.data->rectCount; ++i) {
+      body(rectAtIndex(*d.data, i));
+    }
+    return;
+  }
+  const STUTextRectArray* __unsafe_unretained const array = d.otherArray;
+  const Int rectCount = sign_cast(array.rectCount);
+  for (Int i = 0; i < rectCount; ++i) {
+    body(stu_label::Rect<Float64>{[array rectAtIndex:sign_cast(i)]});
+  }
+}
+
 - (CGRect)rectAtIndex:(size_t)index {
   const DataOrOtherArray d{self};
   if (d.data) {
@@ -397,6 +461,58 @@ STUIndexAndDistance STUTextRectArrayFindRectClosestToPoint(
   return STUTextRectArrayFindRectClosestToPoint(self, point, maxDistance);
 }
 
+/// Returns a retained path, or null if the cache contains no path for the key.
+static CGPathRef __nullable cachedPath(STUTextRectArray* __unsafe_unretained self,
+                                       const PathCacheKey& key)
+{
+  CGPathRef path = nullptr;
+  stu_mutex_lock(&pathCacheMutex);
+  if (PathCache* const cache = self->pathCache_) {
+    for (Int i = 0; i < cache->count; ++i) {
+      if (cache->entries[i].key == key) {
+        path = cache->entries[i].path;
+        CFRetain(path);
+        std::rotate(cache->entries, cache->entries + i, cache->entries + i + 1);
+        break;
+      }
+    }
+  }
+  stu_mutex_unlock(&pathCacheMutex);
+  return path;
+}
+
+static void cachePath(STUTextRectArray* __unsafe_unretained self, const PathCacheKey& key,
+                      CGPathRef path)
+{
+  CFRetain(path);
+  CGPathRef evictedPath = nullptr;
+  stu_mutex_lock(&pathCacheMutex);
+  PathCache* cache = self->pathCache_;
+  if (!cache) {
+    cache = static_cast<PathCache*>(malloc(sizeof(PathCache)));
+    if (!cache) {
+      stu_mutex_unlock(&pathCacheMutex);
+      CFRelease(path);
+      return;
+    }
+    cache->count = 0;
+    self->pathCache_ = cache;
+  }
+  if (cache->count == PathCache::capacity) {
+    evictedPath = cache->entries[PathCache::capacity - 1].path;
+    cache->count -= 1;
+  }
+  // If another thread concurrently inserted a path for the same key, we just keep both entries.
+  std::move_backward(cache->entries, cache->entries + cache->count,
+                     cache->entries + cache->count + 1);
+  cache->entries[0] = PathCache::Entry{.key = key, .path = path};
+  cache->count += 1;
+  stu_mutex_unlock(&pathCacheMutex);
+  if (evictedPath) {
+    CFRelease(evictedPath);
+  }
+}
+
 -   (CGPathRef)createPathWithEdgeInsets:(UIEdgeInsets)edgeInsets
                            cornerRadius:(CGFloat)cornerRadius
 extendTextLinesToCommonHorizontalBounds:(bool)extendLinesToCommonBounds
@@ -407,16 +523,30 @@ extendTextLinesToCommonHorizontalBounds:(bool)extendLinesToCommonBounds
   const DataOrOtherArray d{self};
   if (d.data) {
     const STUTextRectArrayData& data = *d.data;
-    ThreadLocalArenaAllocator::InitialBuffer<2048> buffer;
-    ThreadLocalArenaAllocator alloc{Ref{buffer}};
-    cornerRadius = clampNonNegativeFloatInput(cornerRadius);
-    edgeInsets = clampEdgeInsetsInput(edgeInsets);
-    CGMutablePathRef path = CGPathCreateMutable();
-    addLineSpansPath(*path, data.spans(), data.textLineVerticalPositions(),
-                     ShouldFillTextLineGaps{fillTextLineGaps},
-                     ShouldExtendTextLinesToCommonHorizontalBounds{extendLinesToCommonBounds},
-                     edgeInsets, CornerRadius{cornerRadius}, nil, transform);
-    return path;
+    const PathCacheKey key{.edgeInsets = clampEdgeInsetsInput(edgeInsets),
+                           .cornerRadius = clampNonNegativeFloatInput(cornerRadius),
+                           .extendLinesToCommonBounds = extendLinesToCommonBounds,
+                           .fillTextLineGaps = fillTextLineGaps};
+    CGPathRef path = cachedPath(self, key);
+    if (!path) {
+      ThreadLocalArenaAllocator::InitialBuffer<2048> buffer;
+      ThreadLocalArenaAllocator alloc{Ref{buffer}};
+      const CGMutablePathRef mutablePath = CGPathCreateMutable();
+      addLineSpansPath(*mutablePath, data.spans(), data.textLineVerticalPositions(),
+                       ShouldFillTextLineGaps{fillTextLineGaps},
+                       ShouldExtendTextLinesToCommonHorizontalBounds{extendLinesToCommonBounds},
+                       key.edgeInsets, CornerRadius{key.cornerRadius});
+      path = mutablePath;
+      cachePath(self, key, path);
+    }
+    // The cached path is shared, so we always return a new mutable copy, as the caller may
+    // mutate the returned path or rely on it not being referenced anywhere else.
+    const CGMutablePathRef result =
+      transform && !CGAffineTransformIsIdentity(*transform)
+      ? CGPathCreateMutableCopyByTransformingPath(path, transform)
+      : CGPathCreateMutableCopy(path);
+    CFRelease(path);
+    return result;
   }
   STU_ANALYZER_ASSUME(d.otherArray != nil);
   return [d.otherArray createPathWithEdgeInsets:edgeInsets
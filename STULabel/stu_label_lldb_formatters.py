@@ -799,8 +799,11 @@ class STUTextFrameData_ChildrenProvider:
 
     paragraphsOffset = self.byteSize
     linesOffset = paragraphsOffset + paragraphsByteSize
-    colorsOffset = linesOffset + linesByteSize + sanitizerGap
-    textStylesOffset = colorsOffset + colorsByteSize + sanitizerGap
+    # The lines may be followed by the compact glyph storage, so we locate the colors relative to
+    # the text styles.
+    textStylesOffset = valobj.GetChildMemberWithName('_textStylesData').GetValueAsUnsigned() \
+                     - address
+    colorsOffset = textStylesOffset - sanitizerGap - colorsByteSize
     lineStringIndicesOffset = -sanitizerGap - lineStringIndicesByteSize
     verticalSearchTableOffset = lineStringIndicesOffset - sanitizerGap - verticalSearchTableByteSize
 
@@ -112,6 +112,49 @@ extension STUTextFrame {
                                     displayScale: displayScaleOrZero)
   }
 
+  /// Equivalent to calling `rangeOfGraphemeCluster` for each point, except that the temporary
+  /// state and the glyph iteration for each line are shared between all points.
+  /// Trailing whitespace is ignored, as with `ignoringTrailingWhitespace: true`.
+  @inlinable
+  public func rangesOfGraphemeClusters(closestTo points: [CGPoint],
+                                       frameOrigin: CGPoint, displayScale: CGFloat?)
+    -> [GraphemeClusterRange]
+  {
+    return rangesOfGraphemeClusters(closestTo: points,
+                                    frameOrigin: frameOrigin,
+                                    displayScaleOrZero: displayScale ?? 0)
+  }
+
+  /// Equivalent to the other `rangesOfGraphemeClusters` overload
+  /// with `self.displayScale` as the `displayScale` argument.
+  @inlinable
+  public func rangesOfGraphemeClusters(closestTo points: [CGPoint],
+                                       frameOrigin: CGPoint)
+    -> [GraphemeClusterRange]
+  {
+    return rangesOfGraphemeClusters(closestTo: points,
+                                    frameOrigin: frameOrigin,
+                                    displayScaleOrZero: displayScaleOrZero)
+  }
+
+  @inlinable
+  internal func rangesOfGraphemeClusters(closestTo points: [CGPoint],
+                                         frameOrigin: CGPoint, displayScaleOrZero: CGFloat)
+    -> [GraphemeClusterRange]
+  {
+    if points.isEmpty { return [] }
+    var result = [GraphemeClusterRange](repeating: GraphemeClusterRange(), count: points.count)
+    points.withUnsafeBufferPointer { points in
+      result.withUnsafeMutableBufferPointer { result in
+        __getRangesOfGraphemeClusters(result.baseAddress!, closestTo: points.baseAddress!,
+                                      count: UInt(points.count),
+                                      frameOrigin: frameOrigin,
+                                      displayScale: displayScaleOrZero)
+      }
+    }
+    return result
+  }
+
   @inlinable
   public var rangeInOriginalStringIsFullString: Bool {
     return withExtendedLifetime(self) { self.__data.pointee.rangeInOriginalStringIsFullString }
@@ -435,6 +478,35 @@ extension STUTextFrame {
                    displayScale: displayScaleOrZero)
   }
 
+  /// Equivalent to calling `rects` for each range, except that the temporary state is shared
+  /// between the calls and that equal ranges are mapped to the same `STUTextRectArray` instance.
+  @inlinable
+  public func rects(for ranges: [Range<Index>], frameOrigin: CGPoint, displayScale: CGFloat?)
+    -> [STUTextRectArray]
+  {
+    return rects(for: ranges, frameOrigin: frameOrigin, displayScaleOrZero: displayScale ?? 0)
+  }
+
+  /// Equivalent to the other `rects` overload
+  /// with `self.displayScale` as the `displayScale` argument.
+  @inlinable
+  public func rects(for ranges: [Range<Index>], frameOrigin: CGPoint) -> [STUTextRectArray] {
+    return rects(for: ranges, frameOrigin: frameOrigin, displayScaleOrZero: displayScaleOrZero)
+  }
+
+  @inlinable
+  internal func rects(for ranges: [Range<Index>], frameOrigin: CGPoint,
+                      displayScaleOrZero: CGFloat)
+    -> [STUTextRectArray]
+  {
+    if ranges.isEmpty { return [] }
+    let ranges = ranges.map { __STUTextFrameRange($0) }
+    return ranges.withUnsafeBufferPointer {
+             __rects($0.baseAddress!, count: UInt($0.count), frameOrigin: frameOrigin,
+                     displayScale: displayScaleOrZero)
+           }
+  }
+
   @inlinable
   public func rectsForAllLinksInTruncatedString(frameOrigin: CGPoint, displayScale: CGFloat?)
     -> STUTextLinkArray
@@ -0,0 +1,80 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "DecorationLines.hpp"
+
+#import "STUImageUtils.h"
+#import "STUTextFrame.h"
+
+#import "TestUtils.h"
+
+using namespace stu;
+using namespace stu_label;
+
+static NSData* renderUnderlinedText(CGFloat fontSize) {
+  NSAttributedString* const string =
+    [[NSAttributedString alloc]
+       initWithString:@"gjpqy"
+           attributes:@{NSFontAttributeName: [UIFont fontWithName:@"HelveticaNeue"
+                                                             size:fontSize],
+                        NSUnderlineStyleAttributeName: @(NSUnderlineStyleSingle)}];
+  STUShapedString* const shapedString = [[STUShapedString alloc]
+                                           initWithAttributedString:string];
+  STUTextFrame* const frame = [[STUTextFrame alloc] initWithShapedString:shapedString
+                                                                    size:CGSizeMake(1000, 1000)
+                                                            displayScale:2
+                                                                 options:nil];
+  const CGSize size = CGSizeMake(ceil(frame.layoutBounds.size.width),
+                                 ceil(frame.layoutBounds.size.height));
+  const CGImageRef image = stu_createCGImage(size, 2, UIColor.whiteColor.CGColor,
+                                             stuCGImageFormat(STUPredefinedCGImageFormatGrayscale,
+                                                              STUCGImageFormatWithoutAlphaChannel),
+                                             ^(CGContextRef context) {
+                                               UIGraphicsPushContext(context);
+                                               [frame drawAtPoint:CGPointZero];
+                                               UIGraphicsPopContext();
+                                             });
+  NSData* const data = (__bridge_transfer NSData*)
+                         CGDataProviderCopyData(CGImageGetDataProvider(image));
+  CFRelease(image);
+  return data;
+}
+
+@interface DecorationLinesTests : XCTestCase
+@end
+@implementation DecorationLinesTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+- (void)testGlyphLineIntersectionCache {
+  clearGlyphLineIntersectionCache();
+  NSData* const uncached16 = renderUnderlinedText(16);
+  const GlyphLineIntersectionCacheStatistics stats1 = glyphLineIntersectionCacheStatistics();
+  XCTAssertEqual(stats1.hitCount, 0u);
+  XCTAssertGreaterThan(stats1.missCount, 0u);
+  XCTAssertGreaterThan(stats1.entryCount, 0);
+
+  NSData* const cached16 = renderUnderlinedText(16);
+  const GlyphLineIntersectionCacheStatistics stats2 = glyphLineIntersectionCacheStatistics();
+  XCTAssertGreaterThan(stats2.hitCount, 0u);
+  XCTAssertEqual(stats2.missCount, stats1.missCount);
+  XCTAssertEqualObjects(cached16, uncached16);
+
+  // A different size of the same font must not reuse the entries, since the stripe margin
+  // doesn't scale with the font size.
+  NSData* const uncached32 = renderUnderlinedText(32);
+  const GlyphLineIntersectionCacheStatistics stats3 = glyphLineIntersectionCacheStatistics();
+  XCTAssertEqual(stats3.hitCount, stats2.hitCount);
+  XCTAssertGreaterThan(stats3.entryCount, stats2.entryCount);
+
+  XCTAssertEqualObjects(renderUnderlinedText(32), uncached32);
+  XCTAssertEqualObjects(renderUnderlinedText(16), uncached16);
+
+  clearGlyphLineIntersectionCache();
+  XCTAssertEqual(glyphLineIntersectionCacheStatistics().entryCount, 0);
+  XCTAssertEqualObjects(renderUnderlinedText(32), uncached32);
+}
+
+@end
@@ -0,0 +1,98 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TestUtils.h"
+
+#import "GlyphPathIntersectionBounds.hpp"
+#import "SegmentStripeIntersection.hpp"
+
+#import <random>
+
+using namespace stu_label;
+
+@interface GlyphPathIntersectionBoundsTests : XCTestCase
+@end
+@implementation GlyphPathIntersectionBoundsTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+/// Returns whether `r1` is empty or contained in `r2` outset by `d`.
+static bool isContainedIn(Range<CGFloat> r1, Range<CGFloat> r2, CGFloat d) {
+  if (r1.start > r1.end) return true;
+  return r2.start - d <= r1.start && r1.end <= r2.end + d;
+}
+
+- (void)testSingleSegments {
+  const auto bounds = [](const StripeIntersectionSegment& segment, Range<Float64> y) {
+    return findXBoundsOfSegmentsWithinHorizontalStripes(&segment, 1, y, y).lower;
+  };
+  const auto isEmpty = [](Range<Float64> r) { return r.start > r.end; };
+  // A line crossing the stripe.
+  XCTAssert(bounds(StripeIntersectionSegment::line(0, 0, 4, 4), {1, 2}) == Range<Float64>(1, 2));
+  // A line ending within the stripe.
+  const Range<Float64> l1 = bounds(StripeIntersectionSegment::line(0, 0, 4, 1.5), {1, 2});
+  XCTAssertEqualWithAccuracy(l1.start, 4/1.5, 1e-12);
+  XCTAssertEqual(l1.end, 4);
+  // A horizontal line within the stripe.
+  XCTAssert(bounds(StripeIntersectionSegment::line(-1, 1.5, 3, 1.5), {1, 2})
+            == Range<Float64>(-1, 3));
+  // A line outside the stripe.
+  XCTAssert(isEmpty(bounds(StripeIntersectionSegment::line(0, 3, 4, 5), {1, 2})));
+
+  // The parabola y = (2t - 1)^2, x = 2t - 1, whose vertex is at (0, 0).
+  const auto parabola = StripeIntersectionSegment::quadraticCurve(-1, 1, 0, -1, 1, 1);
+  const Range<Float64> p1 = bounds(parabola, {-0.5, 0.25});
+  XCTAssertEqualWithAccuracy(p1.start, -0.5, 1e-12);
+  XCTAssertEqualWithAccuracy(p1.end, 0.5, 1e-12);
+  XCTAssert(isEmpty(bounds(parabola, {-1, -0.01})));
+
+  // A cubic curve with an x-extremum within the stripe: x = 12t(1 - t)^2, y = t.
+  const auto cubic = StripeIntersectionSegment::cubicCurve(0, 0, 4, 1/3., 0, 2/3., 0, 1);
+  const Range<Float64> c1 = bounds(cubic, {0.2, 0.5});
+  XCTAssertEqualWithAccuracy(c1.start, 12*0.5*0.25, 1e-12);
+  XCTAssertEqualWithAccuracy(c1.end, 12*(1/3.)*(4/9.), 1e-12);
+}
+
+- (void)testAgreementWithFlatteningImplementation {
+  UIFont* const font = [UIFont fontWithName:@"Georgia-Italic" size:32];
+  NSString* const string = @"gjpqy@§&Qß";
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<CGFloat> yDistribution(-10, 5);
+  const CGFloat e = 1/64.f;
+  const auto flattened = [&](CGPathRef path, Range<CGFloat> y, CGFloat d) {
+    const Range<CGFloat> y1 = {y.start - d, y.end + d};
+    return findXBoundsOfPathIntersectionWithHorizontalLinesUsingFlattening(path, y1, y1, e).lower;
+  };
+  for (NSUInteger i = 0; i < string.length; ++i) {
+    const unichar ch = [string characterAtIndex:i];
+    CGGlyph glyph;
+    XCTAssert(CTFontGetGlyphsForCharacters((__bridge CTFontRef)font, &ch, &glyph, 1));
+    const CGPathRef path = CTFontCreatePathForGlyph((__bridge CTFontRef)font, glyph, nullptr);
+    XCTAssert(path != nullptr);
+    for (int k = 0; k < 50; ++k) {
+      const CGFloat minY = yDistribution(rng);
+      const CGFloat h = (k & 1) ? 1.5f : 0.5f;
+      const Range<CGFloat> lowerY = {minY, minY + h};
+      const Range<CGFloat> upperY = (k & 2) ? Range<CGFloat>{minY + 2*h, minY + 3*h} : lowerY;
+      const LowerAndUpperInterval xis = findXBoundsOfPathIntersectionWithHorizontalLines(
+                                          path, lowerY, upperY);
+      if (!(k & 2)) {
+        XCTAssert(xis.upper.start > xis.upper.end);
+      }
+      // The points of the flattened path have a distance of at most e from the curve.
+      const auto check = [&](Range<CGFloat> xi, Range<CGFloat> y) {
+        XCTAssert(isContainedIn(xi, flattened(path, y, e), e), @"glyph: %i", glyph);
+        XCTAssert(isContainedIn(flattened(path, y, -e), xi, e), @"glyph: %i", glyph);
+      };
+      check(xis.lower, lowerY);
+      if (k & 2) {
+        check(xis.upper, upperY);
+      }
+    }
+    CFRelease(path);
+  }
+}
+
+@end
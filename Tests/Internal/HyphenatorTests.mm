@@ -0,0 +1,129 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "Hyphenation.hpp"
+
+#import "TestUtils.h"
+
+#include <algorithm>
+
+using namespace stu_label;
+
+@interface HyphenatorTests : XCTestCase
+@end
+
+@implementation HyphenatorTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+// The patterns from Liang's thesis that apply to "hyphenation".
+static NSArray<NSString*>* const hyphenationPatterns = @[@"hy3ph", @"he2n", @"hena4", @"hen5at",
+                                                         @"1na", @"n2at", @"1tio", @"2io", @"o2n"];
+
+static Vector<Int> hyphenationLocations(const Hyphenator& hyphenator, NSString* string,
+                                        Range<Int> range)
+{
+  Vector<Int> locations;
+  findHyphenationLocations(hyphenator, NSStringRef{string}, range, [&](Int index) {
+    locations.append(index);
+  });
+  return locations;
+}
+
+static Vector<Int> hyphenationLocations(const Hyphenator& hyphenator, NSString* string) {
+  return hyphenationLocations(hyphenator, string, Range<Int>{0, sign_cast(string.length)});
+}
+
+static bool equal(const Vector<Int>& vector, std::initializer_list<Int> values) {
+  return vector.count() == sign_cast(values.size())
+      && std::equal(vector.begin(), vector.end(), values.begin());
+}
+
+- (void)testPatterns {
+  const RC<Hyphenator> h = createHyphenator(hyphenationPatterns, nil);
+  XCTAssert(h);
+  XCTAssert(equal(hyphenationLocations(*h, @"hyphenation"), {2, 6}));
+  XCTAssert(equal(hyphenationLocations(*h, @"Hyphenation"), {2, 6}));
+  XCTAssert(equal(hyphenationLocations(*h, @"HYPHENATION, hyphenation."), {2, 6, 15, 19}));
+  XCTAssert(equal(hyphenationLocations(*h, @"hyphen"), {2}));
+  XCTAssert(equal(hyphenationLocations(*h, @"phenyl"), {}));
+  // Words crossing the range boundaries are ignored.
+  NSString* const twoWords = @"hyphenation hyphenation";
+  XCTAssert(equal(hyphenationLocations(*h, twoWords, Range<Int>{1, 23}), {14, 18}));
+  XCTAssert(equal(hyphenationLocations(*h, twoWords, Range<Int>{0, 22}), {2, 6}));
+}
+
+static ArrayRef<const Char16> utf16(const char16_t* string) {
+  return {string, sign_cast(std::char_traits<char16_t>::length(string))};
+}
+
+static Vector<Int> hyphenateWord(const Hyphenator& hyphenator, const char16_t* word) {
+  Vector<Int> locations;
+  hyphenator.hyphenateWord(utf16(word), [&](Int index) { locations.append(index); });
+  return locations;
+}
+
+- (void)testHyphenateWord {
+  const ArrayRef<const Char16> patterns[] = {utf16(u"hy3ph"), utf16(u"he2n"), utf16(u"hena4"),
+                                             utf16(u"hen5at"), utf16(u"1na"), utf16(u"n2at"),
+                                             utf16(u"1tio"), utf16(u"2io"), utf16(u"o2n")};
+  const ArrayRef<const Char16> exceptions[] = {utf16(u"hy-phena-tion")};
+  const RC<Hyphenator> h1 = Hyphenator::create(patterns, {});
+  XCTAssert(h1);
+  XCTAssert(equal(hyphenateWord(*h1, u"hyphenation"), {2, 6}));
+  XCTAssert(equal(hyphenateWord(*h1, u"hyphen"), {2}));
+  XCTAssert(equal(hyphenateWord(*h1, u"phenyl"), {}));
+  const RC<Hyphenator> h2 = Hyphenator::create(patterns, exceptions);
+  XCTAssert(h2);
+  XCTAssert(equal(hyphenateWord(*h2, u"hyphenation"), {2, 7}));
+  XCTAssert(equal(hyphenateWord(*h2, u"hyphenations"), {2, 6}));
+  const ArrayRef<const Char16> malformedPatterns[] = {utf16(u"h12y")};
+  XCTAssert(!Hyphenator::create(malformedPatterns, {}));
+}
+
+- (void)testDuplicatePatternsAreMerged {
+  const RC<Hyphenator> h = createHyphenator([hyphenationPatterns arrayByAddingObject:@"hy2ph"],
+                                            nil);
+  XCTAssert(h);
+  XCTAssert(equal(hyphenationLocations(*h, @"hyphenation"), {2, 6}));
+}
+
+- (void)testMinPrefixAndSuffixLength {
+  const RC<Hyphenator> h1 = createHyphenator(hyphenationPatterns, nil, 3, 3);
+  XCTAssert(equal(hyphenationLocations(*h1, @"hyphenation"), {6}));
+  const RC<Hyphenator> h2 = createHyphenator(hyphenationPatterns, nil, 2, 6);
+  XCTAssert(equal(hyphenationLocations(*h2, @"hyphenation"), {2}));
+}
+
+- (void)testExceptions {
+  const RC<Hyphenator> h = createHyphenator(hyphenationPatterns, @[@"hy-phena-tion"]);
+  XCTAssert(h);
+  XCTAssert(equal(hyphenationLocations(*h, @"hyphenation"), {2, 7}));
+  XCTAssert(equal(hyphenationLocations(*h, @"Hyphenation"), {2, 7}));
+  // Exceptions only apply to whole words.
+  XCTAssert(equal(hyphenationLocations(*h, @"hyphenations"), {2, 6}));
+}
+
+- (void)testMalformedPatterns {
+  XCTAssert(!createHyphenator(@[@"h12y"], nil));
+  XCTAssert(!createHyphenator(@[@"h.y"], nil));
+  XCTAssert(!createHyphenator(@[@"1"], nil));
+  XCTAssert(!createHyphenator(@[@"hy3ph"], @[@"hy-1phen"]));
+  XCTAssert(createHyphenator(@[@" hy3ph ", @""], @[]));
+}
+
+- (void)testRegistry {
+  const RC<Hyphenator> h = createHyphenator(hyphenationPatterns, nil);
+  setHyphenatorForLocaleIdentifier(CFSTR("en"), h);
+  XCTAssert(hasRegisteredHyphenators());
+  XCTAssertEqual(hyphenatorForLocaleIdentifier(CFSTR("en")).get(), h.get());
+  XCTAssertEqual(hyphenatorForLocaleIdentifier(CFSTR("en-US")).get(), h.get());
+  XCTAssert(!hyphenatorForLocaleIdentifier(CFSTR("de")));
+  setHyphenatorForLocaleIdentifier(CFSTR("en"), nullptr);
+  XCTAssert(!hyphenatorForLocaleIdentifier(CFSTR("en-US")));
+  XCTAssert(!hasRegisteredHyphenators());
+}
+
+@end
@@ -0,0 +1,120 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "LRUCacheStorage.hpp"
+
+#import "TestUtils.h"
+
+using namespace stu_label;
+
+namespace {
+
+struct TestEntry {
+  Int key;
+  HashCode<UInt64> hashCode;
+  UInt64 lastUse;
+  UInt cost;
+  Int* releaseCount;
+
+  void release() { *releaseCount += 1; }
+};
+
+using TestStorage = LRUCacheStorage<TestEntry>;
+
+bool insert(TestStorage& storage, Int key, UInt cost, UInt budget, Int& releaseCount) {
+  return storage.insert(hash(static_cast<UInt64>(key)), cost, budget,
+                        [&](const TestEntry& entry) { return entry.key == key; },
+                        [&]() { return TestEntry{.key = key, .releaseCount = &releaseCount}; });
+}
+
+bool contains(TestStorage& storage, Int key) {
+  return storage.find(hash(static_cast<UInt64>(key)),
+                      [&](const TestEntry& entry) { return entry.key == key; }) != nullptr;
+}
+
+} // namespace
+
+@interface LRUCacheStorageTests : XCTestCase
+@end
+@implementation LRUCacheStorageTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+- (void)testInsertAndFind {
+  Int releaseCount = 0;
+  TestStorage storage{8};
+  XCTAssert(insert(storage, 1, 10, 100, releaseCount));
+  XCTAssert(insert(storage, 2, 20, 100, releaseCount));
+  XCTAssertFalse(insert(storage, 1, 10, 100, releaseCount));
+  XCTAssertEqual(storage.count(), 2);
+  XCTAssertEqual(storage.memoryUsage(), 30u);
+  XCTAssert(contains(storage, 1));
+  XCTAssert(contains(storage, 2));
+  XCTAssertFalse(contains(storage, 3));
+  storage.clear();
+  XCTAssertEqual(storage.count(), 0);
+  XCTAssertEqual(storage.memoryUsage(), 0u);
+  XCTAssertEqual(releaseCount, 2);
+}
+
+- (void)testBudgetEvictsOnlyLeastRecentlyUsedEntries {
+  Int releaseCount = 0;
+  TestStorage storage{8};
+  for (Int i = 0; i < 10; ++i) {
+    XCTAssert(insert(storage, i, 10, 100, releaseCount));
+  }
+  XCTAssertEqual(releaseCount, 0);
+  // Mark the oldest entries as recently used.
+  XCTAssert(contains(storage, 0));
+  XCTAssert(contains(storage, 1));
+  // Exceeding the budget evicts entries until the usage is at most 3/4 of the budget.
+  XCTAssert(insert(storage, 10, 10, 100, releaseCount));
+  XCTAssertEqual(storage.memoryUsage(), 70u);
+  XCTAssertEqual(releaseCount, 4);
+  for (Int i = 2; i < 6; ++i) {
+    XCTAssertFalse(contains(storage, i));
+  }
+  for (const Int i : {0, 1, 6, 7, 8, 9, 10}) {
+    XCTAssert(contains(storage, i));
+  }
+}
+
+- (void)testEntryCountLimitEvictsOnlyLeastRecentlyUsedEntries {
+  Int releaseCount = 0;
+  TestStorage storage{8};
+  const Int n = TestStorage::maxEntryCount;
+  for (Int i = 0; i < n; ++i) {
+    XCTAssert(insert(storage, i, 1, maxValue<UInt>, releaseCount));
+  }
+  XCTAssertEqual(storage.count(), n);
+  XCTAssert(contains(storage, 0));
+  XCTAssert(insert(storage, n, 1, maxValue<UInt>, releaseCount));
+  const Int evictedCount = n/8;
+  XCTAssertEqual(releaseCount, evictedCount);
+  XCTAssertEqual(storage.count(), n - evictedCount + 1);
+  XCTAssert(contains(storage, 0));
+  XCTAssert(contains(storage, n));
+  XCTAssertFalse(contains(storage, 1));
+  XCTAssertFalse(contains(storage, evictedCount));
+  XCTAssert(contains(storage, evictedCount + 1));
+  XCTAssert(contains(storage, n - 1));
+}
+
+- (void)testEvict {
+  Int releaseCount = 0;
+  TestStorage storage{8};
+  for (Int i = 0; i < 4; ++i) {
+    XCTAssert(insert(storage, i, 10, 100, releaseCount));
+  }
+  storage.evict(25);
+  XCTAssertEqual(storage.count(), 2);
+  XCTAssert(contains(storage, 2));
+  XCTAssert(contains(storage, 3));
+  storage.evict(0);
+  XCTAssertEqual(storage.count(), 0);
+  XCTAssertEqual(releaseCount, 4);
+}
+
+@end
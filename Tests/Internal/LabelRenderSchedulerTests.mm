@@ -0,0 +1,114 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "LabelRenderScheduler.hpp"
+
+#import "stu/Vector.hpp"
+
+#import "TestUtils.h"
+
+using namespace stu;
+using namespace stu_label;
+
+namespace {
+
+struct BlockingTask {
+  LabelRenderScheduler::TaskHandle handle;
+  dispatch_semaphore_t started;
+  dispatch_semaphore_t canFinish;
+
+  static void run(void* task) {
+    BlockingTask& self = *static_cast<BlockingTask*>(task);
+    dispatch_semaphore_signal(self.started);
+    dispatch_semaphore_wait(self.canFinish, DISPATCH_TIME_FOREVER);
+  }
+};
+
+struct RecordingTask {
+  LabelRenderScheduler::TaskHandle handle;
+  Int id;
+  Vector<Int>* runOrder;
+  dispatch_semaphore_t finished;
+
+  static void run(void* task) {
+    RecordingTask& self = *static_cast<RecordingTask*>(task);
+    self.runOrder->append(self.id);
+    dispatch_semaphore_signal(self.finished);
+  }
+};
+
+} // namespace
+
+@interface LabelRenderSchedulerTests : XCTestCase
+@end
+@implementation LabelRenderSchedulerTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+- (void)testDeadlineOrderRemovalAndDeadlineUpdates {
+  // We occupy all workers with blocking tasks, so that the recording tasks stay pending until we
+  // let a single worker run them one after the other.
+  const Int workerCount = LabelRenderScheduler::maxWorkerCount();
+  const dispatch_semaphore_t started = dispatch_semaphore_create(0);
+  Vector<BlockingTask> blockingTasks;
+  for (Int i = 0; i < workerCount; ++i) {
+    blockingTasks.append(BlockingTask{.started = started,
+                                      .canFinish = dispatch_semaphore_create(0)});
+  }
+  for (BlockingTask& task : blockingTasks) {
+    LabelRenderScheduler::dispatchAsync(task.handle, &task, BlockingTask::run, 0);
+  }
+  for (Int i = 0; i < workerCount; ++i) {
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+  }
+
+  Vector<Int> runOrder;
+  const dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+  const CFTimeInterval deadlines[] = {3, 1, 2, 4, 3, 5};
+  const Int taskCount = arrayLength(deadlines);
+  Vector<RecordingTask> tasks;
+  for (Int i = 0; i < taskCount; ++i) {
+    tasks.append(RecordingTask{.id = i, .runOrder = &runOrder, .finished = finished});
+  }
+  for (Int i = 0; i < taskCount; ++i) {
+    LabelRenderScheduler::dispatchAsync(tasks[i].handle, &tasks[i], RecordingTask::run,
+                                        deadlines[i]);
+  }
+  XCTAssert(LabelRenderScheduler::tryRemovePendingTask(tasks[2].handle));
+  XCTAssertFalse(LabelRenderScheduler::tryRemovePendingTask(tasks[2].handle));
+  XCTAssertFalse(LabelRenderScheduler::tryUpdatePendingTaskDeadline(tasks[2].handle, 0));
+  XCTAssert(LabelRenderScheduler::tryUpdatePendingTaskDeadline(tasks[3].handle, 0.5));
+  XCTAssert(LabelRenderScheduler::tryUpdatePendingTaskDeadline(tasks[1].handle, 6));
+
+  dispatch_semaphore_signal(blockingTasks[0].canFinish);
+  for (Int i = 0; i < taskCount - 1; ++i) {
+    dispatch_semaphore_wait(finished, DISPATCH_TIME_FOREVER);
+  }
+  for (Int i = 1; i < workerCount; ++i) {
+    dispatch_semaphore_signal(blockingTasks[i].canFinish);
+  }
+
+  // Tasks with equal deadlines run in the order in which they were dispatched.
+  const Int expectedOrder[] = {3, 0, 4, 5, 1};
+  XCTAssertEqual(runOrder.count(), arrayLength(expectedOrder));
+  for (Int i = 0; i < runOrder.count(); ++i) {
+    XCTAssertEqual(runOrder[i], expectedOrder[i]);
+  }
+  for (RecordingTask& task : tasks) {
+    XCTAssertEqual(task.handle.queueIndex, -1);
+    XCTAssertFalse(LabelRenderScheduler::tryRemovePendingTask(task.handle));
+  }
+}
+
+- (void)testDeadline {
+  const CFTimeInterval frame = LabelRenderScheduler::frameDuration;
+  XCTAssertEqual(LabelRenderScheduler::deadline(10, 0, 500), 10 + frame);
+  XCTAssertGreaterThan(LabelRenderScheduler::deadline(10, 100, 500),
+                       LabelRenderScheduler::deadline(10, 50, 500));
+  XCTAssertGreaterThan(LabelRenderScheduler::deadline(10, infinity<CGFloat>, 0),
+                       LabelRenderScheduler::deadline(10, 500, 500));
+}
+
+@end
@@ -0,0 +1,123 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TestUtils.h"
+
+#import "PurgeableImage.hpp"
+
+using namespace stu_label;
+
+@interface PurgeableImageTests : XCTestCase
+@end
+@implementation PurgeableImageTests {
+  UInt _oldBudget;
+}
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+  _oldBudget = PurgeableImageBufferPool::memoryBudget();
+  PurgeableImageBufferPool::setMemoryBudget(1 << 20);
+  PurgeableImageBufferPool::clear();
+}
+
+- (void)tearDown {
+  PurgeableImageBufferPool::setMemoryBudget(_oldBudget);
+  [super tearDown];
+}
+
+static PurgeableImage createImage(SizeInPixels<UInt32> size, CGColorRef backgroundColor,
+                                  CGColorRef fillColor)
+{
+  return PurgeableImage{size, 1, backgroundColor, STUPredefinedCGImageFormatRGB,
+                        STUCGImageFormatOptionsNone, [&](CGContext* context) {
+                          if (!fillColor) return;
+                          CGContextSetFillColorWithColor(context, fillColor);
+                          CGContextFillRect(context, CGRect{{0, 0}, {10, 10}});
+                        }};
+}
+
+static UInt32 pixelAt(CGImageRef image, size_t x, size_t y) {
+  NSData* const data = (__bridge_transfer NSData*)CGDataProviderCopyData(
+                                                    CGImageGetDataProvider(image));
+  UInt32 pixel;
+  memcpy(&pixel, (const Byte*)data.bytes + y*CGImageGetBytesPerRow(image) + 4*x, sizeof(pixel));
+  return pixel;
+}
+
+static UInt32 firstPixel(CGImageRef image) {
+  return pixelAt(image, 0, 0);
+}
+
+- (void)testBufferReuse {
+  const SizeInPixels<UInt32> size{100, 80};
+  {
+    PurgeableImage image = createImage(size, nil, UIColor.redColor.CGColor);
+    const RC<CGImage> cgImage = image.createCGImage();
+    XCTAssert(cgImage);
+    XCTAssertNotEqual(firstPixel(cgImage.get()), 0);
+    image = PurgeableImage();
+    // The CGImage still references the buffer.
+    XCTAssertEqual(PurgeableImageBufferPool::statistics().bufferCount, 0);
+  }
+  PurgeableImageBufferPool::Statistics stats = PurgeableImageBufferPool::statistics();
+  XCTAssertEqual(stats.requestCount, 1);
+  XCTAssertEqual(stats.reuseCount, 0);
+  XCTAssertEqual(stats.bufferCount, 1);
+  XCTAssertGreaterThanOrEqual(stats.memoryUsage, 100*80*4);
+
+  {
+    // A slightly smaller image falls into the same size class.
+    PurgeableImage image = createImage(SizeInPixels<UInt32>{100, 79}, nil, nil);
+    stats = PurgeableImageBufferPool::statistics();
+    XCTAssertEqual(stats.requestCount, 2);
+    XCTAssertEqual(stats.reuseCount + stats.purgedCount, 1);
+    XCTAssertEqual(stats.bufferCount, 0);
+    // The reused buffer must have been cleared.
+    const RC<CGImage> cgImage = image.createCGImage();
+    XCTAssertEqual(firstPixel(cgImage.get()), 0);
+  }
+  XCTAssertEqual(PurgeableImageBufferPool::statistics().bufferCount, 1);
+
+  {
+    // Images with a size in a different size class don't reuse the buffer.
+    PurgeableImage image = createImage(SizeInPixels<UInt32>{200, 200}, nil, nil);
+    stats = PurgeableImageBufferPool::statistics();
+    XCTAssertEqual(stats.requestCount, 3);
+    XCTAssertEqual(stats.bufferCount, 1);
+  }
+  XCTAssertEqual(PurgeableImageBufferPool::statistics().bufferCount, 2);
+
+  PurgeableImageBufferPool::setMemoryBudget(0);
+  XCTAssertEqual(PurgeableImageBufferPool::statistics().bufferCount, 0);
+  { PurgeableImage image = createImage(size, nil, nil); }
+  XCTAssertEqual(PurgeableImageBufferPool::statistics().bufferCount, 0);
+}
+
+- (void)testCopyWithRedrawnRect {
+  PurgeableImage image = createImage(SizeInPixels<UInt32>{20, 20}, nil, UIColor.redColor.CGColor);
+  const RC<CGImage> cgImage = image.createCGImage();
+  const UInt32 red = pixelAt(cgImage.get(), 0, 0);
+  XCTAssertNotEqual(red, 0);
+  XCTAssertEqual(pixelAt(cgImage.get(), 15, 15), 0);
+
+  PurgeableImage copy = image.copyWithRedrawnRect(CGRect{{0, 0}, {5, 5}}, 1, nil,
+                                                  [&](CGContext* context) {
+                                                    // The context is clipped to the rect.
+                                                    CGContextSetFillColorWithColor(
+                                                      context, UIColor.blueColor.CGColor);
+                                                    CGContextFillRect(context,
+                                                                      CGRect{{3, 3}, {17, 17}});
+                                                  });
+  XCTAssert(copy);
+  const RC<CGImage> cgCopy = copy.createCGImage();
+  const UInt32 blue = pixelAt(cgCopy.get(), 4, 4);
+  XCTAssertNotEqual(blue, red);
+  XCTAssertNotEqual(blue, 0);
+  XCTAssertEqual(pixelAt(cgCopy.get(), 0, 0), 0);
+  XCTAssertEqual(pixelAt(cgCopy.get(), 7, 7), red);
+  XCTAssertEqual(pixelAt(cgCopy.get(), 15, 15), 0);
+  // The original image is not modified.
+  XCTAssertEqual(pixelAt(image.createCGImage().get(), 0, 0), red);
+}
+
+@end
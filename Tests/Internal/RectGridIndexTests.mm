@@ -0,0 +1,114 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "RectGridIndex.hpp"
+
+#import "TestUtils.h"
+
+#import <random>
+
+using namespace stu;
+using namespace stu_label;
+
+using TaggedRect = RectGridIndex::TaggedRect;
+
+@interface RectGridIndexTests : XCTestCase
+@end
+
+@implementation RectGridIndexTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+static RectGridIndex::TagAndDistance findRectClosestToUsingLinearSearch(
+                                       ArrayRef<const TaggedRect> rects,
+                                       Point<Float64> point, Float64 maxDistance)
+{
+  RectGridIndex::TagAndDistance result = {.tag = -1, .distance = maxDistance};
+  Float64 minSquaredDistance = infinity<Float64>;
+  for (const TaggedRect& r : rects) {
+    const Float64 squaredDistance = r.rect.squaredDistanceTo(point);
+    if (squaredDistance > maxDistance*maxDistance) continue;
+    if (squaredDistance < minSquaredDistance
+        || (squaredDistance == minSquaredDistance && r.tag < result.tag))
+    {
+      minSquaredDistance = squaredDistance;
+      result.tag = r.tag;
+    }
+  }
+  if (result.tag >= 0) {
+    result.distance = sqrt(minSquaredDistance);
+  }
+  return result;
+}
+
+static TaggedRect taggedRect(Float64 x0, Float64 x1, Float64 y0, Float64 y1, Int32 tag) {
+  return {.rect = {Range{x0, x1}, Range{y0, y1}}, .tag = tag};
+}
+
+- (void)testEmptyIndex {
+  const RectGridIndex index{ArrayRef<const TaggedRect>{}};
+  XCTAssertEqual(index.findRectClosestTo({0, 0}, infinity<Float64>).tag, -1);
+}
+
+- (void)testSimpleCases {
+  const TaggedRect rects[] = {taggedRect(0, 10, 0, 10, 0),
+                              taggedRect(20, 30, 0, 10, 1),
+                              taggedRect(0, 10, 20, 30, 2),
+                              // A rect with the same geometry and a smaller tag than its neighbour.
+                              taggedRect(20, 30, 20, 30, 4),
+                              taggedRect(20, 30, 20, 30, 3)};
+  const RectGridIndex index{rects};
+  XCTAssertEqual(index.findRectClosestTo({5, 5}, 0).tag, 0);
+  XCTAssertEqual(index.findRectClosestTo({5, 5}, 0).distance, 0);
+  XCTAssertEqual(index.findRectClosestTo({16, 5}, 10).tag, 1);
+  XCTAssertEqual(index.findRectClosestTo({16, 5}, 10).distance, 4);
+  XCTAssertEqual(index.findRectClosestTo({15, 5}, 10).tag, 0);
+  XCTAssertEqual(index.findRectClosestTo({25, 25}, 10).tag, 3);
+  XCTAssertEqual(index.findRectClosestTo({-3, -4}, 5).tag, 0);
+  XCTAssertEqual(index.findRectClosestTo({-3, -4}, 5).distance, 5);
+  XCTAssertEqual(index.findRectClosestTo({-3, -4}, 4.9).tag, -1);
+  XCTAssertEqual(index.findRectClosestTo({100, 100}, infinity<Float64>).tag, 3);
+  XCTAssertEqual(index.findRectClosestTo({5, 5}, -1).tag, -1);
+}
+
+- (void)testDegenerateBounds {
+  const TaggedRect horizontalLine[] = {taggedRect(0, 10, 5, 5, 0), taggedRect(20, 30, 5, 5, 1)};
+  const RectGridIndex index1{horizontalLine};
+  XCTAssertEqual(index1.rowCount(), 1);
+  XCTAssertEqual(index1.findRectClosestTo({16, 0}, 10).tag, 1);
+  const TaggedRect point[] = {taggedRect(1, 1, 1, 1, 7)};
+  const RectGridIndex index2{point};
+  XCTAssertEqual(index2.columnCount(), 1);
+  XCTAssertEqual(index2.findRectClosestTo({4, 5}, 5).tag, 7);
+  XCTAssertEqual(index2.findRectClosestTo({4, 5}, 5).distance, 5);
+}
+
+- (void)testRandomRects {
+  std::mt19937 rng{123};
+  std::uniform_real_distribution<Float64> coordinate{0, 300};
+  std::uniform_real_distribution<Float64> extent{0, 40};
+  for (const Int n : {1, 2, 10, 100, 1000}) {
+    Vector<TaggedRect> rects;
+    for (Int i = 0; i < n; ++i) {
+      const Float64 x = coordinate(rng);
+      const Float64 y = coordinate(rng);
+      // Pairs of rects share the same tag, like the rects of a multi-line link.
+      rects.append(taggedRect(x, x + extent(rng), y, y + extent(rng)/2, narrow_cast<Int32>(i/2)));
+    }
+    const RectGridIndex index{rects};
+    XCTAssert(index.columnCount()*index.rowCount() <= n + 2*RectGridIndex::maxGridDimension + 1);
+    for (Int i = 0; i < 200; ++i) {
+      const Point<Float64> point{coordinate(rng)*1.5 - 75, coordinate(rng)*1.5 - 75};
+      for (const Float64 maxDistance : {0., 5., 50., infinity<Float64>}) {
+        const auto expected = findRectClosestToUsingLinearSearch(rects, point, maxDistance);
+        const auto actual = index.findRectClosestTo(point, maxDistance);
+        XCTAssertEqual(actual.tag, expected.tag);
+        XCTAssertEqual(actual.distance, expected.distance);
+      }
+    }
+  }
+}
+
+@end
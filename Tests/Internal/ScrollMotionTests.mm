@@ -0,0 +1,90 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "ScrollMotion.hpp"
+
+#import "TestUtils.h"
+
+using namespace stu;
+using namespace stu_label;
+
+@interface ScrollMotionTests : XCTestCase
+@end
+@implementation ScrollMotionTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+- (void)testAxisMotionTracksConstantAcceleration {
+  const Float64 dt = 1/60.;
+  const Float64 v0 = 2000;
+  const Float64 a = -3000;
+  const auto position = [&](Float64 t) { return v0*t + a*t*t/2; };
+  AxisMotion motion{.position = position(0)};
+  for (Int i = 1; i <= 40; ++i) {
+    motion.update(position(i*dt), dt, i > 1);
+  }
+  const Float64 t = 40*dt;
+  XCTAssertEqual(motion.position, position(t));
+  XCTAssertEqualWithAccuracy(motion.velocity, v0 + a*t, 0.1);
+  XCTAssertEqualWithAccuracy(motion.acceleration, a, 1);
+}
+
+- (void)testAxisMotionFirstUpdateOnlyEstimatesVelocity {
+  AxisMotion motion{.position = 100};
+  motion.update(110, 0.02, false);
+  XCTAssertEqual(motion.position, 110);
+  XCTAssertEqual(motion.velocity, 500);
+  XCTAssertEqual(motion.acceleration, 0);
+}
+
+- (void)testPredictedDisplacement {
+  AxisMotion motion{.velocity = 100, .acceleration = 200};
+  XCTAssertEqualWithAccuracy(motion.predictedDisplacement(0.5), 75, 1e-12);
+  motion.acceleration = -100;
+  XCTAssertEqualWithAccuracy(motion.predictedDisplacement(0.5), 37.5, 1e-12);
+  // A decelerating motion stops instead of reversing its direction.
+  motion.acceleration = -1000;
+  XCTAssertEqualWithAccuracy(motion.predictedDisplacement(0.5), 5, 1e-12);
+  motion = AxisMotion{.velocity = -100, .acceleration = 1000};
+  XCTAssertEqualWithAccuracy(motion.predictedDisplacement(0.5), -5, 1e-12);
+}
+
+- (void)testScrollMotionSampling {
+  ScrollMotion motion{};
+  XCTAssertFalse(motion.hasSample);
+  motion.addSample(Point{0., 0.}, 1);
+  XCTAssert(motion.hasSample);
+  XCTAssertFalse(motion.hasVelocity);
+
+  // Samples closer together than minSampleInterval are ignored.
+  motion.addSample(Point{1., 2.}, 1 + ScrollMotion::minSampleInterval/2);
+  XCTAssertFalse(motion.hasVelocity);
+  XCTAssertEqual(motion.timestamp, 1);
+
+  motion.addSample(Point{10., -20.}, 1.02);
+  XCTAssert(motion.hasVelocity);
+  XCTAssertEqualWithAccuracy(motion.x.velocity, 500, 1e-9);
+  XCTAssertEqualWithAccuracy(motion.y.velocity, -1000, 1e-9);
+  XCTAssertEqual(motion.timestamp, 1.02);
+
+  // A sample after a pause starts a new motion.
+  motion.addSample(Point{50., 50.}, 1.02 + 2*ScrollMotion::maxSampleInterval);
+  XCTAssert(motion.hasSample);
+  XCTAssertFalse(motion.hasVelocity);
+  XCTAssertEqual(motion.x.position, 50);
+  XCTAssertEqual(motion.y.position, 50);
+
+  motion.addSample(Point{60., 50.}, 1.02 + 2*ScrollMotion::maxSampleInterval + 0.02);
+  XCTAssert(motion.hasVelocity);
+  motion.reset();
+  XCTAssertFalse(motion.hasSample);
+  XCTAssertFalse(motion.hasVelocity);
+  // After a reset the next sample starts a new motion even if it follows closely.
+  motion.addSample(Point{70., 50.}, motion.timestamp + 0.02);
+  XCTAssertFalse(motion.hasVelocity);
+  XCTAssertEqual(motion.x.position, 70);
+}
+
+@end
@@ -0,0 +1,216 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TextFrameGlyphStorage.hpp"
+
+#import "TextFrame.hpp"
+
+#import "TestUtils.h"
+
+using namespace stu;
+using namespace stu_label;
+
+@interface TextFrameGlyphStorageTests : XCTestCase
+@end
+
+@implementation TextFrameGlyphStorageTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+static bool equal(Range<Int> range, Int start, Int end) {
+  return range.start == start && range.end == end;
+}
+
+- (void)testStringRangeOfGlyphsInRun {
+  // A left-to-right run where the second and third glyph belong to the same cluster.
+  const Int ltr[] = {0, 1, 1, 3};
+  XCTAssert(equal(stringRangeOfGlyphsInRun(ltr, 4, 5, false, false, {0, 1}), 0, 1));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(ltr, 4, 5, false, false, {1, 2}), 1, 3));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(ltr, 4, 5, false, false, {2, 3}), 1, 3));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(ltr, 4, 5, false, false, {3, 4}), 3, 5));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(ltr, 4, 5, false, false, {0, 4}), 0, 5));
+
+  // The glyphs of a right-to-left run are stored in visual order.
+  const Int rtl[] = {4, 2, 2, 0};
+  XCTAssert(equal(stringRangeOfGlyphsInRun(rtl, 4, 6, true, false, {0, 1}), 4, 6));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(rtl, 4, 6, true, false, {2, 3}), 2, 4));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(rtl, 4, 6, true, false, {3, 4}), 0, 2));
+
+  const Int nonMonotonic[] = {0, 3, 1, 2};
+  XCTAssert(equal(stringRangeOfGlyphsInRun(nonMonotonic, 4, 4, false, true, {0, 1}), 0, 1));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(nonMonotonic, 4, 4, false, true, {1, 2}), 3, 4));
+  XCTAssert(equal(stringRangeOfGlyphsInRun(nonMonotonic, 4, 4, false, true, {1, 3}), 1, 2));
+}
+
+- (void)testStorage {
+  const CGGlyph glyphs[] = {1, 2, 3, 4};
+  const CGPoint positions[] = {{0, 0}, {1, 0}, {3, 0}, {6, 0}};
+  const CGSize advances[] = {{1, 0}, {2, 0}, {3, 0}, {4, 0}};
+  // A negative advance, as e.g. produced by a mark glyph in a RTL run.
+  const CGSize rtlAdvances[] = {{2, 0}, {-1, 0}, {2, 0}};
+  const Int ltrIndices[] = {0, 1, 1, 3};
+  const Int rtlIndices[] = {4, 2, 2};
+
+  const TextFrameGlyphStorage::Counts counts = {.lineCount = 3, .runCount = 4,
+                                                .glyphCount = 4 + 3 + 4 + 1};
+  void* const memory = malloc(TextFrameGlyphStorage::sizeInBytes(counts));
+  TextFrameGlyphStorage::Builder builder{counts, static_cast<Byte*>(memory)};
+  builder.addRun({.textMatrix = CGAffineTransformIdentity, .stringRange = {0, 5},
+                  .typographicWidth = 10, .glyphs = glyphs, .positions = positions,
+                  .advances = advances, .stringIndices = ltrIndices});
+  builder.addRun({.textMatrix = CGAffineTransformIdentity, .status = kCTRunStatusRightToLeft,
+                  .stringRange = {0, 6}, .typographicWidth = 3,
+                  .glyphs = ArrayRef{glyphs, 3}, .positions = ArrayRef{positions, 3},
+                  .advances = rtlAdvances, .stringIndices = rtlIndices});
+  builder.endLine();
+  builder.endLine();
+  // The typographic width is less than the sum of the advances.
+  builder.addRun({.textMatrix = CGAffineTransformIdentity, .stringRange = {20, 25},
+                  .typographicWidth = 9, .glyphs = glyphs, .positions = positions,
+                  .advances = advances, .stringIndices = ltrIndices});
+  builder.startTokenRuns();
+  builder.addRun({.textMatrix = CGAffineTransformIdentity, .stringRange = {0, 1},
+                  .typographicWidth = 5, .glyphs = ArrayRef{glyphs, 1},
+                  .positions = ArrayRef{positions, 1}, .advances = ArrayRef{advances, 1},
+                  .stringIndices = ArrayRef{ltrIndices, 1}});
+  builder.endLine();
+  const TextFrameGlyphStorage& storage = builder.storage();
+
+  XCTAssertEqual(storage.runs().count(), 4);
+  XCTAssertEqual(storage.nonTokenRuns(0).count(), 2);
+  XCTAssertEqual(storage.tokenRuns(0).count(), 0);
+  XCTAssertEqual(storage.nonTokenRuns(1).count(), 0);
+  XCTAssertEqual(storage.tokenRuns(1).count(), 0);
+  XCTAssertEqual(storage.nonTokenRuns(2).count(), 1);
+  XCTAssertEqual(storage.tokenRuns(2).count(), 1);
+
+  const StoredGlyphRun& r1 = storage.nonTokenRuns(0)[0];
+  const StoredGlyphRun& r2 = storage.nonTokenRuns(0)[1];
+  const StoredGlyphRun& r3 = storage.nonTokenRuns(2)[0];
+  const StoredGlyphRun& token = storage.tokenRuns(2)[0];
+  XCTAssertEqual(r1.glyphCount, 4);
+  XCTAssertEqual(r2.glyphCount, 3);
+  XCTAssertEqual(token.glyphCount, 1);
+  XCTAssertEqual(r2.glyphs[2], 3);
+  XCTAssertEqual(r3.positions[3].x, 6);
+  XCTAssertEqual(r2.stringIndices[0], 4);
+
+  const Float64 r1Offsets[] = {0, 1, 3, 6, 10};
+  const Float64 r2Offsets[] = {0, 2, 2, 3};
+  const Float64 r3Offsets[] = {0, 1, 3, 6, 9};
+  for (Int i = 0; i < 5; ++i) {
+    XCTAssertEqual(r1.glyphXOffsets[i], r1Offsets[i]);
+    XCTAssertEqual(r3.glyphXOffsets[i], r3Offsets[i]);
+  }
+  for (Int i = 0; i < 4; ++i) {
+    XCTAssertEqual(r2.glyphXOffsets[i], r2Offsets[i]);
+  }
+  XCTAssertEqual(token.glyphXOffsets[1], 5);
+
+  const GlyphRunRef run1{r1};
+  const GlyphRunRef run2{r2};
+  XCTAssertEqual(run1.count(), 4);
+  XCTAssertEqual(run1.typographicWidth(), 10);
+  XCTAssert(run2.isRightToLeft());
+  XCTAssertEqual(GlyphSpan(run1, {1, 3}, unchecked).typographicWidth(), 5);
+  XCTAssertEqual(GlyphSpan(run1, {1, 3}, unchecked)[1], 3);
+  XCTAssert(equal(GlyphSpan(run1, {1, 2}, unchecked).stringRange(), 1, 3));
+  XCTAssert(equal(GlyphSpan(run1, {3, 4}, unchecked).stringRange(), 3, 5));
+  XCTAssert(equal(GlyphSpan(run2, {0, 1}, unchecked).stringRange(), 4, 6));
+  XCTAssert(equal(GlyphSpan(run2, {2, 3}, unchecked).stringRange(), 2, 4));
+
+  Float64 glyphXOffset;
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {0, 4}, 10, 9,
+                                                            Out{glyphXOffset}), 0);
+  XCTAssertEqual(glyphXOffset, 10);
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {0, 4}, 10, 11,
+                                                            Out{glyphXOffset}), 1);
+  XCTAssertEqual(glyphXOffset, 11);
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {0, 4}, 10, 15.5,
+                                                            Out{glyphXOffset}), 2);
+  XCTAssertEqual(glyphXOffset, 13);
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {0, 4}, 10, 100,
+                                                            Out{glyphXOffset}), 3);
+  XCTAssertEqual(glyphXOffset, 16);
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {1, 3}, 0, 2.5,
+                                                            Out{glyphXOffset}), 1);
+  XCTAssertEqual(glyphXOffset, 2);
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r1, {2, 3}, 0, -1,
+                                                            Out{glyphXOffset}), 0);
+  XCTAssertEqual(glyphXOffset, 0);
+  // The zero-width glyph is skipped.
+  XCTAssertEqual(TextFrameGlyphStorage::glyphIndexAtXOffset(r2, {0, 3}, 0, 2,
+                                                            Out{glyphXOffset}), 2);
+  XCTAssertEqual(glyphXOffset, 2);
+
+  storage.releaseFonts();
+  free(memory);
+}
+
+static STUTextFrame* createTextFrame(NSAttributedString* string, bool usesCompactGlyphStorage) {
+  STUTextFrameOptions* const options = [[STUTextFrameOptions alloc]
+                                          initWithBlock:^(STUTextFrameOptionsBuilder* builder)
+                                        {
+                                          builder.maximumNumberOfLines = 2;
+                                          builder.usesCompactGlyphStorage = usesCompactGlyphStorage;
+                                        }];
+  return [[STUTextFrame alloc] initWithShapedString:[[STUShapedString alloc]
+                                                       initWithAttributedString:string]
+                                               size:CGSizeMake(150, 1000)
+                                       displayScale:2
+                                            options:options];
+}
+
+- (void)testTextFrameWithCompactGlyphStorage {
+  NSAttributedString* const string =
+    [[NSAttributedString alloc]
+       initWithString:@"Test line\nA second line that is long enough to be truncated"
+           attributes:@{NSFontAttributeName: [UIFont systemFontOfSize:16]}];
+  STUTextFrame* const frame = createTextFrame(string, false);
+  STUTextFrame* const compactFrame = createTextFrame(string, true);
+
+  const TextFrame& tf = textFrameRef(frame);
+  const TextFrame& compactTF = textFrameRef(compactFrame);
+  XCTAssert(!tf.glyphStorage());
+  XCTAssert(compactTF.glyphStorage());
+  XCTAssertEqual(compactTF.lines().count(), 2);
+  XCTAssert(compactTF.lines()[1].hasTruncationToken);
+  Int glyphCount = 0;
+  for (const TextFrameLine& line : tf.lines()) {
+    glyphCount += CTLineGetGlyphCount(line._ctLine);
+    if (line._tokenCTLine) {
+      glyphCount += CTLineGetGlyphCount(line._tokenCTLine);
+    }
+  }
+  XCTAssertEqual(compactTF.glyphStorage()->counts().glyphCount, glyphCount);
+  for (const TextFrameLine& line : compactTF.lines()) {
+    XCTAssert(!line._ctLine && !line._tokenCTLine);
+  }
+
+  XCTAssert(CGRectEqualToRect(
+              [frame imageBoundsForRange:frame.fullRange frameOrigin:CGPointZero
+                                 options:nil cancellationFlag:nil],
+              [compactFrame imageBoundsForRange:compactFrame.fullRange frameOrigin:CGPointZero
+                                        options:nil cancellationFlag:nil]));
+
+  for (CGFloat y = 0; y < 60; y += 10) {
+    for (CGFloat x = -5; x < 160; x += 2.5) {
+      const CGPoint point = {x, y};
+      const STUTextFrameGraphemeClusterRange r =
+        [frame rangeOfGraphemeClusterClosestToPoint:point ignoringTrailingWhitespace:true
+                                        frameOrigin:CGPointZero];
+      const STUTextFrameGraphemeClusterRange cr =
+        [compactFrame rangeOfGraphemeClusterClosestToPoint:point ignoringTrailingWhitespace:true
+                                               frameOrigin:CGPointZero];
+      XCTAssert(STUTextFrameIndexEqualToIndex(r.range.start, cr.range.start));
+      XCTAssert(STUTextFrameIndexEqualToIndex(r.range.end, cr.range.end));
+      XCTAssertEqualWithAccuracy(r.bounds.origin.x, cr.bounds.origin.x, 1e-6);
+      XCTAssertEqualWithAccuracy(r.bounds.size.width, cr.bounds.size.width, 1e-6);
+      XCTAssertEqual(r.writingDirection, cr.writingDirection);
+    }
+  }
+}
+
+@end
@@ -0,0 +1,92 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TestUtils.h"
+
+#import "STULabel/STUTextFrame.h"
+
+#import "TextFrameLayouter.hpp"
+
+using namespace stu_label;
+
+static STUShapedString* shapedParagraphs(NSString* paragraph, int paragraphCount) {
+  NSMutableString* const string = [[NSMutableString alloc] init];
+  for (int i = 0; i < paragraphCount; ++i) {
+    [string appendString:paragraph];
+    [string appendString:@"\n"];
+  }
+  NSDictionary* const attributes = @{NSFontAttributeName:
+                                       [UIFont fontWithName:@"HelveticaNeue" size:16]};
+  return [[STUShapedString alloc]
+            initWithAttributedString:[[NSAttributedString alloc] initWithString:string
+                                                                     attributes:attributes]];
+}
+
+/// 500 paragraphs that fit on a single line.
+static STUShapedString* shortParagraphs() {
+  return shapedParagraphs(@"A title that fits on one line", 500);
+}
+
+/// 50 paragraphs with about 1300 UTF-16 code units that don't fit on a single line.
+static STUShapedString* longParagraphs() {
+  NSString* const sentence = @"The quick brown fox jumps over the lazy dog. ";
+  return shapedParagraphs([@"" stringByPaddingToLength:30*sentence.length
+                                            withString:sentence startingAtIndex:0],
+                          50);
+}
+
+static void layOut(STUShapedString* shapedString) {
+  for (int i = 0; i < 10; ++i) {
+    __unused STUTextFrame* const frame = [[STUTextFrame alloc]
+                                            initWithShapedString:shapedString
+                                                            size:CGSize{300, 1e6}
+                                                    displayScale:2
+                                                         options:nil];
+  }
+}
+
+@interface TextFrameLayouterTests : XCTestCase
+@end
+@implementation TextFrameLayouterTests
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+}
+
+// Compare the results of the following tests to evaluate whether the single-line fast path in
+// TextFrameLayouter::breakLine pays off for paragraphs that fit on one line and how much time it
+// wastes for paragraphs that don't.
+
+- (void)testShortParagraphLayoutPerformanceWithSingleLineFastPath {
+  STUShapedString* const string = shortParagraphs();
+  [self measureBlock:^{
+    layOut(string);
+  }];
+}
+
+- (void)testShortParagraphLayoutPerformanceWithoutSingleLineFastPath {
+  STUShapedString* const string = shortParagraphs();
+  TextFrameLayouter::setSingleLineFastPathIsEnabled(false);
+  [self measureBlock:^{
+    layOut(string);
+  }];
+  TextFrameLayouter::setSingleLineFastPathIsEnabled(true);
+}
+
+- (void)testLongParagraphLayoutPerformanceWithSingleLineFastPath {
+  STUShapedString* const string = longParagraphs();
+  [self measureBlock:^{
+    layOut(string);
+  }];
+}
+
+- (void)testLongParagraphLayoutPerformanceWithoutSingleLineFastPath {
+  STUShapedString* const string = longParagraphs();
+  TextFrameLayouter::setSingleLineFastPathIsEnabled(false);
+  [self measureBlock:^{
+    layOut(string);
+  }];
+  TextFrameLayouter::setSingleLineFastPathIsEnabled(true);
+}
+
+@end
@@ -205,6 +205,197 @@ static NSDictionary<NSAttributedStringKey, id>* lotsOfAttributes() {
   XCTAssertEqual(s, &s->next());
 }
 
+- (void)testStyleIndex {
+  ThreadLocalArenaAllocator::InitialBuffer<2048> allocBuffer;
+  ThreadLocalArenaAllocator alloc{Ref{allocBuffer}};
+
+  LocalFontInfoCache fontInfoCache;
+  TextStyleBuffer buffer{Ref{fontInfoCache}, alloc};
+  buffer.enableStyleIndex();
+
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes1 =
+    @{NSForegroundColorAttributeName: UIColor.redColor};
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes2 =
+    @{NSForegroundColorAttributeName: UIColor.blueColor,
+      NSUnderlineStyleAttributeName: @(NSUnderlineStyleSingle)};
+
+  const Int32 n = 10*TextStyleIndexEntry::stride + 3;
+  for (Int32 i = 0; i < n; ++i) {
+    buffer.encodeStringRangeStyle(Range{3*i, 3*i + 3}, i%2 == 0 ? attributes1 : attributes2);
+    if (i + 1 < TextStyleIndexEntry::minStyleCount) {
+      XCTAssert(buffer.styleIndex().isEmpty());
+    }
+  }
+  buffer.addStringTerminatorStyle();
+
+  const auto index = buffer.styleIndex();
+  XCTAssertEqual(index.count(), (n + TextStyleIndexEntry::stride - 1)/TextStyleIndexEntry::stride);
+  XCTAssertEqual(buffer.styleIndexSizeInBytes(), index.count()*sizeof(TextStyleIndexEntry));
+
+  const TextStyle* const firstStyle = reinterpret_cast<const TextStyle*>(buffer.data().begin());
+  const TextStyleSpan span{.firstStyle = firstStyle, .index = index};
+  for (Int32 i = 0; i < 3*n; ++i) {
+    const TextStyle& style = span.styleForStringIndex(i);
+    XCTAssertEqual(&style, &firstStyle->styleForStringIndex(i));
+    XCTAssertEqual(style.stringIndex(), i - i%3);
+  }
+  // Lookups with a cursor before, at or after the target style, both near and far away.
+  for (Int32 i = 0; i < 3*n; i += 2) {
+    for (Int32 j = 0; j < 3*n; j += 5) {
+      const TextStyle& cursor = firstStyle->styleForStringIndex(j);
+      XCTAssertEqual(&span.styleForStringIndex(i, cursor), &cursor.styleForStringIndex(i));
+    }
+  }
+
+  buffer.clearData();
+  XCTAssert(buffer.styleIndex().isEmpty());
+}
+
+- (void)testStyleTemplateCache {
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+
+  NSMutableDictionary<NSAttributedStringKey, id>* NS_VALID_UNTIL_END_OF_SCOPE const
+    attributes = [lotsOfAttributes() mutableCopy];
+  [attributes removeObjectForKey:STUAttachmentAttributeName];
+  [attributes removeObjectForKey:NSShadowAttributeName];
+  attributes[NSParagraphStyleAttributeName] = NSParagraphStyle.defaultParagraphStyle;
+
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes1 = [attributes copy];
+  // Equal keys and values, but a different dictionary instance.
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes2 = [attributes1 mutableCopy];
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const otherAttributes =
+    @{NSForegroundColorAttributeName: UIColor.greenColor};
+
+  const auto encode = [&](NSDictionary* attributes) -> NSData* {
+    ThreadLocalArenaAllocator::InitialBuffer<2048> allocBuffer;
+    ThreadLocalArenaAllocator alloc{Ref{allocBuffer}};
+    LocalFontInfoCache fontInfoCache;
+    TextStyleBuffer buffer{Ref{fontInfoCache}, alloc};
+    TextStyleBuffer::ParagraphAttributes pas;
+    // The preceding style makes sure that the color indices aren't trivial.
+    buffer.encodeStringRangeStyle(Range{0, 1}, otherAttributes, Out{pas});
+    buffer.encodeStringRangeStyle(Range{1, 3}, attributes, Out{pas});
+    if (pas.style != attributes[NSParagraphStyleAttributeName]) return nil;
+    // Encode the attributes again as a big TextStyle.
+    const Int32 bigIndex = TextStyle::maxSmallStringIndex + 1;
+    buffer.encodeStringRangeStyle(Range{3, bigIndex}, otherAttributes, Out{pas});
+    buffer.encodeStringRangeStyle(Range{bigIndex, bigIndex + 1}, attributes, Out{pas});
+    buffer.addStringTerminatorStyle();
+    return [NSData dataWithBytes:buffer.data().begin() length:sign_cast(buffer.data().count())];
+  };
+
+  NSData* const data = encode(attributes1); // Populates the cache.
+  XCTAssertNotNil(data);
+  XCTAssertEqualObjects(encode(attributes1), data);
+  XCTAssertEqualObjects(encode(attributes2), data);
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+  XCTAssertEqualObjects(encode(attributes2), data);
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(false);
+  XCTAssertEqualObjects(encode(attributes1), data);
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(true);
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+}
+
+static NSData* encodeStyle(NSDictionary* attributes,
+                           Optional<Out<TextStyleBuffer::ParagraphAttributes>> outParaAttributes)
+{
+  ThreadLocalArenaAllocator::InitialBuffer<2048> allocBuffer;
+  ThreadLocalArenaAllocator alloc{Ref{allocBuffer}};
+  LocalFontInfoCache fontInfoCache;
+  TextStyleBuffer buffer{Ref{fontInfoCache}, alloc};
+  buffer.encodeStringRangeStyle(Range{0, 1}, attributes, outParaAttributes);
+  buffer.addStringTerminatorStyle();
+  return [NSData dataWithBytes:buffer.data().begin() length:sign_cast(buffer.data().count())];
+}
+
+- (void)testStyleTemplateCacheWithoutParagraphAttributesOutParameter {
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes =
+    @{NSForegroundColorAttributeName: UIColor.greenColor,
+      NSParagraphStyleAttributeName: NSParagraphStyle.defaultParagraphStyle};
+  NSData* const data = encodeStyle(attributes, none);
+  XCTAssertEqual(TextStyleBuffer::globalStyleTemplateCacheEntryCount(), 1);
+  XCTAssertEqualObjects(encodeStyle(attributes, none), data);
+  // The template also contains the paragraph attributes.
+  TextStyleBuffer::ParagraphAttributes pas;
+  XCTAssertEqualObjects(encodeStyle(attributes, Out{pas}), data);
+  XCTAssertEqual(pas.style, NSParagraphStyle.defaultParagraphStyle);
+  XCTAssertEqual(TextStyleBuffer::globalStyleTemplateCacheEntryCount(), 1);
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+}
+
+- (void)testStyleTemplateCacheIgnoresMutableAttributeValues {
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+  NSMutableParagraphStyle* NS_VALID_UNTIL_END_OF_SCOPE const style =
+    [[NSMutableParagraphStyle alloc] init];
+  style.lineSpacing = 1;
+  NSDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes =
+    @{NSForegroundColorAttributeName: UIColor.greenColor,
+      NSParagraphStyleAttributeName: style};
+  TextStyleBuffer::ParagraphAttributes pas;
+  encodeStyle(attributes, Out{pas});
+  XCTAssertEqual(pas.style, style);
+  XCTAssertEqual(TextStyleBuffer::globalStyleTemplateCacheEntryCount(), 0);
+
+  style.lineSpacing = 2;
+  NSData* const data = encodeStyle(attributes, Out{pas});
+  XCTAssertEqual(pas.style, style);
+  XCTAssertEqual(TextStyleBuffer::globalStyleTemplateCacheEntryCount(), 0);
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(false);
+  XCTAssertEqualObjects(encodeStyle(attributes, Out{pas}), data);
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(true);
+
+  // The same dictionary with an immutable copy of the paragraph style is cached.
+  NSMutableDictionary* NS_VALID_UNTIL_END_OF_SCOPE const attributes2 = [attributes mutableCopy];
+  attributes2[NSParagraphStyleAttributeName] = [style copy];
+  encodeStyle(attributes2, Out{pas});
+  XCTAssertEqual(TextStyleBuffer::globalStyleTemplateCacheEntryCount(), 1);
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+}
+
+/// Encodes many ranges with a few shared attribute dictionaries, like a long attributed string
+/// built from a handful of styles.
+static void encodeManyRangesWithSharedAttributes() {
+  NSMutableArray<NSDictionary*>* NS_VALID_UNTIL_END_OF_SCOPE const dictionaries =
+    [[NSMutableArray alloc] init];
+  for (int i = 0; i < 4; ++i) {
+    NSMutableDictionary<NSAttributedStringKey, id>* const attributes =
+      [lotsOfAttributes() mutableCopy];
+    [attributes removeObjectForKey:STUAttachmentAttributeName];
+    [attributes removeObjectForKey:NSShadowAttributeName];
+    attributes[NSParagraphStyleAttributeName] = NSParagraphStyle.defaultParagraphStyle;
+    attributes[NSFontAttributeName] = [UIFont fontWithName:@"HelveticaNeue" size:12 + i];
+    [dictionaries addObject:[attributes copy]];
+  }
+  for (int k = 0; k < 20; ++k) {
+    ThreadLocalArenaAllocator::InitialBuffer<2048> allocBuffer;
+    ThreadLocalArenaAllocator alloc{Ref{allocBuffer}};
+    LocalFontInfoCache fontInfoCache;
+    TextStyleBuffer buffer{Ref{fontInfoCache}, alloc};
+    TextStyleBuffer::ParagraphAttributes pas;
+    for (int i = 0; i < 1000; ++i) {
+      buffer.encodeStringRangeStyle(Range{i, i + 1}, dictionaries[sign_cast(i%4)], Out{pas});
+    }
+    buffer.addStringTerminatorStyle();
+  }
+}
+
+- (void)testEncodingPerformanceWithStyleTemplateCache {
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+  [self measureBlock:^{
+    encodeManyRangesWithSharedAttributes();
+  }];
+  TextStyleBuffer::clearGlobalStyleTemplateCache();
+}
+
+- (void)testEncodingPerformanceWithoutStyleTemplateCache {
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(false);
+  [self measureBlock:^{
+    encodeManyRangesWithSharedAttributes();
+  }];
+  TextStyleBuffer::setGlobalStyleTemplateCacheIsEnabled(true);
+}
+
 // This test is too slow to be enabled by default.
 - (void)testFontOverflowHandling {
   ThreadLocalArenaAllocator::InitialBuffer<2048> allocBuffer;
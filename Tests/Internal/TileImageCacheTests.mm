@@ -0,0 +1,188 @@
+// Copyright 2018 Stephan Tolksdorf
+
+#import "TileImageCache.hpp"
+
+#import "STULabelTiledLayer-Testing.h"
+
+#import "STULabel/STULabelLayer.h"
+
+#import "TestUtils.h"
+
+using namespace stu;
+using namespace stu_label;
+
+static PurgeableImage createImage(UInt32 width, UInt32 height) {
+  return PurgeableImage{SizeInPixels<UInt32>{width, height}, 1, nil,
+                        STUPredefinedCGImageFormatRGB, STUCGImageFormatOptionsNone,
+                        [](CGContext*) {}};
+}
+
+static Rect<Int32> tileFrame(Int32 index) {
+  return Rect{Range{0, 10}, Range{10*index, 10*(index + 1)}};
+}
+
+/// Inserts a 10x10 RGB image (400 bytes) for the tile with the specified index.
+static void insertImage(TileImageCache& cache, const void* owner, Int32 index) {
+  cache.insert(owner, tileFrame(index), createImage(10, 10), 400);
+}
+
+/// Returns true if the cache contained an image for the specified owner and tile index, which is
+/// removed from the cache.
+static bool take(TileImageCache& cache, const void* owner, Int32 index) {
+  return static_cast<bool>(cache.take(owner, tileFrame(index)));
+}
+
+@interface TileImageCacheTests : XCTestCase
+@end
+@implementation TileImageCacheTests {
+  size_t _oldBudget;
+}
+
+- (void)setUp {
+  [super setUp];
+  self.continueAfterFailure = false;
+  _oldBudget = STULabelTiledLayer.retainedTileImagesMemoryBudget;
+  // Clears the shared cache.
+  STULabelTiledLayer.retainedTileImagesMemoryBudget = 0;
+  STULabelTiledLayer.retainedTileImagesMemoryBudget = 1 << 20;
+}
+
+- (void)tearDown {
+  STULabelTiledLayer.retainedTileImagesMemoryBudget = _oldBudget;
+  [super tearDown];
+}
+
+- (void)testInsertAndTake {
+  int owner1, owner2;
+  TileImageCache cache{4000};
+  insertImage(cache, &owner1, 0);
+  insertImage(cache, &owner1, 1);
+  insertImage(cache, &owner2, 0);
+  XCTAssertEqual(cache.count(), 3);
+  XCTAssertEqual(cache.byteCount(), 1200u);
+  // Inserting an image for the same owner and frame replaces the older image.
+  insertImage(cache, &owner1, 1);
+  XCTAssertEqual(cache.count(), 3);
+  XCTAssertEqual(cache.byteCount(), 1200u);
+
+  PurgeableImage image = cache.take(&owner1, tileFrame(1));
+  XCTAssertEqual(image.sizeInPixels().width, 10u);
+  XCTAssertEqual(image.sizeInPixels().height, 10u);
+  XCTAssertEqual(cache.count(), 2);
+  XCTAssertEqual(cache.byteCount(), 800u);
+  XCTAssertFalse(take(cache, &owner1, 1));
+  XCTAssertFalse(take(cache, &owner1, 2));
+  XCTAssert(take(cache, &owner2, 0));
+  XCTAssertEqual(cache.count(), 1);
+  XCTAssertEqual(cache.byteCount(), 400u);
+}
+
+- (void)testMemoryBudgetAndLRUEviction {
+  int owner;
+  TileImageCache cache{4000};
+  for (Int32 i = 0; i < 10; ++i) {
+    insertImage(cache, &owner, i);
+  }
+  XCTAssertEqual(cache.count(), 10);
+  XCTAssertEqual(cache.byteCount(), 4000u);
+
+  // Taking an image and inserting it again makes it the most recently used image.
+  PurgeableImage image = cache.take(&owner, tileFrame(0));
+  XCTAssertEqual(image.sizeInPixels().width, 10u);
+  cache.insert(&owner, tileFrame(0), std::move(image), 400);
+  XCTAssertEqual(cache.count(), 10);
+
+  // The least recently used images are evicted first.
+  insertImage(cache, &owner, 10);
+  insertImage(cache, &owner, 11);
+  XCTAssertEqual(cache.count(), 10);
+  XCTAssertEqual(cache.byteCount(), 4000u);
+  XCTAssertFalse(take(cache, &owner, 1));
+  XCTAssertFalse(take(cache, &owner, 2));
+  XCTAssert(take(cache, &owner, 0));
+  XCTAssert(take(cache, &owner, 3));
+  XCTAssertEqual(cache.count(), 8);
+
+  // Images larger than a quarter of the budget aren't cached.
+  cache.insert(&owner, tileFrame(20), createImage(20, 20), 1600);
+  XCTAssertEqual(cache.count(), 8);
+  XCTAssertFalse(take(cache, &owner, 20));
+
+  // Lowering the budget evicts the least recently used images.
+  cache.setMemoryBudget(1000);
+  XCTAssertEqual(cache.memoryBudget(), 1000u);
+  XCTAssertEqual(cache.count(), 2);
+  XCTAssertEqual(cache.byteCount(), 800u);
+  XCTAssert(take(cache, &owner, 10));
+  XCTAssert(take(cache, &owner, 11));
+
+  // A zero budget disables the cache.
+  cache.setMemoryBudget(0);
+  insertImage(cache, &owner, 0);
+  XCTAssertEqual(cache.count(), 0);
+  XCTAssertEqual(cache.byteCount(), 0u);
+}
+
+- (void)testRemoveAll {
+  int owner1, owner2;
+  TileImageCache cache{4000};
+  insertImage(cache, &owner1, 0);
+  insertImage(cache, &owner2, 0);
+  insertImage(cache, &owner1, 1);
+  cache.removeAll(&owner1);
+  XCTAssertEqual(cache.count(), 1);
+  XCTAssertEqual(cache.byteCount(), 400u);
+  XCTAssert(take(cache, &owner2, 0));
+  insertImage(cache, &owner1, 0);
+  insertImage(cache, &owner2, 0);
+  cache.removeAll();
+  XCTAssertEqual(cache.count(), 0);
+  XCTAssertEqual(cache.byteCount(), 0u);
+}
+
+- (void)testMemoryBudgetCanBeSetOnAnyThread {
+  const CGRect frame = {{0, 0}, {100, 50}};
+  STULabelTiledLayer* const layer = [[STULabelTiledLayer alloc] init];
+  [layer retainBlankTileImageWithFrame:frame];
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 100*50*4u);
+  dispatch_sync(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    STULabelLayer.tileImageCacheMemoryBudget = 0;
+    XCTAssertEqual(STULabelLayer.tileImageCacheMemoryBudget, 0u);
+  });
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 0u);
+}
+
+- (void)testTiledLayerContentChangesRemoveRetainedImages {
+  const CGRect frame = {{0, 0}, {100, 50}};
+  const size_t byteCount = 100*50*4;
+
+  STULabelTiledLayer* const layer = [[STULabelTiledLayer alloc] init];
+  STULabelTiledLayer* const otherLayer = [[STULabelTiledLayer alloc] init];
+  [otherLayer retainBlankTileImageWithFrame:frame];
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, byteCount);
+
+  [layer retainBlankTileImageWithFrame:frame];
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 2*byteCount);
+  layer.drawingBlock = ^(CGContextRef __unused context, CGRect __unused rect,
+                         const STUCancellationFlag* __unused cancellationFlag) {};
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, byteCount);
+
+  [layer retainBlankTileImageWithFrame:frame];
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 2*byteCount);
+  layer.imageFormat = STUPredefinedCGImageFormatGrayscale;
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, byteCount);
+
+  @autoreleasepool {
+    STULabelTiledLayer* layer2 = [[STULabelTiledLayer alloc] init];
+    [layer2 retainBlankTileImageWithFrame:frame];
+    XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 2*byteCount);
+    layer2 = nil;
+  }
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, byteCount);
+
+  // The image of the other layer is only removed when its own content changes.
+  otherLayer.drawingBlock = layer.drawingBlock;
+  XCTAssertEqual(STULabelTiledLayer.retainedTileImagesByteCount, 0u);
+}
+
+@end
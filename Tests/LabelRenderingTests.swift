@@ -0,0 +1,175 @@
+// Copyright 2018 Stephan Tolksdorf
+
+import STULabelSwift
+
+import XCTest
+
+class LabelRenderingTests: XCTestCase {
+  private func alphaMaskLayer(_ label: STULabelLayer) -> CALayer? {
+    label.displayIfNeeded()
+    guard let sublayer = label.sublayers?.first, sublayer.mask != nil else { return nil }
+    return sublayer
+  }
+
+  func testAlphaMaskRenderMode() {
+    let font = UIFont.systemFont(ofSize: 16)
+    let label = STULabelLayer()
+    label.usesAlphaMaskForSingleColorText = true
+    label.attributedText = NSAttributedString(string: "Test",
+                                              attributes: [.font: font,
+                                                           .foregroundColor: UIColor.red])
+    label.bounds = CGRect(origin: .zero,
+                          size: label.sizeThatFits(CGSize(width: 100, height: 100)))
+
+    let maskedLayer = alphaMaskLayer(label)!
+    XCTAssertNil(label.contents)
+    XCTAssertEqual(maskedLayer.backgroundColor, UIColor.red.cgColor)
+    let mask = maskedLayer.mask!.contents as! CGImage
+    XCTAssertEqual(mask.alphaInfo, .alphaOnly)
+    XCTAssertNil(mask.colorSpace)
+    XCTAssertEqual(mask.bitsPerPixel, 8)
+
+    // Changing the override text color must only change the tint, not the mask.
+    label.overrideTextColor = UIColor.blue
+    XCTAssert(alphaMaskLayer(label) === maskedLayer)
+    XCTAssertEqual(maskedLayer.backgroundColor, UIColor.blue.cgColor)
+    XCTAssert(maskedLayer.mask!.contents as! CGImage === mask)
+    label.overrideTextColor = nil
+    XCTAssertEqual(alphaMaskLayer(label)?.backgroundColor, UIColor.red.cgColor)
+
+    // Disabling the mode switches back to the regular rendering.
+    label.usesAlphaMaskForSingleColorText = false
+    XCTAssertNil(alphaMaskLayer(label))
+    XCTAssertNotNil(label.contents)
+    label.usesAlphaMaskForSingleColorText = true
+    XCTAssertNotNil(alphaMaskLayer(label))
+  }
+
+  func testAlphaMaskRenderModeIsNotUsedForUnsupportedText() {
+    let font = UIFont.systemFont(ofSize: 16)
+    let label = STULabelLayer()
+    label.usesAlphaMaskForSingleColorText = true
+    func check(_ string: NSAttributedString, usesAlphaMask: Bool,
+               file: StaticString = #file, line: UInt = #line)
+    {
+      label.attributedText = string
+      label.bounds = CGRect(origin: .zero,
+                            size: label.sizeThatFits(CGSize(width: 200, height: 100)))
+      XCTAssertEqual(alphaMaskLayer(label) != nil, usesAlphaMask, file: file, line: line)
+    }
+
+    check(NSAttributedString(string: "Test", attributes: [.font: font]), usesAlphaMask: true)
+
+    let twoColors = NSMutableAttributedString(string: "Test", attributes: [.font: font])
+    twoColors.addAttribute(.foregroundColor, value: UIColor.red, range: NSRange(0..<1))
+    check(twoColors, usesAlphaMask: false)
+
+    check(NSAttributedString(string: "Test \u{1F600}", attributes: [.font: font]),
+          usesAlphaMask: false)
+
+    check(NSAttributedString(string: "Test",
+                             attributes: [.font: font,
+                                          .underlineStyle: NSUnderlineStyle.single.rawValue]),
+          usesAlphaMask: false)
+
+    let shadow = NSShadow()
+    shadow.shadowOffset = CGSize(width: 1, height: 1)
+    check(NSAttributedString(string: "Test", attributes: [.font: font, .shadow: shadow]),
+          usesAlphaMask: false)
+
+    // The link and the non-link text have to resolve to the same color.
+    let link = NSMutableAttributedString(string: "Test", attributes: [.font: font])
+    link.addAttributes([.link: URL(string: "https://example.com")!,
+                        .foregroundColor: UIColor.blue], range: NSRange(0..<2))
+    check(link, usesAlphaMask: false)
+    label.overrideLinkColor = UIColor.black
+    check(link, usesAlphaMask: true)
+    label.overrideLinkColor = nil
+
+    label.attributedText = NSAttributedString(string: "Test", attributes: [.font: font])
+    label.drawingBlock = { params in params.draw() }
+    XCTAssertNil(alphaMaskLayer(label))
+  }
+
+  private func highlightTestLabel(displaysAsynchronously: Bool) -> STULabelLayer {
+    let label = STULabelLayer()
+    label.displaysAsynchronously = displaysAsynchronously
+    label.attributedText = NSAttributedString(string: "Line 1\nLine 2\nLine 3",
+                                              attributes: [.font: UIFont.systemFont(ofSize: 16)])
+    label.bounds = CGRect(origin: .zero,
+                          size: label.sizeThatFits(CGSize(width: 200, height: 200)))
+    label.highlightStyle = STUTextHighlightStyle { b in b.textColor = UIColor.red }
+    label.setHighlightRange(NSRange(7..<13), type: .rangeInOriginalString)
+    return label
+  }
+
+  private func imageData(_ image: CGImage) -> Data {
+    return image.dataProvider!.data! as Data
+  }
+
+  private func highlightedReferenceImageData() -> Data {
+    let label = highlightTestLabel(displaysAsynchronously: false)
+    label.isHighlighted = true
+    label.displayIfNeeded()
+    return imageData(label.contents as! CGImage)
+  }
+
+  /// Runs the main run loop until the label's contents is an image other than `oldImage`.
+  private func waitForNewContentImage(_ label: STULabelLayer, oldImage: CGImage?) -> CGImage? {
+    let timeout = Date(timeIntervalSinceNow: 5)
+    while Date() < timeout {
+      if let contents = label.contents, contents as AnyObject !== oldImage {
+        return (contents as! CGImage)
+      }
+      RunLoop.current.run(mode: .default, before: Date(timeIntervalSinceNow: 0.01))
+    }
+    return nil
+  }
+
+  func testHighlightChangeRedrawsChangedLinesOfImage() {
+    let label = highlightTestLabel(displaysAsynchronously: false)
+    label.displayIfNeeded()
+    let unhighlightedImage = label.contents as! CGImage
+
+    label.isHighlighted = true
+    // The image is patched instead of being invalidated.
+    XCTAssertFalse(label.needsDisplay())
+    let highlightedImage = label.contents as! CGImage
+    XCTAssert(highlightedImage !== unhighlightedImage)
+    XCTAssertEqual(imageData(highlightedImage), highlightedReferenceImageData())
+
+    label.isHighlighted = false
+    XCTAssertFalse(label.needsDisplay())
+    XCTAssertEqual(imageData(label.contents as! CGImage), imageData(unhighlightedImage))
+
+    // Setting the same values again doesn't change the image.
+    let image = label.contents as! CGImage
+    label.isHighlighted = false
+    label.highlightStyle = label.highlightStyle
+    label.setHighlightRange(NSRange(7..<13), type: .rangeInOriginalString)
+    XCTAssert(label.contents as! CGImage === image)
+  }
+
+  func testAsyncHighlightChangeKeepsImageUntilChangedLinesAreRedrawn() {
+    let label = highlightTestLabel(displaysAsynchronously: true)
+    label.displayIfNeeded()
+    let unhighlightedImage = waitForNewContentImage(label, oldImage: nil)!
+
+    label.isHighlighted = true
+    XCTAssertFalse(label.needsDisplay())
+    XCTAssert(label.contents as! CGImage === unhighlightedImage)
+    let highlightedImage = waitForNewContentImage(label, oldImage: unhighlightedImage)!
+    XCTAssertFalse(label.needsDisplay())
+    XCTAssertEqual(imageData(highlightedImage), highlightedReferenceImageData())
+
+    // A change while the redraw is pending invalidates the image and discards the pending result.
+    label.highlightStyle = STUTextHighlightStyle { b in b.textColor = UIColor.blue }
+    label.isHighlighted = false
+    XCTAssert(label.needsDisplay())
+    label.displayIfNeeded()
+    let image = waitForNewContentImage(label, oldImage: highlightedImage)!
+    let reference = highlightTestLabel(displaysAsynchronously: false)
+    reference.displayIfNeeded()
+    XCTAssertEqual(imageData(image), imageData(reference.contents as! CGImage))
+  }
+}
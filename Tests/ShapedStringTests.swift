@@ -1,5 +1,6 @@
 // Copyright 2018 Stephan Tolksdorf
 
+import STULabel.DynamicTypeFontScaling
 import STULabelSwift
 
 import XCTest
@@ -122,4 +123,94 @@ class ShapedStringTests : XCTestCase {
       }
     }
   }
+
+  func testSharedCache() {
+    let budget = STUShapedString.sharedCacheMemoryBudget
+    defer {
+      STUShapedString.sharedCacheMemoryBudget = budget
+      STUShapedString.clearSharedCache()
+    }
+    func shapedText(_ string: NSAttributedString) -> STUShapedString {
+      let label = STULabelLayer()
+      label.attributedText = string
+      return label.shapedText
+    }
+    let attributes: [NSAttributedString.Key: Any] = [.font: UIFont.systemFont(ofSize: 16)]
+    let string1 = NSAttributedString(string: "Reply", attributes: attributes)
+    let string2 = NSMutableAttributedString(string: "Reply", attributes: attributes)
+
+    STUShapedString.sharedCacheMemoryBudget = 0
+    XCTAssert(shapedText(string1) !== shapedText(string2))
+
+    STUShapedString.sharedCacheMemoryBudget = 1 << 20
+    let shapedString = shapedText(string1)
+    XCTAssert(shapedText(string2) === shapedString)
+
+    string2.addAttribute(.foregroundColor, value: UIColor.red, range: NSRange(0..<1))
+    XCTAssert(shapedText(string2) !== shapedString)
+
+    // Strings with mutable attribute values aren't cached, since the values could be changed
+    // after the string was shaped.
+    let paragraphStyle = NSMutableParagraphStyle()
+    let string3 = NSAttributedString(string: "Reply",
+                                     attributes: [.font: UIFont.systemFont(ofSize: 16),
+                                                  .paragraphStyle: paragraphStyle])
+    XCTAssert(shapedText(string3) !== shapedText(string3))
+    let string4 = NSAttributedString(string: "Reply",
+                                     attributes: [.font: UIFont.systemFont(ofSize: 16),
+                                                  .paragraphStyle: paragraphStyle.copy()])
+    XCTAssert(shapedText(string4) === shapedText(string4))
+
+    STUShapedString.clearSharedCache()
+    XCTAssert(shapedText(string1) !== shapedString)
+  }
+
+  func testCopyWithFontsAdjustedForContentSizeCategory() { if #available(iOS 10, tvOS 10, *) {
+    let large = UITraitCollection(preferredContentSizeCategory: .large)
+    let bodyFont = UIFont.preferredFont(forTextStyle: .body, compatibleWith: large)
+    let captionFont = UIFont.preferredFont(forTextStyle: .caption1, compatibleWith: large)
+    let fixedFont = UIFont.systemFont(ofSize: 16)
+    let string = NSMutableAttributedString(string: "Body ", attributes: [.font: bodyFont])
+    string.append(NSAttributedString(string: "Fixed ", attributes: [.font: fixedFont,
+                                                                    .foregroundColor: UIColor.red]))
+    string.append(NSAttributedString(string: "Caption\nBody", attributes: [.font: captionFont]))
+    string.addAttribute(.font, value: bodyFont, range: NSRange(string.length - 4..<string.length))
+    // The underline, strikethrough and stroke infos contain values derived from the font.
+    string.addAttribute(.underlineStyle, value: NSUnderlineStyle.single.rawValue,
+                        range: NSRange(0..<4))
+    string.addAttribute(.strikethroughStyle, value: NSUnderlineStyle.single.rawValue,
+                        range: NSRange(11..<18))
+    string.addAttribute(.strokeWidth, value: 3, range: NSRange(string.length - 4..<string.length))
+
+    let shapedString = STUShapedString(string)
+    XCTAssert(shapedString.copy(withFontsAdjustedForContentSizeCategory: .large) === shapedString)
+
+    for category in [UIContentSizeCategory.extraSmall, .extraExtraLarge] {
+      let adjustedString = string.stu_copyWithFontsAdjusted(forContentSizeCategory: category)
+      let adjustedShapedString = shapedString.copy(withFontsAdjustedForContentSizeCategory: category)
+      XCTAssert(adjustedShapedString !== shapedString)
+      XCTAssertEqual(adjustedShapedString.attributedString, adjustedString)
+      let size = CGSize(width: 100, height: 1000)
+      let frame1 = STUTextFrame(adjustedShapedString, size: size, displayScale: 2, options: nil)
+      let frame2 = STUTextFrame(STUShapedString(adjustedString), size: size, displayScale: 2,
+                                options: nil)
+      XCTAssertEqual(frame1.layoutBounds, frame2.layoutBounds)
+      XCTAssertEqual(frame1.lines.count, frame2.lines.count)
+      for (line1, line2) in zip(frame1.lines, frame2.lines) {
+        XCTAssertEqual(line1.baselineOrigin, line2.baselineOrigin)
+        XCTAssertEqual(line1.range, line2.range)
+      }
+      let imageBounds = frame2.imageBounds(frameOrigin: .zero)
+      XCTAssertEqual(frame1.imageBounds(frameOrigin: .zero), imageBounds)
+      func render(_ frame: STUTextFrame) -> Data {
+        let image = createImage(imageBounds.size, scale: 2, backgroundColor: .white, .grayscale) {
+                      context in
+                      frame.draw(at: -imageBounds.origin, in: context, contextBaseCTM_d: 1,
+                                 pixelAlignBaselines: true)
+                    }
+        return image.cgImage!.dataProvider!.data! as Data
+      }
+      XCTAssertEqual(render(frame1), render(frame2))
+    }
+  } }
 }
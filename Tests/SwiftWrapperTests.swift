@@ -75,4 +75,104 @@ class SwiftWrapperTests: XCTestCase {
     XCTAssertEqual(line.descent, CGFloat(Float32(-font.descender)))
     XCTAssertEqual(line.leading, expectedLeading)
   }
+
+  func testBatchedPointToIndexAndRectsForRanges() {
+    let string = "Test abc\nfoo bar\nbaz"
+    let tf = STUTextFrame(STUShapedString(NSAttributedString(string, [.font: font])),
+                          size: CGSize(width: 100, height: 100),
+                          displayScale: 2)
+    let origin = CGPoint(x: 1, y: 2)
+    // The expected results are derived from the rects of the individual characters, which are
+    // calculated independently of the point-to-index code.
+    var points = [CGPoint]()
+    var expectedRanges = [Range<STUTextFrame.Index>]()
+    for (i, c) in string.utf16.enumerated() where c != 0x20 && c != 0x0A {
+      let range = tf.range(forRangeInTruncatedString: NSRange(location: i, length: 1))
+      let bounds = tf.rects(for: range, frameOrigin: origin).bounds
+      points.append(CGPoint(x: bounds.midX, y: bounds.midY))
+      expectedRanges.append(range)
+    }
+    // Query the points in reverse order and with duplicates, so that the batch implementation
+    // has to sort and deduplicate them.
+    points = points.reversed() + points
+    expectedRanges = expectedRanges.reversed() + expectedRanges
+    points.append(CGPoint(x: -5, y: -5))
+    expectedRanges.append(tf.range(forRangeInTruncatedString: NSRange(location: 0, length: 1)))
+    let lastIndex = string.utf16.count - 1
+    points.append(CGPoint(x: 200, y: 200))
+    expectedRanges.append(tf.range(forRangeInTruncatedString: NSRange(location: lastIndex,
+                                                                      length: 1)))
+    let ranges = tf.rangesOfGraphemeClusters(closestTo: points, frameOrigin: origin)
+    XCTAssertEqual(ranges.count, points.count)
+    for (i, r) in ranges.enumerated() {
+      XCTAssertEqual(r.range, expectedRanges[i])
+      XCTAssertEqual(r.writingDirection, .leftToRight)
+      XCTAssertFalse(r.isLigatureFraction)
+      let expectedBounds = tf.rects(for: expectedRanges[i], frameOrigin: origin).bounds
+      XCTAssertEqual(r.bounds.minX, expectedBounds.minX, accuracy: 0.001)
+      XCTAssertEqual(r.bounds.maxX, expectedBounds.maxX, accuracy: 0.001)
+    }
+    XCTAssert(tf.rangesOfGraphemeClusters(closestTo: [], frameOrigin: origin).isEmpty)
+
+    // Overlapping ranges spanning multiple lines, so that the batch implementation has to share
+    // the middle line between ranges.
+    let multiLineRanges = [tf.indices,
+                           tf.range(forRangeInTruncatedString: NSRange(location: 2, length: 16)),
+                           tf.range(forRangeInTruncatedString: NSRange(location: 6, length: 6)),
+                           tf.range(forRangeInTruncatedString: NSRange(location: 9, length: 8))]
+    let textRanges = expectedRanges + multiLineRanges + expectedRanges
+    let rectArrays = tf.rects(for: textRanges, frameOrigin: origin)
+    XCTAssertEqual(rectArrays.count, textRanges.count)
+    for (i, rects) in rectArrays.enumerated() {
+      let range = textRanges[i]
+      let expectedRects = tf.rects(for: range, frameOrigin: origin)
+      XCTAssertEqual(rects.bounds, expectedRects.bounds)
+      XCTAssertEqual(rects.rectCount, expectedRects.rectCount)
+      for k in 0..<min(rects.rectCount, expectedRects.rectCount) {
+        XCTAssertEqual(rects.rect(at: k), expectedRects.rect(at: k))
+        XCTAssertEqual(rects.textLineIndexForRect(at: k), expectedRects.textLineIndexForRect(at: k))
+      }
+      // Equal ranges share the rect array of the first occurrence, different ranges don't.
+      let j = textRanges.firstIndex(of: range)!
+      XCTAssert(rects === rectArrays[j])
+      if j == i && i > 0 {
+        XCTAssert(rects !== rectArrays[i - 1])
+      }
+    }
+  }
+
+  func testTextRectArrayPathCaching() {
+    let tf = STUTextFrame(STUShapedString(NSAttributedString("Test test", [.font: font])),
+                          size: CGSize(width: 50, height: 100), displayScale: 0)
+    let rects = tf.rects(for: tf.indices, frameOrigin: .zero)
+    let insets = UIEdgeInsets(top: -1, left: -2, bottom: -1, right: -2)
+    let path = rects.createPath(withEdgeInsets: insets, cornerRadius: 2,
+                                extendTextLinesToCommonHorizontalBounds: false,
+                                fillTextLineGaps: true, transform: nil)
+    // The path is taken from the cache, but every call returns a new mutable path.
+    let path2 = rects.createPath(withEdgeInsets: insets, cornerRadius: 2,
+                                 extendTextLinesToCommonHorizontalBounds: false,
+                                 fillTextLineGaps: true, transform: nil)
+    XCTAssert(path !== path2)
+    XCTAssertEqual(path, path2)
+    (path2 as! CGMutablePath).addRect(CGRect(x: 100, y: 100, width: 10, height: 10))
+    let otherPath = rects.createPath(withEdgeInsets: .zero, cornerRadius: 0,
+                                     extendTextLinesToCommonHorizontalBounds: true,
+                                     fillTextLineGaps: true, transform: nil)
+    XCTAssertNotEqual(path, otherPath)
+    // Mutating a returned path doesn't affect the cached path.
+    XCTAssertEqual(path, rects.createPath(withEdgeInsets: insets, cornerRadius: 2,
+                                          extendTextLinesToCommonHorizontalBounds: false,
+                                          fillTextLineGaps: true, transform: nil))
+    var translation = CGAffineTransform(translationX: 10, y: 20)
+    let translatedPath = rects.createPath(withEdgeInsets: insets, cornerRadius: 2,
+                                          extendTextLinesToCommonHorizontalBounds: false,
+                                          fillTextLineGaps: true, transform: &translation)
+    let bounds = translatedPath.boundingBoxOfPath
+    let expectedBounds = path.boundingBoxOfPath.offsetBy(dx: 10, dy: 20)
+    XCTAssertEqual(bounds.minX, expectedBounds.minX, accuracy: 1e-9)
+    XCTAssertEqual(bounds.minY, expectedBounds.minY, accuracy: 1e-9)
+    XCTAssertEqual(bounds.maxX, expectedBounds.maxX, accuracy: 1e-9)
+    XCTAssertEqual(bounds.maxY, expectedBounds.maxY, accuracy: 1e-9)
+  }
 }
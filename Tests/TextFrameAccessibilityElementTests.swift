@@ -0,0 +1,63 @@
+// Copyright 2018 Stephan Tolksdorf
+
+import STULabelSwift
+
+import XCTest
+
+class TextFrameAccessibilityElementTests : XCTestCase {
+  let font = UIFont.systemFont(ofSize: 16)
+
+  /// Returns a text frame with a visible link and a link that only covers a line terminator and
+  /// hence has no line spans.
+  func textFrameWithLinks() -> (STUTextFrame, visibleLink: NSRange, invisibleLink: NSRange) {
+    let string = NSMutableAttributedString(string: "Link text\nMore text",
+                                           attributes: [.font: font])
+    let visibleLink = NSRange(0..<4)
+    let invisibleLink = NSRange(9..<10)
+    string.addAttribute(.link, value: URL(string: "https://example.com/1")!, range: visibleLink)
+    string.addAttribute(.link, value: URL(string: "https://example.com/2")!, range: invisibleLink)
+    let frame = STUTextFrame(STUShapedString(string), size: CGSize(width: 200, height: 100),
+                             displayScale: 2, options: nil)
+    return (frame, visibleLink, invisibleLink)
+  }
+
+  func accessibilityElement(_ frame: STUTextFrame, separateLinkElements: Bool)
+    -> STUTextFrameAccessibilityElement
+  {
+    return STUTextFrameAccessibilityElement(accessibilityContainer: UIView(), textFrame: frame,
+                                            originInContainerSpace: .zero, displayScale: 2,
+                                            representUntruncatedText: true,
+                                            separateParagraphs: false,
+                                            separateLinkElements: separateLinkElements,
+                                            isDraggableLink: nil, linkActivationHandler: nil)
+  }
+
+  func element(_ container: STUTextFrameAccessibilityElement, _ index: Int) -> NSObject {
+    return container.accessibilityElement(at: index) as! NSObject
+  }
+
+  func testLinksWithoutLineSpansAreNotAnnounced() { if #available(iOS 11, tvOS 11, *) {
+    let (frame, visibleLink, invisibleLink) = textFrameWithLinks()
+
+    let container = accessibilityElement(frame, separateLinkElements: false)
+    // The text element and a rotor element for the visible link.
+    XCTAssertEqual(container.accessibilityElementCount(), 2)
+    let textElement = element(container, 0)
+    XCTAssertEqual(container.index(ofAccessibilityElement: textElement), 0)
+    let label = textElement.accessibilityAttributedLabel!
+    XCTAssertNotNil(label.attribute(.link, at: visibleLink.location, effectiveRange: nil))
+    XCTAssertNil(label.attribute(.link, at: invisibleLink.location, effectiveRange: nil))
+    XCTAssertEqual(element(container, 1).accessibilityTraits, [.staticText, .link])
+
+    // With separate link elements there's no element for the invisible link.
+    let separatingContainer = accessibilityElement(frame, separateLinkElements: true)
+    XCTAssertEqual(separatingContainer.accessibilityElementCount(), 3)
+    XCTAssertEqual(element(separatingContainer, 0).accessibilityTraits, [.staticText, .link])
+    XCTAssertEqual(element(separatingContainer, 0).accessibilityLabel, "Link")
+    XCTAssertEqual(element(separatingContainer, 1).accessibilityTraits, [.staticText])
+    XCTAssertEqual(element(separatingContainer, 1).accessibilityLabel, " text")
+    XCTAssertEqual(element(separatingContainer, 2).accessibilityTraits, [.staticText])
+    XCTAssertEqual(element(separatingContainer, 2).accessibilityLabel, "More text")
+    XCTAssertNil(separatingContainer.accessibilityElement(at: 3))
+  } }
+}
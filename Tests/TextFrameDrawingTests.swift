@@ -157,4 +157,158 @@ class TextFrameDrawingTests: SnapshotTestCase {
 
     self.checkSnapshotImage(pdfImage, referenceImage: referencePDFImage)
   }
+
+  func testGlyphRasterCache() {
+    let font = UIFont(name: "HelveticaNeue", size: 18)!
+    let frame = STUTextFrame(STUShapedString(NSAttributedString("Apple Pie",
+                                                                [.font: font,
+                                                                 .foregroundColor: UIColor.red])),
+                             size: CGSize(width: 1000, height: 1000), displayScale: displayScale,
+                             options: nil)
+    let layoutBounds = frame.layoutBounds
+    let size = CGSize(width: ceil(layoutBounds.maxX + 2), height: ceil(layoutBounds.maxY + 2))
+    let draw = {
+      createImage(size, scale: self.displayScale, backgroundColor: .white, .rgb) { context in
+        frame.draw(in: context, contextBaseCTM_d: 1, pixelAlignBaselines: true)
+      }
+    }
+
+    let oldBudget = STUTextFrame.glyphRasterCacheMemoryBudget
+    STUTextFrame.glyphRasterCacheMemoryBudget = 1 << 20
+    defer { STUTextFrame.glyphRasterCacheMemoryBudget = oldBudget }
+    STUTextFrame.clearGlyphRasterCache()
+
+    _ = draw()
+    let stats1 = STUTextFrame.glyphRasterCacheStatistics
+    XCTAssertEqual(stats1.hitCount + stats1.missCount, 9)
+    XCTAssertGreaterThan(stats1.missCount, 0)
+    XCTAssertGreaterThan(stats1.entryCount, 0)
+    XCTAssertGreaterThan(stats1.memoryUsage, 0)
+
+    _ = draw()
+    let stats2 = STUTextFrame.glyphRasterCacheStatistics
+    XCTAssertEqual(stats2.hitCount, stats1.hitCount + 9)
+    XCTAssertEqual(stats2.missCount, stats1.missCount)
+
+    // The glyphs are cached separately for each antialiasing setting, and the masks for an aliased
+    // context are rasterized without antialiasing, i.e. the drawn pixels are either black or white.
+    let options = STUTextFrame.DrawingOptions()
+    options.contextShouldAntialias = false
+    let frame2 = STUTextFrame(STUShapedString(NSAttributedString("Apple Pie", [.font: font])),
+                              size: CGSize(width: 1000, height: 1000), displayScale: displayScale,
+                              options: nil)
+    let aliasedImage = createImage(size, scale: self.displayScale, backgroundColor: .white,
+                                   .grayscale) { context in
+      context.setShouldAntialias(false)
+      frame2.draw(in: context, contextBaseCTM_d: 1, pixelAlignBaselines: true, options: options)
+    }.cgImage!
+    let stats3 = STUTextFrame.glyphRasterCacheStatistics
+    XCTAssertEqual(stats3.missCount, 2*stats2.missCount)
+    XCTAssertEqual(stats3.entryCount, 2*stats2.entryCount)
+    XCTAssertEqual(aliasedImage.bitsPerPixel, 8)
+    let data = aliasedImage.dataProvider!.data! as Data
+    var blackPixelCount = 0
+    for y in 0..<aliasedImage.height {
+      for x in 0..<aliasedImage.width {
+        let value = data[y*aliasedImage.bytesPerRow + x]
+        XCTAssert(value == 0 || value == 255)
+        blackPixelCount += value == 0 ? 1 : 0
+      }
+    }
+    XCTAssertGreaterThan(blackPixelCount, 0)
+
+    STUTextFrame.glyphRasterCacheMemoryBudget = 0
+    XCTAssertEqual(STUTextFrame.glyphRasterCacheStatistics.entryCount, 0)
+  }
+
+  private func glyphRasterCachePerformanceTextFrame() -> STUTextFrame {
+    let font = UIFont(name: "HelveticaNeue", size: 15)!
+    let string = Array(repeating: "The quick brown fox jumps over the lazy dog.", count: 8)
+                 .joined(separator: " ")
+    return STUTextFrame(STUShapedString(NSAttributedString(string, [.font: font])),
+                        size: CGSize(width: 320, height: 1000), displayScale: displayScale,
+                        options: nil)
+  }
+
+  private func measureDrawing(_ frame: STUTextFrame) {
+    let layoutBounds = frame.layoutBounds
+    let size = CGSize(width: ceil(layoutBounds.maxX), height: ceil(layoutBounds.maxY))
+    self.measure {
+      for _ in 0..<20 {
+        _ = createImage(size, scale: self.displayScale, backgroundColor: .white, .rgb) { context in
+          frame.draw(in: context, contextBaseCTM_d: 1, pixelAlignBaselines: true)
+        }
+      }
+    }
+  }
+
+  // Compare the results of the following two tests to evaluate whether drawing the glyphs with
+  // one CGContextDrawImage call per glyph is actually faster than drawing the runs with Core Text.
+
+  func testDrawingPerformanceWithGlyphRasterCache() {
+    let frame = glyphRasterCachePerformanceTextFrame()
+    let oldBudget = STUTextFrame.glyphRasterCacheMemoryBudget
+    STUTextFrame.glyphRasterCacheMemoryBudget = 1 << 20
+    defer { STUTextFrame.glyphRasterCacheMemoryBudget = oldBudget }
+    measureDrawing(frame)
+  }
+
+  func testDrawingPerformanceWithoutGlyphRasterCache() {
+    let frame = glyphRasterCachePerformanceTextFrame()
+    let oldBudget = STUTextFrame.glyphRasterCacheMemoryBudget
+    STUTextFrame.glyphRasterCacheMemoryBudget = 0
+    defer { STUTextFrame.glyphRasterCacheMemoryBudget = oldBudget }
+    measureDrawing(frame)
+  }
+
+  func testShadowMaskCache() {
+    let font = UIFont(name: "HelveticaNeue", size: 18)!
+    let textFrame = { (color: UIColor, shadowColor: UIColor) -> STUTextFrame in
+      let shadow = NSShadow()
+      shadow.shadowOffset = CGSize(width: 1, height: 2)
+      shadow.shadowBlurRadius = 3
+      shadow.shadowColor = shadowColor
+      return STUTextFrame(STUShapedString(NSAttributedString("Apple Pie",
+                                                             [.font: font,
+                                                              .foregroundColor: color,
+                                                              .shadow: shadow])),
+                          size: CGSize(width: 1000, height: 1000), displayScale: self.displayScale,
+                          options: nil)
+    }
+    let frame1 = textFrame(.red, .black)
+    let frame2 = textFrame(.blue, .green)
+    let layoutBounds = frame1.layoutBounds
+    let size = CGSize(width: ceil(layoutBounds.maxX + 10), height: ceil(layoutBounds.maxY + 10))
+    let draw = { (frame: STUTextFrame) in
+      createImage(size, scale: self.displayScale, backgroundColor: .white, .rgb) { context in
+        frame.draw(in: context, contextBaseCTM_d: 1, pixelAlignBaselines: true)
+      }
+    }
+
+    let oldBudget = STUTextFrame.shadowMaskCacheMemoryBudget
+    STUTextFrame.shadowMaskCacheMemoryBudget = 1 << 20
+    defer { STUTextFrame.shadowMaskCacheMemoryBudget = oldBudget }
+    STUTextFrame.clearShadowMaskCache()
+
+    _ = draw(frame1)
+    let stats1 = STUTextFrame.shadowMaskCacheStatistics
+    XCTAssertGreaterThan(stats1.missCount, 0)
+    XCTAssertEqual(stats1.hitCount, 0)
+    XCTAssertGreaterThan(stats1.entryCount, 0)
+    XCTAssertGreaterThan(stats1.memoryUsage, 0)
+
+    _ = draw(frame1)
+    let stats2 = STUTextFrame.shadowMaskCacheStatistics
+    XCTAssertEqual(stats2.hitCount, stats1.missCount)
+    XCTAssertEqual(stats2.missCount, stats1.missCount)
+
+    // The masks are reused when only the colors change.
+    _ = draw(frame2)
+    let stats3 = STUTextFrame.shadowMaskCacheStatistics
+    XCTAssertEqual(stats3.hitCount, 2*stats1.missCount)
+    XCTAssertEqual(stats3.missCount, stats1.missCount)
+
+    STUTextFrame.shadowMaskCacheMemoryBudget = 0
+    XCTAssertEqual(STUTextFrame.shadowMaskCacheStatistics.entryCount, 0)
+  }
 }
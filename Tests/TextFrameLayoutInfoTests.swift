@@ -19,6 +19,7 @@ class TextFrameLayoutInfoTests : XCTestCase {
       XCTAssertEqual(info0.layoutMode, info.layoutMode)
       XCTAssertEqual(info0.consistentAlignment, info.consistentAlignment)
       XCTAssertEqual(info0.textScaleFactor, info.textScaleFactor)
+      XCTAssertEqual(info0.layoutIterationCount, info.layoutIterationCount)
       XCTAssertEqual(info0.size, info.size)
       XCTAssertEqual(info0.minX, info.minX)
       XCTAssertEqual(info0.maxX, info.maxX)
@@ -264,6 +265,8 @@ class TextFrameLayoutInfoTests : XCTestCase {
       let s: CGFloat = 0.5
       XCTAssertEqual(tf.textScaleFactor, s)
       XCTAssertEqual(tf.lines.count, 1)
+      XCTAssertGreaterThan(tf.layoutInfo(frameOrigin: .zero).layoutIterationCount, 1)
+      XCTAssertLessThanOrEqual(tf.layoutInfo(frameOrigin: .zero).layoutIterationCount, 3)
 
       XCTAssertEqual(tf.firstLineHeight, s*font1LineHeight, accuracyInFloat32ULP: 2)
 
@@ -353,4 +356,50 @@ class TextFrameLayoutInfoTests : XCTestCase {
     })()
   }
 
+  func testLayoutInfoWithoutTextFrame() {
+    let font = UIFont(name: "HelveticaNeue", size: 16)!
+    let paraStyle = NSMutableParagraphStyle()
+    paraStyle.firstLineHeadIndent = 10
+    paraStyle.headIndent = 5
+    paraStyle.tailIndent = -7
+    paraStyle.alignment = .justified
+    let text = NSAttributedString([("Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n",
+                                    [.font: font]),
+                                   ("Sed do eiusmod tempor incididunt ut labore et dolore.",
+                                    [.font: font, .paragraphStyle: paraStyle])])
+    let shapedString = STUShapedString(text)
+    for (width, maxLineCount, minScale) in [(CGFloat(1000), 0, CGFloat(1)), (150, 0, 1),
+                                            (150, 3, 1), (150, 3, 0.5), (100, 2, 0.1)]
+    {
+      let options = STUTextFrameOptions { (b) in b.maximumNumberOfLines = maxLineCount
+                                                 b.minimumTextScaleFactor = minScale }
+      let size = CGSize(width: width, height: 1000)
+      let range = NSRange(0..<text.length)
+      let tf = STUTextFrame(shapedString, stringRange: range, size: size,
+                            displayScaleOrZero: 2, options: options, cancellationFlag: nil)!
+      let info0 = tf.layoutInfo(frameOrigin: .zero)
+      let info = STUTextFrame.layoutInfo(shapedString, stringRange: range, size: size,
+                                         displayScaleOrZero: 2, options: options)
+      XCTAssertEqual(info0.lineCount, info.lineCount)
+      XCTAssertEqual(info0.flags, info.flags)
+      XCTAssertEqual(info0.layoutMode, info.layoutMode)
+      XCTAssertEqual(info0.consistentAlignment, info.consistentAlignment)
+      XCTAssertEqual(info0.textScaleFactor, info.textScaleFactor)
+      XCTAssertEqual(info0.layoutIterationCount, info.layoutIterationCount)
+      XCTAssertEqual(info0.size, info.size)
+      XCTAssertEqual(info0.minX, info.minX)
+      XCTAssertEqual(info0.maxX, info.maxX)
+      XCTAssertEqual(info0.firstBaseline, info.firstBaseline)
+      XCTAssertEqual(info0.lastBaseline, info.lastBaseline)
+      XCTAssertEqual(info0.firstLineHeight, info.firstLineHeight)
+      XCTAssertEqual(info0.firstLineHeightAboveBaseline, info.firstLineHeightAboveBaseline)
+      XCTAssertEqual(info0.lastLineHeight, info.lastLineHeight)
+      XCTAssertEqual(info0.lastLineHeightBelowBaseline, info.lastLineHeightBelowBaseline)
+      XCTAssertEqual(info0.lastLineHeightBelowBaselineWithoutSpacing,
+                     info.lastLineHeightBelowBaselineWithoutSpacing)
+      XCTAssertEqual(info0.lastLineHeightBelowBaselineWithMinimalSpacing,
+                     info.lastLineHeightBelowBaselineWithMinimalSpacing)
+    }
+  }
+
 }
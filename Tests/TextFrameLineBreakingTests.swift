@@ -127,6 +127,27 @@ class TextFrameLineBreakingTests: SnapshotTestCase {
     }();
   }
 
+  func testSingleLineParagraphs() {
+    {
+      let width = typographicWidth("Title")
+      let f = textFrame("Title \nSubtitle", width: width)
+      let lines = f.lines
+      XCTAssertGreaterThan(lines.count, 1)
+      XCTAssertEqual(lines[0].rangeInOriginalString, NSRange(0..<5))
+      XCTAssertEqual(lines[0].trailingWhitespaceInTruncatedStringUTF16Length, 2)
+      XCTAssertTrue(lines[0].isFollowedByTerminatorInOriginalString)
+      XCTAssertEqual(lines[0].width, width)
+    }();
+    {
+      let f = textFrame("Title\u{2028}Subtitle")
+      let lines = f.lines
+      XCTAssertEqual(lines.count, 2)
+      XCTAssertEqual(lines[0].rangeInOriginalString, NSRange(0..<5))
+      XCTAssertEqual(lines[0].trailingWhitespaceInTruncatedStringUTF16Length, 1)
+      XCTAssertEqual(lines[1].rangeInOriginalString, NSRange(6..<14))
+    }();
+  }
+
   func testSoftHyphen() {
     let width = typographicWidth("Test Te‐")
     let f = textFrame("Test Te\u{00AD}st", width: width + 0.01)
@@ -13,6 +13,7 @@ class TextFrameOptionsTests : XCTestCase {
     XCTAssertEqual(opts0.minimumTextScaleFactor, 1)
     XCTAssertEqual(opts0.textScalingBaselineAdjustment, .none)
     XCTAssert(opts0.lastHyphenationLocationInRangeFinder == nil)
+    XCTAssertEqual(opts0.usesCompactGlyphStorage, false)
 
     let opts0b = STUTextFrameOptions { builder in }
     XCTAssertEqual(opts0b.textLayoutMode, .default)
@@ -25,6 +26,7 @@ class TextFrameOptionsTests : XCTestCase {
     XCTAssertEqual(opts0b.minimumTextScaleFactor, 1)
     XCTAssertEqual(opts0b.textScalingBaselineAdjustment, .none)
     XCTAssert(opts0b.lastHyphenationLocationInRangeFinder == nil)
+    XCTAssertEqual(opts0b.usesCompactGlyphStorage, false)
 
     let nonDefaultTruncationToken = NSAttributedString(string: "test")
     let nonDefaultTextAlignment =
@@ -44,6 +46,7 @@ class TextFrameOptionsTests : XCTestCase {
       builder.minimumTextScaleFactor = 0.25
       builder.textScalingBaselineAdjustment = .alignFirstLineXHeightCenter
       builder.lastHyphenationLocationInRangeFinder = dummyHyphenationLocationFinder
+      builder.usesCompactGlyphStorage = true
     }
     XCTAssertEqual(opts1.textLayoutMode, .textKit)
     XCTAssertEqual(opts1.defaultTextAlignment, nonDefaultTextAlignment)
@@ -54,6 +57,7 @@ class TextFrameOptionsTests : XCTestCase {
     XCTAssertEqual(opts1.minimumTextScaleFactor, 0.25)
     XCTAssertEqual(opts1.textScalingBaselineAdjustment, .alignFirstLineXHeightCenter)
     XCTAssert(opts1.lastHyphenationLocationInRangeFinder != nil)
+    XCTAssertEqual(opts1.usesCompactGlyphStorage, true)
 
     let opts1b = opts1.copy(updates: { (_: STUTextFrameOptionsBuilder) in })
     XCTAssertEqual(opts1b.textLayoutMode, .textKit)
@@ -65,6 +69,7 @@ class TextFrameOptionsTests : XCTestCase {
     XCTAssertEqual(opts1b.minimumTextScaleFactor, 0.25)
     XCTAssertEqual(opts1b.textScalingBaselineAdjustment, .alignFirstLineXHeightCenter)
     XCTAssert(opts1b.lastHyphenationLocationInRangeFinder != nil)
+    XCTAssertEqual(opts1b.usesCompactGlyphStorage, true)
 
     let opts2 = opts1b.copy { (builder) in builder.maximumNumberOfLines += 1 }
     XCTAssertEqual(opts2.textLayoutMode, .textKit)
@@ -76,6 +81,7 @@ class TextFrameOptionsTests : XCTestCase {
     XCTAssertEqual(opts2.minimumTextScaleFactor, 0.25)
     XCTAssertEqual(opts2.textScalingBaselineAdjustment, .alignFirstLineXHeightCenter)
     XCTAssert(opts2.lastHyphenationLocationInRangeFinder != nil)
+    XCTAssertEqual(opts2.usesCompactGlyphStorage, true)
   }
 
   func testParameterClamping() {
@@ -87,6 +87,27 @@ class TruncationTests: SnapshotTestCase {
     XCTAssertEqual(lines[0].rangeInTruncatedString, NSRange(0..<5))
   }
 
+  func testLongLineStartAndEndTruncation() {
+    let string = String(repeating: "0123456789", count: 50)
+    let width = typographicWidth("0123456789012") + typographicWidth("…")
+    let f1 = textFrame(string, width: width + 0.001, maxLineCount: 1)
+    XCTAssertEqual(f1.truncatedAttributedString,
+                   NSAttributedString("0123456789012…", [.font: font]))
+    XCTAssertEqual(f1.lines[0].excisedRangeInOriginalString, NSRange(13..<500))
+
+    let f2 = textFrame(string, width: width + 0.001, maxLineCount: 1,
+                       lastLineTruncationMode: .start)
+    XCTAssertEqual(f2.truncatedAttributedString,
+                   NSAttributedString("…7890123456789", [.font: font]))
+    XCTAssertEqual(f2.lines[0].excisedRangeInOriginalString, NSRange(0..<487))
+
+    let f3 = textFrame(string, width: width + 0.001, maxLineCount: 1,
+                       lastLineTruncationMode: .middle)
+    XCTAssertEqual(f3.truncatedAttributedString,
+                   NSAttributedString("0123456…456789", [.font: font]))
+    XCTAssertEqual(f3.lines[0].excisedRangeInOriginalString, NSRange(7..<494))
+  }
+
   func testSingleCharacterTokenFontSelection() {
     let font = UIFont(name: "HoeflerText-Regular", size: 17)!
     let width = typographicWidth("XX", font: font)